@@ -0,0 +1,102 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cassert>
+
+#include "BarrierBatch.h"
+
+static bool IsOverlapping(const vk::ImageSubresourceRange& a, const vk::ImageSubresourceRange& b)
+{
+	return a.baseMipLevel < b.baseMipLevel + b.levelCount && b.baseMipLevel < a.baseMipLevel + a.levelCount
+		&& a.baseArrayLayer < b.baseArrayLayer + b.layerCount && b.baseArrayLayer < a.baseArrayLayer + a.layerCount;
+}
+
+void BarrierBatch::Add(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags sourceStages, vk::PipelineStageFlags destinationStages, const vk::ImageMemoryBarrier& imageMemoryBarrier)
+{
+	//Barriers can't move to another command buffer, whoever queued them has to flush them before recording anywhere else.
+	assert(IsEmpty() || mCommandBuffer == commandBuffer);
+
+	//A subresource can only change layout once per barrier call so a second transition of the same one has to wait for the first.
+	for (auto& pendingBarrier : mImageMemoryBarriers)
+	{
+		if (pendingBarrier.image == imageMemoryBarrier.image && IsOverlapping(pendingBarrier.subresourceRange, imageMemoryBarrier.subresourceRange))
+		{
+			Flush(commandBuffer);
+			break;
+		}
+	}
+
+	mCommandBuffer = commandBuffer;
+	mSourceStages |= sourceStages;
+	mDestinationStages |= destinationStages;
+	mImageMemoryBarriers.push_back(imageMemoryBarrier);
+}
+
+void BarrierBatch::Add(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags sourceStages, vk::PipelineStageFlags destinationStages, const vk::BufferMemoryBarrier& bufferMemoryBarrier)
+{
+	assert(IsEmpty() || mCommandBuffer == commandBuffer);
+
+	for (auto& pendingBarrier : mBufferMemoryBarriers)
+	{
+		if (pendingBarrier.buffer == bufferMemoryBarrier.buffer)
+		{
+			Flush(commandBuffer);
+			break;
+		}
+	}
+
+	mCommandBuffer = commandBuffer;
+	mSourceStages |= sourceStages;
+	mDestinationStages |= destinationStages;
+	mBufferMemoryBarriers.push_back(bufferMemoryBarrier);
+}
+
+bool BarrierBatch::IsEmpty() const
+{
+	return mImageMemoryBarriers.empty() && mBufferMemoryBarriers.empty();
+}
+
+void BarrierBatch::Flush(vk::CommandBuffer commandBuffer)
+{
+	if (IsEmpty())
+	{
+		return;
+	}
+
+	assert(commandBuffer == mCommandBuffer);
+
+	if (!mSourceStages)
+	{
+		mSourceStages = vk::PipelineStageFlagBits::eTopOfPipe;
+	}
+
+	if (!mDestinationStages)
+	{
+		mDestinationStages = vk::PipelineStageFlagBits::eBottomOfPipe;
+	}
+
+	commandBuffer.pipelineBarrier(mSourceStages, mDestinationStages, vk::DependencyFlags(), 0, nullptr, (uint32_t)mBufferMemoryBarriers.size(), mBufferMemoryBarriers.data(), (uint32_t)mImageMemoryBarriers.size(), mImageMemoryBarriers.data());
+	mPipelineBarrierCount++;
+
+	mSourceStages = vk::PipelineStageFlags();
+	mDestinationStages = vk::PipelineStageFlags();
+	mImageMemoryBarriers.clear();
+	mBufferMemoryBarriers.clear();
+}
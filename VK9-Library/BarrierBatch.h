@@ -0,0 +1,49 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vk_sdk_platform.h>
+#include <boost/container/small_vector.hpp>
+
+#ifndef BARRIERBATCH_H
+#define BARRIERBATCH_H
+
+/*
+Collects image and buffer barriers so they can be recorded as a single vkCmdPipelineBarrier right before the next command that depends on them.
+Every pending barrier belongs to the command buffer it was added for, switching to another one without a flush in between is a bug.
+*/
+struct BarrierBatch
+{
+	vk::CommandBuffer mCommandBuffer;
+	vk::PipelineStageFlags mSourceStages;
+	vk::PipelineStageFlags mDestinationStages;
+	boost::container::small_vector<vk::ImageMemoryBarrier, 16> mImageMemoryBarriers;
+	boost::container::small_vector<vk::BufferMemoryBarrier, 4> mBufferMemoryBarriers;
+
+	//Statistics
+	uint32_t mPipelineBarrierCount = 0;
+
+	void Add(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags sourceStages, vk::PipelineStageFlags destinationStages, const vk::ImageMemoryBarrier& imageMemoryBarrier);
+	void Add(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags sourceStages, vk::PipelineStageFlags destinationStages, const vk::BufferMemoryBarrier& bufferMemoryBarrier);
+	bool IsEmpty() const;
+	void Flush(vk::CommandBuffer commandBuffer);
+};
+
+#endif // BARRIERBATCH_H
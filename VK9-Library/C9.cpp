@@ -31,6 +31,7 @@ misrepresented as being the original software.
 #include "CSurface9.h"
 
 #include "Utilities.h"
+#include "FormatConverter.h"
 
 #define APP_SHORT_NAME "VK9"
 
@@ -117,7 +118,11 @@ HRESULT STDMETHODCALLTYPE C9::CheckDepthStencilMatch(UINT Adapter,D3DDEVTYPE Dev
 
 HRESULT STDMETHODCALLTYPE C9::CheckDeviceFormat(UINT Adapter,D3DDEVTYPE DeviceType,D3DFORMAT AdapterFormat,DWORD Usage,D3DRESOURCETYPE RType,D3DFORMAT CheckFormat)
 {
-	if (CheckFormat == D3DFMT_UNKNOWN || (ConvertFormat(AdapterFormat) != vk::Format::eUndefined && ConvertFormat(CheckFormat) != vk::Format::eUndefined))
+	//Formats without a Vulkan equivalent can still be sampled if they are converted as they are uploaded.
+	const bool isTexture = (RType == D3DRTYPE_TEXTURE || RType == D3DRTYPE_CUBETEXTURE || RType == D3DRTYPE_VOLUMETEXTURE) && !(Usage & (D3DUSAGE_RENDERTARGET | D3DUSAGE_DEPTHSTENCIL));
+	const bool isCheckFormatSupported = ConvertFormat(CheckFormat) != vk::Format::eUndefined || (isTexture && HasFormatConversion(CheckFormat));
+
+	if (CheckFormat == D3DFMT_UNKNOWN || (ConvertFormat(AdapterFormat) != vk::Format::eUndefined && isCheckFormatSupported))
 	{
 		BOOST_LOG_TRIVIAL(warning) << "C9::CheckDeviceFormat (D3D_OK) AdapterFormat: " << AdapterFormat << " CheckFormat: " << CheckFormat;
 
@@ -158,11 +158,7 @@ HRESULT STDMETHODCALLTYPE CCubeTexture9::FreePrivateData(REFGUID refguid)
 
 DWORD STDMETHODCALLTYPE CCubeTexture9::GetPriority()
 {
-	//TODO: Implement.
-
-	BOOST_LOG_TRIVIAL(warning) << "CCubeTexture9::GetPriority is not implemented!";
-
-	return 1;
+	return mPriority;
 }
 
 HRESULT STDMETHODCALLTYPE CCubeTexture9::GetPrivateData(REFGUID refguid, void* pData, DWORD* pSizeOfData)
@@ -176,20 +172,32 @@ HRESULT STDMETHODCALLTYPE CCubeTexture9::GetPrivateData(REFGUID refguid, void* p
 
 void STDMETHODCALLTYPE CCubeTexture9::PreLoad()
 {
-	//TODO: Implement.
-
-	BOOST_LOG_TRIVIAL(warning) << "CCubeTexture9::PreLoad is not implemented!";
-
-	return; 
+	//Brings an evicted managed texture back ahead of the draw that needs it.
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_PreLoad;
+	workItem->Id = mId;
+	workItem->Argument1 = mDevice;
+	mCommandStreamManager->RequestWork(workItem);
 }
 
 DWORD STDMETHODCALLTYPE CCubeTexture9::SetPriority(DWORD PriorityNew)
 {
-	//TODO: Implement.
+	//Only managed textures are ever evicted so the priority means nothing for the other pools.
+	if (mPool != D3DPOOL_MANAGED)
+	{
+		return 0;
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CCubeTexture9::SetPriority is not implemented!";
+	DWORD priority = mPriority;
+	mPriority = PriorityNew;
 
-	return 1;
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_SetPriority;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>(PriorityNew);
+	mCommandStreamManager->RequestWork(workItem);
+
+	return priority;
 }
 
 HRESULT STDMETHODCALLTYPE CCubeTexture9::SetPrivateData(REFGUID refguid, const void* pData, DWORD SizeOfData, DWORD Flags)
@@ -258,11 +266,34 @@ D3DRESOURCETYPE STDMETHODCALLTYPE CCubeTexture9::GetType()
 
 HRESULT STDMETHODCALLTYPE CCubeTexture9::AddDirtyRect(D3DCUBEMAP_FACES FaceType, const RECT* pDirtyRect)
 {
-	//TODO: Implement.
+	if ((UINT)FaceType > D3DCUBEMAP_FACE_NEGATIVE_Z)
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CCubeTexture9::AddDirtyRect is not implemented!";
+	//The regions are kept by the worker so UpdateTexture doesn't have to wait for a copy of them.
+	D3DBOX region = { 0, 0, mEdgeLength, mEdgeLength, 0, 1 };
+	if (pDirtyRect != nullptr)
+	{
+		region.Left = pDirtyRect->left;
+		region.Top = pDirtyRect->top;
+		region.Right = std::min((UINT)pDirtyRect->right, mEdgeLength);
+		region.Bottom = std::min((UINT)pDirtyRect->bottom, mEdgeLength);
+	}
 
-	return E_NOTIMPL;
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_AddDirtyRect;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>((UINT)FaceType);
+	workItem->Argument2 = bit_cast<void*>(region.Left);
+	workItem->Argument3 = bit_cast<void*>(region.Top);
+	workItem->Argument4 = bit_cast<void*>(region.Right);
+	workItem->Argument5 = bit_cast<void*>(region.Bottom);
+	workItem->Argument6 = bit_cast<void*>(region.Front);
+	workItem->Argument7 = bit_cast<void*>(region.Back);
+	mCommandStreamManager->RequestWork(workItem);
+
+	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CCubeTexture9::GetCubeMapSurface(D3DCUBEMAP_FACES FaceType, UINT Level, IDirect3DSurface9** ppCubeMapSurface)
@@ -46,7 +46,8 @@ public:
 
 	ULONG mReferenceCount = 1;
 	VkResult mResult = VK_SUCCESS;
-	D3DTEXTUREFILTERTYPE mMipFilter = D3DTEXF_NONE;
+	D3DTEXTUREFILTERTYPE mMipFilter = D3DTEXF_LINEAR; //The default auto generation filter.
+	DWORD mPriority = 0; //Managed textures with a lower priority are evicted first.
 	D3DTEXTUREFILTERTYPE mMinFilter = D3DTEXF_NONE;
 	D3DTEXTUREFILTERTYPE mMagFilter = D3DTEXF_NONE;
 
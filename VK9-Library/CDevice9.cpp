@@ -142,6 +142,11 @@ HRESULT STDMETHODCALLTYPE CDevice9::Present(const RECT *pSourceRect, const RECT
 	workItem->Argument4 = bit_cast<void*>(pDirtyRegion);
 	mCommandStreamManager->RequestWorkAndWait(workItem);
 
+	//The frame before this one is finished so the upload chunks it used can be written again.
+	mUploadFrame = (mUploadFrame + 1) % 2;
+	mUploadChunk = 0;
+	mUploadOffset = 0;
+
 	/*
 	This might be a good spot for a co-routine so that the buffers can be freed after the render target is filled but before the swap chain present finishes.
 	Whether or not the present has to wait long enough depends on what presentation methods are available so this may or may not improve performance.
@@ -227,11 +232,56 @@ HRESULT STDMETHODCALLTYPE CDevice9::BeginStateBlock()
 
 HRESULT STDMETHODCALLTYPE CDevice9::ColorFill(IDirect3DSurface9 *pSurface, const RECT *pRect, D3DCOLOR color)
 {
-	//TODO: Implement.
+	if (pSurface == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::ColorFill is not implemented!";
+	CSurface9* surface9 = (CSurface9*)pSurface;
 
-	return E_NOTIMPL;
+	//Only default pool color surfaces can be filled. Init turns every usage but render target into depth stencil so the format is what tells depth apart.
+	const D3DFORMAT format = surface9->mFormat;
+	if (surface9->mPool != D3DPOOL_DEFAULT || format == D3DFMT_D16_LOCKABLE || format == D3DFMT_D32 || format == D3DFMT_D15S1 || format == D3DFMT_D24S8 || format == D3DFMT_D24X8 || format == D3DFMT_D24X4S4 || format == D3DFMT_D16)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	RECT rect = { 0, 0, (LONG)surface9->mWidth, (LONG)surface9->mHeight };
+	if (pRect != nullptr)
+	{
+		rect = (*pRect);
+	}
+
+	if (rect.left < 0 || rect.top < 0 || rect.right > (LONG)surface9->mWidth || rect.bottom > (LONG)surface9->mHeight || rect.right <= rect.left || rect.bottom <= rect.top)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	//Part of any surface but the render target is filled from a buffer of 32 bit texels and a D3DCOLOR can only be written as one of these.
+	const bool isWholeSurface = (rect.left == 0 && rect.top == 0 && rect.right == (LONG)surface9->mWidth && rect.bottom == (LONG)surface9->mHeight);
+	if (!isWholeSurface && surface9 != mRenderTargets[0] && format != D3DFMT_A8R8G8B8 && format != D3DFMT_X8R8G8B8 && format != D3DFMT_A8B8G8R8)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	//The fill is recorded into the frame so the next lock has to go through the worker to wait for it.
+	if (surface9->mTexture == nullptr && surface9->mCubeTexture == nullptr)
+	{
+		surface9->mStagingState = StagingUnmapped;
+	}
+
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Device_ColorFill;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>(surface9);
+	workItem->Argument2 = bit_cast<void*>(rect.left);
+	workItem->Argument3 = bit_cast<void*>(rect.top);
+	workItem->Argument4 = bit_cast<void*>(rect.right);
+	workItem->Argument5 = bit_cast<void*>(rect.bottom);
+	workItem->Argument6 = bit_cast<void*>(color);
+	mCommandStreamManager->RequestWork(workItem);
+
+	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CDevice9::CreateAdditionalSwapChain(D3DPRESENT_PARAMETERS *pPresentationParameters, IDirect3DSwapChain9 **ppSwapChain)
@@ -254,7 +304,7 @@ HRESULT STDMETHODCALLTYPE CDevice9::CreateCubeTexture(UINT EdgeLength, UINT Leve
 	workItem->Id = this->mId;
 	workItem->WorkItemType = WorkItemType::CubeTexture_Create;
 	workItem->Argument1 = (void*)obj;
-	obj->mId = mCommandStreamManager->RequestWorkAndWait(workItem);
+	obj->mId = mCommandStreamManager->RequestWork(workItem); //The id is handed out before the worker gets to the create so the application doesn't wait for it.
 
 	for (size_t i = 0; i < 6; i++)
 	{
@@ -416,7 +466,7 @@ HRESULT STDMETHODCALLTYPE CDevice9::CreateTexture(UINT Width, UINT Height, UINT
 	workItem->Id = this->mId;
 	workItem->WorkItemType = WorkItemType::Texture_Create;
 	workItem->Argument1 = (void*)obj;
-	obj->mId = mCommandStreamManager->RequestWorkAndWait(workItem);
+	obj->mId = mCommandStreamManager->RequestWork(workItem); //The id is handed out before the worker gets to the create so the application doesn't wait for it.
 
 	for (size_t i = 0; i < obj->mLevels; i++)
 	{
@@ -488,7 +538,7 @@ HRESULT STDMETHODCALLTYPE CDevice9::CreateVolumeTexture(UINT Width, UINT Height,
 	workItem->Id = this->mId;
 	workItem->WorkItemType = WorkItemType::VolumeTexture_Create;
 	workItem->Argument1 = (void*)obj;
-	obj->mId = mCommandStreamManager->RequestWorkAndWait(workItem);
+	obj->mId = mCommandStreamManager->RequestWork(workItem); //The id is handed out before the worker gets to the create so the application doesn't wait for it.
 
 	for (size_t i = 0; i < obj->mLevels; i++)
 	{
@@ -527,87 +577,39 @@ HRESULT STDMETHODCALLTYPE CDevice9::DrawIndexedPrimitive(D3DPRIMITIVETYPE Type,
 
 HRESULT STDMETHODCALLTYPE CDevice9::DrawIndexedPrimitiveUP(D3DPRIMITIVETYPE PrimitiveType, UINT MinVertexIndex, UINT NumVertices, UINT PrimitiveCount, const void *pIndexData, D3DFORMAT IndexDataFormat, const void *pVertexStreamZeroData, UINT VertexStreamZeroStride)
 {
-	//Figure out the current buffer setup.
-	IDirect3DIndexBuffer9* oldIndexBuffer = nullptr;
-
-	GetIndices(&oldIndexBuffer);
-
-	IDirect3DVertexBuffer9* oldVertexBuffer = nullptr;
-	UINT oldOffsetInBytes = 0;
-	UINT oldStride = 0;
-
-	GetStreamSource(0, &oldVertexBuffer, &oldOffsetInBytes, &oldStride);
-
-	//Setup temp buffers
-	UINT indexLength = 0;
-	UINT vertexLength = NumVertices * VertexStreamZeroStride;
-	DWORD Usage = 0;
-
-	switch (PrimitiveType)
+	if (pIndexData == nullptr || pVertexStreamZeroData == nullptr || PrimitiveCount == 0)
 	{
-	case D3DPT_POINTLIST:
-		indexLength = (PrimitiveCount) * (IndexDataFormat == D3DFMT_INDEX16) ? 2 : 4;
-		break;
-	case D3DPT_LINELIST:
-		indexLength = (PrimitiveCount * 2) * (IndexDataFormat == D3DFMT_INDEX16) ? 2 : 4;
-		break;
-	case D3DPT_LINESTRIP:
-		indexLength = (PrimitiveCount + 1) * (IndexDataFormat == D3DFMT_INDEX16) ? 2 : 4;
-		break;
-	case D3DPT_TRIANGLELIST:
-		indexLength = (PrimitiveCount * 3) * (IndexDataFormat == D3DFMT_INDEX16) ? 2 : 4;
-		break;
-	case D3DPT_TRIANGLESTRIP:
-		indexLength = (PrimitiveCount + 2) * (IndexDataFormat == D3DFMT_INDEX16) ? 2 : 4;
-		break;
-	case D3DPT_TRIANGLEFAN:
-		indexLength = (PrimitiveCount + 2) * (IndexDataFormat == D3DFMT_INDEX16) ? 2 : 4;
-		break;
+		return D3DERR_INVALIDCALL;
 	}
 
-	CIndexBuffer9* indexBuffer = nullptr;
-	CVertexBuffer9* vertexBuffer = nullptr;
-	void* buffer = nullptr;
+	UINT indexLength = ConvertPrimitiveCountToVertexCount(PrimitiveType, PrimitiveCount) * ((IndexDataFormat == D3DFMT_INDEX16) ? 2 : 4);
+	UINT vertexLength = (MinVertexIndex + NumVertices) * VertexStreamZeroStride;
 
-	CreateIndexBuffer(indexLength, Usage, IndexDataFormat, D3DPOOL_DEFAULT, (IDirect3DIndexBuffer9**)&indexBuffer, nullptr);
-	CreateVertexBuffer(vertexLength, Usage, D3DFVF_XYZ, D3DPOOL_DEFAULT, (IDirect3DVertexBuffer9**)&vertexBuffer, nullptr);
-
-	vertexBuffer->mSize = NumVertices;
-
-	if (VertexStreamZeroStride != 12)
+	//Copy the data into the upload ring here so the draw doesn't have to wait for the render thread.
+	size_t vertexBufferIndex = 0;
+	UINT vertexOffset = 0;
+	char* vertexData = AllocateUpload(vertexLength + UploadAlignment + indexLength, vertexBufferIndex, vertexOffset);
+	if (vertexData == nullptr)
 	{
-		BOOST_LOG_TRIVIAL(warning) << "CDevice9::DrawIndexedPrimitiveUP unhandled stride " << VertexStreamZeroStride;
+		return D3DERR_OUTOFVIDEOMEMORY;
 	}
+	memcpy(vertexData, pVertexStreamZeroData, vertexLength);
 
-	vertexBuffer->Lock(0, 0, (void**)&buffer, 0);
-	memcpy(buffer, pVertexStreamZeroData, vertexLength);
-	vertexBuffer->Unlock();
-
-	indexBuffer->Lock(0, 0, (void**)&buffer, 0);
-	memcpy(buffer, pIndexData, indexLength);
-	indexBuffer->Unlock();
+	//The indices go in the same chunk right after the vertices.
+	UINT indexOffset = (vertexOffset + vertexLength + UploadAlignment - 1) & ~(UploadAlignment - 1);
+	memcpy(vertexData + (indexOffset - vertexOffset), pIndexData, indexLength);
 
-	SetIndices(indexBuffer);
-	indexBuffer->Release();
-	SetStreamSource(0, vertexBuffer, 0, VertexStreamZeroStride);
-	vertexBuffer->Release();
-	
-	//Queue draw command
-	//DrawIndexedPrimitive(PrimitiveType, 0, MinVertexIndex, NumVertices, 0, PrimitiveCount);
 	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::Device_DrawIndexedPrimitive;
+	workItem->WorkItemType = WorkItemType::Device_DrawIndexedPrimitiveUP;
 	workItem->Id = mId;
 	workItem->Argument1 = bit_cast<void*>(PrimitiveType);
-	workItem->Argument2 = bit_cast<void*>(0);
-	workItem->Argument3 = bit_cast<void*>(MinVertexIndex);
-	workItem->Argument4 = bit_cast<void*>(NumVertices);
-	workItem->Argument5 = bit_cast<void*>(0);
-	workItem->Argument6 = bit_cast<void*>(PrimitiveCount);
-	mCommandStreamManager->RequestWorkAndWait(workItem);
-
-	//Switch the buffers back.
-	SetIndices(oldIndexBuffer);
-	SetStreamSource(0, oldVertexBuffer, oldOffsetInBytes, oldStride);
+	workItem->Argument2 = bit_cast<void*>(PrimitiveCount);
+	workItem->Argument3 = bit_cast<void*>(vertexBufferIndex);
+	workItem->Argument4 = bit_cast<void*>(vertexOffset);
+	workItem->Argument5 = bit_cast<void*>(VertexStreamZeroStride);
+	workItem->Argument6 = bit_cast<void*>(indexOffset);
+	workItem->Argument7 = bit_cast<void*>(IndexDataFormat);
+	mCommandStreamManager->RequestWork(workItem);
 
 	return S_OK;
 }
@@ -627,77 +629,32 @@ HRESULT STDMETHODCALLTYPE CDevice9::DrawPrimitive(D3DPRIMITIVETYPE PrimitiveType
 
 HRESULT STDMETHODCALLTYPE CDevice9::DrawPrimitiveUP(D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, const void *pVertexStreamZeroData, UINT VertexStreamZeroStride)
 {
-	//Figure out the current buffer setup.
-	IDirect3DVertexBuffer9* oldVertexBuffer = nullptr;
-	UINT oldOffsetInBytes = 0;
-	UINT oldStride = 0;
-
-	GetStreamSource(0, &oldVertexBuffer, &oldOffsetInBytes, &oldStride);
-
-	//Setup temp buffers
-	UINT vertexLength = 0;
-	DWORD Usage = 0;
-	UINT NumVertices;
-
-	switch (PrimitiveType)
+	if (pVertexStreamZeroData == nullptr || PrimitiveCount == 0)
 	{
-	case D3DPT_POINTLIST:
-		NumVertices = (PrimitiveCount);
-		vertexLength = NumVertices * VertexStreamZeroStride;
-		break;
-	case D3DPT_LINELIST:
-		NumVertices = (PrimitiveCount * 2);
-		vertexLength = NumVertices * VertexStreamZeroStride;
-		break;
-	case D3DPT_LINESTRIP:
-		NumVertices = (PrimitiveCount + 1);
-		vertexLength = NumVertices * VertexStreamZeroStride;
-		break;
-	case D3DPT_TRIANGLELIST:
-		NumVertices = (PrimitiveCount * 3);
-		vertexLength = NumVertices * VertexStreamZeroStride;
-		break;
-	case D3DPT_TRIANGLESTRIP:
-		NumVertices = (PrimitiveCount + 2);
-		vertexLength = NumVertices * VertexStreamZeroStride;
-		break;
-	case D3DPT_TRIANGLEFAN:
-		NumVertices = (PrimitiveCount + 2);
-		vertexLength = NumVertices * VertexStreamZeroStride;
-		break;
+		return D3DERR_INVALIDCALL;
 	}
 
-	CVertexBuffer9* vertexBuffer = nullptr;
-	void* buffer = nullptr;
-
-	CreateVertexBuffer(vertexLength, Usage, D3DFVF_XYZ, D3DPOOL_DEFAULT, (IDirect3DVertexBuffer9**)&vertexBuffer, nullptr);
-
-	vertexBuffer->mSize = NumVertices;
+	UINT vertexLength = ConvertPrimitiveCountToVertexCount(PrimitiveType, PrimitiveCount) * VertexStreamZeroStride;
 
-	if (VertexStreamZeroStride != 12)
+	//Copy the data into the upload ring here so the draw doesn't have to wait for the render thread.
+	size_t vertexBufferIndex = 0;
+	UINT vertexOffset = 0;
+	char* vertexData = AllocateUpload(vertexLength, vertexBufferIndex, vertexOffset);
+	if (vertexData == nullptr)
 	{
-		BOOST_LOG_TRIVIAL(warning) << "CDevice9::DrawPrimitiveUP unhandled stride " << VertexStreamZeroStride;
+		return D3DERR_OUTOFVIDEOMEMORY;
 	}
+	memcpy(vertexData, pVertexStreamZeroData, vertexLength);
 
-	vertexBuffer->Lock(0, 0, (void**)&buffer, 0);
-	memcpy(buffer, pVertexStreamZeroData, vertexLength);
-	vertexBuffer->Unlock();
-
-	SetStreamSource(0, vertexBuffer, 0, VertexStreamZeroStride);
-	vertexBuffer->Release();
-
-	//Queue draw command
-	//DrawPrimitive(PrimitiveType, 0, PrimitiveCount);
 	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::Device_DrawPrimitive;
+	workItem->WorkItemType = WorkItemType::Device_DrawPrimitiveUP;
 	workItem->Id = mId;
 	workItem->Argument1 = bit_cast<void*>(PrimitiveType);
-	workItem->Argument2 = bit_cast<void*>(0);
-	workItem->Argument3 = bit_cast<void*>(PrimitiveCount);
-	mCommandStreamManager->RequestWorkAndWait(workItem);
-
-	//Switch the buffers back.
-	SetStreamSource(0, oldVertexBuffer, oldOffsetInBytes, oldStride);
+	workItem->Argument2 = bit_cast<void*>(PrimitiveCount);
+	workItem->Argument3 = bit_cast<void*>(vertexBufferIndex);
+	workItem->Argument4 = bit_cast<void*>(vertexOffset);
+	workItem->Argument5 = bit_cast<void*>(VertexStreamZeroStride);
+	mCommandStreamManager->RequestWork(workItem);
 
 	return S_OK;
 }
@@ -743,20 +700,16 @@ HRESULT STDMETHODCALLTYPE CDevice9::EndStateBlock(IDirect3DStateBlock9** ppSB)
 
 HRESULT STDMETHODCALLTYPE CDevice9::EvictManagedResources()
 {
-	//TODO: Implement.
-
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::EvictManagedResources is not implemented!";
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Device_EvictManagedResources;
+	workItem->Id = mId;
+	mCommandStreamManager->RequestWork(workItem);
 
 	return S_OK;
 }
 
 UINT STDMETHODCALLTYPE CDevice9::GetAvailableTextureMem()
 {
-	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::Device_GetAvailableTextureMem;
-	workItem->Id = mId;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
-
 	return mAvailableTextureMemory;
 }
 
@@ -795,11 +748,14 @@ HRESULT STDMETHODCALLTYPE CDevice9::GetCreationParameters(D3DDEVICE_CREATION_PAR
 
 HRESULT STDMETHODCALLTYPE CDevice9::GetCurrentTexturePalette(UINT *pPaletteNumber)
 {
-	//TODO: Implement.
+	if (pPaletteNumber == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::GetCurrentTexturePalette is not implemented!";
+	(*pPaletteNumber) = mCurrentTexturePalette;
 
-	return E_NOTIMPL;
+	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CDevice9::GetDepthStencilSurface(IDirect3DSurface9 **ppZStencilSurface)
@@ -946,11 +902,15 @@ UINT STDMETHODCALLTYPE CDevice9::GetNumberOfSwapChains()
 
 HRESULT STDMETHODCALLTYPE CDevice9::GetPaletteEntries(UINT PaletteNumber, PALETTEENTRY *pEntries)
 {
-	//TODO: Implement.
+	auto it = mPalettes.find(PaletteNumber);
+	if (pEntries == nullptr || it == mPalettes.end())
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::GetPaletteEntries is not implemented!";
+	memcpy(pEntries, it->second->data(), sizeof(PALETTEENTRY) * it->second->size());
 
-	return E_NOTIMPL;
+	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CDevice9::GetPixelShader(IDirect3DPixelShader9 **ppShader)
@@ -1032,9 +992,29 @@ HRESULT STDMETHODCALLTYPE CDevice9::GetRenderTarget(DWORD RenderTargetIndex, IDi
 
 HRESULT STDMETHODCALLTYPE CDevice9::GetRenderTargetData(IDirect3DSurface9 *pRenderTarget, IDirect3DSurface9 *pDestSurface)
 {
-	//TODO: Implement.
+	if (pRenderTarget == nullptr || pDestSurface == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	CSurface9* renderTarget9 = (CSurface9*)pRenderTarget;
+	CSurface9* destination9 = (CSurface9*)pDestSurface;
 
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::GetRenderTargetData is not implemented!";
+	if (destination9->mPool != D3DPOOL_SYSTEMMEM || destination9->mTexture != nullptr || destination9->mCubeTexture != nullptr
+		|| renderTarget9->mWidth != destination9->mWidth || renderTarget9->mHeight != destination9->mHeight || renderTarget9->mFormat != destination9->mFormat)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	//Nothing waits here, the next lock of the destination goes through the worker which waits for the frame carrying the copy.
+	destination9->mStagingState = StagingUnmapped;
+
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Device_GetRenderTargetData;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>(renderTarget9);
+	workItem->Argument2 = bit_cast<void*>(destination9);
+	mCommandStreamManager->RequestWork(workItem);
 
 	return S_OK;
 }
@@ -1276,11 +1256,14 @@ HRESULT STDMETHODCALLTYPE CDevice9::SetClipStatus(const D3DCLIPSTATUS9 *pClipSta
 
 HRESULT STDMETHODCALLTYPE CDevice9::SetCurrentTexturePalette(UINT PaletteNumber)
 {
-	//TODO: Implement.
-
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::SetCurrentTexturePalette is not implemented!";
+	//The palette is applied as levels are uploaded so levels already on the device keep the colors they were uploaded with.
+	if (PaletteNumber != mCurrentTexturePalette)
+	{
+		mCurrentTexturePalette = PaletteNumber;
+		SendTexturePalette();
+	}
 
-	return E_NOTIMPL;
+	return S_OK;
 }
 
 void STDMETHODCALLTYPE CDevice9::SetCursorPosition(INT X, INT Y, DWORD Flags)
@@ -1409,11 +1392,22 @@ HRESULT STDMETHODCALLTYPE CDevice9::SetNPatchMode(float nSegments)
 
 HRESULT STDMETHODCALLTYPE CDevice9::SetPaletteEntries(UINT PaletteNumber, const PALETTEENTRY *pEntries)
 {
-	//TODO: Implement.
+	if (pEntries == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::SetPaletteEntries is not implemented!";
+	//Palettes the worker may still hold are never written, the entries go into a new one.
+	std::shared_ptr<TexturePalette> palette = std::make_shared<TexturePalette>();
+	memcpy(palette->data(), pEntries, sizeof(PALETTEENTRY) * palette->size());
+	mPalettes[PaletteNumber] = palette;
 
-	return E_NOTIMPL;
+	if (PaletteNumber == mCurrentTexturePalette)
+	{
+		SendTexturePalette();
+	}
+
+	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CDevice9::SetPixelShader(IDirect3DPixelShader9* pShader)
@@ -1480,7 +1474,14 @@ HRESULT STDMETHODCALLTYPE CDevice9::SetRenderState(D3DRENDERSTATETYPE State, DWO
 
 HRESULT STDMETHODCALLTYPE CDevice9::SetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget)
 {
-	mRenderTargets[RenderTargetIndex] = (CSurface9*)pRenderTarget;
+	//Only textures created with D3DUSAGE_RENDERTARGET have images that can be rendered to.
+	CSurface9* surface = (CSurface9*)pRenderTarget;
+	if (surface != nullptr && (surface->mTexture != nullptr || surface->mCubeTexture != nullptr) && (surface->mUsage & D3DUSAGE_RENDERTARGET) != D3DUSAGE_RENDERTARGET)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	mRenderTargets[RenderTargetIndex] = surface;
 
 	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
 	workItem->WorkItemType = WorkItemType::Device_SetRenderTarget;
@@ -1674,9 +1675,61 @@ BOOL STDMETHODCALLTYPE CDevice9::ShowCursor(BOOL bShow)
 
 HRESULT STDMETHODCALLTYPE CDevice9::StretchRect(IDirect3DSurface9 *pSourceSurface, const RECT *pSourceRect, IDirect3DSurface9 *pDestSurface, const RECT *pDestRect, D3DTEXTUREFILTERTYPE Filter)
 {
-	//TODO: Implement.
+	if (pSourceSurface == nullptr || pDestSurface == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	CSurface9* source9 = (CSurface9*)pSourceSurface;
+	CSurface9* destination9 = (CSurface9*)pDestSurface;
+
+	if (source9->mPool != D3DPOOL_DEFAULT || destination9->mPool != D3DPOOL_DEFAULT)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	RECT sourceRect = { 0, 0, (LONG)source9->mWidth, (LONG)source9->mHeight };
+	if (pSourceRect != nullptr)
+	{
+		sourceRect = (*pSourceRect);
+	}
+
+	RECT destinationRect = { 0, 0, (LONG)destination9->mWidth, (LONG)destination9->mHeight };
+	if (pDestRect != nullptr)
+	{
+		destinationRect = (*pDestRect);
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::StretchRect is not implemented!";
+	if (sourceRect.left < 0 || sourceRect.top < 0 || sourceRect.right > (LONG)source9->mWidth || sourceRect.bottom > (LONG)source9->mHeight || sourceRect.right <= sourceRect.left || sourceRect.bottom <= sourceRect.top
+		|| destinationRect.left < 0 || destinationRect.top < 0 || destinationRect.right > (LONG)destination9->mWidth || destinationRect.bottom > (LONG)destination9->mHeight || destinationRect.right <= destinationRect.left || destinationRect.bottom <= destinationRect.top)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	//A surface can't be stretched onto itself where the rects overlap.
+	if (source9 == destination9 && sourceRect.left < destinationRect.right && destinationRect.left < sourceRect.right && sourceRect.top < destinationRect.bottom && destinationRect.top < sourceRect.bottom)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	//The blit is recorded into the frame so the next lock has to go through the worker to wait for it.
+	if (destination9->mTexture == nullptr && destination9->mCubeTexture == nullptr)
+	{
+		destination9->mStagingState = StagingUnmapped;
+	}
+
+	//Everything goes by value so the blit doesn't have to wait. Surfaces are never bigger than 16384 so each corner fits in one DWORD.
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Device_StretchRect;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>(source9);
+	workItem->Argument2 = bit_cast<void*>(destination9);
+	workItem->Argument3 = bit_cast<void*>((DWORD)MAKELONG(sourceRect.left, sourceRect.top));
+	workItem->Argument4 = bit_cast<void*>((DWORD)MAKELONG(sourceRect.right, sourceRect.bottom));
+	workItem->Argument5 = bit_cast<void*>((DWORD)MAKELONG(destinationRect.left, destinationRect.top));
+	workItem->Argument6 = bit_cast<void*>((DWORD)MAKELONG(destinationRect.right, destinationRect.bottom));
+	workItem->Argument7 = bit_cast<void*>(Filter);
+	mCommandStreamManager->RequestWork(workItem);
 
 	return S_OK;
 }
@@ -1692,21 +1745,80 @@ HRESULT STDMETHODCALLTYPE CDevice9::TestCooperativeLevel()
 
 HRESULT STDMETHODCALLTYPE CDevice9::UpdateSurface(IDirect3DSurface9 *pSourceSurface, const RECT *pSourceRect, IDirect3DSurface9 *pDestinationSurface, const POINT *pDestinationPoint)
 {
-	//TODO: Implement.
+	if (pSourceSurface == nullptr || pDestinationSurface == nullptr)
+	{
+		return D3DERR_INVALIDCALL;
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CDevice9::UpdateSurface is not implemented!";
+	CSurface9* source9 = (CSurface9*)pSourceSurface;
+	CSurface9* destination9 = (CSurface9*)pDestinationSurface;
 
-	return E_NOTIMPL;
+	//The copy goes from system memory into video memory and can't convert.
+	if (source9->mPool != D3DPOOL_SYSTEMMEM || destination9->mPool != D3DPOOL_DEFAULT || source9->mFormat != destination9->mFormat)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	RECT sourceRect = { 0, 0, (LONG)source9->mWidth, (LONG)source9->mHeight };
+	if (pSourceRect != nullptr)
+	{
+		sourceRect = (*pSourceRect);
+	}
+
+	POINT destinationPoint = {};
+	if (pDestinationPoint != nullptr)
+	{
+		destinationPoint = (*pDestinationPoint);
+	}
+
+	if (sourceRect.left < 0 || sourceRect.top < 0 || sourceRect.right > (LONG)source9->mWidth || sourceRect.bottom > (LONG)source9->mHeight || sourceRect.right <= sourceRect.left || sourceRect.bottom <= sourceRect.top
+		|| destinationPoint.x < 0 || destinationPoint.y < 0 || destinationPoint.x + (sourceRect.right - sourceRect.left) > (LONG)destination9->mWidth || destinationPoint.y + (sourceRect.bottom - sourceRect.top) > (LONG)destination9->mHeight)
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	//Compressed formats are copied in whole blocks. The rect may only stop short of a block where it ends at the edge of the surface.
+	const LONG blockSize = (LONG)GetFormatBlockSize(source9->mFormat);
+	if (blockSize > 1)
+	{
+		if (sourceRect.left % blockSize || sourceRect.top % blockSize || destinationPoint.x % blockSize || destinationPoint.y % blockSize
+			|| (sourceRect.right % blockSize && sourceRect.right != (LONG)source9->mWidth)
+			|| (sourceRect.bottom % blockSize && sourceRect.bottom != (LONG)source9->mHeight))
+		{
+			return D3DERR_INVALIDCALL;
+		}
+	}
+
+	//Everything goes by value so the copy doesn't have to wait. Surfaces are never bigger than 16384 so the point fits in one DWORD.
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Device_UpdateSurface;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>(source9);
+	workItem->Argument2 = bit_cast<void*>(destination9);
+	workItem->Argument3 = bit_cast<void*>(sourceRect.left);
+	workItem->Argument4 = bit_cast<void*>(sourceRect.top);
+	workItem->Argument5 = bit_cast<void*>(sourceRect.right);
+	workItem->Argument6 = bit_cast<void*>(sourceRect.bottom);
+	workItem->Argument7 = bit_cast<void*>((DWORD)MAKELONG(destinationPoint.x, destinationPoint.y));
+	mCommandStreamManager->RequestWork(workItem);
+
+	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CDevice9::UpdateTexture(IDirect3DBaseTexture9* pSourceTexture, IDirect3DBaseTexture9* pDestinationTexture)
 {
+	if (pSourceTexture == nullptr || pDestinationTexture == nullptr || pSourceTexture->GetType() != pDestinationTexture->GetType())
+	{
+		return D3DERR_INVALIDCALL;
+	}
+
+	//The worker keeps the dirty regions of the source so nothing has to be waited on.
 	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
 	workItem->WorkItemType = WorkItemType::Device_UpdateTexture;
 	workItem->Id = mId;
 	workItem->Argument1 = bit_cast<void*>(pSourceTexture);
 	workItem->Argument2 = bit_cast<void*>(pDestinationTexture);
-	mCommandStreamManager->RequestWorkAndWait(workItem);
+	mCommandStreamManager->RequestWork(workItem);
 
 	return S_OK;
 }
@@ -1718,4 +1830,68 @@ HRESULT STDMETHODCALLTYPE CDevice9::ValidateDevice(DWORD *pNumPasses)
 	BOOST_LOG_TRIVIAL(warning) << "CDevice9::ValidateDevice is not implemented!";
 
 	return S_OK;
+}
+
+char* CDevice9::AllocateUpload(UINT size, size_t& bufferIndex, UINT& offset)
+{
+	auto& chunks = mUploadChunks[mUploadFrame];
+
+	mUploadOffset = (mUploadOffset + UploadAlignment - 1) & ~(UploadAlignment - 1);
+
+	//Move on to the next chunk until one has room.
+	while (mUploadChunk < chunks.size() && mUploadOffset + size > chunks[mUploadChunk].Size)
+	{
+		mUploadChunk++;
+		mUploadOffset = 0;
+	}
+
+	if (mUploadChunk == chunks.size())
+	{
+		UploadChunk chunk;
+		chunk.Size = std::max(MinimumUploadChunkSize, size);
+
+		WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+		workItem->WorkItemType = WorkItemType::Device_CreateUploadBuffer;
+		workItem->Id = mId;
+		workItem->Argument1 = bit_cast<void*>(chunk.Size);
+		workItem->Argument2 = bit_cast<void*>(&chunk.Data);
+		workItem->Argument3 = bit_cast<void*>(&chunk.Index);
+		mCommandStreamManager->RequestWorkAndWait(workItem);
+
+		if (chunk.Data == nullptr)
+		{
+			BOOST_LOG_TRIVIAL(error) << "CDevice9::AllocateUpload failed to create an upload buffer of " << chunk.Size << " bytes.";
+			return nullptr;
+		}
+
+		chunks.push_back(chunk);
+		mUploadOffset = 0;
+	}
+
+	auto& chunk = chunks[mUploadChunk];
+	bufferIndex = chunk.Index;
+	offset = mUploadOffset;
+	mUploadOffset += size;
+
+	return chunk.Data + offset;
+}
+
+void CDevice9::SendTexturePalette()
+{
+	/*
+	The worker keeps a reference to the palette that is current at this point in the queue.
+	Uploads queued before this keep the palette they were queued with and uploads queued after get this one.
+	*/
+	std::shared_ptr<const TexturePalette> palette;
+	auto it = mPalettes.find(mCurrentTexturePalette);
+	if (it != mPalettes.end())
+	{
+		palette = it->second;
+	}
+
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Device_SetTexturePalette;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>(new std::shared_ptr<const TexturePalette>(palette));
+	mCommandStreamManager->RequestWork(workItem);
 }
\ No newline at end of file
@@ -23,6 +23,9 @@ misrepresented as being the original software.
 
 #include "d3d9.h" // Base class: IDirect3DDevice9
 #include <boost/container/small_vector.hpp>
+#include <unordered_map>
+#include <array>
+#include <atomic>
 #include "Perf_CommandStreamManager.h"
 
 class C9;
@@ -30,6 +33,19 @@ class CSwapChain9;
 class CVertexBuffer9;
 class CIndexBuffer9;
 
+/*
+A persistently mapped buffer that DrawPrimitiveUP and DrawIndexedPrimitiveUP data is copied into.
+*/
+struct UploadChunk
+{
+	size_t Index = 0; //Index into RealDevice::mUploadBuffers.
+	char* Data = nullptr;
+	UINT Size = 0;
+};
+
+const UINT MinimumUploadChunkSize = 1024 * 1024;
+const UINT UploadAlignment = 16;
+
 class CDevice9 : public IDirect3DDevice9
 {	
 public:
@@ -64,7 +80,21 @@ public:
 
 	CSurface9* mDepthStencilSurface = nullptr;
 
-	UINT mAvailableTextureMemory = 0;
+	std::atomic<UINT> mAvailableTextureMemory{ 0 }; //Refreshed by the worker every frame so GetAvailableTextureMem doesn't have to wait on it.
+
+	//Palettes, P8 and A8P8 levels are expanded with the current palette when they are uploaded. Only the application thread uses these, the worker gets its own reference to the current one.
+	std::unordered_map<UINT, std::shared_ptr<const TexturePalette>> mPalettes;
+	UINT mCurrentTexturePalette = 0;
+
+	void SendTexturePalette();
+
+	//Upload ring for the UP draw calls. Each frame parity has its own chunks which are reused once Present returns for the next frame.
+	std::vector<UploadChunk> mUploadChunks[2];
+	size_t mUploadFrame = 0;
+	size_t mUploadChunk = 0;
+	UINT mUploadOffset = 0;
+
+	char* AllocateUpload(UINT size, size_t& bufferIndex, UINT& offset);
 
 public:
 
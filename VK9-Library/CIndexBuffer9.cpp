@@ -187,24 +187,69 @@ HRESULT STDMETHODCALLTYPE CIndexBuffer9::Lock(UINT OffsetToLock, UINT SizeToLock
 
 	InterlockedIncrement(&mLockCount);
 
-	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::IndexBuffer_Lock;
-	workItem->Id = mId;
-	workItem->Argument1 = (void*)OffsetToLock;
-	workItem->Argument2 = (void*)SizeToLock;
-	workItem->Argument3 = (void*)ppbData;
-	workItem->Argument4 = (void*)Flags;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
+	/*
+	Host visible memory stays mapped so once the worker has handed out the address the pointer can be worked out here.
+	A discard or a plain write to a dynamic buffer still goes through the worker because it may have to rename the buffer or wait on the gpu.
+	*/
+	const bool isDynamic = ((mUsage & D3DUSAGE_DYNAMIC) == D3DUSAGE_DYNAMIC) || mPool == D3DPOOL_SYSTEMMEM || mPool == D3DPOOL_SCRATCH;
+	if (mMappedData != nullptr && (!isDynamic || (!(Flags & D3DLOCK_DISCARD) && (Flags & (D3DLOCK_NOOVERWRITE | D3DLOCK_READONLY)))) && (!mIsUploadPending || (Flags & D3DLOCK_READONLY)))
+	{
+		(*ppbData) = mMappedData + OffsetToLock;
+	}
+	else
+	{
+		WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+		workItem->WorkItemType = WorkItemType::IndexBuffer_Lock;
+		workItem->Id = mId;
+		workItem->Argument1 = (void*)OffsetToLock;
+		workItem->Argument2 = (void*)SizeToLock;
+		workItem->Argument3 = (void*)ppbData;
+		workItem->Argument4 = (void*)Flags;
+		mCommandStreamManager->RequestWorkAndWait(workItem);
+
+		mMappedData = ((*ppbData) != nullptr) ? ((char*)(*ppbData) - OffsetToLock) : nullptr;
+		mIsUploadPending = mIsUploadPending && (Flags & D3DLOCK_READONLY);
+	}
+
+	if (!(Flags & D3DLOCK_READONLY) && OffsetToLock < mLength)
+	{
+		//A size of zero locks the rest of the buffer. Nested locks grow the range so one unlock covers them all.
+		UINT end = (SizeToLock == 0) ? mLength : std::min(mLength, OffsetToLock + SizeToLock);
+		if (mDirtyEnd == mDirtyStart)
+		{
+			mDirtyStart = OffsetToLock;
+			mDirtyEnd = end;
+		}
+		else
+		{
+			mDirtyStart = std::min(mDirtyStart, OffsetToLock);
+			mDirtyEnd = std::max(mDirtyEnd, end);
+		}
+	}
 
 	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CIndexBuffer9::Unlock()
 {
-	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::IndexBuffer_Unlock;
-	workItem->Id = mId;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
+	//Dynamic buffers are written in place in host coherent memory so only a written static buffer needs the worker to copy it into video memory.
+	const bool isDynamic = ((mUsage & D3DUSAGE_DYNAMIC) == D3DUSAGE_DYNAMIC) || mPool == D3DPOOL_SYSTEMMEM || mPool == D3DPOOL_SCRATCH;
+	//Nested locks are copied by the outermost unlock.
+	if (mLockCount <= 1)
+	{
+		if (mDirtyEnd > mDirtyStart && !isDynamic)
+		{
+			WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+			workItem->WorkItemType = WorkItemType::IndexBuffer_Unlock;
+			workItem->Id = mId;
+			workItem->Argument1 = (void*)mDirtyStart;
+			workItem->Argument2 = (void*)(mDirtyEnd - mDirtyStart);
+			mCommandStreamManager->RequestWork(workItem);
+			mIsUploadPending = true;
+		}
+		mDirtyStart = 0;
+		mDirtyEnd = 0;
+	}
 
 	InterlockedDecrement(&mLockCount);
 
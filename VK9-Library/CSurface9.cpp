@@ -200,7 +200,7 @@ void CSurface9::Init()
 	workItem->Id = mDevice->mId;
 	workItem->WorkItemType = WorkItemType::Surface_Create;
 	workItem->Argument1 = this;
-	mId = mCommandStreamManager->RequestWorkAndWait(workItem);
+	mId = mCommandStreamManager->RequestWork(workItem); //Creates don't wait, a texture level doesn't allocate anything until it is first locked.
 }
 
 CSurface9::~CSurface9()
@@ -366,14 +366,61 @@ HRESULT STDMETHODCALLTYPE CSurface9::GetDesc(D3DSURFACE_DESC* pDesc)
 HRESULT STDMETHODCALLTYPE CSurface9::LockRect(D3DLOCKED_RECT* pLockedRect, const RECT* pRect, DWORD Flags)
 {
 	mFlags = Flags;
-	
-	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::Surface_LockRect;
-	workItem->Id = mId;
-	workItem->Argument1 = (void*)pLockedRect;
-	workItem->Argument2 = (void*)pRect;
-	workItem->Argument3 = (void*)Flags;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
+
+	//An idle level can be locked right here. Otherwise the worker hands out the address once the last copy out of the staging memory has finished because it may have given the staging buffer back.
+	uint32_t stagingState = StagingIdle;
+	if (mMappedData == nullptr || !mStagingState.compare_exchange_strong(stagingState, StagingLocked))
+	{
+		D3DLOCKED_RECT lockedRect = {};
+
+		WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+		workItem->WorkItemType = WorkItemType::Surface_LockRect;
+		workItem->Id = mId;
+		workItem->Argument1 = (void*)&lockedRect;
+		workItem->Argument2 = nullptr;
+		workItem->Argument3 = (void*)Flags;
+		workItem->Argument4 = (void*)this;
+		mCommandStreamManager->RequestWorkAndWait(workItem);
+
+		mMappedData = (char*)lockedRect.pBits;
+		mMappedPitch = lockedRect.Pitch;
+	}
+
+	char* bytes = mMappedData;
+	if (bytes != nullptr && pRect != nullptr)
+	{
+		bytes += GetLockOffset(mFormat, mMappedPitch, 0, pRect->left, pRect->top);
+	}
+
+	pLockedRect->pBits = (void*)bytes;
+	pLockedRect->Pitch = mMappedPitch;
+
+	if ((Flags & D3DLOCK_READONLY) != D3DLOCK_READONLY)
+	{
+		D3DBOX region = { 0, 0, mWidth, mHeight, 0, 1 };
+		if (pRect != nullptr)
+		{
+			region.Left = pRect->left;
+			region.Top = pRect->top;
+			region.Right = std::min((UINT)pRect->right, mWidth);
+			region.Bottom = std::min((UINT)pRect->bottom, mHeight);
+		}
+		AddDirtyRegion(mDirtyRegions, region);
+
+		//Only a system memory texture can be the source of an UpdateTexture so only those keep track of what it has to copy, in top level texels.
+		if (mPool == D3DPOOL_SYSTEMMEM && (Flags & D3DLOCK_NO_DIRTY_UPDATE) != D3DLOCK_NO_DIRTY_UPDATE)
+		{
+			RECT dirtyRect = { (LONG)(region.Left << mMipIndex), (LONG)(region.Top << mMipIndex), (LONG)(region.Right << mMipIndex), (LONG)(region.Bottom << mMipIndex) };
+			if (mTexture != nullptr)
+			{
+				mTexture->AddDirtyRect(&dirtyRect);
+			}
+			else if (mCubeTexture != nullptr)
+			{
+				mCubeTexture->AddDirtyRect((D3DCUBEMAP_FACES)mTargetLayer, &dirtyRect);
+			}
+		}
+	}
 
 	return S_OK;
 }
@@ -389,22 +436,37 @@ HRESULT STDMETHODCALLTYPE CSurface9::ReleaseDC(HDC hdc)
 
 HRESULT STDMETHODCALLTYPE CSurface9::UnlockRect()
 {
-	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::Surface_UnlockRect;
-	workItem->Id = mId;
-	workItem->Argument1 = (void*)this;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
-
-	this->Flush();
+	//The staging memory is written in place so all that's left is copying it into the texture.
+	if ((mFlags & D3DLOCK_READONLY) != D3DLOCK_READONLY)
+	{
+		this->Flush();
+	}
+	else
+	{
+		mStagingState = StagingIdle;
+	}
 
 	return S_OK;
 }
 
 void CSurface9::Flush()
 {
+	mStagingState = StagingFlushing;
+
+	/*
+	The regions are handed over as they are so rects written apart from each other don't drag everything between them along.
+	While the level is flushing a lock has to go through the worker so nothing touches the list until the copy has been recorded.
+	*/
+	mFlushRegions.clear();
+	mFlushRegions.swap(mDirtyRegions);
+	if (mFlushRegions.empty())
+	{
+		mFlushRegions.push_back({ 0, 0, mWidth, mHeight, 0, 1 });
+	}
+
 	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
 	workItem->WorkItemType = WorkItemType::Surface_Flush;
 	workItem->Id = mId;
 	workItem->Argument1 = (void*)this;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
+	mCommandStreamManager->RequestWork(workItem);
 }
\ No newline at end of file
@@ -65,6 +65,11 @@ public:
 	uint32_t counter = 0;
 	DWORD mFlags = 0;
 	uint32_t mTargetLayer = 0;
+	char* mMappedData = nullptr; //Host visible memory stays mapped so the address of the staging image never changes.
+	INT mMappedPitch = 0;
+	boost::container::small_vector<D3DBOX, 4> mDirtyRegions; //Written since the last flush, only these are copied into the texture.
+	boost::container::small_vector<D3DBOX, 4> mFlushRegions; //Handed to the worker by Flush, a lock can't come back until the worker has copied them.
+	std::atomic<uint32_t> mStagingState{ StagingUnmapped }; //Shared with the worker, an idle level can be locked without asking it for the address.
 
 	void Init();
 	void Flush();
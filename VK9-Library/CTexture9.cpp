@@ -159,11 +159,7 @@ HRESULT STDMETHODCALLTYPE CTexture9::FreePrivateData(REFGUID refguid)
 
 DWORD STDMETHODCALLTYPE CTexture9::GetPriority()
 {
-	//TODO: Implement.
-
-	BOOST_LOG_TRIVIAL(warning) << "CTexture9::GetPriority is not implemented!";
-
-	return 1;
+	return mPriority;
 }
 
 HRESULT STDMETHODCALLTYPE CTexture9::GetPrivateData(REFGUID refguid, void* pData, DWORD* pSizeOfData)
@@ -177,20 +173,32 @@ HRESULT STDMETHODCALLTYPE CTexture9::GetPrivateData(REFGUID refguid, void* pData
 
 void STDMETHODCALLTYPE CTexture9::PreLoad()
 {
-	//TODO: Implement.
-
-	BOOST_LOG_TRIVIAL(warning) << "CTexture9::PreLoad is not implemented!";
-
-	return;
+	//Brings an evicted managed texture back ahead of the draw that needs it.
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_PreLoad;
+	workItem->Id = mId;
+	workItem->Argument1 = mDevice;
+	mCommandStreamManager->RequestWork(workItem);
 }
 
 DWORD STDMETHODCALLTYPE CTexture9::SetPriority(DWORD PriorityNew)
 {
-	//TODO: Implement.
+	//Only managed textures are ever evicted so the priority means nothing for the other pools.
+	if (mPool != D3DPOOL_MANAGED)
+	{
+		return 0;
+	}
+
+	DWORD priority = mPriority;
+	mPriority = PriorityNew;
 
-	BOOST_LOG_TRIVIAL(warning) << "CTexture9::SetPriority is not implemented!";
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_SetPriority;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>(PriorityNew);
+	mCommandStreamManager->RequestWork(workItem);
 
-	return 1;
+	return priority;
 }
 
 HRESULT STDMETHODCALLTYPE CTexture9::SetPrivateData(REFGUID refguid, const void* pData, DWORD SizeOfData, DWORD Flags)
@@ -261,9 +269,27 @@ D3DRESOURCETYPE STDMETHODCALLTYPE CTexture9::GetType()
 
 HRESULT STDMETHODCALLTYPE CTexture9::AddDirtyRect(const RECT* pDirtyRect)
 {
-	//TODO: Implement.
+	//The regions are kept by the worker so UpdateTexture doesn't have to wait for a copy of them.
+	D3DBOX region = { 0, 0, mWidth, mHeight, 0, 1 };
+	if (pDirtyRect != nullptr)
+	{
+		region.Left = pDirtyRect->left;
+		region.Top = pDirtyRect->top;
+		region.Right = std::min((UINT)pDirtyRect->right, mWidth);
+		region.Bottom = std::min((UINT)pDirtyRect->bottom, mHeight);
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CTexture9::AddDirtyRect is not implemented!";
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_AddDirtyRect;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>((UINT)0);
+	workItem->Argument2 = bit_cast<void*>(region.Left);
+	workItem->Argument3 = bit_cast<void*>(region.Top);
+	workItem->Argument4 = bit_cast<void*>(region.Right);
+	workItem->Argument5 = bit_cast<void*>(region.Bottom);
+	workItem->Argument6 = bit_cast<void*>(region.Front);
+	workItem->Argument7 = bit_cast<void*>(region.Back);
+	mCommandStreamManager->RequestWork(workItem);
 
 	return S_OK;
 }
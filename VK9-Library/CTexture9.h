@@ -47,7 +47,8 @@ public:
 	HANDLE* mSharedHandle = nullptr;
 
 	ULONG mReferenceCount = 1;
-	D3DTEXTUREFILTERTYPE mMipFilter = D3DTEXF_NONE;
+	D3DTEXTUREFILTERTYPE mMipFilter = D3DTEXF_LINEAR; //The default auto generation filter.
+	DWORD mPriority = 0; //Managed textures with a lower priority are evicted first.
 	D3DTEXTUREFILTERTYPE mMinFilter = D3DTEXF_NONE;
 	D3DTEXTUREFILTERTYPE mMagFilter = D3DTEXF_NONE;
 
@@ -45,6 +45,10 @@ public:
 	int32_t mCapacity;
 	bool mIsDirty;
 	uint32_t mLockCount;
+	char* mMappedData = nullptr; //Host visible memory stays mapped so the address only changes when the worker renames the buffer.
+	UINT mDirtyStart = 0; //Bytes written since the last unlock, only this range is copied into video memory.
+	UINT mDirtyEnd = 0;
+	bool mIsUploadPending = false; //The staging buffer is still being copied so the next write lock has to go through the worker.
 
 public:
 	//IUnknown
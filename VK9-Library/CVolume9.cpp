@@ -79,16 +79,38 @@ void CVolume9::Init()
 	workItem->Id = mDevice->mId;
 	workItem->WorkItemType = WorkItemType::Volume_Create;
 	workItem->Argument1 = this;
-	mId = mCommandStreamManager->RequestWorkAndWait(workItem);
+	mId = mCommandStreamManager->RequestWork(workItem); //Creates don't wait, a volume doesn't allocate anything until it is first locked.
 }
 
 void CVolume9::Flush()
 {
-	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::Volume_Flush;
-	workItem->Id = mId;
-	workItem->Argument1 = (void*)this;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
+	mStagingState = StagingFlushing;
+
+	/*
+	The worker copies whatever is in the staging memory when it gets to the flush so each box is handed over by value.
+	Boxes aren't folded together because slices written apart from each other would otherwise drag everything between them along.
+	*/
+	if (mDirtyRegions.empty())
+	{
+		mDirtyRegions.push_back({ 0, 0, mWidth, mHeight, 0, mDepth });
+	}
+
+	for (auto& region : mDirtyRegions)
+	{
+		WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+		workItem->WorkItemType = WorkItemType::Volume_Flush;
+		workItem->Id = mId;
+		workItem->Argument1 = (void*)this;
+		workItem->Argument2 = bit_cast<void*>(region.Left);
+		workItem->Argument3 = bit_cast<void*>(region.Top);
+		workItem->Argument4 = bit_cast<void*>(region.Right);
+		workItem->Argument5 = bit_cast<void*>(region.Bottom);
+		workItem->Argument6 = bit_cast<void*>(region.Front);
+		workItem->Argument7 = bit_cast<void*>(region.Back);
+		mCommandStreamManager->RequestWork(workItem);
+	}
+
+	mDirtyRegions.clear();
 }
 
 //IUnknown
@@ -195,26 +217,72 @@ HRESULT STDMETHODCALLTYPE CVolume9::LockBox(D3DLOCKED_BOX* pLockedVolume, CONST
 {
 	mFlags = Flags;
 
-	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::Volume_LockRect;
-	workItem->Id = mId;
-	workItem->Argument1 = (void*)pLockedVolume;
-	workItem->Argument2 = (void*)pBox;
-	workItem->Argument3 = (void*)Flags;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
+	//An idle level can be locked right here. Otherwise the worker hands out the address once the last copy out of the staging memory has finished because it may have given the staging buffer back.
+	uint32_t stagingState = StagingIdle;
+	if (mMappedData == nullptr || !mStagingState.compare_exchange_strong(stagingState, StagingLocked))
+	{
+		D3DLOCKED_BOX lockedVolume = {};
+
+		WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+		workItem->WorkItemType = WorkItemType::Volume_LockRect;
+		workItem->Id = mId;
+		workItem->Argument1 = (void*)&lockedVolume;
+		workItem->Argument2 = nullptr;
+		workItem->Argument3 = (void*)Flags;
+		workItem->Argument4 = (void*)this;
+		mCommandStreamManager->RequestWorkAndWait(workItem);
+
+		mMappedData = (char*)lockedVolume.pBits;
+		mMappedRowPitch = lockedVolume.RowPitch;
+		mMappedSlicePitch = lockedVolume.SlicePitch;
+	}
+
+	char* bytes = mMappedData;
+	if (bytes != nullptr && pBox != nullptr)
+	{
+		bytes += GetLockOffset(mFormat, mMappedRowPitch, mMappedSlicePitch, pBox->Left, pBox->Top, pBox->Front);
+	}
+
+	pLockedVolume->pBits = (void*)bytes;
+	pLockedVolume->RowPitch = mMappedRowPitch;
+	pLockedVolume->SlicePitch = mMappedSlicePitch;
+
+	if ((Flags & D3DLOCK_READONLY) != D3DLOCK_READONLY)
+	{
+		D3DBOX region = { 0, 0, mWidth, mHeight, 0, mDepth };
+		if (pBox != nullptr)
+		{
+			region.Left = pBox->Left;
+			region.Top = pBox->Top;
+			region.Front = pBox->Front;
+			region.Right = std::min(pBox->Right, mWidth);
+			region.Bottom = std::min(pBox->Bottom, mHeight);
+			region.Back = std::min(pBox->Back, mDepth);
+		}
+		AddDirtyRegion(mDirtyRegions, region);
+
+		//Only a system memory texture can be the source of an UpdateTexture so only those keep track of what it has to copy, in top level texels.
+		if (mPool == D3DPOOL_SYSTEMMEM && (Flags & D3DLOCK_NO_DIRTY_UPDATE) != D3DLOCK_NO_DIRTY_UPDATE)
+		{
+			D3DBOX dirtyBox = { region.Left << mMipIndex, region.Top << mMipIndex, region.Right << mMipIndex, region.Bottom << mMipIndex, region.Front << mMipIndex, region.Back << mMipIndex };
+			mTexture->AddDirtyBox(&dirtyBox);
+		}
+	}
 
 	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CVolume9::UnlockBox()
 {
-	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
-	workItem->WorkItemType = WorkItemType::Volume_UnlockRect;
-	workItem->Id = mId;
-	workItem->Argument1 = (void*)this;
-	mCommandStreamManager->RequestWorkAndWait(workItem);
-
-	this->Flush();
+	//The staging memory is written in place so all that's left is copying it into the texture.
+	if ((mFlags & D3DLOCK_READONLY) != D3DLOCK_READONLY)
+	{
+		this->Flush();
+	}
+	else
+	{
+		mStagingState = StagingIdle;
+	}
 
 	return S_OK;
 }
\ No newline at end of file
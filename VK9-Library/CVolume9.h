@@ -55,6 +55,11 @@ public:
 	uint32_t counter = 0;
 	DWORD mFlags = 0;
 	uint32_t mTargetLayer = 0;
+	char* mMappedData = nullptr; //Host visible memory stays mapped so the address of the staging image never changes.
+	INT mMappedRowPitch = 0;
+	INT mMappedSlicePitch = 0;
+	boost::container::small_vector<D3DBOX, 4> mDirtyRegions; //Written since the last flush, only these are copied into the texture.
+	std::atomic<uint32_t> mStagingState{ StagingUnmapped }; //Shared with the worker, an idle level can be locked without asking it for the address.
 
 	void Init();
 	void Flush();
@@ -157,11 +157,7 @@ HRESULT STDMETHODCALLTYPE CVolumeTexture9::FreePrivateData(REFGUID refguid)
 
 DWORD STDMETHODCALLTYPE CVolumeTexture9::GetPriority()
 {
-	//TODO: Implement.
-
-	BOOST_LOG_TRIVIAL(warning) << "CVolumeTexture9::GetPriority is not implemented!";
-
-	return 1;
+	return mPriority;
 }
 
 HRESULT STDMETHODCALLTYPE CVolumeTexture9::GetPrivateData(REFGUID refguid, void* pData, DWORD* pSizeOfData)
@@ -175,20 +171,32 @@ HRESULT STDMETHODCALLTYPE CVolumeTexture9::GetPrivateData(REFGUID refguid, void*
 
 void STDMETHODCALLTYPE CVolumeTexture9::PreLoad()
 {
-	//TODO: Implement.
-
-	BOOST_LOG_TRIVIAL(warning) << "CVolumeTexture9::PreLoad is not implemented!";
-
-	return; 
+	//Brings an evicted managed texture back ahead of the draw that needs it.
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_PreLoad;
+	workItem->Id = mId;
+	workItem->Argument1 = mDevice;
+	mCommandStreamManager->RequestWork(workItem);
 }
 
 DWORD STDMETHODCALLTYPE CVolumeTexture9::SetPriority(DWORD PriorityNew)
 {
-	//TODO: Implement.
+	//Only managed textures are ever evicted so the priority means nothing for the other pools.
+	if (mPool != D3DPOOL_MANAGED)
+	{
+		return 0;
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CVolumeTexture9::SetPriority is not implemented!";
+	DWORD priority = mPriority;
+	mPriority = PriorityNew;
 
-	return 1;
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_SetPriority;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>(PriorityNew);
+	mCommandStreamManager->RequestWork(workItem);
+
+	return priority;
 }
 
 HRESULT STDMETHODCALLTYPE CVolumeTexture9::SetPrivateData(REFGUID refguid, const void* pData, DWORD SizeOfData, DWORD Flags)
@@ -261,11 +269,31 @@ D3DRESOURCETYPE STDMETHODCALLTYPE CVolumeTexture9::GetType()
 
 HRESULT STDMETHODCALLTYPE CVolumeTexture9::AddDirtyBox(const D3DBOX* pDirtyBox)
 {
-	//TODO: Implement.
+	//The regions are kept by the worker so UpdateTexture doesn't have to wait for a copy of them.
+	D3DBOX region = { 0, 0, mWidth, mHeight, 0, mDepth };
+	if (pDirtyBox != nullptr)
+	{
+		region.Left = pDirtyBox->Left;
+		region.Top = pDirtyBox->Top;
+		region.Front = pDirtyBox->Front;
+		region.Right = std::min(pDirtyBox->Right, mWidth);
+		region.Bottom = std::min(pDirtyBox->Bottom, mHeight);
+		region.Back = std::min(pDirtyBox->Back, mDepth);
+	}
 
-	BOOST_LOG_TRIVIAL(warning) << "CVolumeTexture9::AddDirtyBox is not implemented!";
+	WorkItem* workItem = mCommandStreamManager->GetWorkItem(this);
+	workItem->WorkItemType = WorkItemType::Texture_AddDirtyRect;
+	workItem->Id = mId;
+	workItem->Argument1 = bit_cast<void*>((UINT)0);
+	workItem->Argument2 = bit_cast<void*>(region.Left);
+	workItem->Argument3 = bit_cast<void*>(region.Top);
+	workItem->Argument4 = bit_cast<void*>(region.Right);
+	workItem->Argument5 = bit_cast<void*>(region.Bottom);
+	workItem->Argument6 = bit_cast<void*>(region.Front);
+	workItem->Argument7 = bit_cast<void*>(region.Back);
+	mCommandStreamManager->RequestWork(workItem);
 
-	return E_NOTIMPL;
+	return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CVolumeTexture9::GetLevelDesc(UINT Level, D3DVOLUME_DESC* pDesc)
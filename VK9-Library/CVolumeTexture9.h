@@ -48,7 +48,8 @@ public:
 
 	ULONG mReferenceCount;
 	VkResult mResult;
-	D3DTEXTUREFILTERTYPE mMipFilter = D3DTEXF_NONE;
+	D3DTEXTUREFILTERTYPE mMipFilter = D3DTEXF_LINEAR; //The default auto generation filter.
+	DWORD mPriority = 0; //Managed textures with a lower priority are evicted first.
 	D3DTEXTUREFILTERTYPE mMinFilter = D3DTEXF_NONE;
 	D3DTEXTUREFILTERTYPE mMagFilter = D3DTEXF_NONE;
 
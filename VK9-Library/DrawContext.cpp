@@ -5,9 +5,9 @@ DrawContext::~DrawContext()
 	if (mRealDevice != nullptr)
 	{
 		//BOOST_LOG_TRIVIAL(warning) << "DrawContext::~DrawContext";
-		auto& device = mRealDevice->mDevice;
-		device.destroyPipeline(Pipeline, nullptr);
-		device.destroyPipelineLayout(PipelineLayout, nullptr);
-		device.destroyDescriptorSetLayout(DescriptorSetLayout, nullptr);
+		auto& garbageManager = mRealDevice->mGarbageManager;
+		garbageManager.Retire(Pipeline);
+		garbageManager.Retire(PipelineLayout);
+		garbageManager.Retire(DescriptorSetLayout);
 	}
 }
\ No newline at end of file
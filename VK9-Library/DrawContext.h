@@ -43,6 +43,7 @@ struct DrawContext
 	CVertexShader9* VertexShader = nullptr;
 	CPixelShader9* PixelShader = nullptr;
 	int32_t StreamCount = 0;
+	vk::SampleCountFlagBits Samples = vk::SampleCountFlagBits::e1; //Has to match the render target the pipeline is used with.
 
 	//D3d9 State - Lights
 	ShaderConstantSlots mVertexShaderConstantSlots = {};
@@ -0,0 +1,597 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "FormatConverter.h"
+#include "Utilities.h"
+
+//SSE2 is part of x64 so the vector paths need no runtime check. Other targets use the scalar loops, which also finish the end of every row.
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FORMATCONVERTER_SSE2
+#endif
+
+/*
+The decoders work a block at a time into a 4x4 array of RGBA8 pixels and then copy as much of it as falls inside the level.
+Each step is a fixed length loop over the block so the compiler can keep it in vector registers.
+*/
+
+inline void Unpack565(uint32_t color, uint32_t& r, uint32_t& g, uint32_t& b) noexcept
+{
+	r = (color >> 11) & 0x1F;
+	g = (color >> 5) & 0x3F;
+	b = color & 0x1F;
+
+	r = (r << 3) | (r >> 2);
+	g = (g << 2) | (g >> 4);
+	b = (b << 3) | (b >> 2);
+}
+
+/*
+BC1 color block: two 565 end points and 2 bit indices. BC2 and BC3 always use the four color mode, only BC1 has the punch through alpha mode.
+*/
+inline void DecodeColorBlock(const uint8_t* block, uint32_t (&pixels)[16], bool hasPunchThrough) noexcept
+{
+	const uint32_t color0 = block[0] | (block[1] << 8);
+	const uint32_t color1 = block[2] | (block[3] << 8);
+
+	uint32_t r[4], g[4], b[4], a[4] = { 255, 255, 255, 255 };
+	Unpack565(color0, r[0], g[0], b[0]);
+	Unpack565(color1, r[1], g[1], b[1]);
+
+	if (color0 > color1 || !hasPunchThrough)
+	{
+		r[2] = (2 * r[0] + r[1]) / 3;
+		g[2] = (2 * g[0] + g[1]) / 3;
+		b[2] = (2 * b[0] + b[1]) / 3;
+		r[3] = (r[0] + 2 * r[1]) / 3;
+		g[3] = (g[0] + 2 * g[1]) / 3;
+		b[3] = (b[0] + 2 * b[1]) / 3;
+	}
+	else
+	{
+		r[2] = (r[0] + r[1]) / 2;
+		g[2] = (g[0] + g[1]) / 2;
+		b[2] = (b[0] + b[1]) / 2;
+		r[3] = g[3] = b[3] = a[3] = 0;
+	}
+
+	uint32_t palette[4];
+	for (size_t i = 0; i < 4; i++)
+	{
+		palette[i] = r[i] | (g[i] << 8) | (b[i] << 16) | (a[i] << 24);
+	}
+
+	const uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+	for (size_t i = 0; i < 16; i++)
+	{
+		pixels[i] = palette[(indices >> (2 * i)) & 3];
+	}
+}
+
+/*
+BC2 alpha block: 4 bits of alpha per pixel.
+*/
+inline void DecodeExplicitAlphaBlock(const uint8_t* block, uint32_t (&pixels)[16]) noexcept
+{
+	for (size_t i = 0; i < 16; i++)
+	{
+		const uint32_t alpha = (block[i / 2] >> (4 * (i & 1))) & 0xF;
+		pixels[i] = (pixels[i] & 0x00FFFFFF) | ((alpha * 17) << 24);
+	}
+}
+
+/*
+BC3 alpha block: two 8 bit end points and 3 bit indices.
+*/
+inline void DecodeInterpolatedAlphaBlock(const uint8_t* block, uint32_t (&pixels)[16]) noexcept
+{
+	uint32_t palette[8];
+	palette[0] = block[0];
+	palette[1] = block[1];
+
+	if (palette[0] > palette[1])
+	{
+		for (uint32_t i = 1; i < 7; i++)
+		{
+			palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+		}
+	}
+	else
+	{
+		for (uint32_t i = 1; i < 5; i++)
+		{
+			palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	const uint64_t indices = (uint64_t)block[2] | ((uint64_t)block[3] << 8) | ((uint64_t)block[4] << 16) | ((uint64_t)block[5] << 24) | ((uint64_t)block[6] << 32) | ((uint64_t)block[7] << 40);
+	for (size_t i = 0; i < 16; i++)
+	{
+		pixels[i] = (pixels[i] & 0x00FFFFFF) | (palette[(indices >> (3 * i)) & 7] << 24);
+	}
+}
+
+inline void WriteBlock(const uint32_t (&pixels)[16], char* destination, size_t destinationPitch, uint32_t width, uint32_t height) noexcept
+{
+	width = std::min(width, (uint32_t)4);
+	height = std::min(height, (uint32_t)4);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		memcpy(destination + (destinationPitch * y), &pixels[y * 4], width * sizeof(uint32_t));
+	}
+}
+
+void DecodeBC1(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	uint32_t pixels[16];
+
+	for (uint32_t y = 0; y < height; y += 4)
+	{
+		const uint8_t* block = (const uint8_t*)(source + (sourcePitch * (y / 4)));
+		char* row = destination + (destinationPitch * y);
+
+		for (uint32_t x = 0; x < width; x += 4, block += 8)
+		{
+			DecodeColorBlock(block, pixels, true);
+			WriteBlock(pixels, row + (x * sizeof(uint32_t)), destinationPitch, width - x, height - y);
+		}
+	}
+}
+
+void DecodeBC2(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	uint32_t pixels[16];
+
+	for (uint32_t y = 0; y < height; y += 4)
+	{
+		const uint8_t* block = (const uint8_t*)(source + (sourcePitch * (y / 4)));
+		char* row = destination + (destinationPitch * y);
+
+		for (uint32_t x = 0; x < width; x += 4, block += 16)
+		{
+			DecodeColorBlock(block + 8, pixels, false);
+			DecodeExplicitAlphaBlock(block, pixels);
+			WriteBlock(pixels, row + (x * sizeof(uint32_t)), destinationPitch, width - x, height - y);
+		}
+	}
+}
+
+void DecodeBC3(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	uint32_t pixels[16];
+
+	for (uint32_t y = 0; y < height; y += 4)
+	{
+		const uint8_t* block = (const uint8_t*)(source + (sourcePitch * (y / 4)));
+		char* row = destination + (destinationPitch * y);
+
+		for (uint32_t x = 0; x < width; x += 4, block += 16)
+		{
+			DecodeColorBlock(block + 8, pixels, false);
+			DecodeInterpolatedAlphaBlock(block, pixels);
+			WriteBlock(pixels, row + (x * sizeof(uint32_t)), destinationPitch, width - x, height - y);
+		}
+	}
+}
+
+/*
+The uncompressed conversions all write RGBA8 (or its snorm twin) one row at a time.
+The per pixel functions are branch free so the loops in ConvertPixels vectorize.
+*/
+template <typename SourceType, typename Function>
+inline void ConvertPixels(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, Function function) noexcept
+{
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const SourceType* input = (const SourceType*)(source + (sourcePitch * y));
+		uint32_t* output = (uint32_t*)(destination + (destinationPitch * y));
+
+		for (uint32_t x = 0; x < width; x++)
+		{
+			output[x] = function(input[x]);
+		}
+	}
+}
+
+inline uint32_t PackRGBA(uint32_t r, uint32_t g, uint32_t b, uint32_t a) noexcept
+{
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+inline uint32_t ExpandR3G3B2(uint32_t color) noexcept
+{
+	const uint32_t r = (color >> 5) & 7;
+	const uint32_t g = (color >> 2) & 7;
+	const uint32_t b = color & 3;
+
+	return PackRGBA((r << 5) | (r << 2) | (r >> 1), (g << 5) | (g << 2) | (g >> 1), b * 0x55, 0);
+}
+
+inline uint32_t Clamp8(int32_t value) noexcept
+{
+	return (uint32_t)std::min(std::max(value, 0), 255);
+}
+
+/*
+BT.601 studio range to full range RGB, the same coefficients d3d9 drivers use for YUY2 and UYVY.
+*/
+inline uint32_t ConvertYUV(int32_t y, int32_t u, int32_t v) noexcept
+{
+	const int32_t c = 298 * (y - 16) + 128;
+	const int32_t d = u - 128;
+	const int32_t e = v - 128;
+
+	return PackRGBA(Clamp8((c + 409 * e) >> 8), Clamp8((c - 100 * d - 208 * e) >> 8), Clamp8((c + 516 * d) >> 8), 255);
+}
+
+#ifdef FORMATCONVERTER_SSE2
+/*
+Four pixels of packed 4:2:2 with the same integer math as ConvertYUV.
+Every 32 bit lane holds two 16 bit values so _mm_madd_epi16 does two multiplies and their sum at once, the packs then saturate to 0-255 the way Clamp8 does.
+*/
+template <bool isLumaFirst>
+inline void ConvertPackedYUV4(const uint8_t* input, uint32_t* output) noexcept
+{
+	const __m128i lowWord = _mm_set1_epi32(0xFFFF);
+	const __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)input), _mm_setzero_si128());
+
+	//Luma of each pixel and the U, V, U, V of the two pairs.
+	const __m128i luma = _mm_sub_epi32(isLumaFirst ? _mm_and_si128(words, lowWord) : _mm_srli_epi32(words, 16), _mm_set1_epi32(16));
+	const __m128i chroma = _mm_sub_epi32(isLumaFirst ? _mm_srli_epi32(words, 16) : _mm_and_si128(words, lowWord), _mm_set1_epi32(128));
+	const __m128i d = _mm_shuffle_epi32(chroma, _MM_SHUFFLE(2, 2, 0, 0));
+	const __m128i e = _mm_shuffle_epi32(chroma, _MM_SHUFFLE(3, 3, 1, 1));
+
+	const __m128i yd = _mm_or_si128(_mm_and_si128(luma, lowWord), _mm_slli_epi32(d, 16));
+	const __m128i ye = _mm_or_si128(_mm_and_si128(luma, lowWord), _mm_slli_epi32(e, 16));
+	const __m128i rounding = _mm_set1_epi32(128);
+
+	const __m128i r = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ye, _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409)), rounding), 8);
+	const __m128i g = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yd, _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100)), _mm_madd_epi16(ye, _mm_setr_epi16(0, -208, 0, -208, 0, -208, 0, -208))), rounding), 8);
+	const __m128i b = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yd, _mm_setr_epi16(298, 516, 298, 516, 298, 516, 298, 516)), rounding), 8);
+
+	//R0-R3 G0-G3 and B0-B3 A0-A3 as words, interleaved to R G B A per pixel and packed down to bytes.
+	const __m128i rg = _mm_packs_epi32(r, g);
+	const __m128i ba = _mm_packs_epi32(b, _mm_set1_epi32(255));
+	const __m128i rgPixels = _mm_unpacklo_epi16(rg, _mm_srli_si128(rg, 8));
+	const __m128i baPixels = _mm_unpacklo_epi16(ba, _mm_srli_si128(ba, 8));
+	_mm_storeu_si128((__m128i*)output, _mm_packus_epi16(_mm_unpacklo_epi32(rgPixels, baPixels), _mm_unpackhi_epi32(rgPixels, baPixels)));
+}
+#endif
+
+/*
+Packed 4:2:2 where each pair of pixels shares a U and V. y0, u, y1 and v are the byte positions within the pair.
+*/
+template <size_t y0, size_t u, size_t y1, size_t v>
+inline void ConvertPackedYUV(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height) noexcept
+{
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* input = (const uint8_t*)(source + (sourcePitch * y));
+		uint32_t* output = (uint32_t*)(destination + (destinationPitch * y));
+		uint32_t x = 0;
+
+#ifdef FORMATCONVERTER_SSE2
+		for (; x + 4 <= width; x += 4, input += 8)
+		{
+			ConvertPackedYUV4<y0 == 0>(input, output + x);
+		}
+#endif
+
+		for (; x < width; x += 2, input += 4)
+		{
+			output[x] = ConvertYUV(input[y0], input[u], input[v]);
+			if (x + 1 < width)
+			{
+				output[x + 1] = ConvertYUV(input[y1], input[u], input[v]);
+			}
+		}
+	}
+}
+
+void ConvertR8G8B8(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	//Stored as B, G, R bytes.
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* input = (const uint8_t*)(source + (sourcePitch * y));
+		uint32_t* output = (uint32_t*)(destination + (destinationPitch * y));
+		uint32_t x = 0;
+
+#ifdef FORMATCONVERTER_SSE2
+		//Four pixels from each 16 byte load. The load runs past the fourth pixel so the last few on the row are left to the scalar loop.
+		const __m128i lowByte = _mm_set1_epi32(0xFF);
+		const __m128i greenAlpha = _mm_set1_epi32((int)0xFF00FF00);
+		for (; x + 6 <= width; x += 4, input += 12)
+		{
+			const __m128i bytes = _mm_loadu_si128((const __m128i*)input);
+			const __m128i pixels = _mm_unpacklo_epi64(_mm_unpacklo_epi32(bytes, _mm_srli_si128(bytes, 3)), _mm_unpacklo_epi32(_mm_srli_si128(bytes, 6), _mm_srli_si128(bytes, 9)));
+			const __m128i red = _mm_and_si128(_mm_srli_epi32(pixels, 16), lowByte);
+			const __m128i blue = _mm_slli_epi32(_mm_and_si128(pixels, lowByte), 16);
+			const __m128i green = _mm_and_si128(_mm_or_si128(pixels, _mm_set1_epi32((int)0xFF000000)), greenAlpha);
+			_mm_storeu_si128((__m128i*)(output + x), _mm_or_si128(_mm_or_si128(red, blue), green));
+		}
+#endif
+
+		for (; x < width; x++, input += 3)
+		{
+			output[x] = PackRGBA(input[2], input[1], input[0], 255);
+		}
+	}
+}
+
+void ConvertR3G3B2(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	ConvertPixels<uint8_t>(source, sourcePitch, destination, destinationPitch, width, height, [](uint32_t color)
+	{
+		return ExpandR3G3B2(color) | 0xFF000000;
+	});
+}
+
+void ConvertA8R3G3B2(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	ConvertPixels<uint16_t>(source, sourcePitch, destination, destinationPitch, width, height, [](uint32_t color)
+	{
+		return ExpandR3G3B2(color & 0xFF) | ((color >> 8) << 24);
+	});
+}
+
+/*
+Without a palette the index is shown as a grey level so the texture is at least recognisable.
+*/
+inline uint32_t GetPaletteEntry(const uint32_t* palette, uint32_t index) noexcept
+{
+	return (palette != nullptr) ? palette[index] : PackRGBA(index, index, index, 255);
+}
+
+void ConvertP8(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t* input = (const uint8_t*)(source + (sourcePitch * y));
+		uint32_t* output = (uint32_t*)(destination + (destinationPitch * y));
+		uint32_t x = 0;
+
+#ifdef FORMATCONVERTER_SSE2
+		if (palette != nullptr)
+		{
+			//There is no gather so the lookups stay scalar, the stores are four pixels wide.
+			for (; x + 4 <= width; x += 4)
+			{
+				_mm_storeu_si128((__m128i*)(output + x), _mm_setr_epi32((int)palette[input[x]], (int)palette[input[x + 1]], (int)palette[input[x + 2]], (int)palette[input[x + 3]]));
+			}
+		}
+		else
+		{
+			//Sixteen grey pixels from each load, every index is copied into red, green and blue.
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+			for (; x + 16 <= width; x += 16)
+			{
+				const __m128i bytes = _mm_loadu_si128((const __m128i*)(input + x));
+				const __m128i words[2] = { _mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero) };
+				for (size_t i = 0; i < 4; i++)
+				{
+					const __m128i index = (i & 1) ? _mm_unpackhi_epi16(words[i / 2], zero) : _mm_unpacklo_epi16(words[i / 2], zero);
+					const __m128i grey = _mm_or_si128(_mm_or_si128(index, _mm_slli_epi32(index, 8)), _mm_or_si128(_mm_slli_epi32(index, 16), alpha));
+					_mm_storeu_si128((__m128i*)(output + x + (i * 4)), grey);
+				}
+			}
+		}
+#endif
+
+		for (; x < width; x++)
+		{
+			output[x] = GetPaletteEntry(palette, input[x]);
+		}
+	}
+}
+
+void ConvertA8P8(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	ConvertPixels<uint16_t>(source, sourcePitch, destination, destinationPitch, width, height, [palette](uint32_t color)
+	{
+		return (GetPaletteEntry(palette, color & 0xFF) & 0x00FFFFFF) | ((color >> 8) << 24);
+	});
+}
+
+void ConvertYUY2(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	ConvertPackedYUV<0, 1, 2, 3>(source, sourcePitch, destination, destinationPitch, width, height);
+}
+
+void ConvertUYVY(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	ConvertPackedYUV<1, 0, 3, 2>(source, sourcePitch, destination, destinationPitch, width, height);
+}
+
+void ConvertA4L4(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	ConvertPixels<uint8_t>(source, sourcePitch, destination, destinationPitch, width, height, [](uint32_t color)
+	{
+		const uint32_t luminance = (color & 0xF) * 17;
+		return PackRGBA(luminance, luminance, luminance, (color >> 4) * 17);
+	});
+}
+
+void ConvertL6V5U5(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette)
+{
+	//Written as R8G8B8A8_SNORM holding U, V, L, 1. The signed 5 bit values are sign extended by shifting them to the top of the word and back.
+	ConvertPixels<uint16_t>(source, sourcePitch, destination, destinationPitch, width, height, [](uint32_t color)
+	{
+		const int32_t u = std::max(((int32_t)(color << 27) >> 27) * 127 / 15, -127);
+		const int32_t v = std::max(((int32_t)(color << 22) >> 27) * 127 / 15, -127);
+		const int32_t l = (int32_t)((color >> 10) & 0x3F) * 127 / 63;
+		return PackRGBA((uint8_t)u, (uint8_t)v, (uint8_t)l, 127);
+	});
+}
+
+/*
+The conversion used when the device can't sample a format, or null if there isn't one.
+*/
+inline ConvertFunction GetConvertFunction(D3DFORMAT format, vk::Format& convertedFormat) noexcept
+{
+	convertedFormat = vk::Format::eR8G8B8A8Unorm;
+
+	switch (format)
+	{
+	case D3DFMT_DXT1:
+		return DecodeBC1;
+	case D3DFMT_DXT2:
+	case D3DFMT_DXT3:
+		return DecodeBC2;
+	case D3DFMT_DXT4:
+	case D3DFMT_DXT5:
+		return DecodeBC3;
+	case D3DFMT_R8G8B8:
+		return ConvertR8G8B8;
+	case D3DFMT_R3G3B2:
+		return ConvertR3G3B2;
+	case D3DFMT_A8R3G3B2:
+		return ConvertA8R3G3B2;
+	case D3DFMT_P8:
+		return ConvertP8;
+	case D3DFMT_A8P8:
+		return ConvertA8P8;
+	case D3DFMT_YUY2:
+		return ConvertYUY2;
+	case D3DFMT_UYVY:
+		return ConvertUYVY;
+	case D3DFMT_A4L4:
+		return ConvertA4L4;
+	case D3DFMT_L6V5U5:
+		convertedFormat = vk::Format::eR8G8B8A8Snorm;
+		return ConvertL6V5U5;
+	default:
+		return nullptr;
+	}
+}
+
+bool HasFormatConversion(D3DFORMAT format)
+{
+	vk::Format convertedFormat;
+	return GetConvertFunction(format, convertedFormat) != nullptr;
+}
+
+bool IsFormatSampled(vk::PhysicalDevice physicalDevice, const vk::PhysicalDeviceFeatures& physicalDeviceFeatures, vk::Format format)
+{
+	if (format == vk::Format::eUndefined)
+	{
+		return false;
+	}
+
+	if (format >= vk::Format::eBc1RgbUnormBlock && format <= vk::Format::eBc7SrgbBlock && !physicalDeviceFeatures.textureCompressionBC)
+	{
+		return false;
+	}
+
+	vk::FormatProperties formatProperties = physicalDevice.getFormatProperties(format);
+	return (formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage) == vk::FormatFeatureFlagBits::eSampledImage;
+}
+
+FormatConversion GetFormatConversion(vk::PhysicalDevice physicalDevice, const vk::PhysicalDeviceFeatures& physicalDeviceFeatures, D3DFORMAT format)
+{
+	FormatConversion conversion;
+	conversion.Format = ConvertFormat(format);
+	conversion.TexelSize = GetFormatSize(format);
+	conversion.BlockSize = GetFormatBlockSize(format);
+
+	vk::Format convertedFormat;
+	ConvertFunction convert = GetConvertFunction(format, convertedFormat);
+	if (convert == nullptr)
+	{
+		return conversion;
+	}
+
+	//Use the native format if the device can sample it, otherwise convert on upload.
+	if (IsFormatSampled(physicalDevice, physicalDeviceFeatures, conversion.Format))
+	{
+		if (format == D3DFMT_A4L4) //Stored as R4G4 with alpha in R.
+		{
+			conversion.Components = vk::ComponentMapping(vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eR);
+		}
+		return conversion;
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "GetFormatConversion format " << format << " isn't supported by the device and will be converted to " << (VkFormat)convertedFormat << ".";
+
+	conversion.Format = convertedFormat;
+	conversion.Convert = convert;
+	conversion.TexelSize = 4;
+	conversion.BlockSize = 1;
+
+	return conversion;
+}
+
+void ConvertRegion(ThreadPool& threadPool, const FormatConversion& conversion, D3DFORMAT format, const char* source, const vk::SubresourceLayout& sourceLayout, char* destination, const vk::SubresourceLayout& destinationLayout, const D3DBOX& region, const uint32_t* palette)
+{
+	const uint32_t sourceTexelSize = GetFormatSize(format);
+	const uint32_t sourceBlockSize = GetFormatBlockSize(format);
+
+	//Compressed sources have to be converted from the start of a block and packed YUV from the start of a pair.
+	const uint32_t pairSize = (format == D3DFMT_YUY2 || format == D3DFMT_UYVY) ? 2 : sourceBlockSize;
+	const uint32_t left = region.Left - (region.Left % pairSize);
+	const uint32_t top = region.Top - (region.Top % sourceBlockSize);
+	const uint32_t width = region.Right - left;
+	const uint32_t height = region.Bottom - top;
+
+	if (width == 0 || height == 0)
+	{
+		return;
+	}
+
+	/*
+	Volumes are split by slice and slices are split into bands of block rows until there is a task for every thread in the pool.
+	Bands are a multiple of the block size so no block is split between two threads.
+	*/
+	const uint32_t depth = region.Back - region.Front;
+	const bool isThreaded = ((uint64_t)width * height * depth >= MinimumThreadedConversionSize);
+	uint32_t bandCount = 1;
+	if (isThreaded && depth < threadPool.GetThreadCount())
+	{
+		bandCount = (threadPool.GetThreadCount() + depth - 1) / depth;
+	}
+	uint32_t bandHeight = (height + bandCount - 1) / bandCount;
+	bandHeight = ((bandHeight + sourceBlockSize - 1) / sourceBlockSize) * sourceBlockSize;
+	bandCount = (height + bandHeight - 1) / bandHeight;
+
+	auto convertBand = [&](uint32_t task)
+	{
+		const uint32_t z = region.Front + (task / bandCount);
+		const uint32_t y = top + ((task % bandCount) * bandHeight);
+		const char* sourceBand = source + sourceLayout.offset + (sourceLayout.depthPitch * z) + (sourceLayout.rowPitch * (y / sourceBlockSize)) + (sourceTexelSize * (left / sourceBlockSize));
+		char* destinationBand = destination + destinationLayout.offset + (destinationLayout.depthPitch * z) + (destinationLayout.rowPitch * y) + (conversion.TexelSize * left);
+
+		conversion.Convert(sourceBand, (size_t)sourceLayout.rowPitch, destinationBand, (size_t)destinationLayout.rowPitch, width, std::min(bandHeight, region.Bottom - y), palette);
+	};
+
+	if (!isThreaded)
+	{
+		for (uint32_t task = 0; task < depth; task++)
+		{
+			convertBand(task);
+		}
+		return;
+	}
+
+	threadPool.Run(depth * bandCount, convertBand);
+}
@@ -0,0 +1,76 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vk_sdk_platform.h>
+
+#include "d3d9.h"
+#include "ThreadPool.h"
+
+#ifndef FORMATCONVERTER_H
+#define FORMATCONVERTER_H
+
+const uint32_t MinimumThreadedConversionSize = 256 * 256; //Pixels below which a region is converted on the calling thread.
+const uint32_t MaximumConversionThreadCount = 8; //Threads in the device's conversion pool, including the worker thread.
+
+/*
+Converts width x height pixels from the application's layout to the layout of the image format.
+Compressed sources are passed in whole blocks so sourcePitch is the size of a line of blocks.
+Palettized formats look their colors up in palette (256 RGBA8 entries), other formats ignore it.
+*/
+typedef void(*ConvertFunction)(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+
+/*
+How a d3d9 format is stored on this device.
+If the device can't sample the format natively the image is created with a format it can sample and Convert rewrites the locked data into it before the upload.
+*/
+struct FormatConversion
+{
+	vk::Format Format = vk::Format::eUndefined; //The format the image is created with.
+	ConvertFunction Convert = nullptr; //null if the locked data is uploaded as is.
+	uint32_t TexelSize = 4; //Bytes per texel (or block) of Format.
+	uint32_t BlockSize = 1; //Width and height of the blocks of Format, 4 if the image is block compressed.
+	vk::ComponentMapping Components; //Swizzle views of the image need to read Format as the d3d9 format.
+};
+
+bool HasFormatConversion(D3DFORMAT format);
+bool IsFormatSampled(vk::PhysicalDevice physicalDevice, const vk::PhysicalDeviceFeatures& physicalDeviceFeatures, vk::Format format);
+FormatConversion GetFormatConversion(vk::PhysicalDevice physicalDevice, const vk::PhysicalDeviceFeatures& physicalDeviceFeatures, D3DFORMAT format);
+
+/*
+Runs a conversion over a region of a level. The source has the pitches handed to the application and the destination is packed tightly in Format.
+Large regions are split by slice and into bands of block rows that are converted in parallel on threadPool.
+*/
+void ConvertRegion(ThreadPool& threadPool, const FormatConversion& conversion, D3DFORMAT format, const char* source, const vk::SubresourceLayout& sourceLayout, char* destination, const vk::SubresourceLayout& destinationLayout, const D3DBOX& region, const uint32_t* palette = nullptr);
+
+void DecodeBC1(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void DecodeBC2(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void DecodeBC3(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertR8G8B8(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertR3G3B2(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertA8R3G3B2(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertP8(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertA8P8(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertYUY2(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertUYVY(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertA4L4(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+void ConvertL6V5U5(const char* source, size_t sourcePitch, char* destination, size_t destinationPitch, uint32_t width, uint32_t height, const uint32_t* palette);
+
+#endif // FORMATCONVERTER_H
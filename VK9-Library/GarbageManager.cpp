@@ -17,59 +17,222 @@ appreciated but is not required.
 misrepresented as being the original software.
 3. This notice may not be removed or altered from any source distribution.
 */
+
 #include "GarbageManager.h"
+#include "Utilities.h"
 
+void GarbageManager::Initialize(vk::Device device, vk::DescriptorPool descriptorPool, MemoryManager* memoryManager)
+{
+	mDevice = device;
+	mDescriptorPool = descriptorPool;
+	mMemoryManager = memoryManager;
+}
 
-GarbageManager::GarbageManager()
+void GarbageManager::Destroy()
 {
+	//The caller has already waited for the device to go idle so nothing retired can still be in use.
+	for (auto& handles : mRetiredHandles)
+	{
+		DestroyHandles(handles);
+	}
+	mRetiredHandles.clear();
+}
 
+RetiredHandles& GarbageManager::GetRetiredHandles()
+{
+	if (mRetiredHandles.empty() || mRetiredHandles.back().FrameNumber != mFrameNumber)
+	{
+		mRetiredHandles.emplace_back();
+		mRetiredHandles.back().FrameNumber = mFrameNumber;
+	}
+
+	return mRetiredHandles.back();
 }
 
-GarbageManager::~GarbageManager()
+void GarbageManager::Retire(vk::Image image)
 {
-	this->DestroyHandles();
+	if (image)
+	{
+		GetRetiredHandles().Images.push_back(image);
+		mRetiredCount++;
+	}
 }
 
-void GarbageManager::DestroyHandles()
+void GarbageManager::Retire(vk::ImageView imageView)
 {
-	//Images
-	for (size_t i = 0; i < mImages.size(); i++)
+	if (imageView)
 	{
-		if (mImages[i] != VK_NULL_HANDLE)
-		{
-			vkDestroyImage(mDevice, mImages[i], NULL);
-		}
+		GetRetiredHandles().ImageViews.push_back(imageView);
+		mRetiredCount++;
 	}
-	mImages.clear();
+}
 
-	//Memories
-	for (size_t i = 0; i < mMemories.size(); i++)
+void GarbageManager::Retire(vk::Buffer buffer)
+{
+	if (buffer)
+	{
+		GetRetiredHandles().Buffers.push_back(buffer);
+		mRetiredCount++;
+	}
+}
+
+void GarbageManager::Retire(vk::Sampler sampler)
+{
+	if (sampler)
 	{
-		if (mMemories[i] != VK_NULL_HANDLE)
-		{
-			vkFreeMemory(mDevice, mMemories[i], NULL);
-		}
+		GetRetiredHandles().Samplers.push_back(sampler);
+		mRetiredCount++;
 	}
-	mMemories.clear();
+}
 
-	//Samplers
-	for (size_t i = 0; i < mSamplers.size(); i++)
+void GarbageManager::Retire(vk::Framebuffer framebuffer)
+{
+	if (framebuffer)
 	{
-		if (mSamplers[i] != VK_NULL_HANDLE)
-		{
-			vkDestroySampler(mDevice, mSamplers[i], NULL);
-		}
+		GetRetiredHandles().Framebuffers.push_back(framebuffer);
+		mRetiredCount++;
 	}
-	mSamplers.clear();
+}
 
-	//DescriptorSets
-	for (size_t i = 0; i < mDescriptorSets.size(); i++)
+void GarbageManager::Retire(vk::RenderPass renderPass)
+{
+	if (renderPass)
 	{
-		if (mDescriptorSets[i] != VK_NULL_HANDLE)
-		{
-			vkFreeDescriptorSets(mDevice, mDescriptorPool, 1, &mDescriptorSets[i]);
-		}
+		GetRetiredHandles().RenderPasses.push_back(renderPass);
+		mRetiredCount++;
 	}
-	mDescriptorSets.clear();
+}
+
+void GarbageManager::Retire(vk::Pipeline pipeline)
+{
+	if (pipeline)
+	{
+		GetRetiredHandles().Pipelines.push_back(pipeline);
+		mRetiredCount++;
+	}
+}
+
+void GarbageManager::Retire(vk::PipelineLayout pipelineLayout)
+{
+	if (pipelineLayout)
+	{
+		GetRetiredHandles().PipelineLayouts.push_back(pipelineLayout);
+		mRetiredCount++;
+	}
+}
+
+void GarbageManager::Retire(vk::DescriptorSetLayout descriptorSetLayout)
+{
+	if (descriptorSetLayout)
+	{
+		GetRetiredHandles().DescriptorSetLayouts.push_back(descriptorSetLayout);
+		mRetiredCount++;
+	}
+}
+
+void GarbageManager::Retire(vk::DescriptorSet descriptorSet)
+{
+	if (descriptorSet)
+	{
+		GetRetiredHandles().DescriptorSets.push_back(descriptorSet);
+		mRetiredCount++;
+	}
+}
+
+void GarbageManager::Retire(vk::DeviceMemory memory)
+{
+	if (memory)
+	{
+		GetRetiredHandles().Memories.push_back(memory);
+		mRetiredCount++;
+	}
+}
+
+void GarbageManager::Retire(MemoryAllocation& allocation)
+{
+	if (allocation.Memory)
+	{
+		GetRetiredHandles().Allocations.push_back(allocation);
+		mRetiredCount++;
+	}
+	allocation = MemoryAllocation();
+}
+
+void GarbageManager::DestroyHandles(RetiredHandles& handles)
+{
+	//Views and framebuffers go before the images and render passes they reference.
+	for (auto& framebuffer : handles.Framebuffers)
+	{
+		mDevice.destroyFramebuffer(framebuffer, nullptr);
+	}
+
+	for (auto& renderPass : handles.RenderPasses)
+	{
+		mDevice.destroyRenderPass(renderPass, nullptr);
+	}
+
+	for (auto& pipeline : handles.Pipelines)
+	{
+		mDevice.destroyPipeline(pipeline, nullptr);
+	}
+
+	for (auto& pipelineLayout : handles.PipelineLayouts)
+	{
+		mDevice.destroyPipelineLayout(pipelineLayout, nullptr);
+	}
+
+	for (auto& descriptorSetLayout : handles.DescriptorSetLayouts)
+	{
+		mDevice.destroyDescriptorSetLayout(descriptorSetLayout, nullptr);
+	}
+
+	if (!handles.DescriptorSets.empty())
+	{
+		mDevice.freeDescriptorSets(mDescriptorPool, (uint32_t)handles.DescriptorSets.size(), handles.DescriptorSets.data());
+	}
+
+	for (auto& sampler : handles.Samplers)
+	{
+		mDevice.destroySampler(sampler, nullptr);
+	}
+
+	for (auto& imageView : handles.ImageViews)
+	{
+		mDevice.destroyImageView(imageView, nullptr);
+	}
+
+	for (auto& image : handles.Images)
+	{
+		mDevice.destroyImage(image, nullptr);
+	}
+
+	for (auto& buffer : handles.Buffers)
+	{
+		mDevice.destroyBuffer(buffer, nullptr);
+	}
+
+	for (auto& memory : handles.Memories)
+	{
+		mDevice.freeMemory(memory, nullptr);
+	}
+
+	for (auto& allocation : handles.Allocations)
+	{
+		mMemoryManager->Free(allocation);
+	}
+}
+
+void GarbageManager::DestroyHandles(uint64_t frameNumber, uint64_t completedFrameNumber)
+{
+	while (!mRetiredHandles.empty() && mRetiredHandles.front().FrameNumber <= completedFrameNumber)
+	{
+		DestroyHandles(mRetiredHandles.front());
+		mRetiredHandles.pop_front();
+	}
+
+	BOOST_LOG_TRIVIAL(trace) << "GarbageManager::DestroyHandles " << mRetiredCount << " handles retired with " << mRetiredHandles.size() << " frames waiting.";
 
+	mLastFrameRetiredCount = mRetiredCount;
+	mRetiredCount = 0;
+	mFrameNumber = frameNumber;
 }
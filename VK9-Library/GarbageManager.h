@@ -18,35 +18,69 @@ misrepresented as being the original software.
 3. This notice may not be removed or altered from any source distribution.
 */
 
+#include <deque>
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vk_sdk_platform.h>
+#include <boost/container/small_vector.hpp>
+#include "MemoryManager.h"
+
 #ifndef GARBAGEMANAGER_H
 #define GARBAGEMANAGER_H
 
-#include <vulkan/vulkan.h>
-#include <vulkan/vk_sdk_platform.h>
-#include <boost/container/small_vector.hpp>
+/*
+Handles given up while a frame was being recorded. They can be destroyed once that frame's fence has signaled.
+*/
+struct RetiredHandles
+{
+	uint64_t FrameNumber = 0;
+	boost::container::small_vector<vk::Image, 4> Images;
+	boost::container::small_vector<vk::ImageView, 4> ImageViews;
+	boost::container::small_vector<vk::Buffer, 4> Buffers;
+	boost::container::small_vector<vk::Sampler, 4> Samplers;
+	boost::container::small_vector<vk::Framebuffer, 4> Framebuffers;
+	boost::container::small_vector<vk::RenderPass, 4> RenderPasses;
+	boost::container::small_vector<vk::Pipeline, 4> Pipelines;
+	boost::container::small_vector<vk::PipelineLayout, 4> PipelineLayouts;
+	boost::container::small_vector<vk::DescriptorSetLayout, 4> DescriptorSetLayouts;
+	boost::container::small_vector<vk::DescriptorSet, 4> DescriptorSets;
+	boost::container::small_vector<vk::DeviceMemory, 4> Memories;
+	boost::container::small_vector<MemoryAllocation, 4> Allocations;
+};
 
 /*
 D3d9 will hold unto references to resources while they are in use and free them after if there are no other references. 
-To mirror this functionality this class will hold handles until after a frame has been drawn and then free them.
+To mirror this functionality this class will hold handles until after the frames that could have used them have been drawn and then free them.
+Anything retired belongs to the frame being recorded because that is the newest frame that could reference it.
 */
-class GarbageManager
+struct GarbageManager
 {
-	public:
-		GarbageManager();
-		~GarbageManager();
-
-		void DestroyHandles();
-
-		//Handles to destroy with.
-		VkDevice mDevice = VK_NULL_HANDLE;
-		VkDescriptorPool mDescriptorPool = VK_NULL_HANDLE;
+	vk::Device mDevice;
+	vk::DescriptorPool mDescriptorPool;
+	MemoryManager* mMemoryManager = nullptr;
+	uint64_t mFrameNumber = 1; //The frame being recorded.
+	std::deque<RetiredHandles> mRetiredHandles; //Oldest frame first.
 
-		//Handles to destroy	
-		boost::container::small_vector<VkImage,16> mImages;
-		boost::container::small_vector<VkDeviceMemory,16> mMemories;
-		boost::container::small_vector<VkSampler,16> mSamplers;
-		boost::container::small_vector<VkDescriptorSet,16> mDescriptorSets;
+	//Statistics
+	uint32_t mRetiredCount = 0;
+	uint32_t mLastFrameRetiredCount = 0;
 
+	void Initialize(vk::Device device, vk::DescriptorPool descriptorPool, MemoryManager* memoryManager);
+	void Destroy();
+	RetiredHandles& GetRetiredHandles();
+	void Retire(vk::Image image);
+	void Retire(vk::ImageView imageView);
+	void Retire(vk::Buffer buffer);
+	void Retire(vk::Sampler sampler);
+	void Retire(vk::Framebuffer framebuffer);
+	void Retire(vk::RenderPass renderPass);
+	void Retire(vk::Pipeline pipeline);
+	void Retire(vk::PipelineLayout pipelineLayout);
+	void Retire(vk::DescriptorSetLayout descriptorSetLayout);
+	void Retire(vk::DescriptorSet descriptorSet);
+	void Retire(vk::DeviceMemory memory);
+	void Retire(MemoryAllocation& allocation);
+	void DestroyHandles(RetiredHandles& handles);
+	void DestroyHandles(uint64_t frameNumber, uint64_t completedFrameNumber);
 };
 
 #endif // GARBAGEMANAGER_H
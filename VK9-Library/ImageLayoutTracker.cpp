@@ -0,0 +1,296 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <cassert>
+
+#include "ImageLayoutTracker.h"
+
+const vk::AccessFlags WriteAccessFlags = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite | vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eMemoryWrite;
+
+vk::AccessFlags GetLayoutAccess(vk::ImageLayout layout) noexcept
+{
+	switch (layout)
+	{
+	case vk::ImageLayout::eUndefined:
+	case vk::ImageLayout::ePresentSrcKHR:
+		return vk::AccessFlags();
+	case vk::ImageLayout::eColorAttachmentOptimal:
+		return vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+	case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+		return vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+	case vk::ImageLayout::eDepthStencilReadOnlyOptimal:
+		return vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eShaderRead;
+	case vk::ImageLayout::eShaderReadOnlyOptimal:
+		return vk::AccessFlagBits::eShaderRead;
+	case vk::ImageLayout::eTransferSrcOptimal:
+		return vk::AccessFlagBits::eTransferRead;
+	case vk::ImageLayout::eTransferDstOptimal:
+		return vk::AccessFlagBits::eTransferWrite;
+	case vk::ImageLayout::ePreinitialized:
+		return vk::AccessFlagBits::eHostWrite;
+	case vk::ImageLayout::eGeneral:
+	default:
+		return vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+	}
+}
+
+vk::PipelineStageFlags GetLayoutStages(vk::ImageLayout layout) noexcept
+{
+	switch (layout)
+	{
+	case vk::ImageLayout::eUndefined:
+		return vk::PipelineStageFlagBits::eTopOfPipe;
+	case vk::ImageLayout::ePresentSrcKHR:
+		return vk::PipelineStageFlagBits::eBottomOfPipe;
+	case vk::ImageLayout::eColorAttachmentOptimal:
+		return vk::PipelineStageFlagBits::eColorAttachmentOutput;
+	case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+		return vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+	case vk::ImageLayout::eDepthStencilReadOnlyOptimal:
+		return vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eFragmentShader;
+	case vk::ImageLayout::eShaderReadOnlyOptimal:
+		return vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+	case vk::ImageLayout::eTransferSrcOptimal:
+	case vk::ImageLayout::eTransferDstOptimal:
+		return vk::PipelineStageFlagBits::eTransfer;
+	case vk::ImageLayout::ePreinitialized:
+		return vk::PipelineStageFlagBits::eHost;
+	case vk::ImageLayout::eGeneral:
+	default:
+		return vk::PipelineStageFlagBits::eAllCommands;
+	}
+}
+
+void ImageLayoutTracker::Register(vk::Image image, vk::ImageAspectFlags aspectMask, uint32_t levelCount, uint32_t layerCount, vk::ImageLayout layout)
+{
+	auto& state = mImages[(VkImage)image];
+
+	state.AspectMask = aspectMask;
+	state.LevelCount = std::max(levelCount, (uint32_t)1);
+	state.LayerCount = std::max(layerCount, (uint32_t)1);
+
+	SubresourceLayout subresource;
+	subresource.Layout = layout;
+	if (layout == vk::ImageLayout::ePreinitialized)
+	{
+		subresource.Access = vk::AccessFlagBits::eHostWrite;
+		subresource.Stages = vk::PipelineStageFlagBits::eHost;
+	}
+
+	state.Subresources.clear();
+	state.Subresources.resize(state.LevelCount * state.LayerCount, subresource);
+}
+
+void ImageLayoutTracker::Unregister(vk::Image image)
+{
+	mImages.erase((VkImage)image);
+}
+
+vk::ImageLayout ImageLayoutTracker::GetLayout(vk::Image image, uint32_t mipIndex, uint32_t layerIndex)
+{
+	auto it = mImages.find((VkImage)image);
+	if (it == mImages.end())
+	{
+		return vk::ImageLayout::eUndefined;
+	}
+
+	auto& state = it->second;
+	if (mipIndex >= state.LevelCount || layerIndex >= state.LayerCount)
+	{
+		return vk::ImageLayout::eUndefined;
+	}
+
+	return state.Subresources[layerIndex * state.LevelCount + mipIndex].Layout;
+}
+
+bool ImageLayoutTracker::IsInLayout(vk::Image image, vk::ImageLayout layout)
+{
+	auto it = mImages.find((VkImage)image);
+	if (it == mImages.end())
+	{
+		return false;
+	}
+
+	for (auto& subresource : it->second.Subresources)
+	{
+		if (subresource.Layout != layout)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ImageLayoutTracker::IsUsedInFrame(vk::Image image)
+{
+	auto it = mImages.find((VkImage)image);
+	return (it != mImages.end() && it->second.FrameNumber == mFrameNumber);
+}
+
+void ImageLayoutTracker::Transition(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout newLayout, uint32_t levelCount, uint32_t mipIndex, uint32_t layerCount, uint32_t layerIndex, bool discard)
+{
+	auto it = mImages.find((VkImage)image);
+	if (it == mImages.end())
+	{
+		//Images we didn't create (swap chain images) are treated as a single color subresource.
+		Register(image, vk::ImageAspectFlagBits::eColor);
+		it = mImages.find((VkImage)image);
+	}
+	auto& state = it->second;
+
+	//Anything recorded outside of the frame command buffer executes ahead of it so it can't come after a transition the frame already made.
+	if (commandBuffer == mFrameCommandBuffer)
+	{
+		state.FrameNumber = mFrameNumber;
+	}
+	else
+	{
+		assert(state.FrameNumber != mFrameNumber);
+	}
+
+	if (mipIndex >= state.LevelCount || layerIndex >= state.LayerCount)
+	{
+		return;
+	}
+
+	if (levelCount == VK_REMAINING_MIP_LEVELS || mipIndex + levelCount > state.LevelCount)
+	{
+		levelCount = state.LevelCount - mipIndex;
+	}
+
+	if (layerCount == VK_REMAINING_ARRAY_LAYERS || layerIndex + layerCount > state.LayerCount)
+	{
+		layerCount = state.LayerCount - layerIndex;
+	}
+
+	const vk::AccessFlags newAccess = GetLayoutAccess(newLayout);
+	const vk::PipelineStageFlags newStages = GetLayoutStages(newLayout);
+
+	boost::container::small_vector<vk::ImageMemoryBarrier, 16> barriers;
+	vk::PipelineStageFlags sourceStages;
+
+	for (uint32_t layer = layerIndex; layer < layerIndex + layerCount; layer++)
+	{
+		for (uint32_t level = mipIndex; level < mipIndex + levelCount; level++)
+		{
+			auto& subresource = state.Subresources[layer * state.LevelCount + level];
+
+			//Read after read in the same layout doesn't need any synchronization.
+			if (subresource.Layout == newLayout && !(subresource.Access & WriteAccessFlags) && !(newAccess & WriteAccessFlags))
+			{
+				continue;
+			}
+
+			const vk::ImageLayout oldLayout = discard ? vk::ImageLayout::eUndefined : subresource.Layout;
+
+			//Extend the previous barrier if this is the next level of the same layer coming from the same state.
+			bool merged = false;
+			if (!barriers.empty())
+			{
+				auto& last = barriers.back();
+				if (last.oldLayout == oldLayout && last.srcAccessMask == subresource.Access
+					&& last.subresourceRange.baseArrayLayer == layer && last.subresourceRange.layerCount == 1
+					&& last.subresourceRange.baseMipLevel + last.subresourceRange.levelCount == level)
+				{
+					last.subresourceRange.levelCount++;
+					merged = true;
+				}
+			}
+
+			if (!merged)
+			{
+				vk::ImageMemoryBarrier barrier;
+				barrier.srcAccessMask = subresource.Access;
+				barrier.dstAccessMask = newAccess;
+				barrier.oldLayout = oldLayout;
+				barrier.newLayout = newLayout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = image;
+				barrier.subresourceRange.aspectMask = state.AspectMask;
+				barrier.subresourceRange.baseMipLevel = level;
+				barrier.subresourceRange.levelCount = 1;
+				barrier.subresourceRange.baseArrayLayer = layer;
+				barrier.subresourceRange.layerCount = 1;
+				barriers.push_back(barrier);
+			}
+
+			sourceStages |= subresource.Stages;
+
+			subresource.Layout = newLayout;
+			subresource.Access = newAccess;
+			subresource.Stages = newStages;
+		}
+	}
+
+	if (barriers.empty())
+	{
+		return;
+	}
+
+	//Fold barriers covering the same levels of consecutive layers together.
+	size_t count = 1;
+	for (size_t i = 1; i < barriers.size(); i++)
+	{
+		auto& last = barriers[count - 1];
+		auto& current = barriers[i];
+		if (last.oldLayout == current.oldLayout && last.srcAccessMask == current.srcAccessMask
+			&& last.subresourceRange.baseMipLevel == current.subresourceRange.baseMipLevel
+			&& last.subresourceRange.levelCount == current.subresourceRange.levelCount
+			&& last.subresourceRange.baseArrayLayer + last.subresourceRange.layerCount == current.subresourceRange.baseArrayLayer)
+		{
+			last.subresourceRange.layerCount += current.subresourceRange.layerCount;
+		}
+		else
+		{
+			barriers[count++] = current;
+		}
+	}
+	barriers.resize(count);
+
+	for (auto& barrier : barriers)
+	{
+		mBarrierBatch.Add(commandBuffer, sourceStages, newStages, barrier);
+	}
+
+	mBarrierCount += (uint32_t)barriers.size();
+}
+
+void ImageLayoutTracker::Flush(vk::CommandBuffer commandBuffer)
+{
+	mBarrierBatch.Flush(commandBuffer);
+}
+
+void ImageLayoutTracker::BeginFrame(vk::CommandBuffer commandBuffer, uint64_t frameNumber)
+{
+	mFrameCommandBuffer = commandBuffer;
+	mFrameNumber = frameNumber;
+}
+
+void ImageLayoutTracker::EndFrame()
+{
+	BOOST_LOG_TRIVIAL(trace) << "ImageLayoutTracker::EndFrame " << mBarrierCount << " barriers in " << mBarrierBatch.mPipelineBarrierCount << " vkCmdPipelineBarrier calls.";
+
+	mLastFrameBarrierCount = mBarrierCount;
+	mLastFramePipelineBarrierCount = mBarrierBatch.mPipelineBarrierCount;
+	mBarrierCount = 0;
+	mBarrierBatch.mPipelineBarrierCount = 0;
+}
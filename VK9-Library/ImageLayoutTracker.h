@@ -0,0 +1,83 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vk_sdk_platform.h>
+#include <boost/container/small_vector.hpp>
+#include <boost/container/flat_map.hpp>
+#include "BarrierBatch.h"
+
+#ifndef IMAGELAYOUTTRACKER_H
+#define IMAGELAYOUTTRACKER_H
+
+/*
+The layout and last access of a single mip level of a single array layer.
+*/
+struct SubresourceLayout
+{
+	vk::ImageLayout Layout = vk::ImageLayout::eUndefined;
+	vk::AccessFlags Access;
+	vk::PipelineStageFlags Stages = vk::PipelineStageFlagBits::eTopOfPipe;
+};
+
+struct ImageLayoutState
+{
+	vk::ImageAspectFlags AspectMask = vk::ImageAspectFlagBits::eColor;
+	uint32_t LevelCount = 1;
+	uint32_t LayerCount = 1;
+	uint64_t FrameNumber = 0; //The last frame whose command buffer moved the image.
+	boost::container::small_vector<SubresourceLayout, 16> Subresources; //layer * LevelCount + level
+};
+
+/*
+Keeps track of the layout of every image subresource so transitions start from the real layout instead of undefined and only emit a barrier when one is required.
+Transitions are queued on the batch and have to be flushed before the command that uses the image is recorded.
+
+There is one layout per subresource but two streams record transitions, the upload batch and the frame command buffer, and the upload batch executes first.
+The tracked layouts only match what the gpu sees if every image is moved in at most one of them per frame, or in the upload batch before the frame touches it.
+So once the frame command buffer has moved an image everything else that frame has to be recorded into the frame command buffer as well, IsUsedInFrame tells callers which to pick.
+*/
+struct ImageLayoutTracker
+{
+	boost::container::flat_map<VkImage, ImageLayoutState> mImages;
+	BarrierBatch mBarrierBatch;
+	vk::CommandBuffer mFrameCommandBuffer; //The command buffer the current frame is recorded into.
+	uint64_t mFrameNumber = 0;
+
+	//Statistics
+	uint32_t mBarrierCount = 0;
+	uint32_t mLastFrameBarrierCount = 0;
+	uint32_t mLastFramePipelineBarrierCount = 0;
+
+	void Register(vk::Image image, vk::ImageAspectFlags aspectMask, uint32_t levelCount = 1, uint32_t layerCount = 1, vk::ImageLayout layout = vk::ImageLayout::eUndefined);
+	void Unregister(vk::Image image);
+	vk::ImageLayout GetLayout(vk::Image image, uint32_t mipIndex = 0, uint32_t layerIndex = 0);
+	bool IsInLayout(vk::Image image, vk::ImageLayout layout);
+	bool IsUsedInFrame(vk::Image image);
+	void Transition(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout newLayout, uint32_t levelCount = VK_REMAINING_MIP_LEVELS, uint32_t mipIndex = 0, uint32_t layerCount = VK_REMAINING_ARRAY_LAYERS, uint32_t layerIndex = 0, bool discard = false);
+	void Flush(vk::CommandBuffer commandBuffer);
+	void BeginFrame(vk::CommandBuffer commandBuffer, uint64_t frameNumber);
+	void EndFrame();
+};
+
+vk::AccessFlags GetLayoutAccess(vk::ImageLayout layout) noexcept;
+vk::PipelineStageFlags GetLayoutStages(vk::ImageLayout layout) noexcept;
+
+#endif // IMAGELAYOUTTRACKER_H
@@ -0,0 +1,473 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "MemoryManager.h"
+#include "Utilities.h"
+
+bool MemoryBlock::Allocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset, uint32_t& order)
+{
+	vk::DeviceSize rangeSize = MinimumAllocationSize;
+	uint32_t wantedOrder = 0;
+	while (rangeSize < size || rangeSize < alignment)
+	{
+		rangeSize <<= 1;
+		wantedOrder++;
+	}
+
+	if (wantedOrder >= FreeRanges.size())
+	{
+		return false;
+	}
+
+	uint32_t currentOrder = wantedOrder;
+	while (currentOrder < FreeRanges.size() && FreeRanges[currentOrder].empty())
+	{
+		currentOrder++;
+	}
+
+	if (currentOrder == FreeRanges.size())
+	{
+		return false;
+	}
+
+	//Take the lowest offset so allocations stay packed towards the start of the block.
+	offset = (*FreeRanges[currentOrder].begin());
+	FreeRanges[currentOrder].erase(FreeRanges[currentOrder].begin());
+
+	//Split the range down to the wanted size and put the upper halves back on the free lists.
+	while (currentOrder > wantedOrder)
+	{
+		currentOrder--;
+		FreeRanges[currentOrder].insert(offset + (MinimumAllocationSize << currentOrder));
+	}
+
+	order = wantedOrder;
+
+	AllocationCount++;
+	UsedSize += rangeSize;
+	RequestedSize += size;
+
+	return true;
+}
+
+void MemoryBlock::Free(vk::DeviceSize offset, uint32_t order, vk::DeviceSize size)
+{
+	AllocationCount--;
+	UsedSize -= (MinimumAllocationSize << order);
+	RequestedSize -= size;
+
+	//Merge with the buddy for as long as it is also free.
+	while (order + 1 < FreeRanges.size())
+	{
+		vk::DeviceSize buddy = offset ^ (MinimumAllocationSize << order);
+		auto it = FreeRanges[order].find(buddy);
+		if (it == FreeRanges[order].end())
+		{
+			break;
+		}
+
+		FreeRanges[order].erase(it);
+		offset = std::min(offset, buddy);
+		order++;
+	}
+
+	FreeRanges[order].insert(offset);
+}
+
+vk::DeviceSize MemoryBlock::GetLargestFreeRange() const
+{
+	for (size_t order = FreeRanges.size(); order > 0; order--)
+	{
+		if (!FreeRanges[order - 1].empty())
+		{
+			return (MinimumAllocationSize << (order - 1));
+		}
+	}
+
+	return 0;
+}
+
+vk::Result DeviceMemoryBackend::AllocateMemory(vk::DeviceSize size, uint32_t memoryTypeIndex, vk::DeviceMemory& memory)
+{
+	vk::MemoryAllocateInfo memoryAllocateInfo;
+	memoryAllocateInfo.allocationSize = size;
+	memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+	return mDevice.allocateMemory(&memoryAllocateInfo, nullptr, &memory);
+}
+
+vk::Result DeviceMemoryBackend::MapMemory(vk::DeviceMemory memory, void*& data)
+{
+	return mDevice.mapMemory(memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(), &data);
+}
+
+void DeviceMemoryBackend::FreeMemory(vk::DeviceMemory memory)
+{
+	mDevice.freeMemory(memory, nullptr);
+}
+
+vk::Result DeviceMemoryBackend::FlushMappedMemoryRanges(const vk::MappedMemoryRange& mappedMemoryRange)
+{
+	return mDevice.flushMappedMemoryRanges(1, &mappedMemoryRange);
+}
+
+void MemoryManager::Initialize(vk::Device device, const vk::PhysicalDeviceMemoryProperties& physicalDeviceMemoryProperties, vk::DeviceSize nonCoherentAtomSize)
+{
+	mDeviceBackend.mDevice = device;
+	Initialize(&mDeviceBackend, physicalDeviceMemoryProperties, nonCoherentAtomSize);
+}
+
+void MemoryManager::Initialize(MemoryBackend* backend, const vk::PhysicalDeviceMemoryProperties& physicalDeviceMemoryProperties, vk::DeviceSize nonCoherentAtomSize)
+{
+	mBackend = backend;
+	mPhysicalDeviceMemoryProperties = physicalDeviceMemoryProperties;
+	mNonCoherentAtomSize = std::max(nonCoherentAtomSize, (vk::DeviceSize)1);
+
+	//Small heaps (host visible device local windows for example) get smaller blocks so a single block can't eat most of the heap.
+	for (uint32_t i = 0; i < mPhysicalDeviceMemoryProperties.memoryTypeCount; i++)
+	{
+		vk::DeviceSize heapSize = mPhysicalDeviceMemoryProperties.memoryHeaps[mPhysicalDeviceMemoryProperties.memoryTypes[i].heapIndex].size;
+		vk::DeviceSize blockSize = MaximumBlockSize;
+		while (blockSize > MinimumBlockSize && blockSize > heapSize / 8)
+		{
+			blockSize >>= 1;
+		}
+		mBlockSizes[i] = blockSize;
+	}
+}
+
+void MemoryManager::Destroy()
+{
+	if (mBackend == nullptr)
+	{
+		return;
+	}
+
+	LogStatistics();
+
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		for (auto& blocks : mBlocks[i])
+		{
+			for (auto& block : blocks)
+			{
+				if (block->AllocationCount)
+				{
+					BOOST_LOG_TRIVIAL(warning) << "MemoryManager::Destroy block with " << block->AllocationCount << " allocations still in use.";
+				}
+				mBackend->FreeMemory(block->Memory);
+				TrackHeapUsage(block->MemoryTypeIndex, block->Size, true);
+			}
+			blocks.clear();
+		}
+	}
+
+	mBackend = nullptr;
+}
+
+bool MemoryManager::GetMemoryTypeIndex(uint32_t memoryTypeBits, vk::MemoryPropertyFlags requiredFlags, vk::MemoryPropertyFlags preferredFlags, vk::DeviceSize size, uint32_t& memoryTypeIndex)
+{
+	//A preferred heap that is over budget is skipped so the driver doesn't start paging out resources that are in use.
+	if (preferredFlags && GetMemoryTypeFromProperties(mPhysicalDeviceMemoryProperties, memoryTypeBits, requiredFlags | preferredFlags, &memoryTypeIndex) && !IsOverBudget(memoryTypeIndex, size))
+	{
+		return true;
+	}
+
+	return GetMemoryTypeFromProperties(mPhysicalDeviceMemoryProperties, memoryTypeBits, requiredFlags, &memoryTypeIndex);
+}
+
+vk::Result MemoryManager::Allocate(const vk::MemoryRequirements& memoryRequirements, vk::MemoryPropertyFlags requiredFlags, bool isLinear, MemoryAllocation& allocation, bool isDedicated, vk::MemoryPropertyFlags preferredFlags)
+{
+	allocation = MemoryAllocation();
+
+	uint32_t memoryTypeIndex = 0;
+	if (!GetMemoryTypeIndex(memoryRequirements.memoryTypeBits, requiredFlags, preferredFlags, memoryRequirements.size, memoryTypeIndex))
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "MemoryManager::Allocate Could not find memory type from properties.";
+		return vk::Result::eErrorOutOfDeviceMemory;
+	}
+
+	vk::Result result;
+	const vk::DeviceSize blockSize = mBlockSizes[memoryTypeIndex];
+	if (isDedicated || memoryRequirements.size > blockSize / 2 || memoryRequirements.alignment > blockSize)
+	{
+		result = AllocateDedicated(memoryRequirements.size, memoryTypeIndex, allocation);
+		if (result != vk::Result::eSuccess && preferredFlags)
+		{
+			//The preferred heap is full so settle for any heap that has the required properties.
+			return Allocate(memoryRequirements, requiredFlags, isLinear, allocation, isDedicated);
+		}
+		return result;
+	}
+
+	vk::DeviceSize offset = 0;
+	uint32_t order = 0;
+	MemoryBlock* block = nullptr;
+
+	for (auto& candidate : mBlocks[memoryTypeIndex][isLinear ? 1 : 0])
+	{
+		if (candidate->Allocate(memoryRequirements.size, memoryRequirements.alignment, offset, order))
+		{
+			block = candidate.get();
+			break;
+		}
+	}
+
+	if (block == nullptr)
+	{
+		block = CreateBlock(memoryTypeIndex, isLinear);
+		if (block == nullptr || !block->Allocate(memoryRequirements.size, memoryRequirements.alignment, offset, order))
+		{
+			//There may still be room for the resource by itself even if there isn't room for a whole block.
+			result = AllocateDedicated(memoryRequirements.size, memoryTypeIndex, allocation);
+			if (result != vk::Result::eSuccess && preferredFlags)
+			{
+				return Allocate(memoryRequirements, requiredFlags, isLinear, allocation, isDedicated);
+			}
+			return result;
+		}
+	}
+
+	allocation.Memory = block->Memory;
+	allocation.Offset = offset;
+	allocation.Size = memoryRequirements.size;
+	allocation.Data = (block->Data != nullptr) ? ((char*)block->Data + offset) : nullptr;
+	allocation.MemoryTypeIndex = memoryTypeIndex;
+	allocation.Block = block;
+	allocation.Order = order;
+
+	return vk::Result::eSuccess;
+}
+
+vk::Result MemoryManager::AllocateDedicated(vk::DeviceSize size, uint32_t memoryTypeIndex, MemoryAllocation& allocation)
+{
+	vk::Result result = mBackend->AllocateMemory(size, memoryTypeIndex, allocation.Memory);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "MemoryManager::AllocateDedicated vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		return result;
+	}
+
+	if (mPhysicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+	{
+		result = mBackend->MapMemory(allocation.Memory, allocation.Data);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "MemoryManager::AllocateDedicated vkMapMemory failed with return code of " << GetResultString((VkResult)result);
+			allocation.Data = nullptr;
+		}
+	}
+
+	allocation.Offset = 0;
+	allocation.Size = size;
+	allocation.MemoryTypeIndex = memoryTypeIndex;
+	allocation.Block = nullptr;
+
+	mDedicatedAllocationCount++;
+	mDedicatedSize += size;
+	TrackHeapUsage(memoryTypeIndex, size, false);
+
+	return vk::Result::eSuccess;
+}
+
+MemoryBlock* MemoryManager::CreateBlock(uint32_t memoryTypeIndex, bool isLinear)
+{
+	std::unique_ptr<MemoryBlock> block = std::make_unique<MemoryBlock>();
+	block->Size = mBlockSizes[memoryTypeIndex];
+	block->MemoryTypeIndex = memoryTypeIndex;
+
+	vk::Result result = mBackend->AllocateMemory(block->Size, memoryTypeIndex, block->Memory);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "MemoryManager::CreateBlock vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		return nullptr;
+	}
+
+	if (mPhysicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+	{
+		result = mBackend->MapMemory(block->Memory, block->Data);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "MemoryManager::CreateBlock vkMapMemory failed with return code of " << GetResultString((VkResult)result);
+			mBackend->FreeMemory(block->Memory);
+			return nullptr;
+		}
+	}
+
+	//The whole block starts out as a single free range of the highest order.
+	uint32_t orderCount = 1;
+	while ((MinimumAllocationSize << (orderCount - 1)) < block->Size)
+	{
+		orderCount++;
+	}
+	block->FreeRanges.resize(orderCount);
+	block->FreeRanges[orderCount - 1].insert(0);
+
+	TrackHeapUsage(memoryTypeIndex, block->Size, false);
+
+	auto& blocks = mBlocks[memoryTypeIndex][isLinear ? 1 : 0];
+	blocks.push_back(std::move(block));
+
+	BOOST_LOG_TRIVIAL(info) << "MemoryManager::CreateBlock type " << memoryTypeIndex << " size " << blocks.back()->Size << " (" << blocks.size() << " blocks of this kind)";
+
+	return blocks.back().get();
+}
+
+void MemoryManager::Free(MemoryAllocation& allocation)
+{
+	if (mBackend == nullptr || allocation.Memory == vk::DeviceMemory())
+	{
+		allocation = MemoryAllocation();
+		return;
+	}
+
+	if (allocation.Block == nullptr)
+	{
+		mBackend->FreeMemory(allocation.Memory); //Freeing implicitly unmaps.
+		mDedicatedAllocationCount--;
+		mDedicatedSize -= allocation.Size;
+		TrackHeapUsage(allocation.MemoryTypeIndex, allocation.Size, true);
+		allocation = MemoryAllocation();
+		return;
+	}
+
+	MemoryBlock* block = allocation.Block;
+	block->Free(allocation.Offset, allocation.Order, allocation.Size);
+
+	/*
+	Keep one empty block around per kind so a resource being recreated every frame doesn't allocate and free a block every frame.
+	*/
+	if (block->AllocationCount == 0)
+	{
+		for (auto& blocks : mBlocks[block->MemoryTypeIndex])
+		{
+			auto it = std::find_if(blocks.begin(), blocks.end(), [block](const std::unique_ptr<MemoryBlock>& candidate) { return candidate.get() == block; });
+			if (it == blocks.end())
+			{
+				continue;
+			}
+
+			size_t emptyBlockCount = std::count_if(blocks.begin(), blocks.end(), [](const std::unique_ptr<MemoryBlock>& candidate) { return candidate->AllocationCount == 0; });
+			if (emptyBlockCount > 1)
+			{
+				mBackend->FreeMemory(block->Memory);
+				TrackHeapUsage(block->MemoryTypeIndex, block->Size, true);
+				blocks.erase(it);
+			}
+			break;
+		}
+	}
+
+	allocation = MemoryAllocation();
+}
+
+void MemoryManager::Flush(const MemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size)
+{
+	/*
+	Host writes to coherent memory are visible to the device without any help so only the other memory types need a flush.
+	The range has to be widened to nonCoherentAtomSize which is safe because the whole block stays mapped.
+	*/
+	vk::Result result;
+
+	if (mBackend == nullptr || allocation.Data == nullptr || offset >= allocation.Size
+		|| (mPhysicalDeviceMemoryProperties.memoryTypes[allocation.MemoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent))
+	{
+		return;
+	}
+
+	if (size == VK_WHOLE_SIZE || offset + size > allocation.Size)
+	{
+		size = allocation.Size - offset;
+	}
+
+	const vk::DeviceSize memorySize = (allocation.Block != nullptr) ? allocation.Block->Size : allocation.Size;
+	const vk::DeviceSize start = allocation.Offset + offset;
+	const vk::DeviceSize end = ((start + size + mNonCoherentAtomSize - 1) / mNonCoherentAtomSize) * mNonCoherentAtomSize;
+
+	vk::MappedMemoryRange mappedMemoryRange;
+	mappedMemoryRange.memory = allocation.Memory;
+	mappedMemoryRange.offset = (start / mNonCoherentAtomSize) * mNonCoherentAtomSize;
+	mappedMemoryRange.size = (end >= memorySize) ? VK_WHOLE_SIZE : end - mappedMemoryRange.offset;
+
+	result = mBackend->FlushMappedMemoryRanges(mappedMemoryRange);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "MemoryManager::Flush vkFlushMappedMemoryRanges failed with return code of " << GetResultString((VkResult)result);
+	}
+}
+
+bool MemoryManager::IsOverBudget(uint32_t memoryTypeIndex, vk::DeviceSize size) const
+{
+	const uint32_t heapIndex = mPhysicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	return mHeapBudgets[heapIndex] != 0 && mHeapUsage[heapIndex] + size > mHeapBudgets[heapIndex];
+}
+
+void MemoryManager::TrackHeapUsage(uint32_t memoryTypeIndex, vk::DeviceSize size, bool isFreed)
+{
+	auto& heapUsage = mHeapUsage[mPhysicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+	if (isFreed)
+	{
+		heapUsage -= std::min(heapUsage, size);
+	}
+	else
+	{
+		heapUsage += size;
+	}
+}
+
+MemoryStatistics MemoryManager::GetStatistics() const
+{
+	MemoryStatistics statistics;
+
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		for (auto& blocks : mBlocks[i])
+		{
+			for (auto& block : blocks)
+			{
+				statistics.BlockCount++;
+				statistics.AllocationCount += block->AllocationCount;
+				statistics.BlockSize += block->Size;
+				statistics.UsedSize += block->UsedSize;
+				statistics.RequestedSize += block->RequestedSize;
+				statistics.LargestFreeRange = std::max(statistics.LargestFreeRange, block->GetLargestFreeRange());
+			}
+		}
+	}
+
+	statistics.DedicatedAllocationCount = mDedicatedAllocationCount;
+	statistics.DedicatedSize = mDedicatedSize;
+
+	return statistics;
+}
+
+void MemoryManager::LogStatistics() const
+{
+	MemoryStatistics statistics = GetStatistics();
+
+	//Internal waste is lost to rounding up to a power of two, external fragmentation is free space that isn't in the largest free range.
+	vk::DeviceSize freeSize = statistics.BlockSize - statistics.UsedSize;
+	double internalWaste = statistics.UsedSize ? 1.0 - ((double)statistics.RequestedSize / (double)statistics.UsedSize) : 0.0;
+	double externalFragmentation = freeSize ? 1.0 - ((double)statistics.LargestFreeRange / (double)freeSize) : 0.0;
+
+	BOOST_LOG_TRIVIAL(info) << "MemoryManager::LogStatistics " << statistics.BlockCount << " blocks (" << statistics.BlockSize << " bytes) holding " << statistics.AllocationCount << " allocations";
+	BOOST_LOG_TRIVIAL(info) << "MemoryManager::LogStatistics used " << statistics.UsedSize << " bytes, requested " << statistics.RequestedSize << " bytes, internal waste " << internalWaste << ", external fragmentation " << externalFragmentation;
+	BOOST_LOG_TRIVIAL(info) << "MemoryManager::LogStatistics " << statistics.DedicatedAllocationCount << " dedicated allocations (" << statistics.DedicatedSize << " bytes)";
+}
@@ -0,0 +1,144 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vk_sdk_platform.h>
+#include <boost/container/small_vector.hpp>
+#include <boost/container/flat_set.hpp>
+
+#ifndef MEMORYMANAGER_H
+#define MEMORYMANAGER_H
+
+const vk::DeviceSize MinimumAllocationSize = 256;
+const vk::DeviceSize MinimumBlockSize = 1024 * 1024;
+const vk::DeviceSize MaximumBlockSize = 64 * 1024 * 1024;
+
+/*
+Where the memory manager gets its vk::DeviceMemory from.
+The device backend passes each call to the driver, tests put a mock in its place so the sub-allocator can be exercised without a GPU.
+*/
+struct MemoryBackend
+{
+	virtual ~MemoryBackend() {}
+	virtual vk::Result AllocateMemory(vk::DeviceSize size, uint32_t memoryTypeIndex, vk::DeviceMemory& memory) = 0;
+	virtual vk::Result MapMemory(vk::DeviceMemory memory, void*& data) = 0; //Maps the whole memory.
+	virtual void FreeMemory(vk::DeviceMemory memory) = 0; //Freeing implicitly unmaps.
+	virtual vk::Result FlushMappedMemoryRanges(const vk::MappedMemoryRange& mappedMemoryRange) = 0;
+};
+
+struct DeviceMemoryBackend : MemoryBackend
+{
+	vk::Device mDevice;
+
+	vk::Result AllocateMemory(vk::DeviceSize size, uint32_t memoryTypeIndex, vk::DeviceMemory& memory) override;
+	vk::Result MapMemory(vk::DeviceMemory memory, void*& data) override;
+	void FreeMemory(vk::DeviceMemory memory) override;
+	vk::Result FlushMappedMemoryRanges(const vk::MappedMemoryRange& mappedMemoryRange) override;
+};
+
+/*
+A large vk::DeviceMemory that is split up with a buddy allocator.
+Every range is a power of two in size and its offset is a multiple of its size so any alignment up to the range size is satisfied.
+*/
+struct MemoryBlock
+{
+	vk::DeviceMemory Memory;
+	vk::DeviceSize Size = 0;
+	void* Data = nullptr; //Host visible blocks stay mapped for their whole life.
+	uint32_t MemoryTypeIndex = 0;
+
+	boost::container::small_vector<boost::container::flat_set<vk::DeviceSize>, 20> FreeRanges; //Free offsets by order, a range of order n is MinimumAllocationSize << n bytes.
+
+	//Statistics
+	uint32_t AllocationCount = 0;
+	vk::DeviceSize UsedSize = 0;
+	vk::DeviceSize RequestedSize = 0;
+
+	bool Allocate(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset, uint32_t& order);
+	void Free(vk::DeviceSize offset, uint32_t order, vk::DeviceSize size);
+	vk::DeviceSize GetLargestFreeRange() const;
+};
+
+/*
+A range handed out by the memory manager. Resources bind to Memory at Offset and use Data if the memory is host visible.
+*/
+struct MemoryAllocation
+{
+	vk::DeviceMemory Memory;
+	vk::DeviceSize Offset = 0;
+	vk::DeviceSize Size = 0;
+	void* Data = nullptr;
+	uint32_t MemoryTypeIndex = 0;
+	MemoryBlock* Block = nullptr; //null for dedicated allocations.
+	uint32_t Order = 0;
+};
+
+struct MemoryStatistics
+{
+	uint32_t BlockCount = 0;
+	uint32_t AllocationCount = 0;
+	uint32_t DedicatedAllocationCount = 0;
+	vk::DeviceSize BlockSize = 0;
+	vk::DeviceSize UsedSize = 0;
+	vk::DeviceSize RequestedSize = 0;
+	vk::DeviceSize DedicatedSize = 0;
+	vk::DeviceSize LargestFreeRange = 0;
+};
+
+/*
+Sub-allocates device memory out of per memory type blocks so thousands of small resources only cost a handful of vkAllocateMemory calls.
+Buffers and linear images are kept in different blocks from optimal images so bufferImageGranularity never has to be considered.
+Large resources and render targets get their own allocation.
+What is allocated from each heap is counted so resources that prefer a heap that is over budget go to another one that will do.
+*/
+struct MemoryManager
+{
+	DeviceMemoryBackend mDeviceBackend;
+	MemoryBackend* mBackend = nullptr; //null until initialized and after destroy.
+	vk::PhysicalDeviceMemoryProperties mPhysicalDeviceMemoryProperties;
+	vk::DeviceSize mNonCoherentAtomSize = 1;
+	vk::DeviceSize mBlockSizes[VK_MAX_MEMORY_TYPES] = {};
+	std::vector<std::unique_ptr<MemoryBlock>> mBlocks[VK_MAX_MEMORY_TYPES][2]; //[type][linear]
+
+	vk::DeviceSize mHeapUsage[VK_MAX_MEMORY_HEAPS] = {}; //Bytes allocated from each heap, blocks count in full.
+	vk::DeviceSize mHeapBudgets[VK_MAX_MEMORY_HEAPS] = {}; //Zero until the device sets a budget.
+
+	//Statistics
+	uint32_t mDedicatedAllocationCount = 0;
+	vk::DeviceSize mDedicatedSize = 0;
+
+	void Initialize(vk::Device device, const vk::PhysicalDeviceMemoryProperties& physicalDeviceMemoryProperties, vk::DeviceSize nonCoherentAtomSize);
+	void Initialize(MemoryBackend* backend, const vk::PhysicalDeviceMemoryProperties& physicalDeviceMemoryProperties, vk::DeviceSize nonCoherentAtomSize);
+	void Destroy();
+	vk::Result Allocate(const vk::MemoryRequirements& memoryRequirements, vk::MemoryPropertyFlags requiredFlags, bool isLinear, MemoryAllocation& allocation, bool isDedicated = false, vk::MemoryPropertyFlags preferredFlags = vk::MemoryPropertyFlags());
+	void Free(MemoryAllocation& allocation);
+	void Flush(const MemoryAllocation& allocation, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+	bool GetMemoryTypeIndex(uint32_t memoryTypeBits, vk::MemoryPropertyFlags requiredFlags, vk::MemoryPropertyFlags preferredFlags, vk::DeviceSize size, uint32_t& memoryTypeIndex);
+	bool IsOverBudget(uint32_t memoryTypeIndex, vk::DeviceSize size) const;
+	void TrackHeapUsage(uint32_t memoryTypeIndex, vk::DeviceSize size, bool isFreed);
+	MemoryStatistics GetStatistics() const;
+	void LogStatistics() const;
+	vk::Result AllocateDedicated(vk::DeviceSize size, uint32_t memoryTypeIndex, MemoryAllocation& allocation);
+	MemoryBlock* CreateBlock(uint32_t memoryTypeIndex, bool isLinear);
+};
+
+#endif // MEMORYMANAGER_H
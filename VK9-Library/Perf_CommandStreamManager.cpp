@@ -111,9 +111,6 @@ size_t CommandStreamManager::RequestWork(WorkItem* workItem)
 		workItem->Caller->AddRef();
 	}
 
-	while (!mWorkItems.push(workItem)) {}
-	//while (!mWorkItems.try_enqueue(workItem)) {}
-
 	size_t key = 0;
 
 	//fetching key should be atomic because it's an atomic size_t.
@@ -156,6 +153,12 @@ size_t CommandStreamManager::RequestWork(WorkItem* workItem)
 		break;
 	}
 
+	//The key has to be in the item before the worker can see it because creates don't wait.
+	workItem->Key = key;
+
+	while (!mWorkItems.push(workItem)) {}
+	//while (!mWorkItems.try_enqueue(workItem)) {}
+
 	return key;
 }
 
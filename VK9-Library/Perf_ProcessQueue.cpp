@@ -95,7 +95,7 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 			break;
 			case Texture_Create:
 			{
-				commandStreamManager->mRenderManager.mStateManager.CreateTexture(workItem->Id, workItem->Argument1);
+				commandStreamManager->mRenderManager.mStateManager.CreateTexture(workItem->Id, workItem->Key, workItem->Argument1);
 			}
 			break;
 			case Texture_Destroy:
@@ -105,7 +105,7 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 			break;
 			case CubeTexture_Create:
 			{
-				commandStreamManager->mRenderManager.mStateManager.CreateCubeTexture(workItem->Id, workItem->Argument1);
+				commandStreamManager->mRenderManager.mStateManager.CreateCubeTexture(workItem->Id, workItem->Key, workItem->Argument1);
 			}
 			break;
 			case CubeTexture_Destroy:
@@ -115,7 +115,7 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 			break;
 			case VolumeTexture_Create:
 			{
-				commandStreamManager->mRenderManager.mStateManager.CreateVolumeTexture(workItem->Id, workItem->Argument1);
+				commandStreamManager->mRenderManager.mStateManager.CreateVolumeTexture(workItem->Id, workItem->Key, workItem->Argument1);
 			}
 			break;
 			case VolumeTexture_Destroy:
@@ -125,7 +125,7 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 			break;
 			case Surface_Create:
 			{
-				commandStreamManager->mRenderManager.mStateManager.CreateSurface(workItem->Id, workItem->Argument1);
+				commandStreamManager->mRenderManager.mStateManager.CreateSurface(workItem->Id, workItem->Key, workItem->Argument1);
 			}
 			break;
 			case Surface_Destroy:
@@ -135,7 +135,7 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 			break;
 			case Volume_Create:
 			{
-				commandStreamManager->mRenderManager.mStateManager.CreateVolume(workItem->Id, workItem->Argument1);
+				commandStreamManager->mRenderManager.mStateManager.CreateVolume(workItem->Id, workItem->Key, workItem->Argument1);
 			}
 			break;
 			case Volume_Destroy:
@@ -185,14 +185,15 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 
 					colorSurface = stateManager.mSurfaces[pRenderTarget->mId].get();
 
-					if (pRenderTarget->mTexture != nullptr)
+					//Texture levels and cube faces are attached through the surface's own view of its level and face.
+					if (pRenderTarget->mTexture != nullptr || pRenderTarget->mCubeTexture != nullptr)
 					{
-						colorTexture = stateManager.mTextures[pRenderTarget->mTexture->mId].get();
+						colorTexture = stateManager.mTextures[pRenderTarget->mTextureId].get();
 
 						if (realDevice->mCurrentStateRecording != nullptr)
 						{
 							depthSurface = realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget->mDepthSurface;
-							realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice->mDevice, colorTexture, colorSurface, depthSurface);
+							realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice.get(), colorTexture, colorSurface, depthSurface);
 						}
 						else
 						{			
@@ -202,14 +203,10 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 							}
 
 							depthSurface = realDevice->mDeviceState.mRenderTarget->mDepthSurface;
-							realDevice->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice->mDevice, colorTexture, colorSurface, depthSurface);
+							realDevice->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice.get(), colorTexture, colorSurface, depthSurface);
 							realDevice->mRenderTargets.push_back(realDevice->mDeviceState.mRenderTarget);
 						}
 					}
-					else if (pRenderTarget->mCubeTexture != nullptr)
-					{
-						BOOST_LOG_TRIVIAL(fatal) << "Cube texture not supported for render target!";
-					}
 					else
 					{
 						if (realDevice->mCurrentStateRecording != nullptr)
@@ -218,7 +215,7 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 							{
 								depthSurface = realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget->mDepthSurface;
 							}
-							realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice->mDevice, colorSurface, depthSurface);
+							realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice.get(), colorSurface, depthSurface);
 						}
 						else
 						{
@@ -230,7 +227,7 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 								}
 								depthSurface = realDevice->mDeviceState.mRenderTarget->mDepthSurface;
 							}
-							realDevice->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice->mDevice, colorSurface, depthSurface);
+							realDevice->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice.get(), colorSurface, depthSurface);
 							realDevice->mRenderTargets.push_back(realDevice->mDeviceState.mRenderTarget);
 						}
 					}
@@ -269,11 +266,11 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 
 					if (colorTexture != nullptr)
 					{
-						realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice->mDevice, colorTexture, colorSurface, depthSurface);
+						realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice.get(), colorTexture, colorSurface, depthSurface);
 					}
 					else
 					{
-						realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice->mDevice, colorSurface, depthSurface);
+						realDevice->mCurrentStateRecording->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice.get(), colorSurface, depthSurface);
 					}		
 				}
 				else
@@ -291,16 +288,25 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 
 					if (colorTexture != nullptr)
 					{
-						realDevice->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice->mDevice, colorTexture, colorSurface, depthSurface);
+						realDevice->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice.get(), colorTexture, colorSurface, depthSurface);
 					}
 					else
 					{
-						realDevice->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice->mDevice, colorSurface, depthSurface);
+						realDevice->mDeviceState.mRenderTarget = std::make_shared<RealRenderTarget>(realDevice.get(), colorSurface, depthSurface);
 					}	
 					realDevice->mRenderTargets.push_back(realDevice->mDeviceState.mRenderTarget);
 				}
 			}
 			break;
+			case Device_SetTexturePalette:
+			{
+				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
+				std::shared_ptr<const TexturePalette>* palette = bit_cast<std::shared_ptr<const TexturePalette>*>(workItem->Argument1);
+
+				realDevice->mTexturePalette = (*palette);
+				delete palette;
+			}
+			break;
 			case Device_Clear:
 			{
 				DWORD Count = bit_cast<DWORD>(workItem->Argument1);
@@ -340,6 +346,7 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 
 				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
 				commandStreamManager->mRenderManager.Present(realDevice, pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+				device9->mAvailableTextureMemory = realDevice->GetAvailableTextureMemory();
 			}
 			break;
 			case Device_BeginStateBlock:
@@ -373,6 +380,48 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 				commandStreamManager->mRenderManager.DrawPrimitive(realDevice, PrimitiveType, StartVertex, PrimitiveCount);
 			}
 			break;
+			case Device_DrawIndexedPrimitiveUP:
+			{
+				D3DPRIMITIVETYPE PrimitiveType = bit_cast<D3DPRIMITIVETYPE>(workItem->Argument1);
+				UINT PrimitiveCount = bit_cast<UINT>(workItem->Argument2);
+				size_t uploadBufferIndex = bit_cast<size_t>(workItem->Argument3);
+				UINT vertexOffset = bit_cast<UINT>(workItem->Argument4);
+				UINT vertexStride = bit_cast<UINT>(workItem->Argument5);
+				UINT indexOffset = bit_cast<UINT>(workItem->Argument6);
+				D3DFORMAT indexDataFormat = bit_cast<D3DFORMAT>(workItem->Argument7);
+
+				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
+				commandStreamManager->mRenderManager.DrawIndexedPrimitiveUP(realDevice, PrimitiveType, PrimitiveCount, uploadBufferIndex, vertexOffset, vertexStride, indexOffset, indexDataFormat);
+			}
+			break;
+			case Device_DrawPrimitiveUP:
+			{
+				D3DPRIMITIVETYPE PrimitiveType = bit_cast<D3DPRIMITIVETYPE>(workItem->Argument1);
+				UINT PrimitiveCount = bit_cast<UINT>(workItem->Argument2);
+				size_t uploadBufferIndex = bit_cast<size_t>(workItem->Argument3);
+				UINT vertexOffset = bit_cast<UINT>(workItem->Argument4);
+				UINT vertexStride = bit_cast<UINT>(workItem->Argument5);
+
+				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
+				commandStreamManager->mRenderManager.DrawPrimitiveUP(realDevice, PrimitiveType, PrimitiveCount, uploadBufferIndex, vertexOffset, vertexStride);
+			}
+			break;
+			case Device_CreateUploadBuffer:
+			{
+				UINT size = bit_cast<UINT>(workItem->Argument1);
+				char** ppData = bit_cast<char**>(workItem->Argument2);
+				size_t* pIndex = bit_cast<size_t*>(workItem->Argument3);
+
+				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
+
+				BufferSlot uploadBuffer;
+				realDevice->CreateBuffer(size, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, uploadBuffer.Buffer, uploadBuffer.Allocation);
+
+				(*ppData) = (char*)uploadBuffer.Allocation.Data;
+				(*pIndex) = realDevice->mUploadBuffers.size();
+				realDevice->mUploadBuffers.push_back(uploadBuffer);
+			}
+			break;
 			case Device_EndStateBlock:
 			{
 				IDirect3DStateBlock9** ppSB = bit_cast<IDirect3DStateBlock9**>(workItem->Argument1);
@@ -3104,6 +3153,17 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 				}
 			}
 			break;
+			case Device_UpdateSurface:
+			{
+				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
+				CSurface9* pSourceSurface = bit_cast<CSurface9*>(workItem->Argument1);
+				CSurface9* pDestinationSurface = bit_cast<CSurface9*>(workItem->Argument2);
+				RECT sourceRect = { bit_cast<LONG>(workItem->Argument3), bit_cast<LONG>(workItem->Argument4), bit_cast<LONG>(workItem->Argument5), bit_cast<LONG>(workItem->Argument6) };
+				DWORD destinationPoint = bit_cast<DWORD>(workItem->Argument7);
+
+				commandStreamManager->mRenderManager.UpdateSurface(realDevice, pSourceSurface, sourceRect, pDestinationSurface, LOWORD(destinationPoint), HIWORD(destinationPoint));
+			}
+			break;
 			case Device_UpdateTexture:
 			{
 				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
@@ -3113,12 +3173,48 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 				commandStreamManager->mRenderManager.UpdateTexture(realDevice, pSourceTexture, pDestinationTexture);
 			}
 			break;
-			case Device_GetAvailableTextureMem:
+			case Device_StretchRect:
 			{
 				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
-				CDevice9* device9 = (CDevice9*)workItem->Caller;
-				//                                                                                            Bytes     KB      MB
-				device9->mAvailableTextureMemory = (((realDevice->mEstimatedMemory - realDevice->mEstimatedMemoryUsed) / 1024) / 1024);
+				CSurface9* pSourceSurface = bit_cast<CSurface9*>(workItem->Argument1);
+				CSurface9* pDestSurface = bit_cast<CSurface9*>(workItem->Argument2);
+				DWORD sourceTopLeft = bit_cast<DWORD>(workItem->Argument3);
+				DWORD sourceBottomRight = bit_cast<DWORD>(workItem->Argument4);
+				DWORD destTopLeft = bit_cast<DWORD>(workItem->Argument5);
+				DWORD destBottomRight = bit_cast<DWORD>(workItem->Argument6);
+				D3DTEXTUREFILTERTYPE Filter = bit_cast<D3DTEXTUREFILTERTYPE>(workItem->Argument7);
+
+				RECT sourceRect = { LOWORD(sourceTopLeft), HIWORD(sourceTopLeft), LOWORD(sourceBottomRight), HIWORD(sourceBottomRight) };
+				RECT destRect = { LOWORD(destTopLeft), HIWORD(destTopLeft), LOWORD(destBottomRight), HIWORD(destBottomRight) };
+
+				commandStreamManager->mRenderManager.StretchRect(realDevice, pSourceSurface, sourceRect, pDestSurface, destRect, Filter);
+			}
+			break;
+			case Device_ColorFill:
+			{
+				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
+				CSurface9* pSurface = bit_cast<CSurface9*>(workItem->Argument1);
+				RECT rect = { bit_cast<LONG>(workItem->Argument2), bit_cast<LONG>(workItem->Argument3), bit_cast<LONG>(workItem->Argument4), bit_cast<LONG>(workItem->Argument5) };
+				D3DCOLOR color = bit_cast<D3DCOLOR>(workItem->Argument6);
+
+				commandStreamManager->mRenderManager.ColorFill(realDevice, pSurface, rect, color);
+			}
+			break;
+			case Device_GetRenderTargetData:
+			{
+				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
+				CSurface9* pRenderTarget = bit_cast<CSurface9*>(workItem->Argument1);
+				CSurface9* pDestSurface = bit_cast<CSurface9*>(workItem->Argument2);
+
+				commandStreamManager->mRenderManager.GetRenderTargetData(realDevice, pRenderTarget, pDestSurface);
+			}
+			break;
+			case Device_EvictManagedResources:
+			{
+				auto& realDevice = commandStreamManager->mRenderManager.mStateManager.mDevices[workItem->Id];
+
+				//Everything the frame being recorded doesn't sample goes, the staging buffers keep the contents.
+				realDevice->mResidencyManager.Evict(VK_WHOLE_SIZE, realDevice->mFrameNumber);
 			}
 			break;
 			case Instance_GetAdapterIdentifier:
@@ -3261,32 +3357,59 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 				VOID** ppbData = bit_cast<VOID**>(workItem->Argument3);
 				DWORD Flags = bit_cast<DWORD>(workItem->Argument4);
 
-				if (realVertexBuffer.mData == nullptr)
+				if (realVertexBuffer.mIsDynamic && (Flags & D3DLOCK_READONLY) != D3DLOCK_READONLY)
 				{
-					realVertexBuffer.mData = realVertexBuffer.mRealDevice->mDevice.mapMemory(realVertexBuffer.mMemory, 0, realVertexBuffer.mMemoryRequirements.size, vk::MemoryMapFlags()).value;
-					if (realVertexBuffer.mData == nullptr)
+					/*
+					Discard hands out a copy the gpu isn't reading and no overwrite promises not to touch anything in use so neither has to wait.
+					Any other lock waits for the last submitted frame that used the buffer. If the frame being recorded uses it the buffer is copied instead because draws that are already recorded have to see the old contents.
+					*/
+					if ((Flags & D3DLOCK_DISCARD) == D3DLOCK_DISCARD)
 					{
-						*ppbData = nullptr;
+						realVertexBuffer.mRealDevice->RenameBuffer(realVertexBuffer.mBuffer, realVertexBuffer.mAllocation, realVertexBuffer.mLastUsedFrame, realVertexBuffer.mRetiredSlots, realVertexBuffer.mLength, vk::BufferUsageFlagBits::eVertexBuffer, false);
 					}
-					else
+					else if ((Flags & D3DLOCK_NOOVERWRITE) != D3DLOCK_NOOVERWRITE)
 					{
-						*ppbData = (char *)realVertexBuffer.mData + OffsetToLock;
+						if (realVertexBuffer.mLastUsedFrame == realVertexBuffer.mRealDevice->mFrameNumber)
+						{
+							realVertexBuffer.mRealDevice->RenameBuffer(realVertexBuffer.mBuffer, realVertexBuffer.mAllocation, realVertexBuffer.mLastUsedFrame, realVertexBuffer.mRetiredSlots, realVertexBuffer.mLength, vk::BufferUsageFlagBits::eVertexBuffer, true);
+						}
+						else
+						{
+							realVertexBuffer.mRealDevice->WaitForFrame(realVertexBuffer.mLastUsedFrame);
+						}
 					}
 				}
-				else
+
+				//Static buffers are written through the staging buffer and copied into video memory on unlock. The staging buffer can't be written again until the batch copying out of it is finished.
+				if (!realVertexBuffer.mIsDynamic && (Flags & D3DLOCK_READONLY) != D3DLOCK_READONLY)
+				{
+					realVertexBuffer.mRealDevice->mTransferManager.WaitForBatch(realVertexBuffer.mUploadBatch);
+				}
+
+				char* data = (char*)(realVertexBuffer.mIsDynamic ? realVertexBuffer.mAllocation.Data : realVertexBuffer.mStagingAllocation.Data); //Host visible memory stays mapped.
+				if (data == nullptr)
 				{
-					*ppbData = (char *)realVertexBuffer.mData + OffsetToLock;
+					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue the vertex buffer memory isn't host visible.";
+					*ppbData = nullptr;
+					break;
 				}
+
+				*ppbData = data + OffsetToLock;
 			}
 			break;
 			case VertexBuffer_Unlock:
 			{
 				auto& realVertexBuffer = (*commandStreamManager->mRenderManager.mStateManager.mVertexBuffers[workItem->Id]);
+				UINT dirtyOffset = bit_cast<UINT>(workItem->Argument1);
+				UINT dirtySize = bit_cast<UINT>(workItem->Argument2);
 
-				if (realVertexBuffer.mData != nullptr)
+				//Only static buffers that were written get here, dynamic buffers are written in place. Only the bytes written since the last unlock are flushed and copied.
+				if (!realVertexBuffer.mIsDynamic && dirtyOffset < realVertexBuffer.mLength)
 				{
-					realVertexBuffer.mRealDevice->mDevice.unmapMemory(realVertexBuffer.mMemory);
-					realVertexBuffer.mData = nullptr;
+					dirtySize = std::min(dirtySize, (UINT)realVertexBuffer.mLength - dirtyOffset);
+					realVertexBuffer.mRealDevice->mMemoryManager.Flush(realVertexBuffer.mStagingAllocation, dirtyOffset, dirtySize);
+					realVertexBuffer.mRealDevice->CopyBuffer(realVertexBuffer.mStagingBuffer, realVertexBuffer.mBuffer, dirtyOffset, dirtySize, vk::AccessFlagBits::eVertexAttributeRead, vk::PipelineStageFlagBits::eVertexInput);
+					realVertexBuffer.mUploadBatch = realVertexBuffer.mRealDevice->mTransferManager.mBatchNumber;
 				}
 			}
 			break;
@@ -3298,32 +3421,59 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 				VOID** ppbData = bit_cast<VOID**>(workItem->Argument3);
 				DWORD Flags = bit_cast<DWORD>(workItem->Argument4);
 
-				if (realIndexBuffer.mData == nullptr)
+				if (realIndexBuffer.mIsDynamic && (Flags & D3DLOCK_READONLY) != D3DLOCK_READONLY)
 				{
-					realIndexBuffer.mData = realIndexBuffer.mRealDevice->mDevice.mapMemory(realIndexBuffer.mMemory, 0, realIndexBuffer.mMemoryRequirements.size, vk::MemoryMapFlags()).value;
-					if (realIndexBuffer.mData == nullptr)
+					/*
+					Discard hands out a copy the gpu isn't reading and no overwrite promises not to touch anything in use so neither has to wait.
+					Any other lock waits for the last submitted frame that used the buffer. If the frame being recorded uses it the buffer is copied instead because draws that are already recorded have to see the old contents.
+					*/
+					if ((Flags & D3DLOCK_DISCARD) == D3DLOCK_DISCARD)
 					{
-						(*ppbData) = nullptr;
+						realIndexBuffer.mRealDevice->RenameBuffer(realIndexBuffer.mBuffer, realIndexBuffer.mAllocation, realIndexBuffer.mLastUsedFrame, realIndexBuffer.mRetiredSlots, realIndexBuffer.mLength, vk::BufferUsageFlagBits::eIndexBuffer, false);
 					}
-					else
+					else if ((Flags & D3DLOCK_NOOVERWRITE) != D3DLOCK_NOOVERWRITE)
 					{
-						(*ppbData) = (char *)realIndexBuffer.mData + OffsetToLock;
+						if (realIndexBuffer.mLastUsedFrame == realIndexBuffer.mRealDevice->mFrameNumber)
+						{
+							realIndexBuffer.mRealDevice->RenameBuffer(realIndexBuffer.mBuffer, realIndexBuffer.mAllocation, realIndexBuffer.mLastUsedFrame, realIndexBuffer.mRetiredSlots, realIndexBuffer.mLength, vk::BufferUsageFlagBits::eIndexBuffer, true);
+						}
+						else
+						{
+							realIndexBuffer.mRealDevice->WaitForFrame(realIndexBuffer.mLastUsedFrame);
+						}
 					}
 				}
-				else
+
+				//Static buffers are written through the staging buffer and copied into video memory on unlock. The staging buffer can't be written again until the batch copying out of it is finished.
+				if (!realIndexBuffer.mIsDynamic && (Flags & D3DLOCK_READONLY) != D3DLOCK_READONLY)
 				{
-					(*ppbData) = (char *)realIndexBuffer.mData + OffsetToLock;
+					realIndexBuffer.mRealDevice->mTransferManager.WaitForBatch(realIndexBuffer.mUploadBatch);
 				}
+
+				char* data = (char*)(realIndexBuffer.mIsDynamic ? realIndexBuffer.mAllocation.Data : realIndexBuffer.mStagingAllocation.Data); //Host visible memory stays mapped.
+				if (data == nullptr)
+				{
+					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue the index buffer memory isn't host visible.";
+					(*ppbData) = nullptr;
+					break;
+				}
+
+				(*ppbData) = data + OffsetToLock;
 			}
 			break;
 			case IndexBuffer_Unlock:
 			{
 				auto& realIndexBuffer = (*commandStreamManager->mRenderManager.mStateManager.mIndexBuffers[workItem->Id]);
+				UINT dirtyOffset = bit_cast<UINT>(workItem->Argument1);
+				UINT dirtySize = bit_cast<UINT>(workItem->Argument2);
 
-				if (realIndexBuffer.mData != nullptr)
+				//Only static buffers that were written get here, dynamic buffers are written in place. Only the bytes written since the last unlock are flushed and copied.
+				if (!realIndexBuffer.mIsDynamic && dirtyOffset < realIndexBuffer.mLength)
 				{
-					realIndexBuffer.mRealDevice->mDevice.unmapMemory(realIndexBuffer.mMemory);
-					realIndexBuffer.mData = nullptr;
+					dirtySize = std::min(dirtySize, (UINT)realIndexBuffer.mLength - dirtyOffset);
+					realIndexBuffer.mRealDevice->mMemoryManager.Flush(realIndexBuffer.mStagingAllocation, dirtyOffset, dirtySize);
+					realIndexBuffer.mRealDevice->CopyBuffer(realIndexBuffer.mStagingBuffer, realIndexBuffer.mBuffer, dirtyOffset, dirtySize, vk::AccessFlagBits::eIndexRead, vk::PipelineStageFlagBits::eVertexInput);
+					realIndexBuffer.mUploadBatch = realIndexBuffer.mRealDevice->mTransferManager.mBatchNumber;
 				}
 			}
 			break;
@@ -3363,376 +3513,59 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 			case Texture_GenerateMipSubLevels:
 			{
 				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[workItem->Id]);
-				auto& realDevice = texture.mRealDevice;
 				CTexture9* texture9 = bit_cast<CTexture9*>(workItem->Argument1);
-				auto& device = realDevice->mDevice;
-
-				vk::Result result;
-				vk::PipelineStageFlags sourceStages = vk::PipelineStageFlagBits::eTopOfPipe;
-				vk::PipelineStageFlags destinationStages = vk::PipelineStageFlagBits::eTopOfPipe;
-				vk::CommandBuffer commandBuffer;
-				vk::Filter realFilter = ConvertFilter(texture9->mMipFilter);
-
-				vk::CommandBufferAllocateInfo commandBufferInfo;
-				commandBufferInfo.commandPool = realDevice->mCommandPool;
-				commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
-				commandBufferInfo.commandBufferCount = 1;
-
-				result = device.allocateCommandBuffers(&commandBufferInfo, &commandBuffer);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
-
-				vk::CommandBufferInheritanceInfo commandBufferInheritanceInfo;
-				commandBufferInheritanceInfo.renderPass = nullptr;
-				commandBufferInheritanceInfo.subpass = 0;
-				commandBufferInheritanceInfo.framebuffer = nullptr;
-				commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
-				//commandBufferInheritanceInfo.queryFlags = 0;
-				//commandBufferInheritanceInfo.pipelineStatistics = 0;
-
-				vk::CommandBufferBeginInfo commandBufferBeginInfo;
-				//commandBufferBeginInfo.flags = 0;
-				commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
-
-				result = commandBuffer.begin(&commandBufferBeginInfo);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
-
-				vk::ImageMemoryBarrier imageMemoryBarrier;
-				//imageMemoryBarrier.srcAccessMask = 0;
-				//imageMemoryBarrier.dstAccessMask = 0;
-
-				vk::ImageSubresourceRange mipSubRange;
-				mipSubRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-				mipSubRange.levelCount = 1;
-				mipSubRange.layerCount = 1;
-
-				/*
-				I'm debating whether or not to have the population of the image here. If I don't I'll end up creating another command for that. On the other hand this method should purely populate the other levels as per the spec.
-				*/
-
-				// Transition zero mip level to transfer source
-				//mipSubRange.baseMipLevel = 0;
-
-				//imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				//imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				//imageMemoryBarrier.image = mImage;
-				//imageMemoryBarrier.subresourceRange = mipSubRange;
-				//vkCmdPipelineBarrier(commandBuffer, sourceStages, destinationStages, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-				for (UINT i = 1; i < texture9->mLevels; i++) //Changed to match mLevels datatype
-				{
-					vk::ImageBlit imageBlit;
-
-					// Source
-					imageBlit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-					imageBlit.srcSubresource.layerCount = 1;
-					imageBlit.srcSubresource.mipLevel = 0;
-					imageBlit.srcOffsets[1].x = int32_t(texture9->mWidth);
-					imageBlit.srcOffsets[1].y = int32_t(texture9->mHeight);
-					imageBlit.srcOffsets[1].z = 1;
-
-					// Destination
-					imageBlit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-					imageBlit.dstSubresource.layerCount = 1;
-					imageBlit.dstSubresource.mipLevel = i;
-					imageBlit.dstOffsets[1].x = int32_t(texture9->mWidth >> i);
-					imageBlit.dstOffsets[1].y = int32_t(texture9->mHeight >> i);
-					imageBlit.dstOffsets[1].z = 1;
-
-					mipSubRange.baseMipLevel = i;
-
-					// Transition current mip level to transfer dest
-					imageMemoryBarrier.oldLayout = vk::ImageLayout::eUndefined;
-					imageMemoryBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
-					imageMemoryBarrier.image = texture.mImage;
-					imageMemoryBarrier.subresourceRange = mipSubRange;
-					commandBuffer.pipelineBarrier(sourceStages, destinationStages, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-					// Blit from zero level
-					commandBuffer.blitImage(texture.mImage, vk::ImageLayout::eTransferSrcOptimal, texture.mImage, vk::ImageLayout::eTransferDstOptimal, 1, &imageBlit, vk::Filter::eLinear);
-				}
-
-				commandBuffer.end();
-
-				vk::CommandBuffer commandBuffers[] = { commandBuffer };
-				vk::Fence nullFence;
-				vk::SubmitInfo submitInfo;
-				submitInfo.waitSemaphoreCount = 0;
-				submitInfo.pWaitSemaphores = nullptr;
-				submitInfo.pWaitDstStageMask = nullptr;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = commandBuffers;
-				submitInfo.signalSemaphoreCount = 0;
-				submitInfo.pSignalSemaphores = nullptr;
-
-				result = realDevice->mQueue.submit(1, &submitInfo, nullFence);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
-
-				realDevice->mQueue.waitIdle();
+				auto& renderManager = commandStreamManager->mRenderManager;
+				auto& device = renderManager.mStateManager.mDevices[texture9->mDevice->mId];
 
-				device.freeCommandBuffers(realDevice->mCommandPool, 1, commandBuffers);
-				commandBuffer = nullptr;
+				//A texture the frame rendered to or sampled has to be read after those draws, anything else goes into the upload batch.
+				vk::CommandBuffer commandBuffer = renderManager.GetCopyCommandBuffer(device, renderManager.IsUsedInFrame(device, texture));
+				texture.mRealDevice->GenerateMipSubLevels(commandBuffer, texture.mImage, texture.mRealFormat, vk::Extent3D(texture9->mWidth, texture9->mHeight, 1), texture9->mLevels, 1, 0, ConvertFilter(texture9->mMipFilter));
 			}
 			break;
 			case CubeTexture_GenerateMipSubLevels:
 			{
 				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[workItem->Id]);
-				auto& realDevice = texture.mRealDevice;
 				CCubeTexture9* texture9 = bit_cast<CCubeTexture9*>(workItem->Argument1);
-				auto& device = realDevice->mDevice;
-
-				vk::Result result;
-				vk::PipelineStageFlags sourceStages = vk::PipelineStageFlagBits::eTopOfPipe;
-				vk::PipelineStageFlags destinationStages = vk::PipelineStageFlagBits::eTopOfPipe;
-				vk::CommandBuffer commandBuffer;
-				vk::Filter realFilter = ConvertFilter(texture9->mMipFilter);
-
-				vk::CommandBufferAllocateInfo commandBufferInfo;
-				commandBufferInfo.commandPool = realDevice->mCommandPool;
-				commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
-				commandBufferInfo.commandBufferCount = 1;
-
-				result = device.allocateCommandBuffers(&commandBufferInfo, &commandBuffer);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
-
-				vk::CommandBufferInheritanceInfo commandBufferInheritanceInfo;
-				commandBufferInheritanceInfo.renderPass = nullptr;
-				commandBufferInheritanceInfo.subpass = 0;
-				commandBufferInheritanceInfo.framebuffer = nullptr;
-				commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
-				//commandBufferInheritanceInfo.queryFlags = 0;
-				//commandBufferInheritanceInfo.pipelineStatistics = 0;
-
-				vk::CommandBufferBeginInfo commandBufferBeginInfo;
-				//commandBufferBeginInfo.flags = 0;
-				commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
-
-				result = commandBuffer.begin(&commandBufferBeginInfo);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
-
-				vk::ImageMemoryBarrier imageMemoryBarrier;
-				//imageMemoryBarrier.srcAccessMask = 0;
-				//imageMemoryBarrier.dstAccessMask = 0;
-
-				vk::ImageSubresourceRange mipSubRange;
-				mipSubRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-				mipSubRange.levelCount = 1;
-				mipSubRange.layerCount = 1;
-
-				/*
-				I'm debating whether or not to have the population of the image here. If I don't I'll end up creating another command for that. On the other hand this method should purely populate the other levels as per the spec.
-				*/
-
-				// Transition zero mip level to transfer source
-				//mipSubRange.baseMipLevel = 0;
-
-				//imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				//imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				//imageMemoryBarrier.image = mImage;
-				//imageMemoryBarrier.subresourceRange = mipSubRange;
-				//vkCmdPipelineBarrier(commandBuffer, sourceStages, destinationStages, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-				for (UINT i = 1; i < texture9->mLevels; i++) //Changed to match mLevels datatype
-				{
-					vk::ImageBlit imageBlit;
-
-					// Source
-					imageBlit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-					imageBlit.srcSubresource.layerCount = 6;
-					imageBlit.srcSubresource.mipLevel = 0;
-					imageBlit.srcOffsets[1].x = int32_t(texture9->mEdgeLength);
-					imageBlit.srcOffsets[1].y = int32_t(texture9->mEdgeLength);
-					imageBlit.srcOffsets[1].z = 1;
-
-					// Destination
-					imageBlit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-					imageBlit.dstSubresource.layerCount = 6;
-					imageBlit.dstSubresource.mipLevel = i;
-					imageBlit.dstOffsets[1].x = int32_t(texture9->mEdgeLength >> i);
-					imageBlit.dstOffsets[1].y = int32_t(texture9->mEdgeLength >> i);
-					imageBlit.dstOffsets[1].z = 1;
-
-					mipSubRange.baseMipLevel = i;
-
-					// Transition current mip level to transfer dest
-					imageMemoryBarrier.oldLayout = vk::ImageLayout::eUndefined;
-					imageMemoryBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
-					imageMemoryBarrier.image = texture.mImage;
-					imageMemoryBarrier.subresourceRange = mipSubRange;
-					commandBuffer.pipelineBarrier(sourceStages, destinationStages, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-					// Blit from zero level
-					commandBuffer.blitImage(texture.mImage, vk::ImageLayout::eTransferSrcOptimal, texture.mImage, vk::ImageLayout::eTransferDstOptimal, 1, &imageBlit, vk::Filter::eLinear);
-				}
-
-				commandBuffer.end();
-
-				vk::CommandBuffer commandBuffers[] = { commandBuffer };
-				vk::Fence nullFence;
-				vk::SubmitInfo submitInfo;
-				submitInfo.waitSemaphoreCount = 0;
-				submitInfo.pWaitSemaphores = nullptr;
-				submitInfo.pWaitDstStageMask = nullptr;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = commandBuffers;
-				submitInfo.signalSemaphoreCount = 0;
-				submitInfo.pSignalSemaphores = nullptr;
-
-				result = realDevice->mQueue.submit(1, &submitInfo, nullFence);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
-
-				realDevice->mQueue.waitIdle();
+				auto& renderManager = commandStreamManager->mRenderManager;
+				auto& device = renderManager.mStateManager.mDevices[texture9->mDevice->mId];
 
-				device.freeCommandBuffers(realDevice->mCommandPool, 1, commandBuffers);
-				commandBuffer = nullptr;
+				//A texture the frame rendered to or sampled has to be read after those draws, anything else goes into the upload batch.
+				vk::CommandBuffer commandBuffer = renderManager.GetCopyCommandBuffer(device, renderManager.IsUsedInFrame(device, texture));
+				texture.mRealDevice->GenerateMipSubLevels(commandBuffer, texture.mImage, texture.mRealFormat, vk::Extent3D(texture9->mEdgeLength, texture9->mEdgeLength, 1), texture9->mLevels, 6, 0, ConvertFilter(texture9->mMipFilter));
 			}
 			break;
 			case VolumeTexture_GenerateMipSubLevels:
 			{
 				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[workItem->Id]);
-				auto& realDevice = texture.mRealDevice;
 				CVolumeTexture9* texture9 = bit_cast<CVolumeTexture9*>(workItem->Argument1);
-				auto& device = realDevice->mDevice;
-
-				vk::Result result;
-				vk::PipelineStageFlags sourceStages = vk::PipelineStageFlagBits::eTopOfPipe;
-				vk::PipelineStageFlags destinationStages = vk::PipelineStageFlagBits::eTopOfPipe;
-				vk::CommandBuffer commandBuffer;
-				vk::Filter realFilter = ConvertFilter(texture9->mMipFilter);
-
-				vk::CommandBufferAllocateInfo commandBufferInfo;
-				commandBufferInfo.commandPool = realDevice->mCommandPool;
-				commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
-				commandBufferInfo.commandBufferCount = 1;
-
-				result = device.allocateCommandBuffers(&commandBufferInfo, &commandBuffer);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
-
-				vk::CommandBufferInheritanceInfo commandBufferInheritanceInfo;
-				commandBufferInheritanceInfo.renderPass = nullptr;
-				commandBufferInheritanceInfo.subpass = 0;
-				commandBufferInheritanceInfo.framebuffer = nullptr;
-				commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
-				//commandBufferInheritanceInfo.queryFlags = 0;
-				//commandBufferInheritanceInfo.pipelineStatistics = 0;
-
-				vk::CommandBufferBeginInfo commandBufferBeginInfo;
-				//commandBufferBeginInfo.flags = 0;
-				commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
-
-				result = commandBuffer.begin(&commandBufferBeginInfo);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
-
-				vk::ImageMemoryBarrier imageMemoryBarrier;
-				//imageMemoryBarrier.srcAccessMask = 0;
-				//imageMemoryBarrier.dstAccessMask = 0;
-
-				vk::ImageSubresourceRange mipSubRange;
-				mipSubRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-				mipSubRange.levelCount = 1;
-				mipSubRange.layerCount = 1;
-
-				/*
-				I'm debating whether or not to have the population of the image here. If I don't I'll end up creating another command for that. On the other hand this method should purely populate the other levels as per the spec.
-				*/
-
-				// Transition zero mip level to transfer source
-				//mipSubRange.baseMipLevel = 0;
-
-				//imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				//imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				//imageMemoryBarrier.image = mImage;
-				//imageMemoryBarrier.subresourceRange = mipSubRange;
-				//vkCmdPipelineBarrier(commandBuffer, sourceStages, destinationStages, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-				for (UINT i = 1; i < texture9->mLevels; i++) //Changed to match mLevels datatype
-				{
-					vk::ImageBlit imageBlit;
-
-					// Source
-					imageBlit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-					imageBlit.srcSubresource.layerCount = 1;
-					imageBlit.srcSubresource.mipLevel = 0;
-					imageBlit.srcOffsets[1].x = int32_t(texture9->mWidth);
-					imageBlit.srcOffsets[1].y = int32_t(texture9->mHeight);
-					imageBlit.srcOffsets[1].z = 1;
-
-					// Destination
-					imageBlit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-					imageBlit.dstSubresource.layerCount = 1;
-					imageBlit.dstSubresource.mipLevel = i;
-					imageBlit.dstOffsets[1].x = int32_t(texture9->mWidth >> i);
-					imageBlit.dstOffsets[1].y = int32_t(texture9->mHeight >> i);
-					imageBlit.dstOffsets[1].z = 1;
-
-					mipSubRange.baseMipLevel = i;
-
-					// Transition current mip level to transfer dest
-					imageMemoryBarrier.oldLayout = vk::ImageLayout::eUndefined;
-					imageMemoryBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
-					imageMemoryBarrier.image = texture.mImage;
-					imageMemoryBarrier.subresourceRange = mipSubRange;
-					commandBuffer.pipelineBarrier(sourceStages, destinationStages, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-					// Blit from zero level
-					commandBuffer.blitImage(texture.mImage, vk::ImageLayout::eTransferSrcOptimal, texture.mImage, vk::ImageLayout::eTransferDstOptimal, 1, &imageBlit, vk::Filter::eLinear);
-				}
+				auto& renderManager = commandStreamManager->mRenderManager;
+				auto& device = renderManager.mStateManager.mDevices[texture9->mDevice->mId];
 
-				commandBuffer.end();
-
-				vk::CommandBuffer commandBuffers[] = { commandBuffer };
-				vk::Fence nullFence;
-				vk::SubmitInfo submitInfo;
-				submitInfo.waitSemaphoreCount = 0;
-				submitInfo.pWaitSemaphores = nullptr;
-				submitInfo.pWaitDstStageMask = nullptr;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = commandBuffers;
-				submitInfo.signalSemaphoreCount = 0;
-				submitInfo.pSignalSemaphores = nullptr;
-
-				result = realDevice->mQueue.submit(1, &submitInfo, nullFence);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
+				//A texture the frame rendered to or sampled has to be read after those draws, anything else goes into the upload batch.
+				vk::CommandBuffer commandBuffer = renderManager.GetCopyCommandBuffer(device, renderManager.IsUsedInFrame(device, texture));
+				texture.mRealDevice->GenerateMipSubLevels(commandBuffer, texture.mImage, texture.mRealFormat, vk::Extent3D(texture9->mWidth, texture9->mHeight, texture9->mDepth), texture9->mLevels, 1, 0, ConvertFilter(texture9->mMipFilter));
+			}
+			break;
+			case Texture_PreLoad:
+			{
+				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[workItem->Id]);
 
-				realDevice->mQueue.waitIdle();
+				texture.mRealDevice->mResidencyManager.MakeResident(texture, commandStreamManager->mRenderManager.mStateManager.mSurfaces, texture.mRealDevice->GetTexturePalette());
+			}
+			break;
+			case Texture_SetPriority:
+			{
+				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[workItem->Id]);
+				texture.mPriority = bit_cast<DWORD>(workItem->Argument1);
+			}
+			break;
+			case Texture_AddDirtyRect:
+			{
+				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[workItem->Id]);
+				UINT layer = bit_cast<UINT>(workItem->Argument1);
 
-				device.freeCommandBuffers(realDevice->mCommandPool, 1, commandBuffers);
-				commandBuffer = nullptr;
+				AddDirtyRegion(texture.mDirtyRegions[layer], { bit_cast<UINT>(workItem->Argument2), bit_cast<UINT>(workItem->Argument3), bit_cast<UINT>(workItem->Argument4)
+					, bit_cast<UINT>(workItem->Argument5), bit_cast<UINT>(workItem->Argument6), bit_cast<UINT>(workItem->Argument7) });
 			}
 			break;
 			case Surface_LockRect:
@@ -3745,146 +3578,130 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 				D3DLOCKED_RECT* pLockedRect = bit_cast<D3DLOCKED_RECT*>(workItem->Argument1);
 				RECT* pRect = bit_cast<RECT*>(workItem->Argument2);
 				DWORD Flags = bit_cast<DWORD>(workItem->Argument3);
+				CSurface9* surface9 = bit_cast<CSurface9*>(workItem->Argument4);
 
-				vk::Result result;
-				char* bytes = nullptr;
+				//A copy into or out of the staging memory recorded this frame has to be submitted before it can be waited on.
+				if (surface.mStagingFrame != 0)
+				{
+					if (surface.mStagingFrame >= realDevice->mFrameNumber)
+					{
+						commandStreamManager->mRenderManager.SubmitFrame(commandStreamManager->mRenderManager.mStateManager.mDevices[surface9->mDevice->mId]);
+					}
+					realDevice->WaitForFrame(surface.mStagingFrame);
+				}
+
+				//The staging buffer stays mapped so there is nothing to do but hand out the address once the last copy out of it has finished.
+				realDevice->mTransferManager.WaitForBatch(surface.mUploadBatch);
 
-				if (surface.mData == nullptr)
+				char* bytes = nullptr;
+				if (!surface.mStagingImage)
 				{
-					if (surface.mIsFlushed)
+					auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[surface9->mTextureId]);
+
+					//A level without a staging buffer is copied back out of its texture in the upload batch which can't come after what the frame did with the texture.
+					if (!surface.mStagingBuffer && commandStreamManager->mRenderManager.IsUsedInFrame(commandStreamManager->mRenderManager.mStateManager.mDevices[surface9->mDevice->mId], texture))
 					{
-						realDevice->SetImageLayout(surface.mStagingImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral); //VK_IMAGE_LAYOUT_PREINITIALIZED			
+						commandStreamManager->mRenderManager.SubmitFrame(commandStreamManager->mRenderManager.mStateManager.mDevices[surface9->mDevice->mId]);
 					}
 
-					result = device.mapMemory(surface.mStagingDeviceMemory, 0, surface.mMemoryAllocateInfo.allocationSize, vk::MemoryMapFlags(), &surface.mData);
-					if (result != vk::Result::eSuccess)
+					bytes = surface.GetStagingData(texture.mImage, surface9->mMipIndex, surface9->mTargetLayer);
+				}
+				else
+				{
+					bytes = (char*)surface.mStagingAllocation.Data;
+					if (bytes != nullptr)
 					{
-						BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkMapMemory failed with return code of " << GetResultString((VkResult)result);
-						break;
+						bytes += surface.mLayouts[0].offset;
 					}
 				}
 
-				bytes = (char*)surface.mData;
-
-				if (surface.mLayouts[0].offset)
+				if (bytes == nullptr)
 				{
-					bytes += surface.mLayouts[0].offset;
+					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue the staging memory isn't host visible.";
+					pLockedRect->pBits = nullptr;
+					surface9->mStagingState = StagingUnmapped;
+					break;
 				}
 
 				if (pRect != nullptr)
 				{
-					bytes += (surface.mLayouts[0].rowPitch * pRect->top);
-					bytes += (4 * pRect->left);
+					bytes += GetLockOffset(surface.mFormat, surface.mLayouts[0].rowPitch, surface.mLayouts[0].depthPitch, pRect->left, pRect->top);
 				}
 
 				pLockedRect->pBits = (void*)bytes;
 				pLockedRect->Pitch = surface.mLayouts[0].rowPitch;
-
-				surface.mIsFlushed = false;
+				surface9->mStagingState = StagingLocked;
 			}
 			break;
-			case Surface_UnlockRect:
+			case Surface_Flush:
 			{
 				auto& surface = (*commandStreamManager->mRenderManager.mStateManager.mSurfaces[workItem->Id]);
 				auto& realDevice = surface.mRealDevice;
 				CSurface9* surface9 = bit_cast<CSurface9*>(workItem->Argument1);
-				auto& device = realDevice->mDevice;
+				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[surface9->mTextureId]);
 
-				if (surface.mData != nullptr)
+				//Without a staging buffer nothing has been written since the last upload.
+				if (!surface.mStagingBuffer)
 				{
-					//This work around was replaced with component mapping.
-					//if (surface9->mFormat == D3DFMT_X8R8G8B8)
-					//{
-					//	SetAlpha((char*)surface.mData, surface9->mHeight, surface9->mWidth, surface.mLayouts[0].rowPitch);
-					//}
-
-					device.unmapMemory(surface.mStagingDeviceMemory);
-					surface.mData = nullptr;
+					surface9->mStagingState = StagingUnmapped;
+					break;
 				}
 
-				surface.mIsFlushed = false;
-			}
-			break;
-			case Surface_Flush:
-			{
-				auto& surface = (*commandStreamManager->mRenderManager.mStateManager.mSurfaces[workItem->Id]);
+				surface.mLastLockedFrame = realDevice->mFrameNumber;
 
-				if (surface.mIsFlushed)
+				//An evicted texture picks up everything in the staging buffer when it is restored.
+				if (!texture.mIsResident)
 				{
+					surface9->mStagingState = StagingIdle;
 					break;
 				}
 
-				auto& realDevice = surface.mRealDevice;
-				CSurface9* surface9 = bit_cast<CSurface9*>(workItem->Argument1);
-				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[surface9->mTextureId]);
-				auto& device = realDevice->mDevice;
-
-				vk::CommandBuffer commandBuffer;
-				vk::Result result;
+				/*
+				The copy is recorded into the upload batch which goes out ahead of the frame, queue order keeps it behind the frames still sampling the old contents.
+				If this frame already drew with the texture the copy goes between those draws and the next ones instead.
+				*/
+				auto& renderManager = commandStreamManager->mRenderManager;
+				auto& device = renderManager.mStateManager.mDevices[surface9->mDevice->mId];
+				const bool isUsedInFrame = renderManager.IsUsedInFrame(device, texture);
+				vk::CommandBuffer commandBuffer = renderManager.GetCopyCommandBuffer(device, isUsedInFrame);
 
-				vk::CommandBufferAllocateInfo commandBufferInfo;
-				commandBufferInfo.commandPool = realDevice->mCommandPool;
-				commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
-				commandBufferInfo.commandBufferCount = 1;
+				//Only the regions written since the last flush are copied, all of them in one go.
+				const auto& regions = surface9->mFlushRegions;
 
-				result = device.allocateCommandBuffers(&commandBufferInfo, &commandBuffer);
-				if (result != vk::Result::eSuccess)
+				bool isWholeLevel = false;
+				for (auto& region : regions)
 				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
-					break;
+					isWholeLevel |= (region.Left == 0 && region.Top == 0 && region.Right == surface9->mWidth && region.Bottom == surface9->mHeight);
 				}
 
-				vk::CommandBufferInheritanceInfo commandBufferInheritanceInfo;
-				commandBufferInheritanceInfo.renderPass = nullptr;
-				commandBufferInheritanceInfo.subpass = 0;
-				commandBufferInheritanceInfo.framebuffer = nullptr;
-				commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
-				//commandBufferInheritanceInfo.queryFlags = 0;
-				//commandBufferInheritanceInfo.pipelineStatistics = 0;
-
-				vk::CommandBufferBeginInfo commandBufferBeginInfo;
-				//commandBufferBeginInfo.flags = 0;
-				commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
+				//If the whole level is overwritten the texture doesn't need its old contents.
+				realDevice->mImageLayoutTracker.Transition(commandBuffer, texture.mImage, vk::ImageLayout::eTransferDstOptimal, 1, surface9->mMipIndex, 1, surface9->mTargetLayer, isWholeLevel);
+				realDevice->mImageLayoutTracker.Flush(commandBuffer);
+				
+				surface.CopyToImage(commandBuffer, texture.mImage, regions, surface9->mMipIndex, surface9->mTargetLayer, realDevice->GetTexturePalette());
 
-				result = commandBuffer.begin(&commandBufferBeginInfo);
-				if (result != vk::Result::eSuccess)
+				//Textures created with D3DUSAGE_AUTOGENMIPMAP rebuild the levels below whenever the top one changes. Only the face that was written is regenerated.
+				if (surface9->mMipIndex == 0 && (surface9->mUsage & D3DUSAGE_AUTOGENMIPMAP) == D3DUSAGE_AUTOGENMIPMAP)
 				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
-					break;
+					if (surface9->mTexture != nullptr)
+					{
+						realDevice->GenerateMipSubLevels(commandBuffer, texture.mImage, texture.mRealFormat, vk::Extent3D(surface9->mWidth, surface9->mHeight, 1), surface9->mTexture->mLevels, 1, surface9->mTargetLayer, ConvertFilter(surface9->mTexture->mMipFilter));
+					}
+					else if (surface9->mCubeTexture != nullptr)
+					{
+						realDevice->GenerateMipSubLevels(commandBuffer, texture.mImage, texture.mRealFormat, vk::Extent3D(surface9->mWidth, surface9->mHeight, 1), surface9->mCubeTexture->mLevels, 1, surface9->mTargetLayer, ConvertFilter(surface9->mCubeTexture->mMipFilter));
+					}
 				}
-
-				ReallySetImageLayout(commandBuffer, surface.mStagingImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal, 1, 0, 1); //eGeneral
-				ReallySetImageLayout(commandBuffer, texture.mImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1, surface9->mMipIndex, surface9->mTargetLayer + 1);
-				
-				ReallyCopyImage(commandBuffer, surface.mStagingImage, texture.mImage, 0, 0, surface9->mWidth, surface9->mHeight, 1, 0, surface9->mMipIndex, 0, surface9->mTargetLayer);
 				
-				ReallySetImageLayout(commandBuffer, texture.mImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, 1, surface9->mMipIndex, surface9->mTargetLayer + 1);
-
-				commandBuffer.end();
-
-				vk::CommandBuffer commandBuffers[] = { commandBuffer };
-				vk::Fence nullFence;
-				vk::SubmitInfo submitInfo;
-				submitInfo.waitSemaphoreCount = 0;
-				submitInfo.pWaitSemaphores = nullptr;
-				submitInfo.pWaitDstStageMask = nullptr;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = commandBuffers;
-				submitInfo.signalSemaphoreCount = 0;
-				submitInfo.pSignalSemaphores = nullptr;
-
-				result = realDevice->mQueue.submit(1, &submitInfo, nullFence);
-				if (result != vk::Result::eSuccess)
+				realDevice->mImageLayoutTracker.Transition(commandBuffer, texture.mImage, vk::ImageLayout::eShaderReadOnlyOptimal, 1, surface9->mMipIndex, 1, surface9->mTargetLayer);
+				realDevice->mImageLayoutTracker.Flush(commandBuffer);
+
+				surface.mUploadBatch = realDevice->mTransferManager.mBatchNumber;
+				if (isUsedInFrame)
 				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
-					break;
+					surface.mStagingFrame = realDevice->mFrameNumber;
 				}
-
-				realDevice->mQueue.waitIdle();
-
-				device.freeCommandBuffers(realDevice->mCommandPool, 1, commandBuffers);
-
-				surface.mIsFlushed = true;
+				surface9->mStagingState = StagingUploading;
 			}
 			break;
 			case Volume_LockRect:
@@ -3896,150 +3713,103 @@ void ProcessQueue(CommandStreamManager* commandStreamManager)
 				D3DLOCKED_BOX* pLockedVolume = bit_cast<D3DLOCKED_BOX*>(workItem->Argument1);
 				D3DBOX* pBox = bit_cast<D3DBOX*>(workItem->Argument2);
 				DWORD Flags = bit_cast<DWORD>(workItem->Argument3);
+				CVolume9* volume9 = bit_cast<CVolume9*>(workItem->Argument4);
+				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[volume9->mTextureId]);
 
-				vk::Result result;
-				char* bytes = nullptr;
-
-				if (volume.mData == nullptr)
+				//A copy out of the staging buffer recorded this frame has to be submitted before it can be waited on.
+				if (volume.mStagingFrame != 0)
 				{
-					if (volume.mIsFlushed)
-					{
-						realDevice->SetImageLayout(volume.mStagingImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral); //VK_IMAGE_LAYOUT_PREINITIALIZED			
-					}
-
-					result = device.mapMemory(volume.mStagingDeviceMemory, 0, volume.mMemoryAllocateInfo.allocationSize, vk::MemoryMapFlags(), &volume.mData);
-					if (result != vk::Result::eSuccess)
+					if (volume.mStagingFrame >= realDevice->mFrameNumber)
 					{
-						BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkMapMemory failed with return code of " << GetResultString((VkResult)result);
-						break;
+						commandStreamManager->mRenderManager.SubmitFrame(commandStreamManager->mRenderManager.mStateManager.mDevices[volume9->mDevice->mId]);
 					}
+					realDevice->WaitForFrame(volume.mStagingFrame);
 				}
 
-				bytes = (char*)volume.mData;
+				//The staging buffer stays mapped so there is nothing to do but hand out the address once the last copy out of it has finished.
+				realDevice->mTransferManager.WaitForBatch(volume.mUploadBatch);
+
+				//A level without a staging buffer is copied back out of its texture in the upload batch which can't come after what the frame did with the texture.
+				if (!volume.mStagingBuffer && commandStreamManager->mRenderManager.IsUsedInFrame(commandStreamManager->mRenderManager.mStateManager.mDevices[volume9->mDevice->mId], texture))
+				{
+					commandStreamManager->mRenderManager.SubmitFrame(commandStreamManager->mRenderManager.mStateManager.mDevices[volume9->mDevice->mId]);
+				}
 
-				if (volume.mLayouts[0].offset)
+				char* bytes = volume.GetStagingData(texture.mImage, volume9->mMipIndex, volume9->mTargetLayer);
+				if (bytes == nullptr)
 				{
-					bytes += volume.mLayouts[0].offset;
+					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue the staging memory isn't host visible.";
+					pLockedVolume->pBits = nullptr;
+					volume9->mStagingState = StagingUnmapped;
+					break;
 				}
 
 				if (pBox != nullptr)
 				{
-					bytes += (volume.mLayouts[0].rowPitch * pBox->Top);
-					bytes += (volume.mLayouts[0].depthPitch * pBox->Front);
-					bytes += (4 * pBox->Left);
+					bytes += GetLockOffset(volume.mFormat, volume.mLayouts[0].rowPitch, volume.mLayouts[0].depthPitch, pBox->Left, pBox->Top, pBox->Front);
 				}
 
 				pLockedVolume->pBits = (void*)bytes;
 				pLockedVolume->RowPitch = volume.mLayouts[0].rowPitch;
 				pLockedVolume->SlicePitch = volume.mLayouts[0].depthPitch;
-
-				volume.mIsFlushed = false;
+				volume9->mStagingState = StagingLocked;
 			}
 			break;
-			case Volume_UnlockRect:
+			case Volume_Flush:
 			{
 				auto& volume = (*commandStreamManager->mRenderManager.mStateManager.mSurfaces[workItem->Id]);
 				auto& realDevice = volume.mRealDevice;
 				CVolume9* volume9 = bit_cast<CVolume9*>(workItem->Argument1);
-				auto& device = realDevice->mDevice;
-
-				if (volume.mData != nullptr)
-				{
-					//This work around was replaced with component mapping.
-					//if (Volume9->mFormat == D3DFMT_X8R8G8B8)
-					//{
-					//	SetAlpha((char*)Volume.mData, Volume9->mHeight, Volume9->mWidth, Volume.mLayouts[0].rowPitch);
-					//}
-
-					device.unmapMemory(volume.mStagingDeviceMemory);
-					volume.mData = nullptr;
-				}
-
-				volume.mIsFlushed = false;
-			}
-			break;
-			case Volume_Flush:
-			{
-				auto& volume = (*commandStreamManager->mRenderManager.mStateManager.mSurfaces[workItem->Id]);
+				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[volume9->mTextureId]);
 
-				if (volume.mIsFlushed)
+				//Without a staging buffer nothing has been written since the last upload.
+				if (!volume.mStagingBuffer)
 				{
+					volume9->mStagingState = StagingUnmapped;
 					break;
 				}
 
-				auto& realDevice = volume.mRealDevice;
-				CVolume9* volume9 = bit_cast<CVolume9*>(workItem->Argument1);
-				auto& texture = (*commandStreamManager->mRenderManager.mStateManager.mTextures[volume9->mTextureId]);
-				auto& device = realDevice->mDevice;
-
-				vk::CommandBuffer commandBuffer;
-				vk::Result result;
+				volume.mLastLockedFrame = realDevice->mFrameNumber;
 
-				vk::CommandBufferAllocateInfo commandBufferInfo;
-				commandBufferInfo.commandPool = realDevice->mCommandPool;
-				commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
-				commandBufferInfo.commandBufferCount = 1;
-
-				result = device.allocateCommandBuffers(&commandBufferInfo, &commandBuffer);
-				if (result != vk::Result::eSuccess)
+				//An evicted texture picks up everything in the staging buffer when it is restored.
+				if (!texture.mIsResident)
 				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
+					volume9->mStagingState = StagingIdle;
 					break;
 				}
 
-				vk::CommandBufferInheritanceInfo commandBufferInheritanceInfo;
-				commandBufferInheritanceInfo.renderPass = nullptr;
-				commandBufferInheritanceInfo.subpass = 0;
-				commandBufferInheritanceInfo.framebuffer = nullptr;
-				commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
-				//commandBufferInheritanceInfo.queryFlags = 0;
-				//commandBufferInheritanceInfo.pipelineStatistics = 0;
+				/*
+				The copy is recorded into the upload batch which goes out ahead of the frame, queue order keeps it behind the frames still sampling the old contents.
+				If this frame already drew with the texture the copy goes between those draws and the next ones instead.
+				*/
+				auto& renderManager = commandStreamManager->mRenderManager;
+				auto& device = renderManager.mStateManager.mDevices[volume9->mDevice->mId];
+				const bool isUsedInFrame = renderManager.IsUsedInFrame(device, texture);
+				vk::CommandBuffer commandBuffer = renderManager.GetCopyCommandBuffer(device, isUsedInFrame);
 
-				vk::CommandBufferBeginInfo commandBufferBeginInfo;
-				//commandBufferBeginInfo.flags = 0;
-				commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
+				//Only the box written since the last flush is copied.
+				boost::container::small_vector<D3DBOX, 4> regions;
+				regions.push_back({ bit_cast<UINT>(workItem->Argument2), bit_cast<UINT>(workItem->Argument3), bit_cast<UINT>(workItem->Argument4)
+					, bit_cast<UINT>(workItem->Argument5), bit_cast<UINT>(workItem->Argument6), bit_cast<UINT>(workItem->Argument7) });
 
-				result = commandBuffer.begin(&commandBufferBeginInfo);
-				if (result != vk::Result::eSuccess)
-				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
-					break;
-				}
+				const bool isWholeLevel = (regions.size() == 1 && regions[0].Left == 0 && regions[0].Top == 0 && regions[0].Front == 0
+					&& regions[0].Right == volume9->mWidth && regions[0].Bottom == volume9->mHeight && regions[0].Back == volume9->mDepth);
 
-				ReallySetImageLayout(commandBuffer, volume.mStagingImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal, 1, 0, 1); //eGeneral
-				ReallySetImageLayout(commandBuffer, texture.mImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1, volume9->mMipIndex, volume9->mTargetLayer + 1);
+				//If the whole level is overwritten the texture doesn't need its old contents.
+				realDevice->mImageLayoutTracker.Transition(commandBuffer, texture.mImage, vk::ImageLayout::eTransferDstOptimal, 1, volume9->mMipIndex, 1, volume9->mTargetLayer, isWholeLevel);
+				realDevice->mImageLayoutTracker.Flush(commandBuffer);
 				
-				ReallyCopyImage(commandBuffer, volume.mStagingImage, texture.mImage, 0, 0, volume9->mWidth, volume9->mHeight, volume9->mDepth, 0, volume9->mMipIndex, 0, volume9->mTargetLayer);
+				volume.CopyToImage(commandBuffer, texture.mImage, regions, volume9->mMipIndex, volume9->mTargetLayer, realDevice->GetTexturePalette());
 				
-				ReallySetImageLayout(commandBuffer, texture.mImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, 1, volume9->mMipIndex, volume9->mTargetLayer + 1);
-				//Transition happens on lock.
-				//ReallySetImageLayout(commandBuffer, volume.mStagingImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral, 1, 0, 1);
-
-				commandBuffer.end();
-
-				vk::CommandBuffer commandBuffers[] = { commandBuffer };
-				vk::Fence nullFence;
-				vk::SubmitInfo submitInfo;
-				submitInfo.waitSemaphoreCount = 0;
-				submitInfo.pWaitSemaphores = nullptr;
-				submitInfo.pWaitDstStageMask = nullptr;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = commandBuffers;
-				submitInfo.signalSemaphoreCount = 0;
-				submitInfo.pSignalSemaphores = nullptr;
-
-				result = realDevice->mQueue.submit(1, &submitInfo, nullFence);
-				if (result != vk::Result::eSuccess)
+				realDevice->mImageLayoutTracker.Transition(commandBuffer, texture.mImage, vk::ImageLayout::eShaderReadOnlyOptimal, 1, volume9->mMipIndex, 1, volume9->mTargetLayer);
+				realDevice->mImageLayoutTracker.Flush(commandBuffer);
+
+				volume.mUploadBatch = realDevice->mTransferManager.mBatchNumber;
+				if (isUsedInFrame)
 				{
-					BOOST_LOG_TRIVIAL(fatal) << "ProcessQueue vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
-					break;
+					volume.mStagingFrame = realDevice->mFrameNumber;
 				}
-
-				realDevice->mQueue.waitIdle();
-
-				device.freeCommandBuffers(realDevice->mCommandPool, 1, commandBuffers);
-
-				volume.mIsFlushed = true;
+				volume9->mStagingState = StagingUploading;
 			}
 			break;
 			case Query_Issue:
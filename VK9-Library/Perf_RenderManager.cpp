@@ -45,6 +45,7 @@ misrepresented as being the original software.
 #include "CVolumeTexture9.h"
 #include "CBaseTexture9.h"
 #include "CTexture9.h"
+#include "CDevice9.h"
 #include "CIndexBuffer9.h"
 #include "CVertexBuffer9.h"
 #include "CVertexDeclaration9.h"
@@ -72,17 +73,32 @@ void RenderManager::UpdateBuffer(std::shared_ptr<RealDevice> realDevice)
 		this->StartScene(realDevice, false);
 	}
 
+	//The updates have to land before the shaders read them so they share the caller's barrier batch.
+	vk::BufferMemoryBarrier bufferMemoryBarrier;
+	bufferMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	bufferMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eUniformRead;
+	bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.offset = 0;
+	bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+
 	//The dirty flag for lights can be set by enable light or set light.
 	if (deviceState.mAreLightsDirty)
 	{
 		currentBuffer.updateBuffer(realDevice->mLightBuffer, 0, sizeof(Light)*deviceState.mLights.size(), deviceState.mLights.data()); //context->mSpecializationConstants.lightCount
 		deviceState.mAreLightsDirty = false;
+
+		bufferMemoryBarrier.buffer = realDevice->mLightBuffer;
+		realDevice->mImageLayoutTracker.mBarrierBatch.Add(currentBuffer, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader, bufferMemoryBarrier);
 	}
 
 	if (deviceState.mIsMaterialDirty)
 	{
 		currentBuffer.updateBuffer(realDevice->mMaterialBuffer, 0, sizeof(D3DMATERIAL9), &deviceState.mMaterial);
 		deviceState.mIsMaterialDirty = false;
+
+		bufferMemoryBarrier.buffer = realDevice->mMaterialBuffer;
+		realDevice->mImageLayoutTracker.mBarrierBatch.Add(currentBuffer, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader, bufferMemoryBarrier);
 	}
 }
 
@@ -105,65 +121,29 @@ void RenderManager::StopScene(std::shared_ptr<RealDevice> realDevice)
 
 void RenderManager::CopyImage(std::shared_ptr<RealDevice> realDevice, vk::Image srcImage, vk::Image dstImage, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t depth, uint32_t srcMip, uint32_t dstMip)
 {
-	vk::Result result;
-	vk::CommandBuffer commandBuffer;
-	auto& device = realDevice->mDevice;
+	auto& imageLayoutTracker = realDevice->mImageLayoutTracker;
 
-	vk::CommandBufferAllocateInfo commandBufferInfo;
-	commandBufferInfo.commandPool = realDevice->mCommandPool;
-	commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
-	commandBufferInfo.commandBufferCount = 1;
+	//Both images are put back the way they were found so whatever is recorded after the copy sees the layouts it expects.
+	vk::CommandBuffer commandBuffer = GetCopyCommandBuffer(realDevice, imageLayoutTracker.IsUsedInFrame(srcImage) || imageLayoutTracker.IsUsedInFrame(dstImage));
 
-	result = device.allocateCommandBuffers(&commandBufferInfo, &commandBuffer);
-	if (result != vk::Result::eSuccess)
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "RenderManager::CopyImage vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
-		return;
-	}
+	vk::ImageLayout srcLayout = imageLayoutTracker.GetLayout(srcImage, srcMip);
+	vk::ImageLayout dstLayout = imageLayoutTracker.GetLayout(dstImage, dstMip);
 
-	vk::CommandBufferInheritanceInfo commandBufferInheritanceInfo;
-	commandBufferInheritanceInfo.renderPass = nullptr;
-	commandBufferInheritanceInfo.subpass = 0;
-	commandBufferInheritanceInfo.framebuffer = nullptr;
-	commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
-	//commandBufferInheritanceInfo.queryFlags = 0;
-	//commandBufferInheritanceInfo.pipelineStatistics = 0;
+	imageLayoutTracker.Transition(commandBuffer, srcImage, vk::ImageLayout::eTransferSrcOptimal, 1, srcMip, 1, 0);
+	imageLayoutTracker.Transition(commandBuffer, dstImage, vk::ImageLayout::eTransferDstOptimal, 1, dstMip, 1, 0);
+	imageLayoutTracker.Flush(commandBuffer);
 
-	vk::CommandBufferBeginInfo commandBufferBeginInfo;
-	//commandBufferBeginInfo.flags = 0;
-	commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
+	ReallyCopyImage(commandBuffer, srcImage, dstImage, x, y, width, height, depth, srcMip, dstMip, 0, 0);
 
-	result = commandBuffer.begin(&commandBufferBeginInfo);
-	if (result != vk::Result::eSuccess)
+	if (srcLayout != vk::ImageLayout::eUndefined && srcLayout != vk::ImageLayout::ePreinitialized)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RenderManager::CopyImage vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
-		return;
+		imageLayoutTracker.Transition(commandBuffer, srcImage, srcLayout, 1, srcMip, 1, 0);
 	}
-
-	ReallyCopyImage(commandBuffer, srcImage, dstImage, x, y, width, height, depth, srcMip, dstMip, 0, 0);
-
-	commandBuffer.end();
-
-	vk::CommandBuffer commandBuffers[] = { commandBuffer };
-	vk::Fence nullFence;
-	vk::SubmitInfo submitInfo;
-	submitInfo.waitSemaphoreCount = 0;
-	submitInfo.pWaitSemaphores = nullptr;
-	submitInfo.pWaitDstStageMask = nullptr;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = commandBuffers;
-	submitInfo.signalSemaphoreCount = 0;
-	submitInfo.pSignalSemaphores = nullptr;
-
-	result = realDevice->mQueue.submit(1, &submitInfo, nullFence);
-	if (result != vk::Result::eSuccess)
+	if (dstLayout != vk::ImageLayout::eUndefined && dstLayout != vk::ImageLayout::ePreinitialized)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RenderManager::CopyImage vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
-		return;
+		imageLayoutTracker.Transition(commandBuffer, dstImage, dstLayout, 1, dstMip, 1, 0);
 	}
-
-	realDevice->mQueue.waitIdle();
-	device.freeCommandBuffers(realDevice->mCommandPool, 1, commandBuffers);
+	imageLayoutTracker.Flush(commandBuffer);
 }
 
 void RenderManager::Clear(std::shared_ptr<RealDevice> realDevice, DWORD Count, const D3DRECT *pRects, DWORD Flags, D3DCOLOR Color, float Z, DWORD Stencil)
@@ -188,15 +168,55 @@ void RenderManager::Present(std::shared_ptr<RealDevice> realDevice, const RECT *
 	auto& currentBuffer = realDevice->mCommandBuffers[realDevice->mCurrentCommandBuffer];
 	auto swapchain = mStateManager.GetSwapChain(realDevice, hDestWindowOverride);
 
-	swapchain->Present(currentBuffer, realDevice->mQueue, deviceState.mRenderTarget->mColorSurface->mStagingImage);
+	//Uploads recorded during the frame go out first so queue order puts them ahead of the draws that use them.
+	realDevice->mTransferManager.Submit();
+
+	bool isSubmitted = swapchain->Present(currentBuffer, realDevice->mQueue, realDevice->mImageLayoutTracker, deviceState.mRenderTarget->mOutputImage, realDevice->mCommandBufferFences[realDevice->mCurrentCommandBuffer]);
 	deviceState.hasPresented = true;
-	realDevice->mCurrentCommandBuffer = !realDevice->mCurrentCommandBuffer;
+	realDevice->mImageLayoutTracker.EndFrame();
+	realDevice->mTransferManager.EndFrame();
+	realDevice->EndFrame(isSubmitted);
 
 	//Clean up pipes.
 	FlushDrawBufffer(realDevice);
 
+	/*
+	Levels whose upload has finished go back to idle so the application can lock them again without waiting on the worker.
+	The staging buffers of levels that have been uploaded and not locked for a while are given back.
+	A converted level can't be copied back out of the texture and a managed one is what its texture is restored from so those keep theirs.
+	*/
+	auto& stagedSurfaces = realDevice->mStagedSurfaces;
+	for (size_t i = 0; i < stagedSurfaces.size();)
+	{
+		RealSurface* surface = stagedSurfaces[i];
+		auto& stagingState = (*surface->mStagingState);
+
+		if (stagingState == StagingUploading && realDevice->mTransferManager.IsBatchComplete(surface->mUploadBatch) && realDevice->IsFrameComplete(surface->mStagingFrame))
+		{
+			stagingState = StagingIdle;
+		}
+
+		uint32_t idle = StagingIdle;
+		if (surface->mConversion.Convert == nullptr && !surface->mIsManaged && surface->mUploadBatch != 0 && surface->mLastLockedFrame + StagingIdleFrames < realDevice->mFrameNumber
+			&& stagingState.compare_exchange_strong(idle, StagingUnmapped))
+		{
+			surface->ReleaseStagingBuffer(); //Swaps the last surface into this slot.
+		}
+		else
+		{
+			i++;
+		}
+	}
+
 	//Clean up unreferenced resources.
-	//mGarbageManager.DestroyHandles();
+	realDevice->mGarbageManager.DestroyHandles(realDevice->mFrameNumber, realDevice->mCompletedFrameNumber);
+
+	//Refresh the budget so GetAvailableTextureMem and resource placement follow what the driver reports.
+	realDevice->UpdateMemoryBudget();
+	BOOST_LOG_TRIVIAL(trace) << "RenderManager::Present memory budget " << realDevice->mMemoryBudget << " usage " << realDevice->mMemoryUsage << " swap chain " << realDevice->mSwapChainMemorySize;
+
+	//Over budget managed textures that went unused are evicted, they come back the next time they are bound.
+	realDevice->mResidencyManager.Trim();
 
 	//Print(mDeviceState.mTransforms);
 }
@@ -249,6 +269,149 @@ void RenderManager::DrawPrimitive(std::shared_ptr<RealDevice> realDevice, D3DPRI
 	currentBuffer.draw(std::min(realDevice->mVertexCount, ConvertPrimitiveCountToVertexCount(PrimitiveType, PrimitiveCount)), 1, StartVertex, 0);
 }
 
+void RenderManager::DrawIndexedPrimitiveUP(std::shared_ptr<RealDevice> realDevice, D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, size_t uploadBufferIndex, UINT vertexOffset, UINT vertexStride, UINT indexOffset, D3DFORMAT indexDataFormat)
+{
+	auto& currentBuffer = realDevice->mCommandBuffers[realDevice->mCurrentCommandBuffer];
+
+	if (uploadBufferIndex >= realDevice->mUploadBuffers.size())
+	{
+		BOOST_LOG_TRIVIAL(warning) << "RenderManager::DrawIndexedPrimitiveUP called with invalid upload buffer " << uploadBufferIndex;
+		return;
+	}
+
+	if (!realDevice->mDeviceState.mRenderTarget->mIsSceneStarted)
+	{
+		this->StartScene(realDevice, false);
+	}
+
+	std::shared_ptr<DrawContext> context = std::make_shared<DrawContext>(realDevice.get());
+	std::shared_ptr<ResourceContext> resourceContext = std::make_shared<ResourceContext>(realDevice.get());
+
+	//The data is already in the upload ring so the streams and indices the application set are left alone.
+	auto& uploadDraw = realDevice->mUploadDraw;
+	uploadDraw.IsActive = true;
+	uploadDraw.Buffer = realDevice->mUploadBuffers[uploadBufferIndex].Buffer;
+	uploadDraw.VertexOffset = vertexOffset;
+	uploadDraw.VertexStride = vertexStride;
+	uploadDraw.IndexOffset = indexOffset;
+	uploadDraw.IndexType = (indexDataFormat == D3DFMT_INDEX16) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+
+	BeginDraw(realDevice, context, resourceContext, PrimitiveType);
+
+	currentBuffer.drawIndexed(ConvertPrimitiveCountToVertexCount(PrimitiveType, PrimitiveCount), 1, 0, 0, 0);
+
+	uploadDraw.IsActive = false;
+	realDevice->mIsDirty = true; //The next draw has to bind the application's buffers again.
+}
+
+void RenderManager::DrawPrimitiveUP(std::shared_ptr<RealDevice> realDevice, D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, size_t uploadBufferIndex, UINT vertexOffset, UINT vertexStride)
+{
+	auto& currentBuffer = realDevice->mCommandBuffers[realDevice->mCurrentCommandBuffer];
+
+	if (uploadBufferIndex >= realDevice->mUploadBuffers.size())
+	{
+		BOOST_LOG_TRIVIAL(warning) << "RenderManager::DrawPrimitiveUP called with invalid upload buffer " << uploadBufferIndex;
+		return;
+	}
+
+	if (!realDevice->mDeviceState.mRenderTarget->mIsSceneStarted)
+	{
+		this->StartScene(realDevice, false);
+	}
+
+	std::shared_ptr<DrawContext> context = std::make_shared<DrawContext>(realDevice.get());
+	std::shared_ptr<ResourceContext> resourceContext = std::make_shared<ResourceContext>(realDevice.get());
+
+	//The data is already in the upload ring so the streams the application set are left alone.
+	auto& uploadDraw = realDevice->mUploadDraw;
+	uploadDraw.IsActive = true;
+	uploadDraw.Buffer = realDevice->mUploadBuffers[uploadBufferIndex].Buffer;
+	uploadDraw.VertexOffset = vertexOffset;
+	uploadDraw.VertexStride = vertexStride;
+	uploadDraw.IndexOffset = VK_WHOLE_SIZE;
+
+	BeginDraw(realDevice, context, resourceContext, PrimitiveType);
+
+	currentBuffer.draw(ConvertPrimitiveCountToVertexCount(PrimitiveType, PrimitiveCount), 1, 0, 0);
+
+	uploadDraw.IsActive = false;
+	realDevice->mIsDirty = true; //The next draw has to bind the application's buffers again.
+}
+
+static size_t GetTextureId(IDirect3DBaseTexture9* texture)
+{
+	switch (texture->GetType())
+	{
+	case D3DRTYPE_CUBETEXTURE:
+		return ((CCubeTexture9*)texture)->mId;
+	case D3DRTYPE_VOLUMETEXTURE:
+		return ((CVolumeTexture9*)texture)->mId;
+	default:
+		return ((CTexture9*)texture)->mId;
+	}
+}
+
+vk::Image RenderManager::GetSurfaceImage(CSurface9* surface9)
+{
+	if (surface9->mTexture != nullptr || surface9->mCubeTexture != nullptr)
+	{
+		return mStateManager.mTextures[surface9->mTextureId]->mImage;
+	}
+
+	return mStateManager.mSurfaces[surface9->mId]->mStagingImage;
+}
+
+void RenderManager::UpdateSurface(std::shared_ptr<RealDevice> realDevice, CSurface9* pSourceSurface, const RECT& sourceRect, CSurface9* pDestinationSurface, uint32_t x, uint32_t y)
+{
+	//Texture levels live in their texture's image, anything else has an image of its own.
+	vk::Image sourceImage = GetSurfaceImage(pSourceSurface);
+	vk::Image targetImage = GetSurfaceImage(pDestinationSurface);
+	if (!sourceImage || !targetImage)
+	{
+		return;
+	}
+
+	const uint32_t sourceMip = pSourceSurface->mMipIndex;
+	const uint32_t sourceLayer = pSourceSurface->mTargetLayer;
+	const uint32_t targetMip = pDestinationSurface->mMipIndex;
+	const uint32_t targetLayer = pDestinationSurface->mTargetLayer;
+
+	/*
+	The copy goes into the upload batch behind the flush that put the source contents in place, or between the draws if the frame already used either surface.
+	Both images are put back the way they were found.
+	*/
+	vk::CommandBuffer commandBuffer = GetCopyCommandBuffer(realDevice, IsUsedInFrame(realDevice, pSourceSurface) || IsUsedInFrame(realDevice, pDestinationSurface));
+
+	auto& imageLayoutTracker = realDevice->mImageLayoutTracker;
+	vk::ImageLayout sourceLayout = imageLayoutTracker.GetLayout(sourceImage, sourceMip, sourceLayer);
+	vk::ImageLayout targetLayout = imageLayoutTracker.GetLayout(targetImage, targetMip, targetLayer);
+
+	vk::ImageCopy region;
+	region.srcSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, sourceMip, sourceLayer, 1);
+	region.srcOffset = vk::Offset3D(sourceRect.left, sourceRect.top, 0);
+	region.dstSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, targetMip, targetLayer, 1);
+	region.dstOffset = vk::Offset3D((int32_t)x, (int32_t)y, 0);
+	region.extent = vk::Extent3D((uint32_t)(sourceRect.right - sourceRect.left), (uint32_t)(sourceRect.bottom - sourceRect.top), 1);
+
+	const bool isWholeLevel = (x == 0 && y == 0 && region.extent.width == pDestinationSurface->mWidth && region.extent.height == pDestinationSurface->mHeight);
+
+	imageLayoutTracker.Transition(commandBuffer, sourceImage, vk::ImageLayout::eTransferSrcOptimal, 1, sourceMip, 1, sourceLayer);
+	imageLayoutTracker.Transition(commandBuffer, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, targetMip, 1, targetLayer, isWholeLevel);
+	imageLayoutTracker.Flush(commandBuffer);
+
+	commandBuffer.copyImage(sourceImage, vk::ImageLayout::eTransferSrcOptimal, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+
+	if (sourceLayout != vk::ImageLayout::eUndefined && sourceLayout != vk::ImageLayout::ePreinitialized)
+	{
+		imageLayoutTracker.Transition(commandBuffer, sourceImage, sourceLayout, 1, sourceMip, 1, sourceLayer);
+	}
+	if (targetLayout != vk::ImageLayout::eUndefined && targetLayout != vk::ImageLayout::ePreinitialized)
+	{
+		imageLayoutTracker.Transition(commandBuffer, targetImage, targetLayout, 1, targetMip, 1, targetLayer);
+	}
+	imageLayoutTracker.Flush(commandBuffer);
+}
+
 void RenderManager::UpdateTexture(std::shared_ptr<RealDevice> realDevice, IDirect3DBaseTexture9* pSourceTexture, IDirect3DBaseTexture9* pDestinationTexture)
 {
 	if (pSourceTexture == nullptr || pDestinationTexture == nullptr)
@@ -256,121 +419,510 @@ void RenderManager::UpdateTexture(std::shared_ptr<RealDevice> realDevice, IDirec
 		return;
 	}
 
-	auto& device = realDevice->mDevice;
+	auto& source = (*mStateManager.mTextures[GetTextureId(pSourceTexture)]);
+	auto& target = (*mStateManager.mTextures[GetTextureId(pDestinationTexture)]);
+	if (!source.mImage || !target.mImage)
+	{
+		return;
+	}
 
-	vk::CommandBuffer commandBuffer;
-	vk::Result result;
+	const uint32_t sourceLevels = source.mImageCreateInfo.mipLevels;
+	const uint32_t targetLevels = target.mImageCreateInfo.mipLevels;
+	if (sourceLevels < targetLevels)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "RenderManager::UpdateTexture the source has fewer levels than the destination.";
+		return;
+	}
 
-	vk::CommandBufferAllocateInfo commandBufferInfo = {};
-	commandBufferInfo.commandPool = realDevice->mCommandPool;
-	commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
-	commandBufferInfo.commandBufferCount = 1;
+	//The destination levels line up with the source levels of the same size. An automatically generated chain only gets its top level and is rebuilt from it.
+	const uint32_t levelOffset = sourceLevels - targetLevels;
+	const bool isAutoGenerated = ((target.mUsage & D3DUSAGE_AUTOGENMIPMAP) == D3DUSAGE_AUTOGENMIPMAP);
+	const uint32_t levelCount = isAutoGenerated ? 1 : targetLevels;
+	const uint32_t layerCount = std::min(source.mImageCreateInfo.arrayLayers, target.mImageCreateInfo.arrayLayers);
+	const bool isVolume = (source.mImageCreateInfo.imageType == vk::ImageType::e3D);
+	const uint32_t blockSize = GetFormatBlockSize(source.mFormat);
 
-	result = device.allocateCommandBuffers(&commandBufferInfo, &commandBuffer);
-	if (result != vk::Result::eSuccess)
+	/*
+	Only what has been marked dirty since the last update is copied. The regions are in top level texels so each level gets them scaled down.
+	They are rounded out to whole blocks for compressed formats, a block that runs past the edge of a small level is clamped to it.
+	*/
+	boost::container::small_vector<vk::ImageCopy, 16> regions;
+	for (uint32_t layer = 0; layer < layerCount; layer++)
+	{
+		auto& dirtyRegions = source.mDirtyRegions[layer];
+		for (auto& dirtyRegion : dirtyRegions)
+		{
+			for (uint32_t level = 0; level < levelCount; level++)
+			{
+				const uint32_t sourceLevel = level + levelOffset;
+				const uint32_t mask = (1 << sourceLevel) - 1;
+				const uint32_t width = std::max(source.mExtent.width >> sourceLevel, (uint32_t)1);
+				const uint32_t height = std::max(source.mExtent.height >> sourceLevel, (uint32_t)1);
+				const uint32_t depth = std::max(source.mExtent.depth >> sourceLevel, (uint32_t)1);
+
+				uint32_t left = (dirtyRegion.Left >> sourceLevel) / blockSize * blockSize;
+				uint32_t top = (dirtyRegion.Top >> sourceLevel) / blockSize * blockSize;
+				uint32_t right = std::min((((dirtyRegion.Right + mask) >> sourceLevel) + blockSize - 1) / blockSize * blockSize, width);
+				uint32_t bottom = std::min((((dirtyRegion.Bottom + mask) >> sourceLevel) + blockSize - 1) / blockSize * blockSize, height);
+				uint32_t front = isVolume ? (dirtyRegion.Front >> sourceLevel) : 0;
+				uint32_t back = isVolume ? std::min((dirtyRegion.Back + mask) >> sourceLevel, depth) : 1;
+
+				if (right <= left || bottom <= top || back <= front)
+				{
+					continue;
+				}
+
+				vk::ImageCopy region;
+				region.srcSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, sourceLevel, layer, 1);
+				region.srcOffset = vk::Offset3D((int32_t)left, (int32_t)top, (int32_t)front);
+				region.dstSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, layer, 1);
+				region.dstOffset = region.srcOffset;
+				region.extent = vk::Extent3D(right - left, bottom - top, back - front);
+				regions.push_back(region);
+			}
+		}
+		dirtyRegions.clear();
+	}
+
+	if (regions.empty())
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RenderManager::UpdateTexture vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
-	vk::CommandBufferInheritanceInfo commandBufferInheritanceInfo;
-	commandBufferInheritanceInfo.renderPass = nullptr;
-	commandBufferInheritanceInfo.subpass = 0;
-	commandBufferInheritanceInfo.framebuffer = nullptr;
-	commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
-	//commandBufferInheritanceInfo.queryFlags = 0;
-	//commandBufferInheritanceInfo.pipelineStatistics = 0;
+	//The copies go into the upload batch which goes out ahead of the frame, unless the frame already drew with either texture and they have to follow those draws.
+	vk::CommandBuffer commandBuffer = GetCopyCommandBuffer(realDevice, IsUsedInFrame(realDevice, source) || IsUsedInFrame(realDevice, target));
 
-	vk::CommandBufferBeginInfo commandBufferBeginInfo;
-	//commandBufferBeginInfo.flags = 0;
-	commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
+	auto& imageLayoutTracker = realDevice->mImageLayoutTracker;
+	imageLayoutTracker.Transition(commandBuffer, source.mImage, vk::ImageLayout::eTransferSrcOptimal, levelCount, levelOffset, layerCount, 0);
+	imageLayoutTracker.Transition(commandBuffer, target.mImage, vk::ImageLayout::eTransferDstOptimal, levelCount, 0, layerCount, 0);
+	imageLayoutTracker.Flush(commandBuffer);
 
-	result = commandBuffer.begin(&commandBufferBeginInfo);
-	if (result != vk::Result::eSuccess)
+	commandBuffer.copyImage(source.mImage, vk::ImageLayout::eTransferSrcOptimal, target.mImage, vk::ImageLayout::eTransferDstOptimal, (uint32_t)regions.size(), regions.data());
+
+	if (isAutoGenerated)
+	{
+		realDevice->GenerateMipSubLevels(commandBuffer, target.mImage, target.mRealFormat, target.mExtent, targetLevels, layerCount, 0, ConvertFilter(pDestinationTexture->GetAutoGenFilterType()));
+	}
+
+	imageLayoutTracker.Transition(commandBuffer, source.mImage, vk::ImageLayout::eShaderReadOnlyOptimal, levelCount, levelOffset, layerCount, 0);
+	imageLayoutTracker.Transition(commandBuffer, target.mImage, vk::ImageLayout::eShaderReadOnlyOptimal);
+	imageLayoutTracker.Flush(commandBuffer);
+}
+
+void RenderManager::StretchRect(std::shared_ptr<RealDevice> realDevice, CSurface9* pSourceSurface, const RECT& sourceRect, CSurface9* pDestSurface, const RECT& destRect, D3DTEXTUREFILTERTYPE filter)
+{
+	auto& source = (*mStateManager.mSurfaces[pSourceSurface->mId]);
+	auto& target = (*mStateManager.mSurfaces[pDestSurface->mId]);
+
+	vk::Image sourceImage = GetSurfaceImage(pSourceSurface);
+	vk::Image targetImage = GetSurfaceImage(pDestSurface);
+	if (!sourceImage || !targetImage)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RenderManager::UpdateTexture vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
-	//TODO: Handle dirty regions and multiple mip levels.
+	uint32_t sourceMip = pSourceSurface->mMipIndex;
+	uint32_t sourceLayer = pSourceSurface->mTargetLayer;
+	const uint32_t targetMip = pDestSurface->mMipIndex;
+	const uint32_t targetLayer = pDestSurface->mTargetLayer;
+	const vk::ImageAspectFlags aspectMask = source.mSubresource.aspectMask;
+
+	const int32_t sourceWidth = sourceRect.right - sourceRect.left;
+	const int32_t sourceHeight = sourceRect.bottom - sourceRect.top;
+	const int32_t targetWidth = destRect.right - destRect.left;
+	const int32_t targetHeight = destRect.bottom - destRect.top;
+	const bool isScaled = (sourceWidth != targetWidth || sourceHeight != targetHeight);
+	const bool isWholeTarget = (destRect.left == 0 && destRect.top == 0 && targetWidth == (int32_t)pDestSurface->mWidth && targetHeight == (int32_t)pDestSurface->mHeight);
+
+	/*
+	A multisampled source is resolved straight into the target when nothing has to be scaled or converted.
+	Otherwise the blit reads the single sample copy the render pass resolves into at the end of every scene.
+	*/
+	bool isResolve = false;
+	if (source.mSamples != vk::SampleCountFlagBits::e1)
+	{
+		if (!isScaled && source.mRealFormat == target.mRealFormat && target.mSamples == vk::SampleCountFlagBits::e1 && aspectMask == vk::ImageAspectFlagBits::eColor)
+		{
+			isResolve = true;
+		}
+		else if (source.mResolveImage)
+		{
+			sourceImage = source.mResolveImage;
+			sourceMip = 0;
+			sourceLayer = 0;
+		}
+		else
+		{
+			BOOST_LOG_TRIVIAL(warning) << "RenderManager::StretchRect multisampled depth surfaces can't be stretched.";
+			return;
+		}
+	}
+
+	const bool isCopy = (!isResolve && !isScaled && source.mRealFormat == target.mRealFormat && target.mSamples == vk::SampleCountFlagBits::e1);
 
-	std::shared_ptr<RealTexture> source;
-	std::shared_ptr<RealTexture> target;
-	uint32_t width = 0;
-	uint32_t height = 0;
+	const vk::FormatFeatureFlags sourceFeatures = realDevice->mPhysicalDevice.getFormatProperties(source.mRealFormat).optimalTilingFeatures;
+	const vk::FormatFeatureFlags targetFeatures = realDevice->mPhysicalDevice.getFormatProperties(target.mRealFormat).optimalTilingFeatures;
+	if (!isResolve && !isCopy && (target.mSamples != vk::SampleCountFlagBits::e1 || !(sourceFeatures & vk::FormatFeatureFlagBits::eBlitSrc) || !(targetFeatures & vk::FormatFeatureFlagBits::eBlitDst)))
+	{
+		BOOST_LOG_TRIVIAL(warning) << "RenderManager::StretchRect can't blit from " << (VkFormat)source.mRealFormat << " to " << (VkFormat)target.mRealFormat;
+		return;
+	}
+
+	//Depth can only be blit with nearest and linear needs the format to support it.
+	vk::Filter realFilter = ConvertFilter(filter);
+	if (aspectMask != vk::ImageAspectFlagBits::eColor || !(sourceFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear))
+	{
+		realFilter = vk::Filter::eNearest;
+	}
 
-	if (pDestinationTexture->GetType() != D3DRTYPE_CUBETEXTURE)
+	//The copy is part of the frame so it lands between the draws that come before and after it.
+	vk::CommandBuffer commandBuffer = GetFrameCommandBuffer(realDevice);
+	if (!commandBuffer)
 	{
-		CTexture9& target9 = (*(CTexture9*)pDestinationTexture);
-		target = mStateManager.mTextures[target9.mId];
+		return;
+	}
+
+	auto& imageLayoutTracker = realDevice->mImageLayoutTracker;
+	imageLayoutTracker.Transition(commandBuffer, sourceImage, vk::ImageLayout::eTransferSrcOptimal, 1, sourceMip, 1, sourceLayer);
+	imageLayoutTracker.Transition(commandBuffer, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, targetMip, 1, targetLayer, isWholeTarget);
+	imageLayoutTracker.Flush(commandBuffer);
+
+	const vk::ImageSubresourceLayers sourceSubresource(aspectMask, sourceMip, sourceLayer, 1);
+	const vk::ImageSubresourceLayers targetSubresource(aspectMask, targetMip, targetLayer, 1);
 
-		ReallySetImageLayout(commandBuffer, target->mImage, vk::ImageAspectFlags(), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1, 0, 1);
+	if (isResolve)
+	{
+		vk::ImageResolve region;
+		region.srcSubresource = sourceSubresource;
+		region.srcOffset = vk::Offset3D(sourceRect.left, sourceRect.top, 0);
+		region.dstSubresource = targetSubresource;
+		region.dstOffset = vk::Offset3D(destRect.left, destRect.top, 0);
+		region.extent = vk::Extent3D((uint32_t)sourceWidth, (uint32_t)sourceHeight, 1);
+
+		commandBuffer.resolveImage(sourceImage, vk::ImageLayout::eTransferSrcOptimal, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+	}
+	else if (isCopy)
+	{
+		vk::ImageCopy region;
+		region.srcSubresource = sourceSubresource;
+		region.srcOffset = vk::Offset3D(sourceRect.left, sourceRect.top, 0);
+		region.dstSubresource = targetSubresource;
+		region.dstOffset = vk::Offset3D(destRect.left, destRect.top, 0);
+		region.extent = vk::Extent3D((uint32_t)sourceWidth, (uint32_t)sourceHeight, 1);
+
+		commandBuffer.copyImage(sourceImage, vk::ImageLayout::eTransferSrcOptimal, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, &region);
 	}
 	else
 	{
-		CCubeTexture9& target9 = (*(CCubeTexture9*)pDestinationTexture);
-		target = mStateManager.mTextures[target9.mId];
+		vk::ImageBlit region;
+		region.srcSubresource = sourceSubresource;
+		region.srcOffsets[0] = vk::Offset3D(sourceRect.left, sourceRect.top, 0);
+		region.srcOffsets[1] = vk::Offset3D(sourceRect.right, sourceRect.bottom, 1);
+		region.dstSubresource = targetSubresource;
+		region.dstOffsets[0] = vk::Offset3D(destRect.left, destRect.top, 0);
+		region.dstOffsets[1] = vk::Offset3D(destRect.right, destRect.bottom, 1);
+
+		commandBuffer.blitImage(sourceImage, vk::ImageLayout::eTransferSrcOptimal, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, &region, realFilter);
+	}
+
+	//StartScene and BeginDraw move the images back into the layouts they need.
+	target.mStagingFrame = realDevice->mFrameNumber;
+}
+
+void RenderManager::ColorFill(std::shared_ptr<RealDevice> realDevice, CSurface9* pSurface, const RECT& rect, D3DCOLOR color)
+{
+	auto& surface = (*mStateManager.mSurfaces[pSurface->mId]);
+	auto& renderTarget = realDevice->mDeviceState.mRenderTarget;
 
-		ReallySetImageLayout(commandBuffer, target->mImage, vk::ImageAspectFlags(), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1, 0, 6);
+	vk::Image image = GetSurfaceImage(pSurface);
+	if (!image)
+	{
+		return;
 	}
 
-	if (pSourceTexture->GetType() == D3DRTYPE_CUBETEXTURE)
+	const uint32_t mipIndex = pSurface->mMipIndex;
+	const uint32_t layerIndex = pSurface->mTargetLayer;
+	const uint32_t width = (uint32_t)(rect.right - rect.left);
+	const uint32_t height = (uint32_t)(rect.bottom - rect.top);
+	const bool isWholeSurface = (rect.left == 0 && rect.top == 0 && width == pSurface->mWidth && height == pSurface->mHeight);
+
+	//Clear values are always rgba whatever order the format stores them in.
+	vk::ClearColorValue clearColorValue;
+	clearColorValue.float32[0] = D3DCOLOR_R(color);
+	clearColorValue.float32[1] = D3DCOLOR_G(color);
+	clearColorValue.float32[2] = D3DCOLOR_B(color);
+	clearColorValue.float32[3] = D3DCOLOR_A(color);
+
+	//Part of the render target is cleared inside of the pass so the scene doesn't have to be split. Unlike Clear the viewport doesn't apply.
+	if (!isWholeSurface && renderTarget->mColorSurface == &surface)
 	{
-		CCubeTexture9& source9 = (*(CCubeTexture9*)pSourceTexture);
-		source = mStateManager.mTextures[source9.mId];
+		if (!renderTarget->mIsSceneStarted)
+		{
+			this->StartScene(realDevice, false);
+		}
+
+		vk::ClearAttachment clearAttachment;
+		clearAttachment.aspectMask = vk::ImageAspectFlagBits::eColor;
+		clearAttachment.colorAttachment = 0;
+		clearAttachment.clearValue.color = clearColorValue;
 
-		ReallySetImageLayout(commandBuffer, source->mImage, vk::ImageAspectFlags(), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal, 1, 0, 6);
-		ReallyCopyImage(commandBuffer, source->mImage, target->mImage, 0, 0, source9.mEdgeLength, source9.mEdgeLength, 1, 0, 0, 0, 0);
+		vk::ClearRect clearRect;
+		clearRect.rect.offset = vk::Offset2D(rect.left, rect.top);
+		clearRect.rect.extent = vk::Extent2D(width, height);
+		clearRect.baseArrayLayer = 0;
+		clearRect.layerCount = 1;
+
+		realDevice->mCommandBuffers[realDevice->mCurrentCommandBuffer].clearAttachments(1, &clearAttachment, 1, &clearRect);
+		return;
 	}
-	else if (pSourceTexture->GetType() == D3DRTYPE_VOLUMETEXTURE)
+
+	vk::CommandBuffer commandBuffer = GetFrameCommandBuffer(realDevice);
+	if (!commandBuffer)
 	{
-		CVolumeTexture9& source9 = (*(CVolumeTexture9*)pSourceTexture);
-		source = mStateManager.mTextures[source9.mId];
+		return;
+	}
 
-		ReallySetImageLayout(commandBuffer, source->mImage, vk::ImageAspectFlags(), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal, 1, 0, 1);
-		ReallyCopyImage(commandBuffer, source->mImage, target->mImage, 0, 0, source9.mWidth, source9.mHeight, source9.mDepth, 0, 0, 0, 0);
+	auto& imageLayoutTracker = realDevice->mImageLayoutTracker;
+
+	if (isWholeSurface)
+	{
+		//Everything is overwritten so the old contents can be discarded. A multisampled surface also clears the copy stretches read from.
+		vk::ImageSubresourceRange subresourceRange(vk::ImageAspectFlagBits::eColor, mipIndex, 1, layerIndex, 1);
+
+		imageLayoutTracker.Transition(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, 1, mipIndex, 1, layerIndex, true);
+		if (surface.mResolveImage)
+		{
+			imageLayoutTracker.Transition(commandBuffer, surface.mResolveImage, vk::ImageLayout::eTransferDstOptimal, 1, 0, 1, 0, true);
+		}
+		imageLayoutTracker.Flush(commandBuffer);
+
+		commandBuffer.clearColorImage(image, vk::ImageLayout::eTransferDstOptimal, &clearColorValue, 1, &subresourceRange);
+		if (surface.mResolveImage)
+		{
+			subresourceRange.baseMipLevel = 0;
+			subresourceRange.baseArrayLayer = 0;
+			commandBuffer.clearColorImage(surface.mResolveImage, vk::ImageLayout::eTransferDstOptimal, &clearColorValue, 1, &subresourceRange);
+		}
 	}
 	else
 	{
-		CTexture9& source9 = (*(CTexture9*)pSourceTexture);
-		source = mStateManager.mTextures[source9.mId];
+		/*
+		vkCmdClearColorImage can only clear whole subresources so part of any other surface is filled from a buffer.
+		Only 32 bit color formats can be filled with vkCmdFillBuffer, the D3DCOLOR already has the byte order of B8G8R8A8.
+		*/
+		uint32_t texel = 0;
+		switch (surface.mRealFormat)
+		{
+		case vk::Format::eB8G8R8A8Unorm:
+			texel = color;
+			break;
+		case vk::Format::eR8G8B8A8Unorm:
+			texel = (color & 0xFF00FF00) | ((color & 0x00FF0000) >> 16) | ((color & 0x000000FF) << 16);
+			break;
+		default:
+			//CDevice9::ColorFill turns these down, a format the device had to substitute can still end up here.
+			BOOST_LOG_TRIVIAL(error) << "RenderManager::ColorFill can't fill part of a surface with format " << (VkFormat)surface.mRealFormat;
+			return;
+		}
+
+		//Every partial fill goes through the same buffer. It only grows, the one it replaces lives until the frames copying out of it are finished.
+		const vk::DeviceSize size = (vk::DeviceSize)width * height * sizeof(uint32_t);
+		if (size > realDevice->mFillBufferSize)
+		{
+			realDevice->mGarbageManager.Retire(realDevice->mFillBuffer);
+			realDevice->mGarbageManager.Retire(realDevice->mFillBufferAllocation);
+			realDevice->mFillBuffer = vk::Buffer();
+			realDevice->mFillBufferSize = 0;
+
+			realDevice->CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, realDevice->mFillBuffer, realDevice->mFillBufferAllocation);
+			if (!realDevice->mFillBuffer || !realDevice->mFillBufferAllocation.Memory)
+			{
+				return;
+			}
+			realDevice->mFillBufferSize = size;
+		}
+		vk::Buffer buffer = realDevice->mFillBuffer;
+
+		//The last copy out of the buffer has to finish reading it before it is filled again.
+		vk::BufferMemoryBarrier bufferMemoryBarrier;
+		bufferMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+		bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferMemoryBarrier.buffer = buffer;
+		bufferMemoryBarrier.offset = 0;
+		bufferMemoryBarrier.size = size;
+		imageLayoutTracker.mBarrierBatch.Add(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, bufferMemoryBarrier);
+		imageLayoutTracker.Flush(commandBuffer);
+
+		commandBuffer.fillBuffer(buffer, 0, size, texel);
+
+		bufferMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		bufferMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+		imageLayoutTracker.mBarrierBatch.Add(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, bufferMemoryBarrier);
+
+		imageLayoutTracker.Transition(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, 1, mipIndex, 1, layerIndex);
+		imageLayoutTracker.Flush(commandBuffer);
+
+		vk::BufferImageCopy region;
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mipIndex, layerIndex, 1);
+		region.imageOffset = vk::Offset3D(rect.left, rect.top, 0);
+		region.imageExtent = vk::Extent3D(width, height, 1);
+
+		commandBuffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+	}
+
+	surface.mStagingFrame = realDevice->mFrameNumber;
+}
+
+void RenderManager::GetRenderTargetData(std::shared_ptr<RealDevice> realDevice, CSurface9* pRenderTarget, CSurface9* pDestSurface)
+{
+	auto& source = (*mStateManager.mSurfaces[pRenderTarget->mId]);
+	auto& target = (*mStateManager.mSurfaces[pDestSurface->mId]);
+
+	vk::Image sourceImage = GetSurfaceImage(pRenderTarget);
+	vk::Image targetImage = target.mStagingImage;
+	if (!sourceImage || !targetImage)
+	{
+		return;
+	}
+
+	const uint32_t sourceMip = pRenderTarget->mMipIndex;
+	const uint32_t sourceLayer = pRenderTarget->mTargetLayer;
 
-		ReallySetImageLayout(commandBuffer, source->mImage, vk::ImageAspectFlags(), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal, 1, 0, 1);
-		ReallyCopyImage(commandBuffer, source->mImage, target->mImage, 0, 0, source9.mWidth, source9.mHeight, 1, 0, 0, 0, 0);
+	/*
+	The copy is recorded into the frame instead of being submitted and waited on here.
+	The application only has to wait when it locks the destination and then only for this frame.
+	*/
+	vk::CommandBuffer commandBuffer = GetFrameCommandBuffer(realDevice);
+	if (!commandBuffer)
+	{
+		return;
 	}
 
-	if (pDestinationTexture->GetType() != D3DRTYPE_CUBETEXTURE)
+	auto& imageLayoutTracker = realDevice->mImageLayoutTracker;
+	imageLayoutTracker.Transition(commandBuffer, sourceImage, vk::ImageLayout::eTransferSrcOptimal, 1, sourceMip, 1, sourceLayer);
+	imageLayoutTracker.Transition(commandBuffer, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, 0, 1, 0, true);
+	imageLayoutTracker.Flush(commandBuffer);
+
+	const vk::ImageSubresourceLayers sourceSubresource(vk::ImageAspectFlagBits::eColor, sourceMip, sourceLayer, 1);
+	const vk::ImageSubresourceLayers targetSubresource(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+	const vk::Extent3D extent(std::min(pRenderTarget->mWidth, pDestSurface->mWidth), std::min(pRenderTarget->mHeight, pDestSurface->mHeight), 1);
+
+	if (source.mSamples != vk::SampleCountFlagBits::e1)
 	{
-		ReallySetImageLayout(commandBuffer, target->mImage, vk::ImageAspectFlags(), vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, 1, 0, 1);
+		vk::ImageResolve region;
+		region.srcSubresource = sourceSubresource;
+		region.dstSubresource = targetSubresource;
+		region.extent = extent;
+
+		commandBuffer.resolveImage(sourceImage, vk::ImageLayout::eTransferSrcOptimal, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, &region);
 	}
 	else
 	{
-		ReallySetImageLayout(commandBuffer, target->mImage, vk::ImageAspectFlags(), vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, 1, 0, 6);
+		vk::ImageCopy region;
+		region.srcSubresource = sourceSubresource;
+		region.dstSubresource = targetSubresource;
+		region.extent = extent;
+
+		commandBuffer.copyImage(sourceImage, vk::ImageLayout::eTransferSrcOptimal, targetImage, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+	}
+
+	target.mStagingFrame = realDevice->mFrameNumber;
+}
+
+vk::CommandBuffer RenderManager::GetFrameCommandBuffer(std::shared_ptr<RealDevice> realDevice)
+{
+	auto& deviceState = realDevice->mDeviceState;
+	auto& currentBuffer = realDevice->mCommandBuffers[realDevice->mCurrentCommandBuffer];
+
+	//Transfers can't be recorded inside of a render pass. The next draw starts the store pass again so nothing drawn so far is lost.
+	if (deviceState.mRenderTarget->mIsSceneStarted)
+	{
+		this->StopScene(realDevice);
+	}
+	else if (deviceState.hasPresented)
+	{
+		vk::Result result = currentBuffer.begin(&deviceState.mRenderTarget->mCommandBufferBeginInfo);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RenderManager::GetFrameCommandBuffer vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
+			return vk::CommandBuffer();
+		}
+		deviceState.hasPresented = false;
+	}
+
+	return currentBuffer;
+}
+
+vk::CommandBuffer RenderManager::GetCopyCommandBuffer(std::shared_ptr<RealDevice> realDevice, bool isUsedInFrame)
+{
+	/*
+	Copies go into the upload batch which runs ahead of the frame so they don't break up the render pass.
+	Once the frame has used an image a copy has to land behind those draws, and the layout tracker needs it in the same stream, so it goes into the frame command buffer instead.
+	*/
+	if (isUsedInFrame)
+	{
+		return GetFrameCommandBuffer(realDevice);
 	}
 
-	commandBuffer.end();
+	return realDevice->mTransferManager.GetCommandBuffer();
+}
+
+bool RenderManager::IsUsedInFrame(std::shared_ptr<RealDevice> realDevice, RealTexture& texture)
+{
+	//Sampling a texture that is already readable doesn't move it so BeginDraw's residency stamp is checked too.
+	return (texture.mLastUsedFrame == realDevice->mFrameNumber || realDevice->mImageLayoutTracker.IsUsedInFrame(texture.mImage));
+}
+
+bool RenderManager::IsUsedInFrame(std::shared_ptr<RealDevice> realDevice, CSurface9* surface9)
+{
+	if (surface9->mTexture != nullptr || surface9->mCubeTexture != nullptr)
+	{
+		return IsUsedInFrame(realDevice, (*mStateManager.mTextures[surface9->mTextureId]));
+	}
 
-	vk::CommandBuffer commandBuffers[] = { commandBuffer };
-	vk::Fence nullFence;
+	return realDevice->mImageLayoutTracker.IsUsedInFrame(mStateManager.mSurfaces[surface9->mId]->mStagingImage);
+}
+
+void RenderManager::SubmitFrame(std::shared_ptr<RealDevice> realDevice)
+{
+	auto& deviceState = realDevice->mDeviceState;
+	auto& currentBuffer = realDevice->mCommandBuffers[realDevice->mCurrentCommandBuffer];
+
+	//Nothing has been recorded since the last submit.
+	if (deviceState.hasPresented)
+	{
+		return;
+	}
+
+	if (deviceState.mRenderTarget->mIsSceneStarted)
+	{
+		this->StopScene(realDevice);
+	}
+
+	//Uploads go first just like they do for a present.
+	realDevice->mTransferManager.Submit();
+
+	realDevice->mImageLayoutTracker.Flush(currentBuffer);
+	currentBuffer.end();
 
 	vk::SubmitInfo submitInfo;
-	submitInfo.waitSemaphoreCount = 0;
-	submitInfo.pWaitSemaphores = NULL;
-	submitInfo.pWaitDstStageMask = NULL;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = commandBuffers;
-	submitInfo.signalSemaphoreCount = 0;
-	submitInfo.pSignalSemaphores = NULL;
+	submitInfo.pCommandBuffers = &currentBuffer;
 
-	result = realDevice->mQueue.submit(1, &submitInfo, nullFence);
+	vk::Result result = realDevice->mQueue.submit(1, &submitInfo, realDevice->mCommandBufferFences[realDevice->mCurrentCommandBuffer]);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RenderManager::UpdateTexture vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
-		return;
+		BOOST_LOG_TRIVIAL(fatal) << "RenderManager::SubmitFrame vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
 	}
 
-	realDevice->mQueue.waitIdle();
-	device.freeCommandBuffers(realDevice->mCommandPool, 1, commandBuffers);
+	//The rest of the frame is recorded into the other command buffer which the next draw begins.
+	deviceState.hasPresented = true;
+	realDevice->mIsDirty = true;
+	realDevice->EndFrame(result == vk::Result::eSuccess);
 }
 
 void RenderManager::BeginDraw(std::shared_ptr<RealDevice> realDevice, std::shared_ptr<DrawContext> context, std::shared_ptr<ResourceContext> resourceContext, D3DPRIMITIVETYPE type)
@@ -382,20 +934,12 @@ void RenderManager::BeginDraw(std::shared_ptr<RealDevice> realDevice, std::share
 	auto& deviceState = realDevice->mDeviceState;
 	auto& currentBuffer = realDevice->mCommandBuffers[realDevice->mCurrentCommandBuffer];
 
-	/**********************************************
-	* Update the stuff that need to be done outside of a render pass.
-	**********************************************/
-	if (deviceState.mAreLightsDirty || deviceState.mIsMaterialDirty)
-	{
-		currentBuffer.endRenderPass();
-		UpdateBuffer(realDevice);
-		currentBuffer.beginRenderPass(&realDevice->mDeviceState.mRenderTarget->mRenderPassBeginInfo, vk::SubpassContents::eInline);
-	}
-
 	/**********************************************
 	* Update the textures that are currently mapped.
 	**********************************************/
 	auto& samplerStates = deviceState.mSamplerStates;
+	auto& imageLayoutTracker = realDevice->mImageLayoutTracker;
+	boost::container::small_vector<vk::Image, 16> unreadableImages;
 
 	for (size_t i = 0; i < 16; i++)
 	{
@@ -405,22 +949,39 @@ void RenderManager::BeginDraw(std::shared_ptr<RealDevice> realDevice, std::share
 		{
 			std::shared_ptr<SamplerRequest> request = std::make_shared<SamplerRequest>(realDevice.get());
 			auto& currentSampler = samplerStates[request->SamplerIndex];
+			vk::Image image;
 
-			if (deviceState.mTextures[i]->GetType() == D3DRTYPE_CUBETEXTURE)
+			//All three kinds keep their image in a RealTexture, only the object that knows its id and level count differs.
+			switch (deviceState.mTextures[i]->GetType())
 			{
-				CCubeTexture9* texture9 = (CCubeTexture9*)deviceState.mTextures[i];
-				auto& texture = mStateManager.mTextures[texture9->mId];
-
-				request->MaxLod = texture9->mLevels;
-				targetSampler.imageView = texture->mImageView;
+			case D3DRTYPE_CUBETEXTURE:
+				request->MaxLod = ((CCubeTexture9*)deviceState.mTextures[i])->mLevels;
+				break;
+			case D3DRTYPE_VOLUMETEXTURE:
+				request->MaxLod = ((CVolumeTexture9*)deviceState.mTextures[i])->mLevels;
+				break;
+			default:
+				request->MaxLod = ((CTexture9*)deviceState.mTextures[i])->mLevels;
+				break;
 			}
-			else
+
+			auto& texture = mStateManager.mTextures[GetTextureId(deviceState.mTextures[i])];
+			realDevice->mResidencyManager.MakeResident((*texture), mStateManager.mSurfaces, realDevice->GetTexturePalette());
+
+			targetSampler.imageView = texture->mImageView;
+			image = texture->mImage;
+
+			//A texture that couldn't be restored samples the placeholder instead.
+			if (!image)
 			{
-				CTexture9* texture9 = (CTexture9*)deviceState.mTextures[i];
-				auto& texture = mStateManager.mTextures[texture9->mId];
+				targetSampler.imageView = realDevice->mImageView;
+				image = realDevice->mImage;
+			}
 
-				request->MaxLod = texture9->mLevels;
-				targetSampler.imageView = texture->mImageView;
+			//Textures that were rendered to or copied into have to be made readable outside of the render pass.
+			if (image != deviceState.mRenderTarget->mColorImage && !imageLayoutTracker.IsInLayout(image, vk::ImageLayout::eShaderReadOnlyOptimal))
+			{
+				unreadableImages.push_back(image);
 			}
 
 			request->MagFilter = (D3DTEXTUREFILTERTYPE)currentSampler[D3DSAMP_MAGFILTER];
@@ -458,21 +1019,37 @@ void RenderManager::BeginDraw(std::shared_ptr<RealDevice> realDevice, std::share
 			}
 
 			targetSampler.sampler = request->Sampler;
-			targetSampler.imageLayout = vk::ImageLayout::eGeneral;
+			targetSampler.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 		}
 		else
 		{
 			targetSampler.sampler = realDevice->mSampler;
 			targetSampler.imageView = realDevice->mImageView;
-			targetSampler.imageLayout = vk::ImageLayout::eGeneral;
+			targetSampler.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 		}
 
 	}
 
+	/**********************************************
+	* Update the stuff that need to be done outside of a render pass.
+	**********************************************/
+	if (deviceState.mAreLightsDirty || deviceState.mIsMaterialDirty || !unreadableImages.empty())
+	{
+		currentBuffer.endRenderPass();
+		UpdateBuffer(realDevice);
+		for (auto& image : unreadableImages)
+		{
+			imageLayoutTracker.Transition(currentBuffer, image, vk::ImageLayout::eShaderReadOnlyOptimal);
+		}
+		imageLayoutTracker.Flush(currentBuffer); //One barrier for the buffer updates and every texture.
+		currentBuffer.beginRenderPass(&realDevice->mDeviceState.mRenderTarget->mRenderPassBeginInfo, vk::SubpassContents::eInline);
+	}
+
 	/**********************************************
 	* Setup context.
 	**********************************************/
 	context->PrimitiveType = type;
+	context->Samples = deviceState.mRenderTarget->mSamples;
 
 	if (deviceState.mHasVertexDeclaration)
 	{
@@ -506,7 +1083,9 @@ void RenderManager::BeginDraw(std::shared_ptr<RealDevice> realDevice, std::share
 		context->mPixelShaderConstantSlots = deviceState.mPixelShaderConstantSlots;
 	}
 
-	context->StreamCount = deviceState.mStreamSources.size();
+	auto& uploadDraw = realDevice->mUploadDraw;
+
+	context->StreamCount = uploadDraw.IsActive ? 1 : deviceState.mStreamSources.size();
 	context->mSpecializationConstants = deviceState.mSpecializationConstants;
 
 	SpecializationConstants& constants = context->mSpecializationConstants;
@@ -531,16 +1110,28 @@ void RenderManager::BeginDraw(std::shared_ptr<RealDevice> realDevice, std::share
 	deviceState.mSpecializationConstants.lightCount = constants.lightCount;
 	deviceState.mSpecializationConstants.textureCount = constants.textureCount;
 
-	int i = 0;
-	BOOST_FOREACH(auto& source, deviceState.mStreamSources)
+	if (uploadDraw.IsActive)
 	{
-		realDevice->mVertexInputBindingDescription[i].binding = source.first;
-		realDevice->mVertexInputBindingDescription[i].stride = source.second.Stride;
-		realDevice->mVertexInputBindingDescription[i].inputRate = vk::VertexInputRate::eVertex;
+		//DrawPrimitiveUP always reads from stream zero.
+		realDevice->mVertexInputBindingDescription[0].binding = 0;
+		realDevice->mVertexInputBindingDescription[0].stride = uploadDraw.VertexStride;
+		realDevice->mVertexInputBindingDescription[0].inputRate = vk::VertexInputRate::eVertex;
 
-		context->Bindings[source.first] = source.second.Stride;
+		context->Bindings[0] = uploadDraw.VertexStride;
+	}
+	else
+	{
+		int i = 0;
+		BOOST_FOREACH(auto& source, deviceState.mStreamSources)
+		{
+			realDevice->mVertexInputBindingDescription[i].binding = source.first;
+			realDevice->mVertexInputBindingDescription[i].stride = source.second.Stride;
+			realDevice->mVertexInputBindingDescription[i].inputRate = vk::VertexInputRate::eVertex;
+
+			context->Bindings[source.first] = source.second.Stride;
 
-		i++;
+			i++;
+		}
 	}
 
 	/**********************************************
@@ -553,6 +1144,7 @@ void RenderManager::BeginDraw(std::shared_ptr<RealDevice> realDevice, std::share
 
 		if (drawBuffer.PrimitiveType == context->PrimitiveType
 			&& drawBuffer.StreamCount == context->StreamCount
+			&& drawBuffer.Samples == context->Samples
 
 			&& drawBuffer.VertexShader == context->VertexShader
 			&& drawBuffer.PixelShader == context->PixelShader
@@ -673,15 +1265,28 @@ void RenderManager::BeginDraw(std::shared_ptr<RealDevice> realDevice, std::share
 
 	realDevice->mVertexCount = 0;
 
+	if (uploadDraw.IsActive)
+	{
+		//The upload ring is only rewritten two frames later so there is nothing to track here.
+		currentBuffer.bindVertexBuffers(0, 1, &uploadDraw.Buffer, &uploadDraw.VertexOffset);
+		if (uploadDraw.IndexOffset != VK_WHOLE_SIZE)
+		{
+			currentBuffer.bindIndexBuffer(uploadDraw.Buffer, uploadDraw.IndexOffset, uploadDraw.IndexType);
+		}
+		return;
+	}
+
 	if (deviceState.mIndexBuffer != nullptr)
 	{
 		currentBuffer.bindIndexBuffer(deviceState.mIndexBuffer->mBuffer, 0, deviceState.mIndexBuffer->mIndexType);
+		deviceState.mIndexBuffer->mLastUsedFrame = realDevice->mFrameNumber;
 	}
 
 	BOOST_FOREACH(auto& source, deviceState.mStreamSources)
 	{
 		auto& buffer = mStateManager.mVertexBuffers[source.second.StreamData->mId];
 		currentBuffer.bindVertexBuffers(source.first, 1, &buffer->mBuffer, &source.second.OffsetInBytes);
+		buffer->mLastUsedFrame = realDevice->mFrameNumber;
 		realDevice->mVertexCount += source.second.StreamData->mSize;
 	}
 
@@ -792,6 +1397,7 @@ void RenderManager::CreatePipe(std::shared_ptr<RealDevice> realDevice, std::shar
 	SetCulling(realDevice->mPipelineRasterizationStateCreateInfo, (D3DCULL)constants.cullMode);
 	realDevice->mPipelineRasterizationStateCreateInfo.polygonMode = ConvertFillMode((D3DFILLMODE)constants.fillMode);
 	realDevice->mPipelineInputAssemblyStateCreateInfo.topology = ConvertPrimitiveType(context->PrimitiveType);
+	realDevice->mPipelineMultisampleStateCreateInfo.rasterizationSamples = context->Samples;
 
 	realDevice->mPipelineDepthStencilStateCreateInfo.depthTestEnable = constants.zEnable; //= VK_TRUE;
 	realDevice->mPipelineDepthStencilStateCreateInfo.depthWriteEnable = constants.zWriteEnable; //VK_TRUE;
@@ -42,7 +42,19 @@ struct RenderManager
 	void Present(std::shared_ptr<RealDevice> realDevice, const RECT *pSourceRect, const RECT *pDestRect, HWND hDestWindowOverride, const RGNDATA *pDirtyRegion);
 	void DrawIndexedPrimitive(std::shared_ptr<RealDevice> realDevice, D3DPRIMITIVETYPE Type, INT BaseVertexIndex, UINT MinIndex, UINT NumVertices, UINT StartIndex, UINT PrimitiveCount);
 	void DrawPrimitive(std::shared_ptr<RealDevice> realDevice, D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount);
+	void DrawIndexedPrimitiveUP(std::shared_ptr<RealDevice> realDevice, D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, size_t uploadBufferIndex, UINT vertexOffset, UINT vertexStride, UINT indexOffset, D3DFORMAT indexDataFormat);
+	void DrawPrimitiveUP(std::shared_ptr<RealDevice> realDevice, D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, size_t uploadBufferIndex, UINT vertexOffset, UINT vertexStride);
+	void UpdateSurface(std::shared_ptr<RealDevice> realDevice, CSurface9* pSourceSurface, const RECT& sourceRect, CSurface9* pDestinationSurface, uint32_t x, uint32_t y);
 	void UpdateTexture(std::shared_ptr<RealDevice> realDevice, IDirect3DBaseTexture9* pSourceTexture, IDirect3DBaseTexture9* pDestinationTexture);
+	vk::Image GetSurfaceImage(CSurface9* surface9);
+	void StretchRect(std::shared_ptr<RealDevice> realDevice, CSurface9* pSourceSurface, const RECT& sourceRect, CSurface9* pDestSurface, const RECT& destRect, D3DTEXTUREFILTERTYPE filter);
+	void ColorFill(std::shared_ptr<RealDevice> realDevice, CSurface9* pSurface, const RECT& rect, D3DCOLOR color);
+	void GetRenderTargetData(std::shared_ptr<RealDevice> realDevice, CSurface9* pRenderTarget, CSurface9* pDestSurface);
+	vk::CommandBuffer GetFrameCommandBuffer(std::shared_ptr<RealDevice> realDevice);
+	vk::CommandBuffer GetCopyCommandBuffer(std::shared_ptr<RealDevice> realDevice, bool isUsedInFrame);
+	bool IsUsedInFrame(std::shared_ptr<RealDevice> realDevice, RealTexture& texture);
+	bool IsUsedInFrame(std::shared_ptr<RealDevice> realDevice, CSurface9* surface9);
+	void SubmitFrame(std::shared_ptr<RealDevice> realDevice);
 
 	void BeginDraw(std::shared_ptr<RealDevice> realDevice, std::shared_ptr<DrawContext> context, std::shared_ptr<ResourceContext> resourceContext, D3DPRIMITIVETYPE type);
 	void CreatePipe(std::shared_ptr<RealDevice> realDevice, std::shared_ptr<DrawContext> context);
@@ -37,6 +37,7 @@ misrepresented as being the original software.
 #include "CQuery9.h"
 
 #include "Utilities.h"
+#include "FormatConverter.h"
 
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
@@ -217,6 +218,8 @@ void StateManager::CreateDevice(size_t id, void* argument1)
 		pfn_vkCmdPushDescriptorSetKHR = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(device->mDevice.getProcAddr("vkCmdPushDescriptorSetKHR"));
 	}
 
+	device9->mAvailableTextureMemory = device->GetAvailableTextureMemory();
+
 	mDevices.push_back(device);
 }
 
@@ -334,15 +337,23 @@ void StateManager::CreateVertexBuffer(size_t id, void* argument1)
 	CVertexBuffer9* vertexBuffer9 = bit_cast<CVertexBuffer9*>(argument1);
 	auto ptr = std::make_shared<RealVertexBuffer>(device.get());
 
+	/*
+	Dynamic and system memory buffers are rewritten by the application all the time so they stay host visible.
+	Everything else lives in device local memory and is filled from a staging buffer when it is unlocked.
+	*/
+	ptr->mIsDynamic = ((vertexBuffer9->mUsage & D3DUSAGE_DYNAMIC) == D3DUSAGE_DYNAMIC || vertexBuffer9->mPool == D3DPOOL_SYSTEMMEM || vertexBuffer9->mPool == D3DPOOL_SCRATCH);
+
+	ptr->mLength = vertexBuffer9->mLength;
+
 	vk::BufferCreateInfo bufferCreateInfo;
 	bufferCreateInfo.size = vertexBuffer9->mLength;
 	bufferCreateInfo.usage = vk::BufferUsageFlagBits::eVertexBuffer;
+	if (!ptr->mIsDynamic)
+	{
+		bufferCreateInfo.usage |= vk::BufferUsageFlagBits::eTransferDst;
+	}
 	//bufferCreateInfo.flags = 0;
 
-	vk::MemoryAllocateInfo memoryAllocateInfo;
-	memoryAllocateInfo.allocationSize = 0;
-	memoryAllocateInfo.memoryTypeIndex = 0;
-
 	result = device->mDevice.createBuffer(&bufferCreateInfo, nullptr, &ptr->mBuffer);
 	if (result != vk::Result::eSuccess)
 	{
@@ -352,18 +363,29 @@ void StateManager::CreateVertexBuffer(size_t id, void* argument1)
 
 	ptr->mMemoryRequirements = device->mDevice.getBufferMemoryRequirements(ptr->mBuffer);
 
-	memoryAllocateInfo.allocationSize = ptr->mMemoryRequirements.size;
-
-	GetMemoryTypeFromProperties(device->mPhysicalDeviceMemoryProperties, ptr->mMemoryRequirements.memoryTypeBits, (vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent), &memoryAllocateInfo.memoryTypeIndex);
+	if (ptr->mIsDynamic)
+	{
+		//Write only buffers can use host visible video memory (resizable BAR) if there is any, anything the application may read back wants cached memory.
+		vk::MemoryPropertyFlags preferredFlags = ((vertexBuffer9->mUsage & D3DUSAGE_WRITEONLY) == D3DUSAGE_WRITEONLY) ? vk::MemoryPropertyFlagBits::eDeviceLocal : vk::MemoryPropertyFlagBits::eHostCached;
+		result = device->mMemoryManager.Allocate(ptr->mMemoryRequirements, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, true, ptr->mAllocation, false, preferredFlags);
+	}
+	else
+	{
+		result = device->mMemoryManager.Allocate(ptr->mMemoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, true, ptr->mAllocation);
+	}
 
-	result = device->mDevice.allocateMemory(&memoryAllocateInfo, nullptr, &ptr->mMemory);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateVertexBuffer vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateVertexBuffer MemoryManager::Allocate failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
-	device->mDevice.bindBufferMemory(ptr->mBuffer, ptr->mMemory, 0);
+	device->mDevice.bindBufferMemory(ptr->mBuffer, ptr->mAllocation.Memory, ptr->mAllocation.Offset);
+
+	if (!ptr->mIsDynamic)
+	{
+		device->CreateBuffer(vertexBuffer9->mLength, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, ptr->mStagingBuffer, ptr->mStagingAllocation);
+	}
 
 	uint32_t attributeStride = 0;
 
@@ -444,15 +466,23 @@ void StateManager::CreateIndexBuffer(size_t id, void* argument1)
 	CIndexBuffer9* indexBuffer9 = bit_cast<CIndexBuffer9*>(argument1);
 	auto ptr = std::make_shared<RealIndexBuffer>(device.get());
 
+	/*
+	Dynamic and system memory buffers are rewritten by the application all the time so they stay host visible.
+	Everything else lives in device local memory and is filled from a staging buffer when it is unlocked.
+	*/
+	ptr->mIsDynamic = ((indexBuffer9->mUsage & D3DUSAGE_DYNAMIC) == D3DUSAGE_DYNAMIC || indexBuffer9->mPool == D3DPOOL_SYSTEMMEM || indexBuffer9->mPool == D3DPOOL_SCRATCH);
+
+	ptr->mLength = indexBuffer9->mLength;
+
 	vk::BufferCreateInfo bufferCreateInfo;
 	bufferCreateInfo.size = indexBuffer9->mLength;
 	bufferCreateInfo.usage = vk::BufferUsageFlagBits::eIndexBuffer;
+	if (!ptr->mIsDynamic)
+	{
+		bufferCreateInfo.usage |= vk::BufferUsageFlagBits::eTransferDst;
+	}
 	//bufferCreateInfo.flags = 0;
 
-	vk::MemoryAllocateInfo memoryAllocateInfo;
-	memoryAllocateInfo.allocationSize = 0;
-	memoryAllocateInfo.memoryTypeIndex = 0;
-
 	result = device->mDevice.createBuffer(&bufferCreateInfo, nullptr, &ptr->mBuffer);
 	if (result != vk::Result::eSuccess)
 	{
@@ -462,18 +492,29 @@ void StateManager::CreateIndexBuffer(size_t id, void* argument1)
 
 	ptr->mMemoryRequirements = device->mDevice.getBufferMemoryRequirements(ptr->mBuffer);
 
-	memoryAllocateInfo.allocationSize = ptr->mMemoryRequirements.size;
-
-	GetMemoryTypeFromProperties(device->mPhysicalDeviceMemoryProperties, ptr->mMemoryRequirements.memoryTypeBits, (vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent), &memoryAllocateInfo.memoryTypeIndex);
+	if (ptr->mIsDynamic)
+	{
+		//Write only buffers can use host visible video memory (resizable BAR) if there is any, anything the application may read back wants cached memory.
+		vk::MemoryPropertyFlags preferredFlags = ((indexBuffer9->mUsage & D3DUSAGE_WRITEONLY) == D3DUSAGE_WRITEONLY) ? vk::MemoryPropertyFlagBits::eDeviceLocal : vk::MemoryPropertyFlagBits::eHostCached;
+		result = device->mMemoryManager.Allocate(ptr->mMemoryRequirements, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, true, ptr->mAllocation, false, preferredFlags);
+	}
+	else
+	{
+		result = device->mMemoryManager.Allocate(ptr->mMemoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, true, ptr->mAllocation);
+	}
 
-	result = device->mDevice.allocateMemory(&memoryAllocateInfo, nullptr, &ptr->mMemory);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateIndexBuffer vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateIndexBuffer MemoryManager::Allocate failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
-	device->mDevice.bindBufferMemory(ptr->mBuffer, ptr->mMemory, 0);
+	device->mDevice.bindBufferMemory(ptr->mBuffer, ptr->mAllocation.Memory, ptr->mAllocation.Offset);
+
+	if (!ptr->mIsDynamic)
+	{
+		device->CreateBuffer(indexBuffer9->mLength, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, ptr->mStagingBuffer, ptr->mStagingAllocation);
+	}
 
 	switch (indexBuffer9->mFormat)
 	{
@@ -497,18 +538,20 @@ void StateManager::CreateIndexBuffer(size_t id, void* argument1)
 
 void StateManager::DestroyTexture(size_t id)
 {
-	mTextures[id]->mRealDevice->mEstimatedMemoryUsed -= mTextures[id]->mMemoryAllocateInfo.allocationSize;
 	mTextures[id].reset();
 }
 
-void StateManager::CreateTexture(size_t id, void* argument1)
+void StateManager::CreateTexture(size_t id, size_t key, void* argument1)
 {
 	vk::Result result;
 	auto device = mDevices[id];
 	CTexture9* texture9 = bit_cast<CTexture9*>(argument1);
 	std::shared_ptr<RealTexture> ptr = std::make_shared<RealTexture>(device.get());
+	StoreHandle(mTextures, key, ptr); //Stored up front so a create that fails still fills the slot the application was handed.
 
-	ptr->mRealFormat = ConvertFormat(texture9->mFormat);
+	//Formats the device can't sample are created in one it can and converted as they are uploaded.
+	FormatConversion conversion = GetFormatConversion(device->mPhysicalDevice, device->mPhysicalDeviceFeatures, texture9->mFormat);
+	ptr->mRealFormat = conversion.Format;
 
 	if (ptr->mRealFormat == vk::Format::eUndefined)//VK_FORMAT_UNDEFINED
 	{
@@ -525,7 +568,11 @@ void StateManager::CreateTexture(size_t id, void* argument1)
 	imageCreateInfo.arrayLayers = 1;
 	imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
 	imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
-	imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eColorAttachment;
+	imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc;
+	if ((texture9->mUsage & D3DUSAGE_RENDERTARGET) == D3DUSAGE_RENDERTARGET && device->mPhysicalDevice.getFormatProperties(conversion.Format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eColorAttachment) //Compressed and 24 bit images usually can't be rendered to.
+	{
+		imageCreateInfo.usage |= vk::ImageUsageFlagBits::eColorAttachment;
+	}
 	//imageCreateInfo.flags = 0;
 	imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined; //VK_IMAGE_LAYOUT_PREINITIALIZED;
 
@@ -543,22 +590,15 @@ void StateManager::CreateTexture(size_t id, void* argument1)
 	ptr->mMemoryAllocateInfo.memoryTypeIndex = 0;
 	ptr->mMemoryAllocateInfo.allocationSize = memoryRequirements.size;
 
-	device->mEstimatedMemoryUsed += memoryRequirements.size;
-
-	if (!GetMemoryTypeFromProperties(device->mPhysicalDeviceMemoryProperties, memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal, &ptr->mMemoryAllocateInfo.memoryTypeIndex))
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateTexture Could not find memory type from properties.";
-		return;
-	}
-
-	result = device->mDevice.allocateMemory(&ptr->mMemoryAllocateInfo, nullptr, &ptr->mDeviceMemory);
+	result = device->mResidencyManager.Allocate(memoryRequirements, ptr->mAllocation); //Evicts managed textures if video memory is full.
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateTexture vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateTexture ResidencyManager::Allocate failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
+	ptr->mMemoryAllocateInfo.memoryTypeIndex = ptr->mAllocation.MemoryTypeIndex;
 
-	device->mDevice.bindImageMemory(ptr->mImage, ptr->mDeviceMemory, 0);
+	device->mDevice.bindImageMemory(ptr->mImage, ptr->mAllocation.Memory, ptr->mAllocation.Offset);
 
 	vk::ImageViewCreateInfo imageViewCreateInfo;
 	imageViewCreateInfo.image = ptr->mImage;
@@ -588,6 +628,7 @@ void StateManager::CreateTexture(size_t id, void* argument1)
 		imageViewCreateInfo.components = vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eOne);
 		break;
 	default:
+		imageViewCreateInfo.components = conversion.Components;
 		break;
 	}
 
@@ -598,25 +639,43 @@ void StateManager::CreateTexture(size_t id, void* argument1)
 		return;
 	}
 
-	device->SetImageLayout(ptr->mImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+	device->mImageLayoutTracker.Register(ptr->mImage, vk::ImageAspectFlagBits::eColor, texture9->mLevels, 1);
+	device->SetImageLayout(ptr->mImage, vk::ImageLayout::eShaderReadOnlyOptimal);
 
-	mTextures.push_back(ptr);
+	ptr->mImageCreateInfo = imageCreateInfo;
+	ptr->mImageViewCreateInfo = imageViewCreateInfo;
+	ptr->mPool = texture9->mPool;
+	ptr->mUsage = texture9->mUsage;
+	ptr->mFormat = texture9->mFormat;
+	ptr->mLastUsedFrame = device->mFrameNumber;
+
+	//A new texture is dirty all over so the first UpdateTexture out of it copies everything.
+	for (uint32_t i = 0; i < imageCreateInfo.arrayLayers; i++)
+	{
+		ptr->mDirtyRegions[i].push_back({ 0, 0, imageCreateInfo.extent.width, imageCreateInfo.extent.height, 0, imageCreateInfo.extent.depth });
+	}
+	if (ptr->mPool == D3DPOOL_MANAGED)
+	{
+		device->mResidencyManager.Register(ptr.get());
+	}
 }
 
 void StateManager::DestroyCubeTexture(size_t id)
 {
-	mTextures[id]->mRealDevice->mEstimatedMemoryUsed -= mTextures[id]->mMemoryAllocateInfo.allocationSize;
 	mTextures[id].reset();
 }
 
-void StateManager::CreateCubeTexture(size_t id, void* argument1)
+void StateManager::CreateCubeTexture(size_t id, size_t key, void* argument1)
 {
 	vk::Result result;
 	auto device = mDevices[id];
 	CCubeTexture9* texture9 = bit_cast<CCubeTexture9*>(argument1);
 	std::shared_ptr<RealTexture> ptr = std::make_shared<RealTexture>(device.get());
+	StoreHandle(mTextures, key, ptr); //Stored up front so a create that fails still fills the slot the application was handed.
 
-	ptr->mRealFormat = ConvertFormat(texture9->mFormat);
+	//Formats the device can't sample are created in one it can and converted as they are uploaded.
+	FormatConversion conversion = GetFormatConversion(device->mPhysicalDevice, device->mPhysicalDeviceFeatures, texture9->mFormat);
+	ptr->mRealFormat = conversion.Format;
 
 	if (ptr->mRealFormat == vk::Format::eUndefined)//VK_FORMAT_UNDEFINED
 	{
@@ -632,6 +691,10 @@ void StateManager::CreateCubeTexture(size_t id, void* argument1)
 	imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
 	imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
 	imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc;
+	if ((texture9->mUsage & D3DUSAGE_RENDERTARGET) == D3DUSAGE_RENDERTARGET && device->mPhysicalDevice.getFormatProperties(conversion.Format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eColorAttachment) //Faces are rendered to through views of their own.
+	{
+		imageCreateInfo.usage |= vk::ImageUsageFlagBits::eColorAttachment;
+	}
 	imageCreateInfo.flags = vk::ImageCreateFlagBits::eCubeCompatible;
 	imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined; //VK_IMAGE_LAYOUT_PREINITIALIZED;
 	imageCreateInfo.sharingMode = vk::SharingMode::eExclusive;
@@ -655,22 +718,15 @@ void StateManager::CreateCubeTexture(size_t id, void* argument1)
 	ptr->mMemoryAllocateInfo.memoryTypeIndex = 0;
 	ptr->mMemoryAllocateInfo.allocationSize = memoryRequirements.size;
 
-	device->mEstimatedMemoryUsed += memoryRequirements.size;
-
-	if (!GetMemoryTypeFromProperties(device->mPhysicalDeviceMemoryProperties, memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal, &ptr->mMemoryAllocateInfo.memoryTypeIndex))
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateCubeTexture Could not find memory type from properties.";
-		return;
-	}
-
-	result = device->mDevice.allocateMemory(&ptr->mMemoryAllocateInfo, nullptr, &ptr->mDeviceMemory);
+	result = device->mResidencyManager.Allocate(memoryRequirements, ptr->mAllocation); //Evicts managed textures if video memory is full.
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateCubeTexture vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateCubeTexture ResidencyManager::Allocate failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
+	ptr->mMemoryAllocateInfo.memoryTypeIndex = ptr->mAllocation.MemoryTypeIndex;
 
-	device->mDevice.bindImageMemory(ptr->mImage, ptr->mDeviceMemory, 0);
+	device->mDevice.bindImageMemory(ptr->mImage, ptr->mAllocation.Memory, ptr->mAllocation.Offset);
 
 	vk::ImageViewCreateInfo imageViewCreateInfo;
 	imageViewCreateInfo.image = ptr->mImage;
@@ -699,6 +755,7 @@ void StateManager::CreateCubeTexture(size_t id, void* argument1)
 		imageViewCreateInfo.components = vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eOne);
 		break;
 	default:
+		imageViewCreateInfo.components = conversion.Components;
 		break;
 	}
 
@@ -709,25 +766,43 @@ void StateManager::CreateCubeTexture(size_t id, void* argument1)
 		return;
 	}
 
-	device->SetImageLayout(ptr->mImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+	device->mImageLayoutTracker.Register(ptr->mImage, vk::ImageAspectFlagBits::eColor, texture9->mLevels, 6);
+	device->SetImageLayout(ptr->mImage, vk::ImageLayout::eShaderReadOnlyOptimal);
 
-	mTextures.push_back(ptr);
+	ptr->mImageCreateInfo = imageCreateInfo;
+	ptr->mImageViewCreateInfo = imageViewCreateInfo;
+	ptr->mPool = texture9->mPool;
+	ptr->mUsage = texture9->mUsage;
+	ptr->mFormat = texture9->mFormat;
+	ptr->mLastUsedFrame = device->mFrameNumber;
+
+	//A new texture is dirty all over so the first UpdateTexture out of it copies everything.
+	for (uint32_t i = 0; i < imageCreateInfo.arrayLayers; i++)
+	{
+		ptr->mDirtyRegions[i].push_back({ 0, 0, imageCreateInfo.extent.width, imageCreateInfo.extent.height, 0, imageCreateInfo.extent.depth });
+	}
+	if (ptr->mPool == D3DPOOL_MANAGED)
+	{
+		device->mResidencyManager.Register(ptr.get());
+	}
 }
 
 void StateManager::DestroyVolumeTexture(size_t id)
 {
-	mTextures[id]->mRealDevice->mEstimatedMemoryUsed -= mTextures[id]->mMemoryAllocateInfo.allocationSize;
 	mTextures[id].reset();
 }
 
-void StateManager::CreateVolumeTexture(size_t id, void* argument1)
+void StateManager::CreateVolumeTexture(size_t id, size_t key, void* argument1)
 {
 	vk::Result result;
 	std::shared_ptr<RealDevice> device = mDevices[id];
 	CVolumeTexture9* texture9 = bit_cast<CVolumeTexture9*>(argument1);
 	std::shared_ptr<RealTexture> ptr = std::make_shared<RealTexture>(device.get());
+	StoreHandle(mTextures, key, ptr); //Stored up front so a create that fails still fills the slot the application was handed.
 
-	ptr->mRealFormat = ConvertFormat(texture9->mFormat);
+	//Formats the device can't sample are created in one it can and converted as they are uploaded.
+	FormatConversion conversion = GetFormatConversion(device->mPhysicalDevice, device->mPhysicalDeviceFeatures, texture9->mFormat);
+	ptr->mRealFormat = conversion.Format;
 
 	if (ptr->mRealFormat == vk::Format::eUndefined)//VK_FORMAT_UNDEFINED
 	{
@@ -766,22 +841,15 @@ void StateManager::CreateVolumeTexture(size_t id, void* argument1)
 	ptr->mMemoryAllocateInfo.memoryTypeIndex = 0;
 	ptr->mMemoryAllocateInfo.allocationSize = memoryRequirements.size;
 
-	device->mEstimatedMemoryUsed += memoryRequirements.size;
-
-	if (!GetMemoryTypeFromProperties(device->mPhysicalDeviceMemoryProperties, memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal, &ptr->mMemoryAllocateInfo.memoryTypeIndex))
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateVolumeTexture Could not find memory type from properties.";
-		return;
-	}
-
-	result = device->mDevice.allocateMemory(&ptr->mMemoryAllocateInfo, nullptr, &ptr->mDeviceMemory);
+	result = device->mResidencyManager.Allocate(memoryRequirements, ptr->mAllocation); //Evicts managed textures if video memory is full.
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateVolumeTexture vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateVolumeTexture ResidencyManager::Allocate failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
+	ptr->mMemoryAllocateInfo.memoryTypeIndex = ptr->mAllocation.MemoryTypeIndex;
 
-	device->mDevice.bindImageMemory(ptr->mImage, ptr->mDeviceMemory, 0);
+	device->mDevice.bindImageMemory(ptr->mImage, ptr->mAllocation.Memory, ptr->mAllocation.Offset);
 
 	vk::ImageViewCreateInfo imageViewCreateInfo;
 	imageViewCreateInfo.image = ptr->mImage;
@@ -810,6 +878,7 @@ void StateManager::CreateVolumeTexture(size_t id, void* argument1)
 		imageViewCreateInfo.components = vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eOne);
 		break;
 	default:
+		imageViewCreateInfo.components = conversion.Components;
 		break;
 	}
 
@@ -820,9 +889,25 @@ void StateManager::CreateVolumeTexture(size_t id, void* argument1)
 		return;
 	}
 
-	device->SetImageLayout(ptr->mImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+	device->mImageLayoutTracker.Register(ptr->mImage, vk::ImageAspectFlagBits::eColor, texture9->mLevels, 1);
+	device->SetImageLayout(ptr->mImage, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+	ptr->mImageCreateInfo = imageCreateInfo;
+	ptr->mImageViewCreateInfo = imageViewCreateInfo;
+	ptr->mPool = texture9->mPool;
+	ptr->mUsage = texture9->mUsage;
+	ptr->mFormat = texture9->mFormat;
+	ptr->mLastUsedFrame = device->mFrameNumber;
 
-	mTextures.push_back(ptr);
+	//A new texture is dirty all over so the first UpdateTexture out of it copies everything.
+	for (uint32_t i = 0; i < imageCreateInfo.arrayLayers; i++)
+	{
+		ptr->mDirtyRegions[i].push_back({ 0, 0, imageCreateInfo.extent.width, imageCreateInfo.extent.height, 0, imageCreateInfo.extent.depth });
+	}
+	if (ptr->mPool == D3DPOOL_MANAGED)
+	{
+		device->mResidencyManager.Register(ptr.get());
+	}
 }
 
 void StateManager::DestroySurface(size_t id)
@@ -833,42 +918,44 @@ void StateManager::DestroySurface(size_t id)
 	}
 }
 
-void StateManager::CreateSurface(size_t id, void* argument1)
+void StateManager::CreateSurface(size_t id, size_t key, void* argument1)
 {
 	auto device = mDevices[id];
 	CSurface9* surface9 = bit_cast<CSurface9*>(argument1);
 	vk::Image* parentImage = nullptr;
 
-	if (surface9->mTexture != nullptr)
+	//Levels of textures that can be rendered to get a view of their own level and face to attach.
+	if ((surface9->mTexture != nullptr && (surface9->mTexture->mUsage & D3DUSAGE_RENDERTARGET) == D3DUSAGE_RENDERTARGET)
+		|| (surface9->mCubeTexture != nullptr && (surface9->mCubeTexture->mUsage & D3DUSAGE_RENDERTARGET) == D3DUSAGE_RENDERTARGET))
 	{
-		parentImage = &mTextures[surface9->mTexture->mId]->mImage;
+		parentImage = &mTextures[surface9->mTextureId]->mImage;
 	}
 
 	std::shared_ptr<RealSurface> ptr = std::make_shared<RealSurface>(device.get(), surface9, parentImage);
 
-	auto& realFormat = ptr->mRealFormat;
-	if (realFormat == vk::Format::eD16UnormS8Uint || realFormat == vk::Format::eD24UnormS8Uint || realFormat == vk::Format::eD32SfloatS8Uint)
-	{
-		device->SetImageLayout(ptr->mStagingImage, vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
-	}
-	else if (realFormat == vk::Format::eS8Uint)
-	{
-		device->SetImageLayout(ptr->mStagingImage, vk::ImageAspectFlagBits::eStencil, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
-	}
-	else if (realFormat == vk::Format::eD16Unorm)
+	//Texture level surfaces only have a staging buffer, everything else is an attachment.
+	if (ptr->mStagingImage)
 	{
-		device->SetImageLayout(ptr->mStagingImage, vk::ImageAspectFlagBits::eDepth, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+		vk::ImageLayout layout = (surface9->mUsage == D3DUSAGE_DEPTHSTENCIL) ? vk::ImageLayout::eDepthStencilAttachmentOptimal : vk::ImageLayout::eColorAttachmentOptimal;
+		device->mImageLayoutTracker.Register(ptr->mStagingImage, ptr->mSubresource.aspectMask, 1, 1, vk::ImageLayout::ePreinitialized);
+		device->SetImageLayout(ptr->mStagingImage, layout);
 	}
-	else if(realFormat == vk::Format::eD16Unorm)
+
+	if (ptr->mResolveImage)
 	{
-		device->SetImageLayout(ptr->mStagingImage, vk::ImageAspectFlagBits::eDepth, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+		device->mImageLayoutTracker.Register(ptr->mResolveImage, vk::ImageAspectFlagBits::eColor);
+		device->SetImageLayout(ptr->mResolveImage, vk::ImageLayout::eColorAttachmentOptimal);
 	}
-	else
+
+	//Texture levels remember where they go so an evicted texture can be restored from them.
+	if (surface9->mTexture != nullptr || surface9->mCubeTexture != nullptr)
 	{
-		device->SetImageLayout(ptr->mStagingImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+		ptr->mSubresource.mipLevel = surface9->mMipIndex;
+		ptr->mSubresource.arrayLayer = surface9->mTargetLayer;
+		mTextures[surface9->mTextureId]->mSurfaceIds.push_back(key);
 	}
 
-	mSurfaces.push_back(ptr);
+	StoreHandle(mSurfaces, key, ptr);
 }
 
 void StateManager::DestroyVolume(size_t id)
@@ -876,16 +963,16 @@ void StateManager::DestroyVolume(size_t id)
 	mSurfaces[id].reset();
 }
 
-void StateManager::CreateVolume(size_t id, void* argument1)
+void StateManager::CreateVolume(size_t id, size_t key, void* argument1)
 {
-	vk::Result result;
 	auto device = mDevices[id];
 	CVolume9* volume9 = bit_cast<CVolume9*>(argument1);
 	std::shared_ptr<RealSurface> ptr = std::make_shared<RealSurface>(device.get(), volume9);
 
-	device->SetImageLayout(ptr->mStagingImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+	ptr->mSubresource.mipLevel = volume9->mMipIndex;
+	mTextures[volume9->mTextureId]->mSurfaceIds.push_back(key);
 
-	mSurfaces.push_back(ptr);
+	StoreHandle(mSurfaces, key, ptr);
 }
 
 void StateManager::DestroyShader(size_t id)
@@ -1018,6 +1105,7 @@ std::shared_ptr<RealSwapChain> StateManager::GetSwapChain(std::shared_ptr<RealDe
 		uint32_t height = realDevice->mDeviceState.mRenderTarget->mColorSurface->mExtent.height;
 		auto output = std::make_shared<RealSwapChain>(instance, physicalDevice, device, windowHandle, width, height);
 		mSwapChains[handle] = output;
+		realDevice->mSwapChainMemorySize += output->mMemorySize;
 
 		return output;
 	}
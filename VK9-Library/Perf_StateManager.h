@@ -86,6 +86,19 @@ VKAPI_ATTR void VKAPI_CALL vkDebugReportMessageEXT(
 #include "ResourceContext.h"
 #include "DrawContext.h"
 
+/*
+Creates that don't wait for the worker can be queued from more than one thread so the handle is stored at the key it was given rather than appended.
+*/
+template <typename T>
+inline void StoreHandle(std::vector< std::shared_ptr<T> >& handles, size_t key, const std::shared_ptr<T>& handle)
+{
+	if (handles.size() <= key)
+	{
+		handles.resize(key + 1);
+	}
+	handles[key] = handle;
+}
+
 struct StateManager
 {
 	boost::container::small_vector< std::shared_ptr<RealInstance>, 1> mInstances;
@@ -130,19 +143,19 @@ struct StateManager
 	void CreateIndexBuffer(size_t id, void* argument1);
 
 	void DestroyTexture(size_t id);
-	void CreateTexture(size_t id, void* argument1);
+	void CreateTexture(size_t id, size_t key, void* argument1);
 
 	void DestroyCubeTexture(size_t id);
-	void CreateCubeTexture(size_t id, void* argument1);
+	void CreateCubeTexture(size_t id, size_t key, void* argument1);
 
 	void DestroyVolumeTexture(size_t id);
-	void CreateVolumeTexture(size_t id, void* argument1);
+	void CreateVolumeTexture(size_t id, size_t key, void* argument1);
 
 	void DestroySurface(size_t id);
-	void CreateSurface(size_t id, void* argument1);
+	void CreateSurface(size_t id, size_t key, void* argument1);
 
 	void DestroyVolume(size_t id);
-	void CreateVolume(size_t id, void* argument1);
+	void CreateVolume(size_t id, size_t key, void* argument1);
 
 	void DestroyShader(size_t id);
 	void CreateShader(size_t id, void* argument1, void* argument2, void* argument3);
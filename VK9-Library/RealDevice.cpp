@@ -19,7 +19,9 @@ misrepresented as being the original software.
 */
 
 #include "RealDevice.h"
+#include "FormatConverter.h"
 #include "RealRenderTarget.h"
+#include "RenderPassRequest.h"
 #include "Utilities.h"
 
 RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice, int32_t width, int32_t height)
@@ -30,6 +32,8 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 
 	vk::Result result;
 
+	mThreadPool.Initialize(std::max(std::min(std::thread::hardware_concurrency(), MaximumConversionThreadCount), (uint32_t)1));
+
 	//Grab the properties for GetAdapterIdentifier and other calls.
 	physicalDevice.getProperties(&mPhysicalDeviceProperties);
 
@@ -48,6 +52,24 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 	boost::container::small_vector<char*, 16> layerNames;
 
 	extensionNames.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+	//With VK_EXT_memory_budget GetAvailableTextureMem reports what the driver will actually let us use.
+#ifdef VK_EXT_memory_budget
+	uint32_t extensionCount = 0;
+	physicalDevice.enumerateDeviceExtensionProperties(nullptr, &extensionCount, nullptr);
+	std::vector<vk::ExtensionProperties> extensionProperties(extensionCount);
+	physicalDevice.enumerateDeviceExtensionProperties(nullptr, &extensionCount, extensionProperties.data());
+	for (auto& extension : extensionProperties)
+	{
+		if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+		{
+			extensionNames.push_back((char*)VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			mGetPhysicalDeviceMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(instance.getProcAddr("vkGetPhysicalDeviceMemoryProperties2KHR"));
+			mHasMemoryBudget = (mGetPhysicalDeviceMemoryProperties2 != nullptr);
+			break;
+		}
+	}
+#endif // VK_EXT_memory_budget
 	//extensionNames.push_back("VK_KHR_maintenance1");
 	//extensionNames.push_back("VK_KHR_push_descriptor");
 	//extensionNames.push_back("VK_KHR_sampler_mirror_clamp_to_edge");
@@ -76,6 +98,8 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 		return;
 	}
 
+	mMemoryManager.Initialize(mDevice, mPhysicalDeviceMemoryProperties, mPhysicalDeviceProperties.limits.nonCoherentAtomSize);
+
 	vk::DescriptorPoolSize descriptorPoolSizes[11] = {};
 	descriptorPoolSizes[0].type = vk::DescriptorType::eSampler; //VK_DESCRIPTOR_TYPE_SAMPLER;
 	descriptorPoolSizes[0].descriptorCount = std::min((uint32_t)MAX_DESCRIPTOR, mPhysicalDeviceProperties.limits.maxDescriptorSetSamplers);
@@ -113,11 +137,11 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 		return;
 	}
 
-	for (size_t i = 0; i < mPhysicalDeviceMemoryProperties.memoryHeapCount; i++)
-	{
-		mEstimatedMemory += mPhysicalDeviceMemoryProperties.memoryHeaps[i].size;
-	}
-	BOOST_LOG_TRIVIAL(info) << "RealDevice::RealDevice The total size of all heaps is " << mEstimatedMemory;
+	mGarbageManager.Initialize(mDevice, mDescriptorPool, &mMemoryManager);
+	mResidencyManager.Initialize(this);
+
+	UpdateMemoryBudget();
+	BOOST_LOG_TRIVIAL(info) << "RealDevice::RealDevice memory budget is " << mMemoryBudget << " bytes (" << (mHasMemoryBudget ? "VK_EXT_memory_budget" : "device local heaps") << ")";
 
 	vk::Bool32 doesSupportGraphics = false;
 	uint32_t graphicsQueueIndex = 0;
@@ -149,6 +173,13 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 	//Create queue so we can submit command buffers.
 	mDevice.getQueue(graphicsQueueIndex, 0, &mQueue); //no result?
 
+	result = mTransferManager.Initialize(mDevice, mQueue, graphicsQueueIndex);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RealDevice TransferManager::Initialize failed with return code of " << GetResultString((VkResult)result);
+		return;
+	}
+
 	vk::CommandBufferAllocateInfo commandBufferInfo;
 	commandBufferInfo.commandPool = mCommandPool;
 	commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
@@ -160,6 +191,18 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RealDevice vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
+	mImageLayoutTracker.BeginFrame(mCommandBuffers[mCurrentCommandBuffer], mFrameNumber);
+
+	vk::FenceCreateInfo fenceInfo;
+	for (size_t i = 0; i < 2; i++)
+	{
+		result = mDevice.createFence(&fenceInfo, nullptr, &mCommandBufferFences[i]);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RealDevice vkCreateFence failed with return code of " << GetResultString((VkResult)result);
+			return;
+		}
+	}
 
 	//Load fixed function shaders.
 	mVertShaderModule_XYZRHW = LoadShaderFromFile(mDevice, "VertexBuffer_XYZRHW.vert.spv");
@@ -362,10 +405,6 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 	//imageCreateInfo2.flags = 0;
 	imageCreateInfo2.initialLayout = vk::ImageLayout::ePreinitialized;
 
-	vk::MemoryAllocateInfo memoryAllocateInfo;
-	memoryAllocateInfo.allocationSize = 0;
-	memoryAllocateInfo.memoryTypeIndex = 0;
-
 	vk::MemoryRequirements memoryRequirements2;
 
 	result = mDevice.createImage(&imageCreateInfo2, nullptr, &mImage);
@@ -376,17 +415,15 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 	}
 
 	mDevice.getImageMemoryRequirements(mImage, &memoryRequirements2);
-	memoryAllocateInfo.allocationSize = memoryRequirements2.size;
-	GetMemoryTypeFromProperties(mPhysicalDeviceMemoryProperties, memoryRequirements2.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible, &memoryAllocateInfo.memoryTypeIndex);
 
-	result = mDevice.allocateMemory(&memoryAllocateInfo, nullptr, &mDeviceMemory);
+	result = mMemoryManager.Allocate(memoryRequirements2, vk::MemoryPropertyFlagBits::eHostVisible, true, mImageAllocation);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RealDevice vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RealDevice MemoryManager::Allocate failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
-	mDevice.bindImageMemory(mImage, mDeviceMemory, 0);
+	mDevice.bindImageMemory(mImage, mImageAllocation.Memory, mImageAllocation.Offset);
 
 	vk::ImageSubresource imageSubresource;
 	imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
@@ -401,10 +438,10 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 	//BOOST_LOG_TRIVIAL(info) << "RealDevice::RealDevice using format " << (VkFormat)textureFormat;
 	mDevice.getImageSubresourceLayout(mImage, &imageSubresource, &subresourceLayout);
 
-	data = mDevice.mapMemory(mDeviceMemory, 0, memoryAllocateInfo.allocationSize, vk::MemoryMapFlags()).value;
-	if (data == nullptr)
+	data = (char*)mImageAllocation.Data + subresourceLayout.offset;
+	if (mImageAllocation.Data == nullptr)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RealDevice vkMapMemory failed.";
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RealDevice the placeholder image isn't host visible.";
 		return;
 	}
 
@@ -417,9 +454,10 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 		}
 	}
 
-	mDevice.unmapMemory(mDeviceMemory);
-	mImageLayout = vk::ImageLayout::eGeneral;
-	SetImageLayout(mImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+	mMemoryManager.Flush(mImageAllocation);
+	mImageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	mImageLayoutTracker.Register(mImage, vk::ImageAspectFlagBits::eColor, 1, 1, vk::ImageLayout::ePreinitialized);
+	SetImageLayout(mImage, vk::ImageLayout::eShaderReadOnlyOptimal);
 
 	vk::ImageViewCreateInfo imageViewCreateInfo2;
 	imageViewCreateInfo2.image = mImage;
@@ -477,7 +515,7 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 	{
 		mDeviceState.mDescriptorImageInfo[i].sampler = mSampler;
 		mDeviceState.mDescriptorImageInfo[i].imageView = mImageView;
-		mDeviceState.mDescriptorImageInfo[i].imageLayout = vk::ImageLayout::eGeneral;
+		mDeviceState.mDescriptorImageInfo[i].imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 	}
 
 	//initialize vulkan/d3d9 viewport and scissor structures.
@@ -509,31 +547,43 @@ RealDevice::RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,
 	mBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
 
 	//revisit - light should be sized dynamically. Really more that 4 lights is stupid but this limit isn't correct behavior.
-	CreateBuffer(sizeof(Light) * 4, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, mLightBuffer, mLightBufferMemory);
-	CreateBuffer(sizeof(D3DMATERIAL9), vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, mMaterialBuffer, mMaterialBufferMemory);
+	CreateBuffer(sizeof(Light) * 4, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, mLightBuffer, mLightBufferAllocation);
+	CreateBuffer(sizeof(D3DMATERIAL9), vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, mMaterialBuffer, mMaterialBufferAllocation);
 }
 
 RealDevice::~RealDevice()
 {
 	BOOST_LOG_TRIVIAL(info) << "RealDevice::~RealDevice";
 	delete[] mQueueFamilyProperties;
+	mThreadPool.Destroy();
 	if (mDevice == vk::Device())
 	{
 		return;
 	}
 
+	//Frames may still be in flight.
+	mDevice.waitIdle();
+	mTransferManager.Destroy();
+
 	mDrawBuffer.clear();
 	mSamplerRequests.clear();
 
 	mDeviceState.mRenderTarget.reset();
 	
 	mDevice.destroyBuffer(mLightBuffer, nullptr);
-	mDevice.freeMemory(mLightBufferMemory, nullptr);
+	mMemoryManager.Free(mLightBufferAllocation);
 	mDevice.destroyBuffer(mMaterialBuffer, nullptr);
-	mDevice.freeMemory(mMaterialBufferMemory, nullptr);
+	mMemoryManager.Free(mMaterialBufferAllocation);
+	for (auto& uploadBuffer : mUploadBuffers)
+	{
+		mDevice.destroyBuffer(uploadBuffer.Buffer, nullptr);
+		mMemoryManager.Free(uploadBuffer.Allocation);
+	}
+	mDevice.destroyBuffer(mFillBuffer, nullptr);
+	mMemoryManager.Free(mFillBufferAllocation);
 	mDevice.destroyImageView(mImageView, nullptr);
 	mDevice.destroyImage(mImage, nullptr);
-	mDevice.freeMemory(mDeviceMemory, nullptr);
+	mMemoryManager.Free(mImageAllocation);
 	mDevice.destroySampler(mSampler, nullptr);
 
 	mDevice.destroyShaderModule(mVertShaderModule_XYZRHW, nullptr);
@@ -569,9 +619,10 @@ RealDevice::~RealDevice()
 
 	mDevice.freeCommandBuffers(mCommandPool, 1, &mCommandBuffer);
 	mDevice.freeCommandBuffers(mCommandPool, 2, mCommandBuffers);
+	mDevice.destroyFence(mCommandBufferFences[0], nullptr);
+	mDevice.destroyFence(mCommandBufferFences[1], nullptr);
 	mDevice.destroyCommandPool(mCommandPool, nullptr);
 
-	mDevice.destroyDescriptorPool(mDescriptorPool, nullptr);
 	//destroy render targets before the device
 	for(int i=0; i < mRenderTargets.size();i++)
 	{
@@ -579,120 +630,577 @@ RealDevice::~RealDevice()
 	}
 	mRenderTargets.clear();
 
+	//framebuffers reference the render passes so they go first.
+	mFramebufferRequests.clear();
+	mRenderPassRequests.clear();
+
+	//The device is idle so everything that was retired above or earlier can go right away.
+	mGarbageManager.Destroy();
 
+	mDevice.destroyDescriptorPool(mDescriptorPool, nullptr);
+	mMemoryManager.Destroy();
 	mDevice.destroy();
 }
 
-void RealDevice::SetImageLayout(vk::Image image, vk::ImageAspectFlags aspectMask, vk::ImageLayout oldImageLayout, vk::ImageLayout newImageLayout, uint32_t levelCount, uint32_t mipIndex, uint32_t layerCount)
+void RealDevice::SetImageLayout(vk::Image image, vk::ImageLayout newImageLayout, uint32_t levelCount, uint32_t mipIndex, uint32_t layerCount, uint32_t layerIndex)
 {
 	/*
-	This is just a helper method to reduce repeat code.
+	The transition is recorded into the upload batch so creating an image never submits and waits on its own.
+	New images can't have been used by the frame yet and the batch goes out ahead of it, so the frame sees the layout the tracker now has.
 	*/
+	if (mImageLayoutTracker.IsInLayout(image, newImageLayout))
+	{
+		return;
+	}
+
+	vk::CommandBuffer commandBuffer = mTransferManager.GetCommandBuffer();
+	mImageLayoutTracker.Transition(commandBuffer, image, newImageLayout, levelCount, mipIndex, layerCount, layerIndex);
+	mImageLayoutTracker.Flush(commandBuffer);
+}
+
+void RealDevice::CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Buffer& buffer, MemoryAllocation& allocation)
+{
 	vk::Result result;
-	vk::CommandBuffer commandBuffer;
 
-	if (aspectMask == vk::ImageAspectFlags())
+	vk::BufferCreateInfo bufferInfo;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+	result = mDevice.createBuffer(&bufferInfo, nullptr, &buffer);
+	if (result != vk::Result::eSuccess)
 	{
-		aspectMask = vk::ImageAspectFlagBits::eColor;
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::CreateBuffer vkCreateBuffer failed with return code of " << GetResultString((VkResult)result);
+		return;
 	}
 
-	vk::CommandBufferAllocateInfo commandBufferInfo = {};
-	commandBufferInfo.commandPool = mCommandPool;
-	commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
-	commandBufferInfo.commandBufferCount = 1;
+	vk::MemoryRequirements memoryRequirements;
+	mDevice.getBufferMemoryRequirements(buffer, &memoryRequirements);
 
-	result = mDevice.allocateCommandBuffers(&commandBufferInfo, &commandBuffer);
+	result = mMemoryManager.Allocate(memoryRequirements, properties, true, allocation);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::SetImageLayout vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::CreateBuffer MemoryManager::Allocate failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
-	vk::CommandBufferInheritanceInfo commandBufferInheritanceInfo;
-	commandBufferInheritanceInfo.subpass = 0;
-	commandBufferInheritanceInfo.occlusionQueryEnable = VK_FALSE;
+	mDevice.bindBufferMemory(buffer, allocation.Memory, allocation.Offset);
+}
 
-	vk::CommandBufferBeginInfo commandBufferBeginInfo;
-	commandBufferBeginInfo.pInheritanceInfo = &commandBufferInheritanceInfo;
+void RealDevice::CopyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize offset, vk::DeviceSize size, vk::AccessFlags dstAccessMask, vk::PipelineStageFlags dstStageMask)
+{
+	/*
+	The copy goes into the upload batch so it runs ahead of the frame being recorded without a submit and wait of its own.
+	Queue order puts it after the frames that read the old contents so a barrier is enough to keep it from overwriting them early.
+	*/
+	vk::CommandBuffer commandBuffer = mTransferManager.GetCommandBuffer();
+	mTransferManager.mUploadSize += size;
+
+	vk::BufferMemoryBarrier bufferMemoryBarrier;
+	bufferMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+	bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferMemoryBarrier.buffer = dstBuffer;
+	bufferMemoryBarrier.offset = offset;
+	bufferMemoryBarrier.size = size;
+	mImageLayoutTracker.mBarrierBatch.Add(commandBuffer, dstStageMask, vk::PipelineStageFlagBits::eTransfer, bufferMemoryBarrier);
+	mImageLayoutTracker.Flush(commandBuffer);
+
+	mCopyRegion.srcOffset = offset;
+	mCopyRegion.dstOffset = offset;
+	mCopyRegion.size = size;
+	commandBuffer.copyBuffer(srcBuffer, dstBuffer, 1, &mCopyRegion);
+
+	//Make the copy visible to whatever reads the buffer next.
+	bufferMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	bufferMemoryBarrier.dstAccessMask = dstAccessMask;
+	mImageLayoutTracker.mBarrierBatch.Add(commandBuffer, vk::PipelineStageFlagBits::eTransfer, dstStageMask, bufferMemoryBarrier);
+	mImageLayoutTracker.Flush(commandBuffer);
+}
+void RealDevice::GenerateMipSubLevels(vk::CommandBuffer commandBuffer, vk::Image image, vk::Format format, vk::Extent3D extent, uint32_t levelCount, uint32_t layerCount, uint32_t layerIndex, vk::Filter filter)
+{
+	//Evicted textures rebuild their levels when they are restored.
+	if (levelCount < 2 || !image)
+	{
+		return;
+	}
 
-	result = commandBuffer.begin(&commandBufferBeginInfo);
-	if (result != vk::Result::eSuccess)
+	vk::FormatProperties formatProperties;
+	mPhysicalDevice.getFormatProperties(format, &formatProperties);
+
+	const vk::FormatFeatureFlags features = formatProperties.optimalTilingFeatures;
+	if (!(features & vk::FormatFeatureFlagBits::eBlitSrc) || !(features & vk::FormatFeatureFlagBits::eBlitDst))
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::SetImageLayout vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(warning) << "RealDevice::GenerateMipSubLevels format " << (VkFormat)format << " doesn't support blits.";
 		return;
 	}
 
-	ReallySetImageLayout(commandBuffer, image, aspectMask, oldImageLayout, newImageLayout, levelCount, mipIndex, layerCount);
+	if (filter != vk::Filter::eNearest)
+	{
+		filter = (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear) ? vk::Filter::eLinear : vk::Filter::eNearest;
+	}
+
+	/*
+	The blits go into whichever command buffer the top level was written in, right behind that write, so nothing has to be submitted or waited on here.
+	Each level is made from the one above it so every blit only reads a quarter of what the last one wrote.
+	*/
+	vk::Offset3D srcSize((int32_t)extent.width, (int32_t)extent.height, (int32_t)extent.depth);
+	for (uint32_t i = 1; i < levelCount; i++)
+	{
+		vk::Offset3D dstSize(std::max(srcSize.x / 2, 1), std::max(srcSize.y / 2, 1), std::max(srcSize.z / 2, 1));
+
+		//Every level below the top is overwritten so its old contents can be discarded.
+		mImageLayoutTracker.Transition(commandBuffer, image, vk::ImageLayout::eTransferSrcOptimal, 1, i - 1, layerCount, layerIndex);
+		mImageLayoutTracker.Transition(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, 1, i, layerCount, layerIndex, true);
+		mImageLayoutTracker.Flush(commandBuffer);
+
+		vk::ImageBlit imageBlit;
+		imageBlit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		imageBlit.srcSubresource.mipLevel = i - 1;
+		imageBlit.srcSubresource.baseArrayLayer = layerIndex;
+		imageBlit.srcSubresource.layerCount = layerCount;
+		imageBlit.srcOffsets[1] = srcSize;
+		imageBlit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		imageBlit.dstSubresource.mipLevel = i;
+		imageBlit.dstSubresource.baseArrayLayer = layerIndex;
+		imageBlit.dstSubresource.layerCount = layerCount;
+		imageBlit.dstOffsets[1] = dstSize;
+
+		commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, 1, &imageBlit, filter);
+
+		srcSize = dstSize;
+	}
 
-	commandBuffer.end();
+	mImageLayoutTracker.Transition(commandBuffer, image, vk::ImageLayout::eShaderReadOnlyOptimal, levelCount, 0, layerCount, layerIndex);
+	mImageLayoutTracker.Flush(commandBuffer);
+}
 
-	vk::CommandBuffer commandBuffers[] = { commandBuffer };
-	vk::Fence nullFence;
-	vk::SubmitInfo submitInfo;
-	submitInfo.waitSemaphoreCount = 0;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = commandBuffers;
-	submitInfo.signalSemaphoreCount = 0;
+vk::RenderPass RealDevice::GetRenderPass(vk::Format colorFormat, vk::Format depthFormat, vk::AttachmentLoadOp colorLoadOp, vk::AttachmentLoadOp depthLoadOp, vk::AttachmentLoadOp stencilLoadOp, vk::AttachmentStoreOp storeOp, vk::SampleCountFlagBits samples)
+{
+	for (size_t i = 0; i < mRenderPassRequests.size(); i++)
+	{
+		auto& renderPassRequest = (*mRenderPassRequests[i]);
+		if (renderPassRequest.ColorFormat == colorFormat
+			&& renderPassRequest.DepthFormat == depthFormat
+			&& renderPassRequest.ColorLoadOp == colorLoadOp
+			&& renderPassRequest.DepthLoadOp == depthLoadOp
+			&& renderPassRequest.StencilLoadOp == stencilLoadOp
+			&& renderPassRequest.StoreOp == storeOp
+			&& renderPassRequest.Samples == samples)
+		{
+			renderPassRequest.LastUsed = std::chrono::steady_clock::now();
+			return renderPassRequest.RenderPass;
+		}
+	}
 
-	result = mQueue.submit(1, &submitInfo, nullFence);
+	vk::Result result;
+	std::shared_ptr<RenderPassRequest> request = std::make_shared<RenderPassRequest>(this);
+	request->ColorFormat = colorFormat;
+	request->DepthFormat = depthFormat;
+	request->ColorLoadOp = colorLoadOp;
+	request->DepthLoadOp = depthLoadOp;
+	request->StencilLoadOp = stencilLoadOp;
+	request->StoreOp = storeOp;
+	request->Samples = samples;
+
+	vk::AttachmentReference colorReference;
+	colorReference.attachment = 0;
+	colorReference.layout = vk::ImageLayout::eColorAttachmentOptimal;
+
+	vk::AttachmentReference depthReference;
+	depthReference.attachment = 1;
+	depthReference.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+	//Multisampled passes resolve into a single sample attachment at the end of the subpass so there is no separate resolve step.
+	const bool hasResolve = (samples != vk::SampleCountFlagBits::e1);
+	const uint32_t resolveIndex = (depthFormat != vk::Format::eUndefined) ? 2 : 1;
+
+	vk::AttachmentReference resolveReference;
+	resolveReference.attachment = resolveIndex;
+	resolveReference.layout = vk::ImageLayout::eColorAttachmentOptimal;
+
+	vk::SubpassDescription subpass;
+	subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+	subpass.inputAttachmentCount = 0;
+	subpass.pInputAttachments = nullptr;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorReference;
+	subpass.pResolveAttachments = hasResolve ? &resolveReference : nullptr;
+	subpass.pDepthStencilAttachment = (depthFormat != vk::Format::eUndefined) ? &depthReference : nullptr;
+	subpass.preserveAttachmentCount = 0;
+	subpass.pPreserveAttachments = nullptr;
+
+	vk::AttachmentDescription renderAttachments[3];
+
+	renderAttachments[0].format = colorFormat;
+	renderAttachments[0].samples = samples;
+	renderAttachments[0].loadOp = colorLoadOp;
+	renderAttachments[0].storeOp = storeOp;
+	renderAttachments[0].stencilLoadOp = vk::AttachmentLoadOp::eLoad;
+	renderAttachments[0].stencilStoreOp = vk::AttachmentStoreOp::eStore;
+	renderAttachments[0].initialLayout = vk::ImageLayout::eColorAttachmentOptimal; //The layout tracker moves the image before the pass begins.
+	renderAttachments[0].finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
+
+	renderAttachments[1].format = depthFormat;
+	renderAttachments[1].samples = samples;
+	renderAttachments[1].loadOp = depthLoadOp;
+	renderAttachments[1].storeOp = storeOp;
+	renderAttachments[1].stencilLoadOp = stencilLoadOp;
+	renderAttachments[1].stencilStoreOp = storeOp;
+	renderAttachments[1].initialLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+	renderAttachments[1].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+	renderAttachments[resolveIndex].format = colorFormat;
+	renderAttachments[resolveIndex].samples = vk::SampleCountFlagBits::e1;
+	renderAttachments[resolveIndex].loadOp = vk::AttachmentLoadOp::eDontCare; //Every pixel is overwritten by the resolve.
+	renderAttachments[resolveIndex].storeOp = vk::AttachmentStoreOp::eStore;
+	renderAttachments[resolveIndex].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+	renderAttachments[resolveIndex].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+	renderAttachments[resolveIndex].initialLayout = vk::ImageLayout::eColorAttachmentOptimal;
+	renderAttachments[resolveIndex].finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
+
+	vk::SubpassDependency dependency;
+	dependency.srcStageMask = vk::PipelineStageFlagBits::eAllGraphics;
+	dependency.dstStageMask = vk::PipelineStageFlagBits::eAllGraphics;
+
+	vk::RenderPassCreateInfo renderPassCreateInfo;
+	renderPassCreateInfo.attachmentCount = hasResolve ? resolveIndex + 1 : resolveIndex;
+	renderPassCreateInfo.pAttachments = renderAttachments;
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpass;
+	renderPassCreateInfo.dependencyCount = 1;
+	renderPassCreateInfo.pDependencies = &dependency;
+
+	result = mDevice.createRenderPass(&renderPassCreateInfo, nullptr, &request->RenderPass);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::SetImageLayout vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
-		return;
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::GetRenderPass vkCreateRenderPass failed with return code of " << GetResultString((VkResult)result);
+		request->mRealDevice = nullptr;
+		return nullptr;
 	}
 
-	mQueue.waitIdle();
-	mDevice.freeCommandBuffers(mCommandPool, 1, commandBuffers);
+	mRenderPassRequests.push_back(request);
+
+	return request->RenderPass;
 }
 
-void RealDevice::CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlagBits properties, vk::Buffer& buffer, vk::DeviceMemory& deviceMemory)
+vk::Framebuffer RealDevice::GetFramebuffer(vk::RenderPass renderPass, vk::ImageView colorView, vk::ImageView depthView, uint32_t width, uint32_t height, vk::ImageView resolveView)
 {
-	vk::Result result; // = VK_SUCCESS
+	for (size_t i = 0; i < mFramebufferRequests.size(); i++)
+	{
+		auto& framebufferRequest = (*mFramebufferRequests[i]);
+		if (framebufferRequest.RenderPass == renderPass
+			&& framebufferRequest.ColorView == colorView
+			&& framebufferRequest.DepthView == depthView
+			&& framebufferRequest.ResolveView == resolveView
+			&& framebufferRequest.Width == width
+			&& framebufferRequest.Height == height)
+		{
+			framebufferRequest.LastUsed = std::chrono::steady_clock::now();
+			return framebufferRequest.Framebuffer;
+		}
+	}
 
-	vk::BufferCreateInfo bufferInfo;
-	bufferInfo.size = size;
-	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+	vk::Result result;
+	std::shared_ptr<FramebufferRequest> request = std::make_shared<FramebufferRequest>(this);
+	request->RenderPass = renderPass;
+	request->ColorView = colorView;
+	request->DepthView = depthView;
+	request->ResolveView = resolveView;
+	request->Width = width;
+	request->Height = height;
+
+	//Attachment order has to match GetRenderPass: color, depth, then resolve.
+	vk::ImageView attachments[3];
+	uint32_t attachmentCount = 0;
+	attachments[attachmentCount++] = colorView;
+	if (depthView)
+	{
+		attachments[attachmentCount++] = depthView;
+	}
+	if (resolveView)
+	{
+		attachments[attachmentCount++] = resolveView;
+	}
 
-	result = mDevice.createBuffer(&bufferInfo, nullptr, &buffer);
+	vk::FramebufferCreateInfo framebufferCreateInfo;
+	framebufferCreateInfo.renderPass = renderPass;
+	framebufferCreateInfo.attachmentCount = attachmentCount;
+	framebufferCreateInfo.pAttachments = attachments;
+	framebufferCreateInfo.width = width;
+	framebufferCreateInfo.height = height;
+	framebufferCreateInfo.layers = 1;
+
+	result = mDevice.createFramebuffer(&framebufferCreateInfo, nullptr, &request->Framebuffer);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::CreateBuffer vkCreateBuffer failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::GetFramebuffer vkCreateFramebuffer failed with return code of " << GetResultString((VkResult)result);
+		request->mRealDevice = nullptr;
+		return nullptr;
+	}
+
+	mFramebufferRequests.push_back(request);
+
+	return request->Framebuffer;
+}
+
+void RealDevice::DestroyFramebuffers(vk::ImageView imageView)
+{
+	/*
+	A framebuffer can't outlive the views it was created with so any entry that references this view has to go.
+	*/
+	for (size_t i = 0; i < mFramebufferRequests.size();)
+	{
+		auto& framebufferRequest = (*mFramebufferRequests[i]);
+		if (framebufferRequest.ColorView == imageView || framebufferRequest.DepthView == imageView || framebufferRequest.ResolveView == imageView)
+		{
+			mFramebufferRequests.erase(mFramebufferRequests.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+bool RealDevice::IsFrameComplete(uint64_t frameNumber)
+{
+	if (frameNumber <= mCompletedFrameNumber)
+	{
+		return true;
+	}
+
+	if (frameNumber >= mFrameNumber)
+	{
+		return false; //The frame hasn't been submitted yet.
+	}
+
+	//A fence also covers everything submitted before it so the newest signaled fence tells us how far the gpu has got.
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (mCommandBufferFrames[i] > mCompletedFrameNumber && mDevice.getFenceStatus(mCommandBufferFences[i]) == vk::Result::eSuccess)
+		{
+			mCompletedFrameNumber = mCommandBufferFrames[i];
+		}
+	}
+
+	return frameNumber <= mCompletedFrameNumber;
+}
+
+void RealDevice::WaitForFrame(uint64_t frameNumber)
+{
+	vk::Result result;
+
+	//The frame being recorded can't be waited on so the best we can do is wait for everything before it.
+	frameNumber = std::min(frameNumber, mFrameNumber - 1);
+
+	if (IsFrameComplete(frameNumber))
+	{
 		return;
 	}
 
-	vk::MemoryRequirements memoryRequirements;
-	mDevice.getBufferMemoryRequirements(buffer, &memoryRequirements);
+	//Wait on the oldest submitted frame that covers the one requested.
+	size_t index = 2;
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (mCommandBufferFrames[i] >= frameNumber && (index == 2 || mCommandBufferFrames[i] < mCommandBufferFrames[index]))
+		{
+			index = i;
+		}
+	}
 
-	vk::MemoryAllocateInfo allocInfo;
-	allocInfo.allocationSize = memoryRequirements.size;
-	//allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	if (index == 2)
+	{
+		//The frame was never submitted (a failed present) so there is nothing to wait for.
+		mCompletedFrameNumber = frameNumber;
+		return;
+	}
 
-	if (!GetMemoryTypeFromProperties(mPhysicalDeviceMemoryProperties, memoryRequirements.memoryTypeBits, properties, &allocInfo.memoryTypeIndex))
+	result = mDevice.waitForFences(1, &mCommandBufferFences[index], VK_TRUE, UINT64_MAX);
+	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "Memory type index not found!";
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::WaitForFrame vkWaitForFences failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
-	result = mDevice.allocateMemory(&allocInfo, nullptr, &deviceMemory);
+	mCompletedFrameNumber = std::max(mCompletedFrameNumber, mCommandBufferFrames[index]);
+}
+
+void RealDevice::WaitForSubmittedFrames()
+{
+	//Pending uploads count as submitted because the caller is usually about to destroy something they might reference.
+	mTransferManager.Finish();
+	WaitForFrame(mFrameNumber - 1);
+}
+
+void RealDevice::EndFrame(bool isSubmitted)
+{
+	/*
+	Recording moves to the other command buffer once the gpu is done with the frame it carried last.
+	That lets the gpu work on one frame while the next one is recorded without the cpu ever getting more than a frame ahead.
+	*/
+	vk::Result result;
+
+	if (isSubmitted)
+	{
+		mCommandBufferFrames[mCurrentCommandBuffer] = mFrameNumber;
+	}
+	mFrameNumber++;
+	mCurrentCommandBuffer = !mCurrentCommandBuffer;
+
+	WaitForFrame(mCommandBufferFrames[mCurrentCommandBuffer]);
+
+	result = mDevice.resetFences(1, &mCommandBufferFences[mCurrentCommandBuffer]);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::CreateBuffer vkCreateBuffer failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "RealDevice::EndFrame vkResetFences failed with return code of " << GetResultString((VkResult)result);
+	}
+
+	mCommandBuffers[mCurrentCommandBuffer].reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+	mImageLayoutTracker.BeginFrame(mCommandBuffers[mCurrentCommandBuffer], mFrameNumber);
+}
+
+const uint32_t* RealDevice::GetTexturePalette() const
+{
+	//PALETTEENTRY is red, green, blue and alpha bytes so it can be read as RGBA8.
+	if (mTexturePalette == nullptr)
+	{
+		return nullptr;
+	}
+
+	return (const uint32_t*)mTexturePalette->data();
+}
+
+void RealDevice::UpdateMemoryBudget()
+{
+	mMemoryBudget = 0;
+	mMemoryUsage = 0;
+
+#ifdef VK_EXT_memory_budget
+	if (mHasMemoryBudget)
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT memoryBudgetProperties = {};
+		memoryBudgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2KHR memoryProperties = {};
+		memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+		memoryProperties.pNext = &memoryBudgetProperties;
+
+		mGetPhysicalDeviceMemoryProperties2((VkPhysicalDevice)mPhysicalDevice, &memoryProperties);
+
+		//The driver's usage takes in everything on the heap including the swap chain and other processes.
+		for (uint32_t i = 0; i < mPhysicalDeviceMemoryProperties.memoryHeapCount; i++)
+		{
+			mMemoryManager.mHeapBudgets[i] = memoryBudgetProperties.heapBudget[i];
+			if (mPhysicalDeviceMemoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+			{
+				mMemoryBudget += memoryBudgetProperties.heapBudget[i];
+				mMemoryUsage += memoryBudgetProperties.heapUsage[i];
+			}
+		}
+
 		return;
 	}
+#endif // VK_EXT_memory_budget
 
-	mDevice.bindBufferMemory(buffer, deviceMemory, 0);
+	//Without the extension the budget is the size of the heaps and the usage is what we allocated from them.
+	for (uint32_t i = 0; i < mPhysicalDeviceMemoryProperties.memoryHeapCount; i++)
+	{
+		mMemoryManager.mHeapBudgets[i] = mPhysicalDeviceMemoryProperties.memoryHeaps[i].size;
+		if (mPhysicalDeviceMemoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+		{
+			mMemoryBudget += mPhysicalDeviceMemoryProperties.memoryHeaps[i].size;
+			mMemoryUsage += mMemoryManager.mHeapUsage[i];
+		}
+	}
+	mMemoryUsage += mSwapChainMemorySize;
 }
 
-void RealDevice::CopyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size)
+UINT RealDevice::GetAvailableTextureMemory() const
 {
-	mCommandBuffer.begin(&mBeginInfo);
+	//d3d9 answers in bytes rounded to a megabyte and the answer has to fit in a UINT.
+	vk::DeviceSize availableMemory = (mMemoryBudget > mMemoryUsage) ? (mMemoryBudget - mMemoryUsage) : 0;
+	availableMemory = std::min(availableMemory, (vk::DeviceSize)UINT_MAX);
+
+	return (UINT)(availableMemory & ~((vk::DeviceSize)1024 * 1024 - 1));
+}
+
+void RealDevice::RenameBuffer(vk::Buffer& buffer, MemoryAllocation& allocation, uint64_t& lastUsedFrame, boost::container::small_vector<BufferSlot, 4>& retiredSlots, vk::DeviceSize size, vk::BufferUsageFlags usage, bool preserveContents)
+{
+	/*
+	Swaps the buffer for a copy the gpu isn't reading so the caller can write without waiting on a frame.
+	The old buffer is retired until the last frame that used it is finished and then gets handed out again.
+	*/
+	vk::Result result;
+
+	if (IsFrameComplete(lastUsedFrame))
 	{
-		mCopyRegion.size = size;
-		mCommandBuffer.copyBuffer(srcBuffer, dstBuffer, 1, &mCopyRegion);
+		return; //Nothing is reading the buffer so it can be written in place.
 	}
-	mCommandBuffer.end();
-	mQueue.submit(1, &mSubmitInfo, nullptr);
-	mQueue.waitIdle();
-	mCommandBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources); //So far resetting a command buffer is about 10 times faster than allocating a new one.
-}
\ No newline at end of file
+
+	BufferSlot slot;
+	auto it = std::find_if(retiredSlots.begin(), retiredSlots.end(), [this](const BufferSlot& retiredSlot) { return IsFrameComplete(retiredSlot.LastUsedFrame); });
+	if (it == retiredSlots.end() && retiredSlots.size() >= MaximumRetiredBuffers)
+	{
+		//Don't let a buffer that is discarded every frame grow without bound, wait for the oldest copy unless the current frame is using it.
+		it = std::min_element(retiredSlots.begin(), retiredSlots.end(), [](const BufferSlot& a, const BufferSlot& b) { return a.LastUsedFrame < b.LastUsedFrame; });
+		if (it->LastUsedFrame < mFrameNumber)
+		{
+			WaitForFrame(it->LastUsedFrame);
+		}
+		else
+		{
+			it = retiredSlots.end();
+		}
+	}
+
+	if (it != retiredSlots.end())
+	{
+		slot = (*it);
+		retiredSlots.erase(it);
+	}
+	else
+	{
+		vk::BufferCreateInfo bufferCreateInfo;
+		bufferCreateInfo.size = size;
+		bufferCreateInfo.usage = usage;
+		bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+
+		result = mDevice.createBuffer(&bufferCreateInfo, nullptr, &slot.Buffer);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RenameBuffer vkCreateBuffer failed with return code of " << GetResultString((VkResult)result);
+			return;
+		}
+
+		//The copy has to come from the same memory type so it behaves like the original.
+		vk::MemoryRequirements memoryRequirements;
+		mDevice.getBufferMemoryRequirements(slot.Buffer, &memoryRequirements);
+		memoryRequirements.memoryTypeBits &= (1 << allocation.MemoryTypeIndex);
+
+		result = mMemoryManager.Allocate(memoryRequirements, vk::MemoryPropertyFlags(), true, slot.Allocation);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealDevice::RenameBuffer MemoryManager::Allocate failed with return code of " << GetResultString((VkResult)result);
+			mDevice.destroyBuffer(slot.Buffer, nullptr);
+			return;
+		}
+
+		mDevice.bindBufferMemory(slot.Buffer, slot.Allocation.Memory, slot.Allocation.Offset);
+	}
+
+	if (preserveContents && slot.Allocation.Data != nullptr && allocation.Data != nullptr)
+	{
+		memcpy(slot.Allocation.Data, allocation.Data, size);
+	}
+
+	BufferSlot retiredSlot;
+	retiredSlot.Buffer = buffer;
+	retiredSlot.Allocation = allocation;
+	retiredSlot.LastUsedFrame = lastUsedFrame;
+	retiredSlots.push_back(retiredSlot);
+
+	buffer = slot.Buffer;
+	allocation = slot.Allocation;
+	lastUsedFrame = slot.LastUsedFrame;
+}
@@ -22,11 +22,21 @@ misrepresented as being the original software.
 #include <vulkan/vk_sdk_platform.h>
 #include <memory>
 #include <vector>
+#include <array>
 
 #include "CTypes.h" //needed for DeviceState
+#include "ImageLayoutTracker.h"
+#include "MemoryManager.h"
+#include "TransferManager.h"
+#include "GarbageManager.h"
+#include "ResidencyManager.h"
+#include "ThreadPool.h"
 
 struct RealRenderTarget;
+struct RealSurface;
 struct SamplerRequest;
+struct RenderPassRequest;
+struct FramebufferRequest;
 struct DrawContext;
 class CStateBlock9;
 
@@ -45,6 +55,37 @@ class CStateBlock9;
 #ifndef REALDEVICE_H
 #define REALDEVICE_H
 
+const size_t MaximumRetiredBuffers = 8;
+
+/*
+A texture palette is never changed once it has been handed out, setting new entries makes a new one.
+That lets the application thread and the worker share it without a lock.
+*/
+typedef std::array<PALETTEENTRY, 256> TexturePalette;
+
+/*
+A copy of a buffer that was swapped out by a discard lock. It can be handed out again once the last frame that used it is finished.
+*/
+struct BufferSlot
+{
+	vk::Buffer Buffer;
+	MemoryAllocation Allocation;
+	uint64_t LastUsedFrame = 0;
+};
+
+/*
+Where the data of a DrawPrimitiveUP or DrawIndexedPrimitiveUP call was written in the upload ring.
+*/
+struct UploadDraw
+{
+	bool IsActive = false;
+	vk::Buffer Buffer;
+	vk::DeviceSize VertexOffset = 0;
+	UINT VertexStride = 0;
+	vk::DeviceSize IndexOffset = 0;
+	vk::IndexType IndexType = vk::IndexType::eUint16;
+};
+
 struct RealDevice
 {
 	//Feature and property information
@@ -62,17 +103,48 @@ struct RealDevice
 	vk::CommandPool mCommandPool;
 	vk::CommandBuffer mCommandBuffers[2];
 	uint32_t mCurrentCommandBuffer = 0;
+
+	//Frames are numbered from one. Each command buffer fence signals when the frame it carried last is finished.
+	vk::Fence mCommandBufferFences[2];
+	uint64_t mCommandBufferFrames[2] = {};
+	uint64_t mFrameNumber = 1; //The frame being recorded.
+	uint64_t mCompletedFrameNumber = 0;
+
+	//Upload ring for DrawPrimitiveUP and DrawIndexedPrimitiveUP. The application thread owns the write position.
+	std::vector<BufferSlot> mUploadBuffers;
+	UploadDraw mUploadDraw;
+
+	//Partial ColorFill of a surface that isn't the render target copies out of this, grown to the largest fill.
+	vk::Buffer mFillBuffer;
+	MemoryAllocation mFillBufferAllocation;
+	vk::DeviceSize mFillBufferSize = 0;
+
 	vk::Queue mQueue;
+	TransferManager mTransferManager; //Uploads are recorded here and go out ahead of the frame.
+	GarbageManager mGarbageManager; //Handles wait here until the frames that could use them are finished.
+	ResidencyManager mResidencyManager; //Evicts managed textures when video memory runs short.
+	std::vector<RealSurface*> mStagedSurfaces; //Texture levels holding a staging buffer.
+	ThreadPool mThreadPool; //Splits format conversions of large uploads across threads.
 	vk::Sampler mSampler;
 
+	//Memory budget, refreshed every frame. Only device local heaps count.
+	bool mHasMemoryBudget = false; //VK_EXT_memory_budget is enabled so the driver reports budget and usage.
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR mGetPhysicalDeviceMemoryProperties2 = nullptr;
+	vk::DeviceSize mMemoryBudget = 0;
+	vk::DeviceSize mMemoryUsage = 0;
+	vk::DeviceSize mSwapChainMemorySize = 0; //Estimated, the driver allocates the swap chain images.
+
 	//Misc
-	vk::DeviceSize mEstimatedMemoryUsed = 0;
-	vk::DeviceSize mEstimatedMemory = 2147483648;
 	DeviceState mDeviceState = {};
+	std::shared_ptr<const TexturePalette> mTexturePalette; //The palette P8 and A8P8 levels are expanded with as of the work being processed.
 	CStateBlock9* mCurrentStateRecording = nullptr;
 	boost::container::small_vector< std::shared_ptr<SamplerRequest>, 16> mSamplerRequests;
 	boost::container::small_vector< std::shared_ptr<DrawContext>, 16> mDrawBuffer;
 	std::vector< std::shared_ptr<RealRenderTarget> > mRenderTargets;
+	boost::container::small_vector< std::shared_ptr<RenderPassRequest>, 16> mRenderPassRequests;
+	boost::container::small_vector< std::shared_ptr<FramebufferRequest>, 16> mFramebufferRequests;
+	ImageLayoutTracker mImageLayoutTracker;
+	MemoryManager mMemoryManager;
 	int32_t mVertexCount = 0;
 	Transformations mTransformations;
 	bool mIsDirty = true;
@@ -1170,13 +1242,13 @@ struct RealDevice
 	//Buffer Stuff
 	vk::BufferCopy mCopyRegion;
 	vk::Buffer mLightBuffer;
-	vk::DeviceMemory mLightBufferMemory;
+	MemoryAllocation mLightBufferAllocation;
 	vk::Buffer mMaterialBuffer;
-	vk::DeviceMemory mMaterialBufferMemory;
+	MemoryAllocation mMaterialBufferAllocation;
 
 	//Placeholder image for unbound sampler slots.
 	vk::Image mImage;
-	vk::DeviceMemory mDeviceMemory;
+	MemoryAllocation mImageAllocation;
 	vk::ImageLayout mImageLayout;
 	vk::ImageView mImageView;
 
@@ -1213,9 +1285,21 @@ struct RealDevice
 	RealDevice(vk::Instance instance, vk::PhysicalDevice physicalDevice,int32_t width, int32_t height);
 	~RealDevice();
 
-	void SetImageLayout(vk::Image image, vk::ImageAspectFlags aspectMask, vk::ImageLayout oldImageLayout, vk::ImageLayout newImageLayout, uint32_t levelCount = 1, uint32_t mipIndex = 0, uint32_t layerCount = 1);
-	void CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlagBits properties, vk::Buffer& buffer, vk::DeviceMemory& deviceMemory);
-	void CopyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size);
+	void SetImageLayout(vk::Image image, vk::ImageLayout newImageLayout, uint32_t levelCount = VK_REMAINING_MIP_LEVELS, uint32_t mipIndex = 0, uint32_t layerCount = VK_REMAINING_ARRAY_LAYERS, uint32_t layerIndex = 0);
+	void CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, vk::Buffer& buffer, MemoryAllocation& allocation);
+	void GenerateMipSubLevels(vk::CommandBuffer commandBuffer, vk::Image image, vk::Format format, vk::Extent3D extent, uint32_t levelCount, uint32_t layerCount, uint32_t layerIndex, vk::Filter filter);
+	void CopyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize offset, vk::DeviceSize size, vk::AccessFlags dstAccessMask = vk::AccessFlagBits::eMemoryRead, vk::PipelineStageFlags dstStageMask = vk::PipelineStageFlagBits::eAllCommands);
+	vk::RenderPass GetRenderPass(vk::Format colorFormat, vk::Format depthFormat, vk::AttachmentLoadOp colorLoadOp, vk::AttachmentLoadOp depthLoadOp, vk::AttachmentLoadOp stencilLoadOp, vk::AttachmentStoreOp storeOp, vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1);
+	vk::Framebuffer GetFramebuffer(vk::RenderPass renderPass, vk::ImageView colorView, vk::ImageView depthView, uint32_t width, uint32_t height, vk::ImageView resolveView = nullptr);
+	void DestroyFramebuffers(vk::ImageView imageView);
+	bool IsFrameComplete(uint64_t frameNumber);
+	void WaitForFrame(uint64_t frameNumber);
+	void WaitForSubmittedFrames();
+	void EndFrame(bool isSubmitted);
+	const uint32_t* GetTexturePalette() const;
+	void UpdateMemoryBudget();
+	UINT GetAvailableTextureMemory() const;
+	void RenameBuffer(vk::Buffer& buffer, MemoryAllocation& allocation, uint64_t& lastUsedFrame, boost::container::small_vector<BufferSlot, 4>& retiredSlots, vk::DeviceSize size, vk::BufferUsageFlags usage, bool preserveContents);
 };
 
 #endif // REALDEVICE_H
\ No newline at end of file
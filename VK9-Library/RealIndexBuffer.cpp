@@ -31,8 +31,16 @@ RealIndexBuffer::~RealIndexBuffer()
 	BOOST_LOG_TRIVIAL(info) << "RealIndexBuffer::~RealIndexBuffer";
 	if (mRealDevice != nullptr)
 	{
-		auto& device = mRealDevice->mDevice;
-		device.destroyBuffer(mBuffer, nullptr);
-		device.freeMemory(mMemory, nullptr);
+		//A frame or upload that is still in flight might be reading the buffer or one of its retired copies so they go to the garbage manager instead of being waited on.
+		auto& garbageManager = mRealDevice->mGarbageManager;
+		garbageManager.Retire(mBuffer);
+		garbageManager.Retire(mAllocation);
+		for (auto& slot : mRetiredSlots)
+		{
+			garbageManager.Retire(slot.Buffer);
+			garbageManager.Retire(slot.Allocation);
+		}
+		garbageManager.Retire(mStagingBuffer);
+		garbageManager.Retire(mStagingAllocation);
 	}
 }
\ No newline at end of file
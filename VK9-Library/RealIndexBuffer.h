@@ -31,9 +31,19 @@ struct RealIndexBuffer
 {
 	vk::MemoryRequirements mMemoryRequirements;
 	vk::Buffer mBuffer;
-	vk::DeviceMemory mMemory;
+	MemoryAllocation mAllocation;
+	vk::DeviceSize mLength = 0;
+	bool mIsDynamic = false;
+	uint64_t mLastUsedFrame = 0;
+
+	//Dynamic buffers swap to one of these on a discard lock while the gpu finishes with the old contents.
+	boost::container::small_vector<BufferSlot, 4> mRetiredSlots;
+
+	//Static buffers live in device local memory and are written through this buffer.
+	vk::Buffer mStagingBuffer;
+	MemoryAllocation mStagingAllocation;
+	uint64_t mUploadBatch = 0; //The upload batch that last copied out of the staging buffer.
 	vk::IndexType mIndexType;
-	void* mData = nullptr;
 	int32_t mSize;
 
 	RealDevice* mRealDevice = nullptr; //null if not owner.
@@ -24,141 +24,37 @@ misrepresented as being the original software.
 #include "Utilities.h"
 
 
-RealRenderTarget::RealRenderTarget(vk::Device device, RealTexture* colorTexture, RealSurface* colorSurface, RealSurface* depthSurface)
-	: mDevice(device),
+RealRenderTarget::RealRenderTarget(RealDevice* realDevice, RealTexture* colorTexture, RealSurface* colorSurface, RealSurface* depthSurface)
+	: mRealDevice(realDevice),
+	mDevice(realDevice->mDevice),
 	mColorTexture(colorTexture),
 	mColorSurface(colorSurface),
 	mDepthSurface(depthSurface)
 {
-	if (colorTexture == nullptr || depthSurface == nullptr)
+	if (colorTexture == nullptr || colorSurface == nullptr || depthSurface == nullptr)
 	{
 		return;
 	}
 	//BOOST_LOG_TRIVIAL(info) << "RealRenderTarget::RealRenderTarget";
 
-	vk::Result result;
-
-	mCommandBufferBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-
-	vk::AttachmentReference colorReference;
-	colorReference.attachment = 0;
-	colorReference.layout = vk::ImageLayout::eGeneral; //eColorAttachmentOptimal
-
-	vk::AttachmentReference depthReference;
-	depthReference.attachment = 1;
-	depthReference.layout = vk::ImageLayout::eGeneral; //eDepthStencilAttachmentOptimal
-
-	vk::SubpassDescription subpass;
-	subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-	subpass.inputAttachmentCount = 0;
-	subpass.pInputAttachments = nullptr;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorReference;
-	subpass.pResolveAttachments = nullptr;
-	subpass.pDepthStencilAttachment = &depthReference;
-	subpass.preserveAttachmentCount = 0;
-	subpass.pPreserveAttachments = nullptr;
-
-	mRenderAttachments[0].format = mColorTexture->mRealFormat;
-	mRenderAttachments[0].samples = vk::SampleCountFlagBits::e1;
-	mRenderAttachments[0].loadOp = vk::AttachmentLoadOp::eLoad;
-	mRenderAttachments[0].storeOp = vk::AttachmentStoreOp::eStore;
-	mRenderAttachments[0].stencilLoadOp = vk::AttachmentLoadOp::eLoad;
-	mRenderAttachments[0].stencilStoreOp = vk::AttachmentStoreOp::eStore;
-	mRenderAttachments[0].initialLayout = vk::ImageLayout::eGeneral;
-	mRenderAttachments[0].finalLayout = vk::ImageLayout::eGeneral;
-
-	mRenderAttachments[1].format = mDepthSurface->mRealFormat;
-	mRenderAttachments[1].samples = vk::SampleCountFlagBits::e1;
-	mRenderAttachments[1].loadOp = vk::AttachmentLoadOp::eLoad;
-	mRenderAttachments[1].storeOp = vk::AttachmentStoreOp::eStore;
-	mRenderAttachments[1].stencilLoadOp = vk::AttachmentLoadOp::eLoad;
-	mRenderAttachments[1].stencilStoreOp = vk::AttachmentStoreOp::eStore;
-	mRenderAttachments[1].initialLayout = vk::ImageLayout::eGeneral;
-	mRenderAttachments[1].finalLayout = vk::ImageLayout::eGeneral;
-
-	vk::SubpassDependency dependency;
-	dependency.srcStageMask = vk::PipelineStageFlagBits::eAllGraphics;
-	dependency.dstStageMask = vk::PipelineStageFlagBits::eAllGraphics;
-
-	vk::RenderPassCreateInfo renderPassCreateInfo;
-	renderPassCreateInfo.attachmentCount = 2; //revisit
-	renderPassCreateInfo.pAttachments = mRenderAttachments;
-	renderPassCreateInfo.subpassCount = 1;
-	renderPassCreateInfo.pSubpasses = &subpass;
-	renderPassCreateInfo.dependencyCount = 1;
-	renderPassCreateInfo.pDependencies = &dependency;
-
-	result = mDevice.createRenderPass(&renderPassCreateInfo, nullptr, &mStoreRenderPass);
-	if (result != vk::Result::eSuccess)
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealRenderTarget::RealRenderTarget vkCreateRenderPass failed with return code of " << GetResultString((VkResult)result);
-		return;
-	}
-
-	mRenderAttachments[0].loadOp = vk::AttachmentLoadOp::eClear;
-	mRenderAttachments[1].loadOp = vk::AttachmentLoadOp::eClear;
-
-	result = mDevice.createRenderPass(&renderPassCreateInfo, nullptr, &mClearRenderPass);
-	if (result != vk::Result::eSuccess)
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealRenderTarget::RealRenderTarget vkCreateRenderPass failed with return code of " << GetResultString((VkResult)result);
-		return;
-	}
-
-	vk::ImageView attachments[2];
-	attachments[0] = mColorTexture->mImageView;
-	attachments[1] = mDepthSurface->mStagingImageView;
-
-	vk::FramebufferCreateInfo framebufferCreateInfo;
-	framebufferCreateInfo.renderPass = mStoreRenderPass;
-	framebufferCreateInfo.attachmentCount = 2;
-	framebufferCreateInfo.pAttachments = attachments;
-	framebufferCreateInfo.width = mColorTexture->mExtent.width;
-	framebufferCreateInfo.height = mColorTexture->mExtent.height;
-	framebufferCreateInfo.layers = 1;
-
-	result = mDevice.createFramebuffer(&framebufferCreateInfo, nullptr, &mFramebuffer);
-	if (result != vk::Result::eSuccess)
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealRenderTarget::RealRenderTarget vkCreateFramebuffer failed with return code of " << GetResultString((VkResult)result);
-		return;
-	}
-
-	mClearValues[0].color = mClearColorValue;
-	mClearValues[1].depthStencil = mClearDepthValue; //vk::ClearDepthStencilValue(1.0f, 0);
-
-	mRenderPassBeginInfo.framebuffer = mFramebuffer;
-	mRenderPassBeginInfo.renderArea.offset.x = 0;
-	mRenderPassBeginInfo.renderArea.offset.y = 0;
-	mRenderPassBeginInfo.renderArea.extent.width = mColorTexture->mExtent.width;
-	mRenderPassBeginInfo.renderArea.extent.height = mColorTexture->mExtent.height;
-	mRenderPassBeginInfo.clearValueCount = 2; //2
-	mRenderPassBeginInfo.pClearValues = mClearValues;
-
-	//realWindow.mImageMemoryBarrier.srcAccessMask = 0;
-	mImageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
-	mImageMemoryBarrier.oldLayout = vk::ImageLayout::eGeneral; //eUndefined
-	mImageMemoryBarrier.newLayout = vk::ImageLayout::eGeneral; //ePresentSrcKHR
-	mImageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	mImageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	mImageMemoryBarrier.image = mColorTexture->mImage;
-	mImageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-
-	result = mDevice.createSemaphore(&mPresentCompleteSemaphoreCreateInfo, nullptr, &mPresentCompleteSemaphore);
-	if (result != vk::Result::eSuccess)
+	//The surface's view covers only its own level and cube face so any of them can be attached.
+	if (!mColorSurface->mStagingImageView)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateWindow1 vkCreateSemaphore failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "RealRenderTarget::RealRenderTarget the texture level has no view to render to.";
 		return;
 	}
+	mColorImage = mColorTexture->mImage;
+	mOutputImage = mColorImage;
+	mColorMipIndex = mColorSurface->mSubresource.mipLevel;
+	mColorLayerIndex = mColorSurface->mSubresource.arrayLayer;
+	mColorFormat = mColorTexture->mRealFormat;
 
-	vk::FenceCreateInfo fenceInfo;
-
-	mDevice.createFence(&fenceInfo, nullptr, &mCommandFence);
+	Initialize();
 }
 
-RealRenderTarget::RealRenderTarget(vk::Device device, RealSurface* colorSurface, RealSurface* depthSurface)
-	: mDevice(device),
+RealRenderTarget::RealRenderTarget(RealDevice* realDevice, RealSurface* colorSurface, RealSurface* depthSurface)
+	: mRealDevice(realDevice),
+	mDevice(realDevice->mDevice),
 	mColorSurface(colorSurface),
 	mDepthSurface(depthSurface)
 {
@@ -173,97 +69,37 @@ RealRenderTarget::RealRenderTarget(vk::Device device, RealSurface* colorSurface,
 
 	//BOOST_LOG_TRIVIAL(info) << "RealRenderTarget::RealRenderTarget";
 
+	//Multisampled targets are resolved by the render pass so anything reading the result uses the resolve image.
+	mColorImage = mColorSurface->mStagingImage;
+	mOutputImage = mColorSurface->mResolveImage ? mColorSurface->mResolveImage : mColorImage;
+	mSamples = mColorSurface->mSamples;
+	mColorFormat = mColorSurface->mRealFormat;
+
+	Initialize();
+}
+
+void RealRenderTarget::Initialize()
+{
 	vk::Result result;
 
 	mCommandBufferBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
 
-	vk::AttachmentReference colorReference;
-	colorReference.attachment = 0;
-	colorReference.layout = vk::ImageLayout::eGeneral; //eColorAttachmentOptimal
-
-	vk::AttachmentReference depthReference;
-	depthReference.attachment = 1;
-	depthReference.layout = vk::ImageLayout::eGeneral; //eDepthStencilAttachmentOptimal
-
-	vk::SubpassDescription subpass;
-	subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-	subpass.inputAttachmentCount = 0;
-	subpass.pInputAttachments = nullptr;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorReference;
-	subpass.pResolveAttachments = nullptr;
-	subpass.pDepthStencilAttachment = &depthReference;
-	subpass.preserveAttachmentCount = 0;
-	subpass.pPreserveAttachments = nullptr;
-
-	mRenderAttachments[0].format = mColorSurface->mRealFormat;
-	mRenderAttachments[0].samples = vk::SampleCountFlagBits::e1;
-	mRenderAttachments[0].loadOp = vk::AttachmentLoadOp::eLoad;
-	mRenderAttachments[0].storeOp = vk::AttachmentStoreOp::eStore;
-	mRenderAttachments[0].stencilLoadOp = vk::AttachmentLoadOp::eLoad;
-	mRenderAttachments[0].stencilStoreOp = vk::AttachmentStoreOp::eStore;
-	mRenderAttachments[0].initialLayout = vk::ImageLayout::eGeneral; // vk::ImageLayout::eUndefined;  ePresentSrcKHR
-	mRenderAttachments[0].finalLayout = vk::ImageLayout::eGeneral;
-
-	mRenderAttachments[1].format = mDepthSurface->mRealFormat;
-	mRenderAttachments[1].samples = vk::SampleCountFlagBits::e1;
-	mRenderAttachments[1].loadOp = vk::AttachmentLoadOp::eLoad;
-	mRenderAttachments[1].storeOp = vk::AttachmentStoreOp::eStore;
-	mRenderAttachments[1].stencilLoadOp = vk::AttachmentLoadOp::eLoad;
-	mRenderAttachments[1].stencilStoreOp = vk::AttachmentStoreOp::eStore;
-	mRenderAttachments[1].initialLayout = vk::ImageLayout::eGeneral; //vk::ImageLayout::eUndefined; eDepthStencilAttachmentOptimal
-	mRenderAttachments[1].finalLayout = vk::ImageLayout::eGeneral;
-
-	vk::SubpassDependency dependency;
-	dependency.srcStageMask = vk::PipelineStageFlagBits::eAllGraphics;
-	dependency.dstStageMask = vk::PipelineStageFlagBits::eAllGraphics;
-
-	vk::RenderPassCreateInfo renderPassCreateInfo;
-	renderPassCreateInfo.attachmentCount = 2; //revisit
-	renderPassCreateInfo.pAttachments = mRenderAttachments;
-	renderPassCreateInfo.subpassCount = 1;
-	renderPassCreateInfo.pSubpasses = &subpass;
-	renderPassCreateInfo.dependencyCount = 1;
-	renderPassCreateInfo.pDependencies = &dependency;
-
-	result = mDevice.createRenderPass(&renderPassCreateInfo, nullptr, &mStoreRenderPass);
-	if (result != vk::Result::eSuccess)
+	//The passes and framebuffer are owned by the device so switching targets doesn't have to rebuild them.
+	//Clear passes are looked up when a clear actually starts the scene because they depend on the clear flags.
+	mDepthFormat = mDepthSurface->mRealFormat;
+	if (mDepthSurface->mSamples != mSamples)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealRenderTarget::RealRenderTarget vkCreateRenderPass failed with return code of " << GetResultString((VkResult)result);
-		return;
+		BOOST_LOG_TRIVIAL(warning) << "RealRenderTarget::Initialize the depth surface sample count doesn't match the color attachment.";
 	}
-
-	mRenderAttachments[0].loadOp = vk::AttachmentLoadOp::eClear;
-	mRenderAttachments[1].loadOp = vk::AttachmentLoadOp::eClear;
-
-	result = mDevice.createRenderPass(&renderPassCreateInfo, nullptr, &mClearRenderPass);
-	if (result != vk::Result::eSuccess)
+	mStoreRenderPass = mRealDevice->GetRenderPass(mColorFormat, mDepthFormat, vk::AttachmentLoadOp::eLoad, vk::AttachmentLoadOp::eLoad, vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore, mSamples);
+	mFramebuffer = mRealDevice->GetFramebuffer(mStoreRenderPass, mColorSurface->mStagingImageView, mDepthSurface->mStagingImageView, mColorSurface->mExtent.width, mColorSurface->mExtent.height, mColorSurface->mResolveImageView);
+	if (!mStoreRenderPass || !mFramebuffer)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealRenderTarget::RealRenderTarget vkCreateRenderPass failed with return code of " << GetResultString((VkResult)result);
-		return;
-	}
-
-	vk::ImageView attachments[2];
-	attachments[0] = mColorSurface->mStagingImageView;
-	attachments[1] = mDepthSurface->mStagingImageView;
-
-	vk::FramebufferCreateInfo framebufferCreateInfo;
-	framebufferCreateInfo.renderPass = mStoreRenderPass;
-	framebufferCreateInfo.attachmentCount = 2;
-	framebufferCreateInfo.pAttachments = attachments;
-	framebufferCreateInfo.width = mColorSurface->mExtent.width;
-	framebufferCreateInfo.height = mColorSurface->mExtent.height;
-	framebufferCreateInfo.layers = 1;
-
-	result = mDevice.createFramebuffer(&framebufferCreateInfo, nullptr, &mFramebuffer);
-	if (result != vk::Result::eSuccess)
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealRenderTarget::RealRenderTarget vkCreateFramebuffer failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
 	mClearValues[0].color = mClearColorValue;
-	mClearValues[1].depthStencil = vk::ClearDepthStencilValue(1.0f, 0);
+	mClearValues[1].depthStencil = mClearDepthValue;
 
 	mRenderPassBeginInfo.framebuffer = mFramebuffer;
 	mRenderPassBeginInfo.renderArea.offset.x = 0;
@@ -279,13 +115,13 @@ RealRenderTarget::RealRenderTarget(vk::Device device, RealSurface* colorSurface,
 	mImageMemoryBarrier.newLayout = vk::ImageLayout::eGeneral; //ePresentSrcKHR
 	mImageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	mImageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	mImageMemoryBarrier.image = mColorSurface->mStagingImage;
-	mImageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	mImageMemoryBarrier.image = mColorImage;
+	mImageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, mColorMipIndex, 1, mColorLayerIndex, 1 };
 
 	result = mDevice.createSemaphore(&mPresentCompleteSemaphoreCreateInfo, nullptr, &mPresentCompleteSemaphore);
 	if (result != vk::Result::eSuccess)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "StateManager::CreateWindow1 vkCreateSemaphore failed with return code of " << GetResultString((VkResult)result);
+		BOOST_LOG_TRIVIAL(fatal) << "RealRenderTarget::Initialize vkCreateSemaphore failed with return code of " << GetResultString((VkResult)result);
 		return;
 	}
 
@@ -299,9 +135,26 @@ RealRenderTarget::~RealRenderTarget()
 	BOOST_LOG_TRIVIAL(info) << "RealRenderTarget::~RealRenderTarget";
 	mDevice.destroyFence(mCommandFence, nullptr);
 	mDevice.destroySemaphore(mPresentCompleteSemaphore, nullptr);
-	mDevice.destroyFramebuffer(mFramebuffer, nullptr);
-	mDevice.destroyRenderPass(mStoreRenderPass, nullptr);
-	mDevice.destroyRenderPass(mClearRenderPass, nullptr);
+	//The framebuffer and render passes belong to the device cache.
+}
+
+bool RealRenderTarget::HasDepth() const
+{
+	return (mDepthFormat != vk::Format::eUndefined && mDepthFormat != vk::Format::eS8Uint);
+}
+
+bool RealRenderTarget::HasStencil() const
+{
+	return (mDepthFormat == vk::Format::eD16UnormS8Uint || mDepthFormat == vk::Format::eD24UnormS8Uint || mDepthFormat == vk::Format::eD32SfloatS8Uint || mDepthFormat == vk::Format::eS8Uint);
+}
+
+vk::RenderPass RealRenderTarget::GetClearRenderPass(DWORD Flags)
+{
+	vk::AttachmentLoadOp colorLoadOp = ((Flags & D3DCLEAR_TARGET) == D3DCLEAR_TARGET) ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+	vk::AttachmentLoadOp depthLoadOp = ((Flags & D3DCLEAR_ZBUFFER) == D3DCLEAR_ZBUFFER) ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+	vk::AttachmentLoadOp stencilLoadOp = ((Flags & D3DCLEAR_STENCIL) == D3DCLEAR_STENCIL) ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+
+	return mRealDevice->GetRenderPass(mColorFormat, mDepthFormat, colorLoadOp, depthLoadOp, stencilLoadOp, vk::AttachmentStoreOp::eStore, mSamples);
 }
 
 void RealRenderTarget::StartScene(vk::CommandBuffer command, DeviceState& deviceState, bool clear, bool createNewCommand)
@@ -311,7 +164,8 @@ void RealRenderTarget::StartScene(vk::CommandBuffer command, DeviceState& device
 	if (clear)
 	{
 		mClearValues[0].color = mClearColorValue;
-		mRenderPassBeginInfo.renderPass = mClearRenderPass;
+		mClearValues[1].depthStencil = mClearDepthValue;
+		mRenderPassBeginInfo.renderPass = GetClearRenderPass(mClearFlags);
 	}
 	else
 	{
@@ -331,21 +185,18 @@ void RealRenderTarget::StartScene(vk::CommandBuffer command, DeviceState& device
 	command.setViewport(0, 1, &deviceState.mViewport);
 	command.setScissor(0, 1, &deviceState.mScissor);
 
-	ReallySetImageLayout(command, mColorSurface->mStagingImage, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, 0, 1); //ePresentSrcKHR
-	
-	auto& realFormat = mDepthSurface->mRealFormat;
-	if (realFormat == vk::Format::eD16UnormS8Uint || realFormat == vk::Format::eD24UnormS8Uint || realFormat == vk::Format::eD32SfloatS8Uint)
-	{
-		ReallySetImageLayout(command, mDepthSurface->mStagingImage, vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, 0, 1); //eDepthStencilAttachmentOptimal
-	}
-	else if (realFormat == vk::Format::eS8Uint)
+	//Attachments a clear load op fully overwrites don't need their old contents so the transition can discard them.
+	auto& imageLayoutTracker = mRealDevice->mImageLayoutTracker;
+	DWORD clearFlags = clear ? mClearFlags : 0;
+	bool discardDepth = (!HasDepth() || (clearFlags & D3DCLEAR_ZBUFFER) == D3DCLEAR_ZBUFFER) && (!HasStencil() || (clearFlags & D3DCLEAR_STENCIL) == D3DCLEAR_STENCIL);
+
+	imageLayoutTracker.Transition(command, mColorImage, vk::ImageLayout::eColorAttachmentOptimal, 1, mColorMipIndex, 1, mColorLayerIndex, (clearFlags & D3DCLEAR_TARGET) == D3DCLEAR_TARGET);
+	imageLayoutTracker.Transition(command, mDepthSurface->mStagingImage, vk::ImageLayout::eDepthStencilAttachmentOptimal, 1, 0, 1, 0, discardDepth);
+	if (mOutputImage != mColorImage)
 	{
-		ReallySetImageLayout(command, mDepthSurface->mStagingImage, vk::ImageAspectFlagBits::eStencil, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, 0, 1); //eDepthStencilAttachmentOptimal
+		imageLayoutTracker.Transition(command, mOutputImage, vk::ImageLayout::eColorAttachmentOptimal, 1, 0, 1, 0, true);
 	}
-	else
-	{
-		ReallySetImageLayout(command, mDepthSurface->mStagingImage, vk::ImageAspectFlagBits::eDepth, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, 0, 1); //eDepthStencilAttachmentOptimal
-	}	
+	imageLayoutTracker.Flush(command);
 
 	command.beginRenderPass(&mRenderPassBeginInfo, vk::SubpassContents::eInline);
 
@@ -379,55 +230,122 @@ void RealRenderTarget::Clear(vk::CommandBuffer command, DeviceState& deviceState
 		mClearDepthValue = vk::ClearDepthStencilValue(Z, Stencil);
 	}
 
-	if (Count > 0 && pRects != nullptr)
+	//Only clear the aspects the depth format actually has.
+	if (!HasStencil())
 	{
-		BOOST_LOG_TRIVIAL(warning) << "RealRenderTarget::Clear is not fully implemented!";
-		return;
+		Flags &= ~D3DCLEAR_STENCIL;
+	}
+	if (!HasDepth())
+	{
+		Flags &= ~D3DCLEAR_ZBUFFER;
 	}
 
-	vk::ImageSubresourceRange subResourceRange;
-	//subResourceRange.aspectMask = vk::ImageAspectFlagBits::eColor | vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
-	subResourceRange.baseMipLevel = 0;
-	subResourceRange.levelCount = 1;
-	subResourceRange.baseArrayLayer = 0;
-	subResourceRange.layerCount = 1;
+	/*
+	D3D9 clears the viewport (or the rects clipped to the viewport) so a load op clear can only be used when the viewport covers the whole target.
+	*/
+	auto& renderArea = mRenderPassBeginInfo.renderArea;
+	auto& viewport = deviceState.m9Viewport;
+	bool isFullClear = ((Count == 0 || pRects == nullptr)
+		&& viewport.X == 0 && viewport.Y == 0
+		&& viewport.Width >= renderArea.extent.width && viewport.Height >= renderArea.extent.height);
 
-	if (mIsSceneStarted)
+	if (!mIsSceneStarted)
 	{
-		command.endRenderPass();
-
-		if ((Flags & D3DCLEAR_TARGET) == D3DCLEAR_TARGET)
+		if (isFullClear)
 		{
-			subResourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+			//Nothing has been drawn yet so the clear can be done by the render pass load op.
+			mClearFlags = Flags;
+			this->StartScene(command, deviceState, true, deviceState.hasPresented);
+			deviceState.hasPresented = false;
+			return;
+		}
 
-			//ReallySetImageLayout(command, mColorSurface->mStagingImage, subResourceRange.aspectMask, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1, 0, 1);
-			command.clearColorImage(mColorSurface->mStagingImage, vk::ImageLayout::eGeneral, &mClearColorValue, 1, &subResourceRange);
-			//ReallySetImageLayout(command, mColorSurface->mStagingImage, subResourceRange.aspectMask, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, 1, 0, 1);
+		this->StartScene(command, deviceState, false, deviceState.hasPresented);
+		deviceState.hasPresented = false;
+	}
+
+	//The scene is already running so clear the attachments inside of the pass instead of splitting it.
+	vk::ClearAttachment clearAttachments[2];
+	uint32_t clearAttachmentCount = 0;
+
+	if ((Flags & D3DCLEAR_TARGET) == D3DCLEAR_TARGET)
+	{
+		clearAttachments[clearAttachmentCount].aspectMask = vk::ImageAspectFlagBits::eColor;
+		clearAttachments[clearAttachmentCount].colorAttachment = 0;
+		clearAttachments[clearAttachmentCount].clearValue.color = mClearColorValue;
+		clearAttachmentCount++;
+	}
+
+	if ((Flags & D3DCLEAR_STENCIL) == D3DCLEAR_STENCIL || (Flags & D3DCLEAR_ZBUFFER) == D3DCLEAR_ZBUFFER)
+	{
+		vk::ImageAspectFlags aspectMask;
+
+		if ((Flags & D3DCLEAR_STENCIL) == D3DCLEAR_STENCIL)
+		{
+			aspectMask |= vk::ImageAspectFlagBits::eStencil;
 		}
 
-		if ((Flags & D3DCLEAR_STENCIL) == D3DCLEAR_STENCIL || (Flags & D3DCLEAR_ZBUFFER) == D3DCLEAR_ZBUFFER)
+		if ((Flags & D3DCLEAR_ZBUFFER) == D3DCLEAR_ZBUFFER)
 		{
-			subResourceRange.aspectMask = vk::ImageAspectFlags();
+			aspectMask |= vk::ImageAspectFlagBits::eDepth;
+		}
 
-			if ((Flags & D3DCLEAR_STENCIL) == D3DCLEAR_STENCIL)
-			{
-				subResourceRange.aspectMask |= vk::ImageAspectFlagBits::eStencil;
-			}
+		clearAttachments[clearAttachmentCount].aspectMask = aspectMask;
+		clearAttachments[clearAttachmentCount].clearValue.depthStencil = mClearDepthValue;
+		clearAttachmentCount++;
+	}
 
-			if ((Flags & D3DCLEAR_ZBUFFER) == D3DCLEAR_ZBUFFER)
+	if (!clearAttachmentCount)
+	{
+		return;
+	}
+
+	//Clamp everything to the viewport and the render area.
+	int32_t left = std::max((int32_t)viewport.X, renderArea.offset.x);
+	int32_t top = std::max((int32_t)viewport.Y, renderArea.offset.y);
+	int32_t right = std::min((int32_t)(viewport.X + viewport.Width), renderArea.offset.x + (int32_t)renderArea.extent.width);
+	int32_t bottom = std::min((int32_t)(viewport.Y + viewport.Height), renderArea.offset.y + (int32_t)renderArea.extent.height);
+
+	boost::container::small_vector<vk::ClearRect, 16> clearRects;
+
+	if (Count > 0 && pRects != nullptr)
+	{
+		for (size_t i = 0; i < Count; i++)
+		{
+			int32_t x1 = std::max((int32_t)pRects[i].x1, left);
+			int32_t y1 = std::max((int32_t)pRects[i].y1, top);
+			int32_t x2 = std::min((int32_t)pRects[i].x2, right);
+			int32_t y2 = std::min((int32_t)pRects[i].y2, bottom);
+
+			if (x2 <= x1 || y2 <= y1)
 			{
-				subResourceRange.aspectMask |= vk::ImageAspectFlagBits::eDepth;
+				continue;
 			}
 
-			//ReallySetImageLayout(command, mDepthSurface->mStagingImage, subResourceRange.aspectMask, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1, 0, 1);
-			command.clearDepthStencilImage(mDepthSurface->mStagingImage, vk::ImageLayout::eGeneral, &mClearDepthValue, 1, &subResourceRange);
-			//ReallySetImageLayout(command, mDepthSurface->mStagingImage, subResourceRange.aspectMask, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral, 1, 0, 1);
+			vk::ClearRect clearRect;
+			clearRect.rect.offset.x = x1;
+			clearRect.rect.offset.y = y1;
+			clearRect.rect.extent.width = (uint32_t)(x2 - x1);
+			clearRect.rect.extent.height = (uint32_t)(y2 - y1);
+			clearRect.baseArrayLayer = 0;
+			clearRect.layerCount = 1;
+			clearRects.push_back(clearRect);
 		}
-
-		command.beginRenderPass(&mRenderPassBeginInfo, vk::SubpassContents::eInline);
 	}
-	else
+	else if (right > left && bottom > top)
+	{
+		vk::ClearRect clearRect;
+		clearRect.rect.offset.x = left;
+		clearRect.rect.offset.y = top;
+		clearRect.rect.extent.width = (uint32_t)(right - left);
+		clearRect.rect.extent.height = (uint32_t)(bottom - top);
+		clearRect.baseArrayLayer = 0;
+		clearRect.layerCount = 1;
+		clearRects.push_back(clearRect);
+	}
+
+	if (clearRects.size())
 	{
-		this->StartScene(command, deviceState, true, deviceState.hasPresented);
+		command.clearAttachments(clearAttachmentCount, clearAttachments, (uint32_t)clearRects.size(), clearRects.data());
 	}
-}
\ No newline at end of file
+}
@@ -24,6 +24,7 @@ misrepresented as being the original software.
 #include "d3d9.h"
 #include "CTypes.h" //Needed for DeviceState
 
+struct RealDevice;
 struct RealSurface;
 struct RealTexture;
 
@@ -32,23 +33,30 @@ struct RealTexture;
 
 struct RealRenderTarget
 {
+	RealDevice* mRealDevice = nullptr;
 	vk::Device mDevice;
 	RealTexture* mColorTexture = nullptr;
 	RealSurface* mColorSurface = nullptr;
 	RealSurface* mDepthSurface = nullptr;
+	vk::Image mColorImage; //The texture image for texture targets otherwise the surface image.
+	vk::Image mOutputImage; //The resolve image for multisampled targets otherwise the color image.
+	uint32_t mColorMipIndex = 0; //The level and face of mColorImage that is attached, only texture targets use anything but the first.
+	uint32_t mColorLayerIndex = 0;
+	vk::SampleCountFlagBits mSamples = vk::SampleCountFlagBits::e1;
 
-	RealRenderTarget(vk::Device device, RealTexture* colorTexture, RealSurface* colorSurface, RealSurface* depthSurface);
-	RealRenderTarget(vk::Device device, RealSurface* colorSurface, RealSurface* depthSurface);
+	RealRenderTarget(RealDevice* realDevice, RealTexture* colorTexture, RealSurface* colorSurface, RealSurface* depthSurface);
+	RealRenderTarget(RealDevice* realDevice, RealSurface* colorSurface, RealSurface* depthSurface);
 	~RealRenderTarget();
 
 	bool mIsSceneStarted = false;
 	vk::RenderPass mStoreRenderPass;
-	vk::RenderPass mClearRenderPass;
-	vk::AttachmentDescription mRenderAttachments[2];
+	vk::Format mColorFormat = vk::Format::eUndefined;
+	vk::Format mDepthFormat = vk::Format::eUndefined;
+	DWORD mClearFlags = 0;
 	vk::ClearValue mClearValues[2];
 	vk::ColorSpaceKHR mColorSpace;
 	vk::ClearColorValue mClearColorValue;
-	vk::ClearDepthStencilValue mClearDepthValue;
+	vk::ClearDepthStencilValue mClearDepthValue = vk::ClearDepthStencilValue(1.0f, 0); //The values a clear leaves behind, also used by the load op of clear passes.
 	vk::Framebuffer mFramebuffer;
 	vk::RenderPassBeginInfo mRenderPassBeginInfo;
 	vk::ImageMemoryBarrier mImageMemoryBarrier;
@@ -61,6 +69,10 @@ struct RealRenderTarget
 	vk::Fence mCommandFence;
 	vk::CommandBufferBeginInfo mCommandBufferBeginInfo;
 
+	void Initialize(); //Setup shared by texture and surface targets once the color attachment is known.
+	bool HasDepth() const;
+	bool HasStencil() const;
+	vk::RenderPass GetClearRenderPass(DWORD Flags);
 	void StartScene(vk::CommandBuffer command, DeviceState& deviceState, bool clear, bool createNewCommand);
 	void StopScene(vk::CommandBuffer command, vk::Queue queue);
 	void Clear(vk::CommandBuffer command, DeviceState& deviceState, DWORD Count, const D3DRECT *pRects, DWORD Flags, D3DCOLOR Color, float Z, DWORD Stencil);
@@ -31,7 +31,8 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 
 	vk::Result result;
 
-	mRealFormat = ConvertFormat(surface9->mFormat);
+	mConversion = GetFormatConversion(realDevice->mPhysicalDevice, realDevice->mPhysicalDeviceFeatures, surface9->mFormat);
+	mRealFormat = mConversion.Format;
 
 	if (mRealFormat == vk::Format::eUndefined)//VK_FORMAT_UNDEFINED
 	{
@@ -55,6 +56,10 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 
 	}
 
+	const bool isTextureLevel = (surface9->mTexture != nullptr || surface9->mCubeTexture != nullptr);
+	mStagingState = &surface9->mStagingState;
+	mIsManaged = (isTextureLevel && surface9->mPool == D3DPOOL_MANAGED);
+
 	vk::ImageCreateInfo imageCreateInfo;
 	imageCreateInfo.imageType = vk::ImageType::e2D;
 	imageCreateInfo.format = mRealFormat; //VK_FORMAT_B8G8R8A8_UNORM
@@ -62,28 +67,26 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 	imageCreateInfo.mipLevels = 1;
 	imageCreateInfo.arrayLayers = 1;
 	imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
+	imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
+	imageCreateInfo.initialLayout = vk::ImageLayout::ePreinitialized; //ePreinitialized
 
-	if (surface9->mTexture != nullptr || surface9->mCubeTexture != nullptr)
+	auto& limits = realDevice->mPhysicalDeviceProperties.limits;
+	if (surface9->mUsage == D3DUSAGE_DEPTHSTENCIL)
 	{
-		imageCreateInfo.tiling = vk::ImageTiling::eLinear;
-		imageCreateInfo.initialLayout = vk::ImageLayout::ePreinitialized;
-
-		imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+		imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eDepthStencilAttachment;
+		mSamples = ConvertMultiSample(surface9->mMultiSample, limits.framebufferDepthSampleCounts & limits.framebufferStencilSampleCounts);
 	}
 	else
 	{
-		imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
-		imageCreateInfo.initialLayout = vk::ImageLayout::ePreinitialized; //ePreinitialized
+		imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eColorAttachment; //
+		mSamples = ConvertMultiSample(surface9->mMultiSample, limits.framebufferColorSampleCounts);
+	}
 
-		if (surface9->mUsage == D3DUSAGE_DEPTHSTENCIL)
-		{
-			imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eDepthStencilAttachment;
-		}
-		else
-		{
-			imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eColorAttachment; //
-		}
+	if (isTextureLevel)
+	{
+		mSamples = vk::SampleCountFlagBits::e1;
 	}
+	imageCreateInfo.samples = mSamples;
 
 	mExtent = imageCreateInfo.extent;
 
@@ -92,59 +95,48 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 	//	imageCreateInfo.flags = vk::ImageCreateFlagBits::eCubeCompatible;
 	//}
 
-	result = realDevice->mDevice.createImage(&imageCreateInfo, nullptr, &mStagingImage);
-	if (result != vk::Result::eSuccess)
+	vk::MemoryRequirements memoryRequirements;
+
+	if (!isTextureLevel)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage failed with return code of " << GetResultString((VkResult)result);
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage format:" << (VkFormat)imageCreateInfo.format;
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage imageType:" << (VkImageType)imageCreateInfo.imageType;
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage tiling:" << (VkImageTiling)imageCreateInfo.tiling;
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage usage:" << (VkImageUsageFlags)imageCreateInfo.usage;
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage flags:" << (VkImageCreateFlags)imageCreateInfo.flags;
-		return;
-	}
+		result = realDevice->mDevice.createImage(&imageCreateInfo, nullptr, &mStagingImage);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage failed with return code of " << GetResultString((VkResult)result);
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage format:" << (VkFormat)imageCreateInfo.format;
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage imageType:" << (VkImageType)imageCreateInfo.imageType;
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage tiling:" << (VkImageTiling)imageCreateInfo.tiling;
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage usage:" << (VkImageUsageFlags)imageCreateInfo.usage;
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage flags:" << (VkImageCreateFlags)imageCreateInfo.flags;
+			return;
+		}
 
-	//BOOST_LOG_TRIVIAL(info) << "RealSurface::RealSurface vkCreateImage: " << static_cast<uint64_t>(mStagingImage);
+		//BOOST_LOG_TRIVIAL(info) << "RealSurface::RealSurface vkCreateImage: " << static_cast<uint64_t>(mStagingImage);
 
-	//vk::DebugMarkerObjectNameInfoEXT objectName;
-	//objectName.object = static_cast<uint64_t>(mStagingImage);
-	//objectName.objectType = vk::DebugReportObjectTypeEXT::eImage;
+		//vk::DebugMarkerObjectNameInfoEXT objectName;
+		//objectName.object = static_cast<uint64_t>(mStagingImage);
+		//objectName.objectType = vk::DebugReportObjectTypeEXT::eImage;
 
-	//realDevice->mDevice.debugMarkerSetObjectNameEXT(objectName);
+		//realDevice->mDevice.debugMarkerSetObjectNameEXT(objectName);
 
-	vk::MemoryRequirements memoryRequirements;
-	realDevice->mDevice.getImageMemoryRequirements(mStagingImage, &memoryRequirements);
+		realDevice->mDevice.getImageMemoryRequirements(mStagingImage, &memoryRequirements);
 
-	//mMemoryAllocateInfo.allocationSize = 0;
-	mMemoryAllocateInfo.memoryTypeIndex = 0;
-	mMemoryAllocateInfo.allocationSize = memoryRequirements.size;
+		//mMemoryAllocateInfo.allocationSize = 0;
+		mMemoryAllocateInfo.memoryTypeIndex = 0;
+		mMemoryAllocateInfo.allocationSize = memoryRequirements.size;
 
-	if (surface9->mTexture != nullptr || surface9->mCubeTexture != nullptr)
-	{
-		if (!GetMemoryTypeFromProperties(realDevice->mPhysicalDeviceMemoryProperties, memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, &mMemoryAllocateInfo.memoryTypeIndex))
-		{
-			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface Could not find memory type from properties.";
-			return;
-		}
-	}
-	else
-	{
-		if (!GetMemoryTypeFromProperties(realDevice->mPhysicalDeviceMemoryProperties, memoryRequirements.memoryTypeBits, 0, &mMemoryAllocateInfo.memoryTypeIndex))
+		//Render targets and depth buffers are large and live for a long time so they get their own allocation.
+		result = realDevice->mMemoryManager.Allocate(memoryRequirements, vk::MemoryPropertyFlags(), false, mStagingAllocation, true, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		if (result != vk::Result::eSuccess)
 		{
-			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface Could not find memory type from properties.";
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface MemoryManager::Allocate failed with return code of " << GetResultString((VkResult)result);
 			return;
 		}
-	}
+		mMemoryAllocateInfo.memoryTypeIndex = mStagingAllocation.MemoryTypeIndex;
 
-	result = realDevice->mDevice.allocateMemory(&mMemoryAllocateInfo, nullptr, &mStagingDeviceMemory);
-	if (result != vk::Result::eSuccess)
-	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
-		return;
+		realDevice->mDevice.bindImageMemory(mStagingImage, mStagingAllocation.Memory, mStagingAllocation.Offset);
 	}
 
-	realDevice->mDevice.bindImageMemory(mStagingImage, mStagingDeviceMemory, 0);
-
 	mSubresource.mipLevel = 0;
 
 	vk::ImageViewCreateInfo imageViewCreateInfo;
@@ -159,7 +151,7 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 		mSubresource.aspectMask = vk::ImageAspectFlagBits::eStencil;
 		imageViewCreateInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eStencil;
 	}
-	else if (mRealFormat == vk::Format::eD16Unorm)
+	else if (mRealFormat == vk::Format::eD16Unorm || mRealFormat == vk::Format::eX8D24UnormPack32 || mRealFormat == vk::Format::eD32Sfloat)
 	{
 		mSubresource.aspectMask = vk::ImageAspectFlagBits::eDepth;
 		imageViewCreateInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
@@ -172,12 +164,7 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 
 	mSubresource.arrayLayer = 0; //if this is wrong you may get 4294967296.
 
-	mLayouts[0] = {};
-	if (imageCreateInfo.tiling == vk::ImageTiling::eLinear)
-	{
-		//BOOST_LOG_TRIVIAL(info) << "RealSurface::RealSurface (CSurface9) using format " << (VkFormat)mRealFormat;
-		realDevice->mDevice.getImageSubresourceLayout(mStagingImage, &mSubresource, &mLayouts[0]);
-	}
+	SetStagingLayout(surface9->mFormat);
 
 	imageViewCreateInfo.image = mStagingImage;
 	//imageViewCreateInfo.viewType = vk::ImageViewType::e3D;
@@ -207,6 +194,7 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 			imageViewCreateInfo.components = vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eOne);
 			break;
 		default:
+			imageViewCreateInfo.components = mConversion.Components;
 			break;
 		}
 	}
@@ -227,9 +215,13 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 			return;
 		}
 	}
-	else if (parentImage != nullptr)
+	else if (parentImage != nullptr && !mIsManaged) //Managed textures can't be rendered to and their image goes away when they are evicted.
 	{
+		//A 2D view of just this level and face so it can be a framebuffer attachment, those can't have a swizzle.
 		imageViewCreateInfo.image = (*parentImage);
+		imageViewCreateInfo.subresourceRange.baseMipLevel = surface9->mMipIndex;
+		imageViewCreateInfo.subresourceRange.baseArrayLayer = surface9->mTargetLayer;
+		imageViewCreateInfo.components = vk::ComponentMapping();
 
 		result = realDevice->mDevice.createImageView(&imageViewCreateInfo, nullptr, &mStagingImageView);
 		if (result != vk::Result::eSuccess)
@@ -238,6 +230,42 @@ RealSurface::RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image*
 			return;
 		}
 	}
+
+	/*
+	A multisampled color surface can't be presented or copied directly so it gets a single sample image that the render pass resolves into.
+	*/
+	if (mSamples != vk::SampleCountFlagBits::e1 && surface9->mUsage != D3DUSAGE_DEPTHSTENCIL)
+	{
+		imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
+		imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+		result = realDevice->mDevice.createImage(&imageCreateInfo, nullptr, &mResolveImage);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage failed with return code of " << GetResultString((VkResult)result);
+			return;
+		}
+
+		realDevice->mDevice.getImageMemoryRequirements(mResolveImage, &memoryRequirements);
+
+		result = realDevice->mMemoryManager.Allocate(memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, false, mResolveAllocation, true);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface MemoryManager::Allocate failed with return code of " << GetResultString((VkResult)result);
+			return;
+		}
+
+		realDevice->mDevice.bindImageMemory(mResolveImage, mResolveAllocation.Memory, mResolveAllocation.Offset);
+
+		imageViewCreateInfo.image = mResolveImage;
+
+		result = realDevice->mDevice.createImageView(&imageViewCreateInfo, nullptr, &mResolveImageView);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImageView failed with return code of " << GetResultString((VkResult)result);
+			return;
+		}
+	}
 }
 
 RealSurface::RealSurface(RealDevice* realDevice, CVolume9* volume9)
@@ -245,9 +273,8 @@ RealSurface::RealSurface(RealDevice* realDevice, CVolume9* volume9)
 {
 	BOOST_LOG_TRIVIAL(info) << "RealSurface::RealSurface";
 
-	vk::Result result;
-
-	mRealFormat = ConvertFormat(volume9->mFormat);
+	mConversion = GetFormatConversion(realDevice->mPhysicalDevice, realDevice->mPhysicalDeviceFeatures, volume9->mFormat);
+	mRealFormat = mConversion.Format;
 
 	if (mRealFormat == vk::Format::eUndefined)//VK_FORMAT_UNDEFINED
 	{
@@ -271,74 +298,187 @@ RealSurface::RealSurface(RealDevice* realDevice, CVolume9* volume9)
 
 	}
 
-	vk::ImageCreateInfo imageCreateInfo;
-	imageCreateInfo.imageType = vk::ImageType::e3D;
-	imageCreateInfo.format = mRealFormat;
-	imageCreateInfo.extent = vk::Extent3D(volume9->mWidth, volume9->mHeight, volume9->mDepth);
-	imageCreateInfo.mipLevels = 1;
-	imageCreateInfo.arrayLayers = 1;
-	imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
-	imageCreateInfo.tiling = vk::ImageTiling::eLinear;
-	imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
-	imageCreateInfo.initialLayout = vk::ImageLayout::ePreinitialized;
+	mExtent = vk::Extent3D(volume9->mWidth, volume9->mHeight, volume9->mDepth);
+	mIsManaged = (volume9->mPool == D3DPOOL_MANAGED);
+	mStagingState = &volume9->mStagingState;
 
-	//if (Volume9->mCubeTexture != nullptr)
-	//{
-	//	imageCreateInfo.flags = vk::ImageCreateFlagBits::eCubeCompatible;
-	//}
+	mSubresource.mipLevel = 0;
+	mSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+	mSubresource.arrayLayer = 0; //if this is wrong you may get 4294967296.
 
-	result = realDevice->mDevice.createImage(&imageCreateInfo, nullptr, &mStagingImage);
-	if (result != vk::Result::eSuccess)
+	SetStagingLayout(volume9->mFormat);
+}
+
+RealSurface::~RealSurface()
+{
+	BOOST_LOG_TRIVIAL(info) << "RealSurface::~RealSurface";
+	if (mRealDevice != nullptr)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage failed with return code of " << GetResultString((VkResult)result);
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage format:" << (VkFormat)imageCreateInfo.format;
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage imageType:" << (VkImageType)imageCreateInfo.imageType;
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage tiling:" << (VkImageTiling)imageCreateInfo.tiling;
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage usage:" << (VkImageUsageFlags)imageCreateInfo.usage;
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkCreateImage flags:" << (VkImageCreateFlags)imageCreateInfo.flags;
-		return;
+		auto& garbageManager = mRealDevice->mGarbageManager;
+
+		if (mStagingBuffer)
+		{
+			ReleaseStagingBuffer();
+		}
+
+		garbageManager.Retire(mConvertedBuffer);
+		garbageManager.Retire(mConvertedAllocation);
+
+		mRealDevice->DestroyFramebuffers(mStagingImageView);
+		mRealDevice->mImageLayoutTracker.Unregister(mStagingImage);
+		garbageManager.Retire(mStagingImageView);
+		garbageManager.Retire(mStagingImage);
+		garbageManager.Retire(mStagingAllocation);
+
+		if (mResolveImage)
+		{
+			mRealDevice->DestroyFramebuffers(mResolveImageView);
+			mRealDevice->mImageLayoutTracker.Unregister(mResolveImage);
+			garbageManager.Retire(mResolveImageView);
+			garbageManager.Retire(mResolveImage);
+			garbageManager.Retire(mResolveAllocation);
+		}
 	}
+}
 
-	//BOOST_LOG_TRIVIAL(info) << "RealSurface::RealSurface vkCreateImage: " << static_cast<uint64_t>(mStagingImage);
+void RealSurface::SetStagingLayout(D3DFORMAT format)
+{
+	mFormat = format;
+	mTexelSize = GetFormatSize(format);
+	mBlockSize = GetFormatBlockSize(format);
 
-	vk::MemoryRequirements memoryRequirements;
-	realDevice->mDevice.getImageMemoryRequirements(mStagingImage, &memoryRequirements);
+	//Rows are packed the way d3d9 would lay them out, rounded up to a dword so the application sees the pitch it expects. Volume slices follow one another.
+	const vk::DeviceSize width = (mExtent.width + mBlockSize - 1) / mBlockSize;
+	const vk::DeviceSize height = (mExtent.height + mBlockSize - 1) / mBlockSize;
+	mLayouts[0] = {};
+	mLayouts[0].rowPitch = width * mTexelSize;
+	if (mTexelSize != 3)
+	{
+		mLayouts[0].rowPitch = (mLayouts[0].rowPitch + 3) & ~((vk::DeviceSize)3);
+	}
+	mLayouts[0].depthPitch = mLayouts[0].rowPitch * height;
+	mLayouts[0].arrayPitch = mLayouts[0].depthPitch * mExtent.depth;
+	mLayouts[0].size = mLayouts[0].arrayPitch;
+
+	//The converted copy is tightly packed in the format of the image.
+	mConvertedLayout = {};
+	if (mConversion.Convert != nullptr)
+	{
+		mConvertedLayout.rowPitch = mExtent.width * mConversion.TexelSize;
+		mConvertedLayout.depthPitch = mConvertedLayout.rowPitch * mExtent.height;
+		mConvertedLayout.arrayPitch = mConvertedLayout.depthPitch * mExtent.depth;
+		mConvertedLayout.size = mConvertedLayout.arrayPitch;
+	}
+}
 
-	//mMemoryAllocateInfo.allocationSize = 0;
-	mMemoryAllocateInfo.memoryTypeIndex = 0;
-	mMemoryAllocateInfo.allocationSize = memoryRequirements.size;
+char* RealSurface::GetStagingData(vk::Image image, uint32_t mipIndex, uint32_t layerIndex)
+{
+	auto& transferManager = mRealDevice->mTransferManager;
 
-	if (!GetMemoryTypeFromProperties(realDevice->mPhysicalDeviceMemoryProperties, memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, &mMemoryAllocateInfo.memoryTypeIndex))
+	if (!mStagingBuffer)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface Could not find memory type from properties.";
-		return;
+		mRealDevice->CreateBuffer(mLayouts[0].size, vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, mStagingBuffer, mStagingAllocation);
+		if (!mStagingBuffer || mStagingAllocation.Data == nullptr)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::GetStagingData unable to create a staging buffer.";
+			return nullptr;
+		}
+
+		mRealDevice->mStagedSurfaces.push_back(this);
+
+		/*
+		The buffer was given back after an earlier upload so the application expects to find what it wrote last time.
+		Copy the level back out of the texture, this costs a wait but only happens to levels that sat idle for a while.
+		*/
+		if (mUploadBatch != 0)
+		{
+			auto& imageLayoutTracker = mRealDevice->mImageLayoutTracker;
+			vk::CommandBuffer commandBuffer = transferManager.GetCommandBuffer();
+			vk::ImageLayout oldLayout = imageLayoutTracker.GetLayout(image, mipIndex, layerIndex);
+
+			imageLayoutTracker.Transition(commandBuffer, image, vk::ImageLayout::eTransferSrcOptimal, 1, mipIndex, 1, layerIndex);
+			imageLayoutTracker.Flush(commandBuffer);
+
+			vk::BufferImageCopy region;
+			region.bufferOffset = mLayouts[0].offset;
+			region.bufferRowLength = (uint32_t)(mLayouts[0].rowPitch / mTexelSize) * mBlockSize;
+			region.bufferImageHeight = (uint32_t)(mLayouts[0].depthPitch / mLayouts[0].rowPitch) * mBlockSize;
+			region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+			region.imageSubresource.mipLevel = mipIndex;
+			region.imageSubresource.baseArrayLayer = layerIndex;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = mExtent;
+			commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, mStagingBuffer, 1, &region);
+
+			if (oldLayout != vk::ImageLayout::eUndefined && oldLayout != vk::ImageLayout::ePreinitialized)
+			{
+				imageLayoutTracker.Transition(commandBuffer, image, oldLayout, 1, mipIndex, 1, layerIndex);
+				imageLayoutTracker.Flush(commandBuffer);
+			}
+
+			mUploadBatch = transferManager.mBatchNumber;
+			transferManager.WaitForBatch(mUploadBatch);
+		}
 	}
 
-	result = realDevice->mDevice.allocateMemory(&mMemoryAllocateInfo, nullptr, &mStagingDeviceMemory);
-	if (result != vk::Result::eSuccess)
+	mLastLockedFrame = mRealDevice->mFrameNumber;
+
+	return (char*)mStagingAllocation.Data + mLayouts[0].offset;
+}
+
+void RealSurface::CopyToImage(vk::CommandBuffer commandBuffer, vk::Image image, const boost::container::small_vector<D3DBOX, 4>& regions, uint32_t mipIndex, uint32_t layerIndex, const uint32_t* palette)
+{
+	const auto& layout = mLayouts[0];
+
+	//Only the rows that were written have to be flushed.
+	for (auto& region : regions)
+	{
+		vk::DeviceSize start = layout.offset + (layout.depthPitch * region.Front) + (layout.rowPitch * (region.Top / mBlockSize));
+		vk::DeviceSize end = layout.offset + (layout.depthPitch * (region.Back - 1)) + (layout.rowPitch * ((region.Bottom + mBlockSize - 1) / mBlockSize));
+		mRealDevice->mMemoryManager.Flush(mStagingAllocation, start, end - start);
+		mRealDevice->mTransferManager.mUploadSize += (end - start);
+	}
+
+	if (mConversion.Convert == nullptr)
 	{
-		BOOST_LOG_TRIVIAL(fatal) << "RealSurface::RealSurface vkAllocateMemory failed with return code of " << GetResultString((VkResult)result);
+		ReallyCopyBufferToImage(commandBuffer, mStagingBuffer, image, layout, mTexelSize, mBlockSize, regions, mipIndex, layerIndex);
 		return;
 	}
 
-	realDevice->mDevice.bindImageMemory(mStagingImage, mStagingDeviceMemory, 0);
+	//Like the staging buffer this is only written once the lock has waited for the last upload out of it.
+	if (!mConvertedBuffer)
+	{
+		mRealDevice->CreateBuffer(mConvertedLayout.size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, mConvertedBuffer, mConvertedAllocation);
+		if (!mConvertedBuffer || mConvertedAllocation.Data == nullptr)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "RealSurface::CopyToImage unable to create a conversion buffer.";
+			return;
+		}
+	}
 
-	mSubresource.mipLevel = 0;
-	mSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	mSubresource.arrayLayer = 0; //if this is wrong you may get 4294967296.
+	for (auto& region : regions)
+	{
+		ConvertRegion(mRealDevice->mThreadPool, mConversion, mFormat, (const char*)mStagingAllocation.Data, layout, (char*)mConvertedAllocation.Data, mConvertedLayout, region, palette);
+	}
 
-	//BOOST_LOG_TRIVIAL(info) << "RealSurface::RealSurface (CVolume9) using format " << (VkFormat)mRealFormat;
-	realDevice->mDevice.getImageSubresourceLayout(mStagingImage, &mSubresource, &mLayouts[0]);
+	ReallyCopyBufferToImage(commandBuffer, mConvertedBuffer, image, mConvertedLayout, mConversion.TexelSize, mConversion.BlockSize, regions, mipIndex, layerIndex);
 }
 
-RealSurface::~RealSurface()
+void RealSurface::ReleaseStagingBuffer()
 {
-	BOOST_LOG_TRIVIAL(info) << "RealSurface::~RealSurface";
-	if (mRealDevice != nullptr)
+	//An upload out of the buffer may still be in flight.
+	mRealDevice->mGarbageManager.Retire(mStagingBuffer);
+	mRealDevice->mGarbageManager.Retire(mStagingAllocation);
+	mStagingBuffer = vk::Buffer();
+
+	auto& stagedSurfaces = mRealDevice->mStagedSurfaces;
+	for (size_t i = 0; i < stagedSurfaces.size(); i++)
 	{
-		auto& device = mRealDevice->mDevice;
-		device.destroyImageView(mStagingImageView, nullptr);
-		device.destroyImage(mStagingImage, nullptr);
-		device.freeMemory(mStagingDeviceMemory, nullptr);
+		if (stagedSurfaces[i] == this)
+		{
+			stagedSurfaces[i] = stagedSurfaces.back();
+			stagedSurfaces.pop_back();
+			break;
+		}
 	}
-}
\ No newline at end of file
+}
@@ -21,34 +21,82 @@ misrepresented as being the original software.
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vk_sdk_platform.h>
 #include <boost/container/small_vector.hpp>
+#include <atomic>
 
 #include "RealDevice.h"
+#include "FormatConverter.h"
 
 #ifndef REALSURFACE_H
 #define REALSURFACE_H
 
+const uint64_t StagingIdleFrames = 120; //Frames without a lock before the staging buffer of an uploaded level is given back.
+
+/*
+Who may touch the staging buffer of a texture level. The application thread and the worker share it through mStagingState on CSurface9 and CVolume9.
+A level that is idle can be locked without asking the worker. Only the worker takes a level out of idle and only to give its buffer back.
+*/
+enum StagingState : uint32_t
+{
+	StagingUnmapped, //The application has no address for the level.
+	StagingIdle, //Mapped and no upload is reading it.
+	StagingLocked, //The application is writing.
+	StagingFlushing, //Unlocked but the flush hasn't reached the worker yet.
+	StagingUploading //The copy is recorded and its upload batch or frame hasn't finished.
+};
+
 class CSurface9;
 class CVolume9;
 
+/*
+Standalone surfaces are attachments that live in mStagingImage.
+Texture levels and volumes are written through mStagingBuffer with the pitches handed to the application and copied into the texture with copyBufferToImage.
+The buffer is only created on the first lock and is given back once the level has been uploaded and left alone for a while.
+Managed levels never give it back because it is what their texture is restored from after an eviction.
+Formats the device can't sample are rewritten into mConvertedBuffer on upload, those levels keep their staging buffer because they can't be read back.
+*/
 struct RealSurface
 {
-	BOOL mIsFlushed = false;
-	void* mData = nullptr;
 	vk::Image mStagingImage;
-	vk::DeviceMemory mStagingDeviceMemory;
+	vk::Buffer mStagingBuffer;
+	MemoryAllocation mStagingAllocation;
 	vk::ImageView mStagingImageView;
+	uint64_t mUploadBatch = 0; //The upload batch that last copied out of the staging buffer, zero if the level was never uploaded.
+	uint64_t mLastLockedFrame = 0;
+	uint64_t mStagingFrame = 0; //The frame whose command buffer last copied into or out of the staging memory, a lock has to wait for it.
+	std::atomic<uint32_t>* mStagingState = nullptr; //Lives in the CSurface9 or CVolume9 so the application can lock without a round trip.
+	bool mIsManaged = false; //A level of a D3DPOOL_MANAGED texture.
+	D3DFORMAT mFormat = D3DFMT_UNKNOWN;
+	uint32_t mTexelSize = 4; //Bytes per pixel, or per block for compressed formats.
+	uint32_t mBlockSize = 1; //4 for compressed formats, each row of mLayouts is then a line of blocks.
+
+	//Conversion
+	FormatConversion mConversion;
+	vk::Buffer mConvertedBuffer;
+	MemoryAllocation mConvertedAllocation;
+	vk::SubresourceLayout mConvertedLayout = {};
+
+	//Multisampling
+	vk::SampleCountFlagBits mSamples = vk::SampleCountFlagBits::e1;
+	vk::Image mResolveImage; //Single sample copy of a multisampled color surface.
+	MemoryAllocation mResolveAllocation;
+	vk::ImageView mResolveImageView;
 
 	vk::Extent3D mExtent;
 	vk::Format mRealFormat = vk::Format::eR8G8B8A8Unorm;
 	vk::MemoryAllocateInfo mMemoryAllocateInfo;
 	vk::ImageLayout mImageLayout = vk::ImageLayout::eGeneral;
-	vk::SubresourceLayout mLayouts[1] = {};
+	vk::SubresourceLayout mLayouts[1] = {}; //Where the level sits in the staging buffer.
 	vk::ImageSubresource mSubresource;
 
 	RealDevice* mRealDevice = nullptr; //null if not owner.
 	RealSurface(RealDevice* realDevice, CSurface9* surface9, vk::Image* parentImage);
 	RealSurface(RealDevice* realDevice, CVolume9* volume9);
 	~RealSurface();
+
+	void SetStagingLayout(D3DFORMAT format);
+	char* GetStagingData(vk::Image image, uint32_t mipIndex, uint32_t layerIndex);
+	void CopyToImage(vk::CommandBuffer commandBuffer, vk::Image image, const boost::container::small_vector<D3DBOX, 4>& regions, uint32_t mipIndex, uint32_t layerIndex, const uint32_t* palette = nullptr);
+	void ReleaseStagingBuffer();
 };
 
 #endif // REALSURFACE_H
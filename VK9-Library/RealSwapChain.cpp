@@ -82,6 +82,9 @@ RealSwapChain::~RealSwapChain()
 {
 	BOOST_LOG_TRIVIAL(info) << "RealSwapChain::~RealSwapChain";
 
+	//The last present may still be in flight.
+	mDevice.waitIdle();
+
 	DestroyDepthBuffer(); //Might not need will revisit later.
 	DestroySwapChain();
 	DestroySurface();
@@ -252,6 +255,8 @@ void RealSwapChain::InitSwapChain()
 		return;
 	}
 
+	mMemorySize = (vk::DeviceSize)mSwapchainImageCount * mSwapchainExtent.width * mSwapchainExtent.height * 4;
+
 	mImages = new vk::Image[mSwapchainImageCount];
 	mViews = new vk::ImageView[mSwapchainImageCount];
 
@@ -363,6 +368,7 @@ void RealSwapChain::InitDepthBuffer()
 	}
 
 	mDevice.bindImageMemory(mDepthImage, mDepthDeviceMemory, 0);
+	mMemorySize += memoryRequirements.size;
 
 	//ptr->SetImageLayout(mDepthImage, vk::ImageAspectFlagBits::eDepth, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
 
@@ -392,37 +398,31 @@ void RealSwapChain::DestroyDepthBuffer()
 	mDevice.freeMemory(mDepthDeviceMemory, nullptr);
 }
 
-void RealSwapChain::Present(vk::CommandBuffer commandBuffer, vk::Queue queue, vk::Image source)
+bool RealSwapChain::Present(vk::CommandBuffer commandBuffer, vk::Queue queue, ImageLayoutTracker& imageLayoutTracker, vk::Image source, vk::Fence fence)
 {
 	mResult = mDevice.acquireNextImageKHR(mSwapchain, UINT64_MAX, nullptr, mSwapFence, &mCurrentIndex);
 	if (mResult != vk::Result::eSuccess)
 	{
 		BOOST_LOG_TRIVIAL(fatal) << "RealSwapChain::Start vkAcquireNextImageKHR failed with return code of " << GetResultString((VkResult)mResult);
-		return;
+		return false;
 	}
 
 	mDevice.waitForFences(1, &mSwapFence, VK_TRUE, UINT64_MAX);
 	mDevice.resetFences(1, &mSwapFence);
 
-	mImageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eMemoryWrite;
-	mImageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
-	mImageMemoryBarrier.oldLayout = vk::ImageLayout::eGeneral;
-	mImageMemoryBarrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-	mImageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	mImageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	mImageMemoryBarrier.image = source;
-	mImageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &mImageMemoryBarrier);
+	imageLayoutTracker.Transition(commandBuffer, source, vk::ImageLayout::eTransferSrcOptimal, 1, 0, 1, 0);
 
-	//mImageMemoryBarrier.srcAccessMask = 0;
-	mImageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryWrite;
+	//Swap chain images are fully overwritten every frame so they are not tracked.
+	mImageMemoryBarrier.srcAccessMask = vk::AccessFlags();
+	mImageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
 	mImageMemoryBarrier.oldLayout = vk::ImageLayout::eUndefined;
 	mImageMemoryBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
 	mImageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	mImageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	mImageMemoryBarrier.image = mImages[mCurrentIndex];
 	mImageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &mImageMemoryBarrier);
+	imageLayoutTracker.mBarrierBatch.Add(commandBuffer, vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, mImageMemoryBarrier);
+	imageLayoutTracker.Flush(commandBuffer);
 
 	vk::ImageSubresourceLayers subResource1;
 	subResource1.aspectMask = vk::ImageAspectFlagBits::eColor;
@@ -450,15 +450,17 @@ void RealSwapChain::Present(vk::CommandBuffer commandBuffer, vk::Queue queue, vk
 		mImages[mCurrentIndex], vk::ImageLayout::eTransferDstOptimal,
 		1, &region);
 
-	//realWindow.mImageMemoryBarrier.srcAccessMask = 0;
-	mImageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead; //VK_ACCESS_MEMORY_READ_BIT;
+	mImageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	mImageMemoryBarrier.dstAccessMask = vk::AccessFlags();
 	mImageMemoryBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
 	mImageMemoryBarrier.newLayout = vk::ImageLayout::ePresentSrcKHR; //VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 	mImageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	mImageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	mImageMemoryBarrier.image = mImages[mCurrentIndex];
 	mImageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1, &mImageMemoryBarrier);
+	imageLayoutTracker.mBarrierBatch.Add(commandBuffer, vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, mImageMemoryBarrier);
+	imageLayoutTracker.Flush(commandBuffer);
+	imageLayoutTracker.mBarrierCount += 2;
 
 	//mImageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eMemoryWrite;
 	//mImageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
@@ -473,21 +475,20 @@ void RealSwapChain::Present(vk::CommandBuffer commandBuffer, vk::Queue queue, vk
 	commandBuffer.end();
 
 	mSubmitInfo.pCommandBuffers = &commandBuffer;
-	mResult = queue.submit(1, &mSubmitInfo, mNullFence);
+	mResult = queue.submit(1, &mSubmitInfo, fence);
 	if (mResult != vk::Result::eSuccess)
 	{
 		BOOST_LOG_TRIVIAL(fatal) << "RealSwapChain::Present vkQueueSubmit failed with return code of " << GetResultString((VkResult)mResult);
-		return;
+		return false;
 	}
-	queue.waitIdle();
 
+	//The fence tells the device when the frame is finished so there is no need to wait for the queue here.
 	mPresentInfo.pImageIndices = &mCurrentIndex;
 	mResult = queue.presentKHR(&mPresentInfo);
 	if (mResult != vk::Result::eSuccess)
 	{
 		BOOST_LOG_TRIVIAL(fatal) << "RealSwapChain::Present vkQueuePresentKHR failed with return code of " << GetResultString((VkResult)mResult);
-		return;
 	}
-	queue.waitIdle();
-	commandBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+
+	return true;
 }
\ No newline at end of file
@@ -21,6 +21,7 @@ misrepresented as being the original software.
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vk_sdk_platform.h>
 #include <boost/container/small_vector.hpp>
+#include "ImageLayoutTracker.h"
 
 #ifndef REALSWAPCHAIN_H
 #define REALSWAPCHAIN_H
@@ -60,6 +61,8 @@ struct RealSwapChain
 	vk::DeviceMemory mDepthDeviceMemory;
 	vk::Format mDepthFormat = vk::Format::eD16Unorm;
 
+	vk::DeviceSize mMemorySize = 0; //Estimated size of the swap chain images and depth buffer for the memory budget.
+
 	//Presentation
 	vk::SemaphoreCreateInfo mPresentCompleteSemaphoreCreateInfo;
 	
@@ -88,7 +91,7 @@ struct RealSwapChain
 	void InitDepthBuffer();
 	void DestroyDepthBuffer();
 
-	void Present(vk::CommandBuffer commandBuffer, vk::Queue queue, vk::Image source);
+	bool Present(vk::CommandBuffer commandBuffer, vk::Queue queue, ImageLayoutTracker& imageLayoutTracker, vk::Image source, vk::Fence fence);
 
 };
 
@@ -31,12 +31,46 @@ RealTexture::~RealTexture()
 	BOOST_LOG_TRIVIAL(info) << "RealTexture::~RealTexture";
 	if (mRealDevice != nullptr)
 	{
-		auto& device = mRealDevice->mDevice;
-		device.destroyImageView(mImageView, nullptr);
-		device.destroySampler(mSampler, nullptr);
-		device.destroyImage(mImage, nullptr);
-		device.freeMemory(mDeviceMemory, nullptr);
+		auto& garbageManager = mRealDevice->mGarbageManager;
+		if (mPool == D3DPOOL_MANAGED)
+		{
+			mRealDevice->mResidencyManager.Unregister(this);
+		}
+		mRealDevice->DestroyFramebuffers(mImageView);
+		mRealDevice->mImageLayoutTracker.Unregister(mImage);
+		garbageManager.Retire(mImageView);
+		garbageManager.Retire(mSampler);
+		garbageManager.Retire(mImage);
+		garbageManager.Retire(mAllocation);
 	}
 
 }
 
+void RealTexture::Evict(bool isImmediate)
+{
+	//The staging buffers of the levels still hold everything that was written so only the image and its memory have to go.
+	auto& garbageManager = mRealDevice->mGarbageManager;
+	mRealDevice->DestroyFramebuffers(mImageView);
+	mRealDevice->mImageLayoutTracker.Unregister(mImage);
+
+	if (isImmediate)
+	{
+		//The caller has waited for every frame that could have used the texture.
+		RetiredHandles handles;
+		handles.ImageViews.push_back(mImageView);
+		handles.Images.push_back(mImage);
+		handles.Allocations.push_back(mAllocation);
+		garbageManager.DestroyHandles(handles);
+		mAllocation = MemoryAllocation();
+	}
+	else
+	{
+		garbageManager.Retire(mImageView);
+		garbageManager.Retire(mImage);
+		garbageManager.Retire(mAllocation);
+	}
+
+	mImageView = vk::ImageView();
+	mImage = vk::Image();
+	mIsResident = false;
+}
@@ -36,13 +36,29 @@ struct RealTexture
 	vk::Format mRealFormat;
 	vk::MemoryAllocateInfo mMemoryAllocateInfo;
 	vk::Image mImage;
-	vk::DeviceMemory mDeviceMemory;
+	MemoryAllocation mAllocation;
 	vk::Sampler mSampler;
 	vk::ImageView mImageView;
+	vk::ImageCreateInfo mImageCreateInfo; //Kept so an evicted texture can be created again.
+	vk::ImageViewCreateInfo mImageViewCreateInfo;
+	D3DFORMAT mFormat = D3DFMT_UNKNOWN;
+
+	//Residency
+	D3DPOOL mPool = D3DPOOL_DEFAULT;
+	DWORD mUsage = 0;
+	DWORD mPriority = 0;
+	uint64_t mLastUsedFrame = 0;
+	bool mIsResident = true;
+	boost::container::small_vector<size_t, 16> mSurfaceIds; //The levels by surface id, a managed texture is restored from their staging buffers.
+
+	//UpdateTexture
+	boost::container::small_vector<D3DBOX, 4> mDirtyRegions[6]; //Per face in top level texels, only these are copied when this texture is the source of an UpdateTexture.
 
 	RealDevice* mRealDevice = nullptr; //null if not owner.
 	RealTexture(RealDevice* realDevice);
 	~RealTexture();
+
+	void Evict(bool isImmediate);
 };
 
 #endif // REALTEXTURE_H
@@ -0,0 +1,75 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <chrono>
+#include <vulkan/vulkan.hpp>
+#include "RealDevice.h"
+
+#ifndef RENDERPASSREQUEST_H
+#define RENDERPASSREQUEST_H
+
+/*
+Render passes only depend on the attachment formats, load/store ops, and sample count so they can be shared by every render target that matches.
+*/
+struct RenderPassRequest
+{
+	//Vulkan State
+	vk::RenderPass RenderPass;
+
+	//Key
+	vk::Format ColorFormat = vk::Format::eUndefined;
+	vk::Format DepthFormat = vk::Format::eUndefined;
+	vk::AttachmentLoadOp ColorLoadOp = vk::AttachmentLoadOp::eLoad;
+	vk::AttachmentLoadOp DepthLoadOp = vk::AttachmentLoadOp::eLoad;
+	vk::AttachmentLoadOp StencilLoadOp = vk::AttachmentLoadOp::eLoad;
+	vk::AttachmentStoreOp StoreOp = vk::AttachmentStoreOp::eStore;
+	vk::SampleCountFlagBits Samples = vk::SampleCountFlagBits::e1;
+
+	//Resource Handling.
+	std::chrono::steady_clock::time_point LastUsed = std::chrono::steady_clock::now();
+	RealDevice* mRealDevice = nullptr; //null if not owner.
+	RenderPassRequest(RealDevice* realDevice) : mRealDevice(realDevice) {}
+	~RenderPassRequest();
+};
+
+/*
+Framebuffers depend on the attachment views so they have to be dropped when one of those views is destroyed.
+*/
+struct FramebufferRequest
+{
+	//Vulkan State
+	vk::Framebuffer Framebuffer;
+
+	//Key
+	vk::RenderPass RenderPass;
+	vk::ImageView ColorView;
+	vk::ImageView DepthView;
+	vk::ImageView ResolveView;
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+
+	//Resource Handling.
+	std::chrono::steady_clock::time_point LastUsed = std::chrono::steady_clock::now();
+	RealDevice* mRealDevice = nullptr; //null if not owner.
+	FramebufferRequest(RealDevice* realDevice) : mRealDevice(realDevice) {}
+	~FramebufferRequest();
+};
+
+#endif //RENDERPASSREQUEST_H
@@ -0,0 +1,222 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "ResidencyManager.h"
+#include "RealDevice.h"
+#include "RealTexture.h"
+#include "RealSurface.h"
+#include "Utilities.h"
+
+#include <algorithm>
+
+void ResidencyManager::Initialize(RealDevice* realDevice)
+{
+	mRealDevice = realDevice;
+}
+
+void ResidencyManager::Register(RealTexture* texture)
+{
+	mTextures.push_back(texture);
+}
+
+void ResidencyManager::Unregister(RealTexture* texture)
+{
+	auto it = std::find(mTextures.begin(), mTextures.end(), texture);
+	if (it != mTextures.end())
+	{
+		(*it) = mTextures.back();
+		mTextures.pop_back();
+	}
+}
+
+vk::Result ResidencyManager::Allocate(const vk::MemoryRequirements& memoryRequirements, MemoryAllocation& allocation)
+{
+	auto& memoryManager = mRealDevice->mMemoryManager;
+
+	vk::Result result = memoryManager.Allocate(memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, false, allocation);
+	if (result == vk::Result::eSuccess || mTextures.empty())
+	{
+		return result;
+	}
+
+	/*
+	Video memory is full so make room by throwing out managed textures the frame being recorded doesn't sample.
+	Once the submitted frames are finished nothing else can reference them so their memory is given back right away instead of going through the garbage manager.
+	*/
+	mRealDevice->WaitForSubmittedFrames();
+
+	while (result != vk::Result::eSuccess)
+	{
+		if (Evict(memoryRequirements.size, mRealDevice->mFrameNumber, true) == 0)
+		{
+			break;
+		}
+
+		result = memoryManager.Allocate(memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, false, allocation);
+	}
+
+	return result;
+}
+
+vk::DeviceSize ResidencyManager::Evict(vk::DeviceSize size, uint64_t frameNumber, bool isImmediate)
+{
+	//Only textures that haven't been used since frameNumber are considered. The lowest priority goes first and the longest unused within a priority.
+	std::vector<RealTexture*> candidates;
+	for (auto texture : mTextures)
+	{
+		if (texture->mIsResident && texture->mLastUsedFrame < frameNumber)
+		{
+			candidates.push_back(texture);
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const RealTexture* a, const RealTexture* b)
+	{
+		return (a->mPriority != b->mPriority) ? (a->mPriority < b->mPriority) : (a->mLastUsedFrame < b->mLastUsedFrame);
+	});
+
+	vk::DeviceSize evictedSize = 0;
+	uint32_t evictedCount = 0;
+	for (auto texture : candidates)
+	{
+		if (evictedSize >= size)
+		{
+			break;
+		}
+
+		evictedSize += texture->mAllocation.Size;
+		texture->Evict(isImmediate);
+		evictedCount++;
+	}
+
+	if (evictedCount)
+	{
+		mEvictionCount += evictedCount;
+		mEvictionFrame = mRealDevice->mFrameNumber;
+
+		BOOST_LOG_TRIVIAL(info) << "ResidencyManager::Evict evicted " << evictedCount << " managed textures holding " << evictedSize << " bytes.";
+	}
+
+	return evictedSize;
+}
+
+void ResidencyManager::Trim()
+{
+	//The memory given up by the last eviction doesn't show up in the usage until the frame that retired it is finished.
+	if (mRealDevice->mMemoryUsage <= mRealDevice->mMemoryBudget || mEvictionFrame > mRealDevice->mCompletedFrameNumber)
+	{
+		return;
+	}
+
+	//Textures the last frame sampled will most likely be sampled by the next one so they are kept.
+	Evict(mRealDevice->mMemoryUsage - mRealDevice->mMemoryBudget, mRealDevice->mFrameNumber - 1);
+}
+
+void ResidencyManager::MakeResident(RealTexture& texture, const std::vector<std::shared_ptr<RealSurface>>& surfaces, const uint32_t* palette)
+{
+	texture.mLastUsedFrame = mRealDevice->mFrameNumber;
+
+	if (!texture.mIsResident)
+	{
+		Restore(texture, surfaces, palette);
+	}
+}
+
+bool ResidencyManager::Restore(RealTexture& texture, const std::vector<std::shared_ptr<RealSurface>>& surfaces, const uint32_t* palette)
+{
+	vk::Result result;
+	auto& device = mRealDevice->mDevice;
+	auto& imageLayoutTracker = mRealDevice->mImageLayoutTracker;
+	auto& transferManager = mRealDevice->mTransferManager;
+
+	result = device.createImage(&texture.mImageCreateInfo, nullptr, &texture.mImage);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "ResidencyManager::Restore vkCreateImage failed with return code of " << GetResultString((VkResult)result);
+		texture.mImage = vk::Image();
+		return false;
+	}
+
+	vk::MemoryRequirements memoryRequirements;
+	device.getImageMemoryRequirements(texture.mImage, &memoryRequirements);
+
+	result = Allocate(memoryRequirements, texture.mAllocation);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "ResidencyManager::Restore ResidencyManager::Allocate failed with return code of " << GetResultString((VkResult)result);
+		device.destroyImage(texture.mImage, nullptr);
+		texture.mImage = vk::Image();
+		return false;
+	}
+
+	device.bindImageMemory(texture.mImage, texture.mAllocation.Memory, texture.mAllocation.Offset);
+
+	texture.mImageViewCreateInfo.image = texture.mImage;
+	result = device.createImageView(&texture.mImageViewCreateInfo, nullptr, &texture.mImageView);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "ResidencyManager::Restore vkCreateImageView failed with return code of " << GetResultString((VkResult)result);
+		device.destroyImage(texture.mImage, nullptr);
+		mRealDevice->mMemoryManager.Free(texture.mAllocation);
+		texture.mImage = vk::Image();
+		texture.mImageView = vk::ImageView();
+		return false;
+	}
+
+	const uint32_t levelCount = texture.mImageCreateInfo.mipLevels;
+	const uint32_t layerCount = texture.mImageCreateInfo.arrayLayers;
+	imageLayoutTracker.Register(texture.mImage, vk::ImageAspectFlagBits::eColor, levelCount, layerCount);
+
+	//Every level the application wrote is copied back in full from its staging buffer, like any other upload it goes out ahead of the frame.
+	vk::CommandBuffer commandBuffer = transferManager.GetCommandBuffer();
+	imageLayoutTracker.Transition(commandBuffer, texture.mImage, vk::ImageLayout::eTransferDstOptimal, levelCount, 0, layerCount, 0, true);
+	imageLayoutTracker.Flush(commandBuffer);
+
+	for (auto id : texture.mSurfaceIds)
+	{
+		auto& surface = surfaces[id];
+		if (surface == nullptr || !surface->mStagingBuffer)
+		{
+			continue; //Never locked so there is nothing to restore.
+		}
+
+		boost::container::small_vector<D3DBOX, 4> regions;
+		regions.push_back({ 0, 0, surface->mExtent.width, surface->mExtent.height, 0, surface->mExtent.depth });
+
+		surface->CopyToImage(commandBuffer, texture.mImage, regions, surface->mSubresource.mipLevel, surface->mSubresource.arrayLayer, palette);
+		surface->mUploadBatch = transferManager.mBatchNumber;
+	}
+
+	imageLayoutTracker.Transition(commandBuffer, texture.mImage, vk::ImageLayout::eShaderReadOnlyOptimal, levelCount, 0, layerCount, 0);
+	imageLayoutTracker.Flush(commandBuffer);
+
+	//The application never wrote the levels below the top of an auto generated chain so they are rebuilt, with the default filter because the texture's isn't known here.
+	if ((texture.mUsage & D3DUSAGE_AUTOGENMIPMAP) == D3DUSAGE_AUTOGENMIPMAP)
+	{
+		mRealDevice->GenerateMipSubLevels(commandBuffer, texture.mImage, texture.mRealFormat, texture.mImageCreateInfo.extent, levelCount, layerCount, 0, vk::Filter::eLinear);
+	}
+
+	texture.mIsResident = true;
+	mRestoreCount++;
+
+	BOOST_LOG_TRIVIAL(info) << "ResidencyManager::Restore restored a managed texture of " << texture.mAllocation.Size << " bytes.";
+
+	return true;
+}
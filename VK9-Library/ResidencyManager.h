@@ -0,0 +1,59 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vk_sdk_platform.h>
+#include "MemoryManager.h"
+
+struct RealDevice;
+struct RealTexture;
+struct RealSurface;
+
+#ifndef RESIDENCYMANAGER_H
+#define RESIDENCYMANAGER_H
+
+/*
+Keeps D3DPOOL_MANAGED textures within the memory budget.
+Managed levels hold on to their staging buffers so the image can be thrown away when video memory runs short and uploaded again from them.
+The textures that go first are the lowest priority ones that have gone unused the longest, anything the frame being recorded samples stays.
+*/
+struct ResidencyManager
+{
+	RealDevice* mRealDevice = nullptr;
+	std::vector<RealTexture*> mTextures; //Managed textures whether they are resident or not.
+	uint64_t mEvictionFrame = 0; //Nothing else is evicted for the budget until the frame that retired the last textures is finished.
+
+	//Statistics
+	uint32_t mEvictionCount = 0;
+	uint32_t mRestoreCount = 0;
+
+	void Initialize(RealDevice* realDevice);
+	void Register(RealTexture* texture);
+	void Unregister(RealTexture* texture);
+	vk::Result Allocate(const vk::MemoryRequirements& memoryRequirements, MemoryAllocation& allocation);
+	vk::DeviceSize Evict(vk::DeviceSize size, uint64_t frameNumber, bool isImmediate = false);
+	void Trim();
+	void MakeResident(RealTexture& texture, const std::vector<std::shared_ptr<RealSurface>>& surfaces, const uint32_t* palette);
+	bool Restore(RealTexture& texture, const std::vector<std::shared_ptr<RealSurface>>& surfaces, const uint32_t* palette);
+};
+
+#endif // RESIDENCYMANAGER_H
@@ -25,7 +25,6 @@ ResourceContext::~ResourceContext()
 	if (mRealDevice != nullptr)
 	{
 		//BOOST_LOG_TRIVIAL(warning) << "ResourceContext::~ResourceContext";
-		auto& device = mRealDevice->mDevice;
-		device.freeDescriptorSets(mRealDevice->mDescriptorPool, 1, &DescriptorSet);
+		mRealDevice->mGarbageManager.Retire(DescriptorSet);
 	}
 }
\ No newline at end of file
@@ -25,7 +25,6 @@ SamplerRequest::~SamplerRequest()
 	if (mRealDevice != nullptr)
 	{
 		//BOOST_LOG_TRIVIAL(warning) << "SamplerRequest::~SamplerRequest";
-		auto& device = mRealDevice->mDevice;
-		device.destroySampler(Sampler, nullptr);
+		mRealDevice->mGarbageManager.Retire(Sampler);
 	}
 }
\ No newline at end of file
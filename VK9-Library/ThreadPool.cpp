@@ -0,0 +1,116 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "ThreadPool.h"
+
+void ThreadPool::Initialize(uint32_t threadCount)
+{
+	//The calling thread is one of the threads.
+	for (uint32_t i = 1; i < threadCount; i++)
+	{
+		mThreads.push_back(std::thread(&ThreadPool::Work, this));
+	}
+}
+
+void ThreadPool::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mIsStopping = true;
+	}
+	mTaskAvailable.notify_all();
+
+	for (auto& thread : mThreads)
+	{
+		thread.join();
+	}
+	mThreads.clear();
+}
+
+uint32_t ThreadPool::GetThreadCount() const
+{
+	return (uint32_t)mThreads.size() + 1;
+}
+
+void ThreadPool::Run(uint32_t taskCount, const std::function<void(uint32_t)>& task)
+{
+	if (taskCount == 0)
+	{
+		return;
+	}
+
+	if (taskCount == 1 || mThreads.empty())
+	{
+		for (uint32_t i = 0; i < taskCount; i++)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mTask = &task;
+	mTaskCount = taskCount;
+	mNextTask = 0;
+	mFinishedTaskCount = 0;
+	mTaskAvailable.notify_all();
+
+	RunTasks(lock);
+
+	//Workers may still be finishing the last tasks they took.
+	mJobFinished.wait(lock, [this]() { return mFinishedTaskCount == mTaskCount; });
+	mTask = nullptr;
+	mTaskCount = 0;
+	mNextTask = 0;
+}
+
+void ThreadPool::Work()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mTaskAvailable.wait(lock, [this]() { return mIsStopping || mNextTask < mTaskCount; });
+		if (mIsStopping)
+		{
+			return;
+		}
+
+		RunTasks(lock);
+	}
+}
+
+void ThreadPool::RunTasks(std::unique_lock<std::mutex>& lock)
+{
+	//Takes tasks until there are none left, the lock is held only to hand them out.
+	while (mNextTask < mTaskCount)
+	{
+		const uint32_t index = mNextTask++;
+		const std::function<void(uint32_t)>& task = *mTask;
+
+		lock.unlock();
+		task(index);
+		lock.lock();
+
+		if (++mFinishedTaskCount == mTaskCount)
+		{
+			mJobFinished.notify_one();
+		}
+	}
+}
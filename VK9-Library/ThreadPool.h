@@ -0,0 +1,58 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/*
+Workers that are started with the device and sleep until the worker thread has a job it wants to split up.
+A job is a number of independent tasks, the calling thread takes tasks too and Run returns once every task has finished.
+Only one job runs at a time and Run is only called from the worker thread so the job doesn't need to be copied.
+*/
+struct ThreadPool
+{
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mTaskAvailable;
+	std::condition_variable mJobFinished;
+	const std::function<void(uint32_t)>* mTask = nullptr; //The job being run, valid while mNextTask < mTaskCount.
+	uint32_t mTaskCount = 0;
+	uint32_t mNextTask = 0;
+	uint32_t mFinishedTaskCount = 0;
+	bool mIsStopping = false;
+
+	void Initialize(uint32_t threadCount);
+	void Destroy();
+	uint32_t GetThreadCount() const; //Including the calling thread.
+	void Run(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+
+private:
+	void Work();
+	void RunTasks(std::unique_lock<std::mutex>& lock);
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,260 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <algorithm>
+
+#include "TransferManager.h"
+#include "Utilities.h"
+
+vk::Result TransferManager::Initialize(vk::Device device, vk::Queue queue, uint32_t queueFamilyIndex)
+{
+	vk::Result result;
+
+	mDevice = device;
+	mQueue = queue;
+	mQueueFamilyIndex = queueFamilyIndex;
+
+	vk::CommandPoolCreateInfo commandPoolInfo;
+	commandPoolInfo.queueFamilyIndex = queueFamilyIndex;
+	commandPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient;
+
+	result = mDevice.createCommandPool(&commandPoolInfo, nullptr, &mCommandPool);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "TransferManager::Initialize vkCreateCommandPool failed with return code of " << GetResultString((VkResult)result);
+		return result;
+	}
+
+	vk::CommandBufferAllocateInfo commandBufferInfo;
+	commandBufferInfo.commandPool = mCommandPool;
+	commandBufferInfo.level = vk::CommandBufferLevel::ePrimary;
+	commandBufferInfo.commandBufferCount = 2;
+
+	result = mDevice.allocateCommandBuffers(&commandBufferInfo, mCommandBuffers);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "TransferManager::Initialize vkAllocateCommandBuffers failed with return code of " << GetResultString((VkResult)result);
+		return result;
+	}
+
+	vk::FenceCreateInfo fenceInfo;
+	for (size_t i = 0; i < 2; i++)
+	{
+		result = mDevice.createFence(&fenceInfo, nullptr, &mFences[i]);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "TransferManager::Initialize vkCreateFence failed with return code of " << GetResultString((VkResult)result);
+			return result;
+		}
+	}
+
+	return vk::Result::eSuccess;
+}
+
+void TransferManager::Destroy()
+{
+	if (mDevice == vk::Device())
+	{
+		return;
+	}
+
+	Finish();
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		mDevice.destroyFence(mFences[i], nullptr);
+	}
+	mDevice.freeCommandBuffers(mCommandPool, 2, mCommandBuffers);
+	mDevice.destroyCommandPool(mCommandPool, nullptr);
+	mDevice = vk::Device();
+}
+
+vk::CommandBuffer TransferManager::GetCommandBuffer()
+{
+	auto& commandBuffer = mCommandBuffers[mCurrentCommandBuffer];
+
+	if (!mIsRecording)
+	{
+		vk::Result result;
+
+		//The command buffer carried the batch before last so this almost never has to wait.
+		if (mBatchNumbers[mCurrentCommandBuffer] != 0)
+		{
+			result = mDevice.waitForFences(1, &mFences[mCurrentCommandBuffer], VK_TRUE, UINT64_MAX);
+			if (result != vk::Result::eSuccess)
+			{
+				BOOST_LOG_TRIVIAL(fatal) << "TransferManager::GetCommandBuffer vkWaitForFences failed with return code of " << GetResultString((VkResult)result);
+			}
+			mCompletedBatchNumber = std::max(mCompletedBatchNumber, mBatchNumbers[mCurrentCommandBuffer]);
+		}
+
+		//This is the only place fences are reset, their batch is finished and the submit needs an unsignaled fence.
+		mDevice.resetFences(1, &mFences[mCurrentCommandBuffer]);
+		mBatchNumbers[mCurrentCommandBuffer] = 0;
+
+		commandBuffer.reset(vk::CommandBufferResetFlags());
+
+		vk::CommandBufferBeginInfo beginInfo;
+		beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+
+		result = commandBuffer.begin(&beginInfo);
+		if (result != vk::Result::eSuccess)
+		{
+			BOOST_LOG_TRIVIAL(fatal) << "TransferManager::GetCommandBuffer vkBeginCommandBuffer failed with return code of " << GetResultString((VkResult)result);
+			return commandBuffer;
+		}
+
+		mIsRecording = true;
+	}
+
+	if (!mIsLoading)
+	{
+		mIsLoading = true;
+		mLoadStart = std::chrono::steady_clock::now();
+	}
+
+	mUploadCount++;
+
+	return commandBuffer;
+}
+
+void TransferManager::Submit()
+{
+	if (!mIsRecording)
+	{
+		return;
+	}
+
+	auto& commandBuffer = mCommandBuffers[mCurrentCommandBuffer];
+	commandBuffer.end();
+	mIsRecording = false;
+
+	vk::SubmitInfo submitInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	vk::Result result = mQueue.submit(1, &submitInfo, mFences[mCurrentCommandBuffer]);
+	if (result != vk::Result::eSuccess)
+	{
+		BOOST_LOG_TRIVIAL(fatal) << "TransferManager::Submit vkQueueSubmit failed with return code of " << GetResultString((VkResult)result);
+		mBatchNumber++; //Nothing was submitted so there is nothing to wait for.
+		return;
+	}
+
+	mBatchNumbers[mCurrentCommandBuffer] = mBatchNumber++;
+	mCurrentCommandBuffer = !mCurrentCommandBuffer;
+	mBatchCount++;
+}
+
+bool TransferManager::IsBatchComplete(uint64_t batchNumber)
+{
+	if (batchNumber <= mCompletedBatchNumber)
+	{
+		return true;
+	}
+
+	if (batchNumber >= mBatchNumber)
+	{
+		return false; //The batch hasn't been submitted yet.
+	}
+
+	//Fences stay signaled until GetCommandBuffer reuses their command buffer so polling them is harmless.
+	const uint64_t completedBatchNumber = mCompletedBatchNumber;
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (mBatchNumbers[i] > completedBatchNumber && mDevice.getFenceStatus(mFences[i]) == vk::Result::eSuccess)
+		{
+			mCompletedBatchNumber = std::max(mCompletedBatchNumber, mBatchNumbers[i]);
+		}
+	}
+
+	return batchNumber <= mCompletedBatchNumber;
+}
+
+void TransferManager::WaitForBatch(uint64_t batchNumber)
+{
+	if (batchNumber <= mCompletedBatchNumber)
+	{
+		return;
+	}
+
+	//The batch is still being recorded so it has to go out early.
+	if (batchNumber >= mBatchNumber)
+	{
+		Submit();
+	}
+
+	const uint64_t completedBatchNumber = mCompletedBatchNumber;
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (mBatchNumbers[i] > completedBatchNumber && mBatchNumbers[i] <= batchNumber)
+		{
+			vk::Result result = mDevice.waitForFences(1, &mFences[i], VK_TRUE, UINT64_MAX);
+			if (result != vk::Result::eSuccess)
+			{
+				BOOST_LOG_TRIVIAL(fatal) << "TransferManager::WaitForBatch vkWaitForFences failed with return code of " << GetResultString((VkResult)result);
+				return;
+			}
+			mCompletedBatchNumber = std::max(mCompletedBatchNumber, mBatchNumbers[i]);
+		}
+	}
+
+	mCompletedBatchNumber = std::max(mCompletedBatchNumber, std::min(batchNumber, mBatchNumber - 1));
+}
+
+void TransferManager::Finish()
+{
+	WaitForBatch(mBatchNumber);
+}
+
+void TransferManager::EndFrame()
+{
+	BOOST_LOG_TRIVIAL(trace) << "TransferManager::EndFrame " << mUploadCount << " uploads (" << mUploadSize << " bytes) in " << mBatchCount << " batches.";
+
+	if (mIsLoading)
+	{
+		if (mUploadCount != 0)
+		{
+			mLoadFrameCount++;
+			mLoadUploadCount += mUploadCount;
+			mLoadBatchCount += mBatchCount;
+			mLoadUploadSize += mUploadSize;
+		}
+		else
+		{
+			//The load ends with the first frame that uploads nothing, by then every frame that carried its uploads has been submitted.
+			const auto loadTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - mLoadStart);
+			BOOST_LOG_TRIVIAL(info) << "TransferManager::EndFrame load of " << mLoadUploadCount << " uploads (" << mLoadUploadSize << " bytes) in " << mLoadBatchCount << " batches over " << mLoadFrameCount << " frames took " << loadTime.count() << " ms.";
+
+			mIsLoading = false;
+			mLoadFrameCount = 0;
+			mLoadUploadCount = 0;
+			mLoadBatchCount = 0;
+			mLoadUploadSize = 0;
+		}
+	}
+
+	mLastFrameUploadCount = mUploadCount;
+	mLastFrameBatchCount = mBatchCount;
+	mLastFrameUploadSize = mUploadSize;
+	mUploadCount = 0;
+	mBatchCount = 0;
+	mUploadSize = 0;
+}
@@ -0,0 +1,78 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vk_sdk_platform.h>
+#include <chrono>
+
+#ifndef TRANSFERMANAGER_H
+#define TRANSFERMANAGER_H
+
+/*
+Collects uploads into one command buffer that goes out just ahead of the frame instead of submitting and waiting for every copy.
+The batch is submitted on the graphics queue so queue order alone puts it ahead of the frame that uses the uploads and behind the frames that used the old contents.
+Batches are numbered so a resource can remember which one last read its staging memory and wait for just that batch before it is written again.
+
+There is deliberately no dedicated transfer queue and so no semaphores between queues. Images are created with exclusive sharing so every upload on another queue family would need an ownership release and acquire pair, and the image layout tracker relies on one queue seeing every transition in submission order.
+The staging memory is the buffer each level keeps mapped rather than a shared ring, so a level only ever waits for the batch that last read its own buffer.
+
+A load is a run of frames that upload something. When a frame without uploads ends one, its upload count, size and wall time are logged so load times can be compared between builds.
+*/
+struct TransferManager
+{
+	vk::Device mDevice;
+	vk::Queue mQueue;
+	uint32_t mQueueFamilyIndex = 0;
+	vk::CommandPool mCommandPool;
+	vk::CommandBuffer mCommandBuffers[2];
+	vk::Fence mFences[2];
+	uint64_t mBatchNumbers[2] = {}; //The batch each command buffer carried last, 0 once its fence has been reset for the next one.
+	size_t mCurrentCommandBuffer = 0;
+	bool mIsRecording = false;
+	uint64_t mBatchNumber = 1; //The batch being recorded.
+	uint64_t mCompletedBatchNumber = 0;
+
+	//Statistics
+	uint32_t mUploadCount = 0;
+	uint32_t mBatchCount = 0;
+	vk::DeviceSize mUploadSize = 0; //Bytes copied out of staging memory, added by the code recording the copy.
+	uint32_t mLastFrameUploadCount = 0;
+	uint32_t mLastFrameBatchCount = 0;
+	vk::DeviceSize mLastFrameUploadSize = 0;
+
+	//Load timing
+	bool mIsLoading = false;
+	std::chrono::steady_clock::time_point mLoadStart; //When the first upload of the load was recorded.
+	uint32_t mLoadFrameCount = 0;
+	uint32_t mLoadUploadCount = 0;
+	uint32_t mLoadBatchCount = 0;
+	vk::DeviceSize mLoadUploadSize = 0;
+
+	vk::Result Initialize(vk::Device device, vk::Queue queue, uint32_t queueFamilyIndex);
+	void Destroy();
+	vk::CommandBuffer GetCommandBuffer();
+	void Submit();
+	bool IsBatchComplete(uint64_t batchNumber);
+	void WaitForBatch(uint64_t batchNumber);
+	void Finish();
+	void EndFrame();
+};
+
+#endif // TRANSFERMANAGER_H
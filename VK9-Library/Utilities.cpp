@@ -766,6 +766,54 @@ void MergeState(const DeviceState& sourceState, DeviceState& targetState, D3DSTA
 	//IDirect3DDevice9::SetVertexShaderConstantI
 }
 
+void AddDirtyRegion(boost::container::small_vector<D3DBOX, 4>& regions, D3DBOX region)
+{
+	if (region.Right <= region.Left || region.Bottom <= region.Top || region.Back <= region.Front)
+	{
+		return;
+	}
+
+	//Regions that overlap or touch are folded into one so every texel is only copied once.
+	for (size_t i = 0; i < regions.size();)
+	{
+		auto& existing = regions[i];
+		if (existing.Left <= region.Right && region.Left <= existing.Right
+			&& existing.Top <= region.Bottom && region.Top <= existing.Bottom
+			&& existing.Front <= region.Back && region.Front <= existing.Back)
+		{
+			region.Left = std::min(region.Left, existing.Left);
+			region.Top = std::min(region.Top, existing.Top);
+			region.Front = std::min(region.Front, existing.Front);
+			region.Right = std::max(region.Right, existing.Right);
+			region.Bottom = std::max(region.Bottom, existing.Bottom);
+			region.Back = std::max(region.Back, existing.Back);
+			regions.erase(regions.begin() + i);
+			i = 0; //The bigger region may now touch one that was already checked.
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	//Past a handful of regions a single bounding box is cheaper than tracking them all.
+	if (regions.size() >= 4)
+	{
+		for (auto& existing : regions)
+		{
+			region.Left = std::min(region.Left, existing.Left);
+			region.Top = std::min(region.Top, existing.Top);
+			region.Front = std::min(region.Front, existing.Front);
+			region.Right = std::max(region.Right, existing.Right);
+			region.Bottom = std::max(region.Bottom, existing.Bottom);
+			region.Back = std::max(region.Back, existing.Back);
+		}
+		regions.clear();
+	}
+
+	regions.push_back(region);
+}
+
 HMODULE GetModule(HMODULE module)
 {
 	static HMODULE dllModule = 0;
@@ -874,7 +922,7 @@ vk::ShaderModule LoadShaderFromResource(vk::Device device, WORD resource)
 	return module;
 }
 
-void ReallyCopyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t depth, uint32_t srcMip, uint32_t dstMip, uint32_t srcLayer, uint32_t dstLayer)
+void ReallyCopyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t depth, uint32_t srcMip, uint32_t dstMip, uint32_t srcLayer, uint32_t dstLayer, vk::ImageLayout srcLayout)
 {
 	//vk::Result result;
 
@@ -900,7 +948,7 @@ void ReallyCopyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Im
 	region.extent.depth = depth;
 
 	commandBuffer.copyImage(
-		srcImage, vk::ImageLayout::eTransferSrcOptimal,
+		srcImage, srcLayout,
 		dstImage, vk::ImageLayout::eTransferDstOptimal,
 		1, &region);
 }
@@ -938,6 +986,81 @@ void ReallyCopyImage(VkCommandBuffer commandBuffer, VkImage srcImage, VkImage ds
 	);
 }
 
+void ReallyCopyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage, const boost::container::small_vector<D3DBOX, 4>& regions, uint32_t srcMip, uint32_t dstMip, uint32_t srcLayer, uint32_t dstLayer, vk::ImageLayout srcLayout)
+{
+	boost::container::small_vector<vk::ImageCopy, 4> copies;
+
+	for (auto& box : regions)
+	{
+		vk::ImageCopy region;
+		region.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		region.srcSubresource.baseArrayLayer = srcLayer;
+		region.srcSubresource.mipLevel = srcMip;
+		region.srcSubresource.layerCount = 1;
+		region.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		region.dstSubresource.baseArrayLayer = dstLayer;
+		region.dstSubresource.mipLevel = dstMip;
+		region.dstSubresource.layerCount = 1;
+		region.srcOffset = vk::Offset3D(box.Left, box.Top, box.Front);
+		region.dstOffset = vk::Offset3D(box.Left, box.Top, box.Front);
+		region.extent.width = box.Right - box.Left;
+		region.extent.height = box.Bottom - box.Top;
+		region.extent.depth = box.Back - box.Front;
+		copies.push_back(region);
+	}
+
+	if (copies.empty())
+	{
+		return;
+	}
+
+	commandBuffer.copyImage(
+		srcImage, srcLayout,
+		dstImage, vk::ImageLayout::eTransferDstOptimal,
+		(uint32_t)copies.size(), copies.data());
+}
+
+void ReallyCopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer srcBuffer, vk::Image dstImage, const vk::SubresourceLayout& layout, uint32_t texelSize, uint32_t blockSize, const boost::container::small_vector<D3DBOX, 4>& regions, uint32_t dstMip, uint32_t dstLayer)
+{
+	boost::container::small_vector<vk::BufferImageCopy, 4> copies;
+
+	//The buffer holds the whole level with the pitches handed to the application so each region starts at its own offset into it.
+	//For compressed formats texelSize is the size of a block and each row of the buffer is a line of blocks.
+	for (auto& box : regions)
+	{
+		//Compressed copies have to start on a block.
+		uint32_t left = box.Left - (box.Left % blockSize);
+		uint32_t top = box.Top - (box.Top % blockSize);
+
+		//Buffer offsets have to be a multiple of four so narrow formats widen the region to the left until it lines up.
+		while (left > 0 && ((texelSize * left) & 3) != 0)
+		{
+			left--;
+		}
+
+		vk::BufferImageCopy region;
+		region.bufferOffset = layout.offset + (layout.depthPitch * box.Front) + (layout.rowPitch * (top / blockSize)) + (texelSize * (left / blockSize));
+		region.bufferRowLength = (uint32_t)(layout.rowPitch / texelSize) * blockSize;
+		region.bufferImageHeight = (uint32_t)(layout.depthPitch / layout.rowPitch) * blockSize;
+		region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		region.imageSubresource.baseArrayLayer = dstLayer;
+		region.imageSubresource.mipLevel = dstMip;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = vk::Offset3D(left, top, box.Front);
+		region.imageExtent.width = box.Right - left;
+		region.imageExtent.height = box.Bottom - top;
+		region.imageExtent.depth = box.Back - box.Front;
+		copies.push_back(region);
+	}
+
+	if (copies.empty())
+	{
+		return;
+	}
+
+	commandBuffer.copyBufferToImage(srcBuffer, dstImage, vk::ImageLayout::eTransferDstOptimal, (uint32_t)copies.size(), copies.data());
+}
+
 void ReallySetImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageAspectFlags aspectMask, vk::ImageLayout oldImageLayout, vk::ImageLayout newImageLayout, uint32_t levelCount, uint32_t mipIndex, uint32_t layerCount)
 {
 	//VkResult result;
@@ -77,11 +77,15 @@ void MergeState(const DeviceState& sourceState, DeviceState& targetState, D3DSTA
 
 HMODULE GetModule(HMODULE module = 0);
 
+void AddDirtyRegion(boost::container::small_vector<D3DBOX, 4>& regions, D3DBOX region);
+
 vk::ShaderModule LoadShaderFromFile(vk::Device device, const char *filename);
 vk::ShaderModule LoadShaderFromResource(vk::Device device, WORD resource);
 
-void ReallyCopyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t depth, uint32_t srcMip, uint32_t dstMip, uint32_t srcLayer, uint32_t dstLayer);
+void ReallyCopyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t depth, uint32_t srcMip, uint32_t dstMip, uint32_t srcLayer, uint32_t dstLayer, vk::ImageLayout srcLayout = vk::ImageLayout::eTransferSrcOptimal);
 void ReallyCopyImage(VkCommandBuffer commandBuffer, VkImage srcImage, VkImage dstImage, int32_t x, int32_t y, uint32_t width, uint32_t height, uint32_t srcMip, uint32_t dstMip, uint32_t srcLayer, uint32_t dstLayer);
+void ReallyCopyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage, const boost::container::small_vector<D3DBOX, 4>& regions, uint32_t srcMip, uint32_t dstMip, uint32_t srcLayer, uint32_t dstLayer, vk::ImageLayout srcLayout = vk::ImageLayout::eTransferSrcOptimal);
+void ReallyCopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer srcBuffer, vk::Image dstImage, const vk::SubresourceLayout& layout, uint32_t texelSize, uint32_t blockSize, const boost::container::small_vector<D3DBOX, 4>& regions, uint32_t dstMip, uint32_t dstLayer);
 void ReallySetImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageAspectFlags aspectMask, vk::ImageLayout oldImageLayout, vk::ImageLayout newImageLayout, uint32_t levelCount, uint32_t mipIndex, uint32_t layerCount);
 
 inline uint32_t FindMemoryType(vk::PhysicalDeviceMemoryProperties& memoryProperties, uint32_t typeFilter, vk::MemoryPropertyFlagBits properties)
@@ -428,6 +432,47 @@ inline vk::PolygonMode ConvertFillMode(D3DFILLMODE input) noexcept
 	return output;
 }
 
+inline vk::SampleCountFlagBits ConvertMultiSample(D3DMULTISAMPLE_TYPE input, vk::SampleCountFlags supported) noexcept
+{
+	vk::SampleCountFlagBits output;
+
+	switch (input)
+	{
+	case D3DMULTISAMPLE_NONE:
+		output = vk::SampleCountFlagBits::e1;
+		break;
+	case D3DMULTISAMPLE_NONMASKABLE: //The quality level picks the sample count on real hardware so just use a common one.
+		output = vk::SampleCountFlagBits::e4;
+		break;
+	default:
+		if (input >= D3DMULTISAMPLE_16_SAMPLES)
+		{
+			output = vk::SampleCountFlagBits::e16;
+		}
+		else if (input >= D3DMULTISAMPLE_8_SAMPLES)
+		{
+			output = vk::SampleCountFlagBits::e8;
+		}
+		else if (input >= D3DMULTISAMPLE_4_SAMPLES)
+		{
+			output = vk::SampleCountFlagBits::e4;
+		}
+		else
+		{
+			output = vk::SampleCountFlagBits::e2;
+		}
+		break;
+	}
+
+	//Fall back to the highest count the device can actually render with.
+	while (output != vk::SampleCountFlagBits::e1 && !(supported & output))
+	{
+		output = (vk::SampleCountFlagBits)((VkSampleCountFlags)output >> 1);
+	}
+
+	return output;
+}
+
 inline vk::PrimitiveTopology ConvertPrimitiveType(D3DPRIMITIVETYPE input) noexcept
 {
 	vk::PrimitiveTopology output;
@@ -515,7 +560,7 @@ inline vk::Format ConvertFormat(D3DFORMAT format) noexcept
 	case D3DFMT_UNKNOWN:
 		return  (vk::Format)VK_FORMAT_UNDEFINED;
 	case D3DFMT_R8G8B8:
-		return (vk::Format)VK_FORMAT_R8G8B8_UNORM;
+		return (vk::Format)VK_FORMAT_B8G8R8_UNORM; //Stored as B, G, R bytes.
 	case D3DFMT_A8R8G8B8:
 		return (vk::Format)VK_FORMAT_B8G8R8A8_UNORM;
 	case D3DFMT_X8R8G8B8:
@@ -560,7 +605,7 @@ inline vk::Format ConvertFormat(D3DFORMAT format) noexcept
 	case D3DFMT_A8L8:
 		return (vk::Format)VK_FORMAT_R8G8_UNORM; //L8A8_UNORM
 	case D3DFMT_A4L4:
-		return (vk::Format)VK_FORMAT_UNDEFINED; //L4A4_UNORM
+		return (vk::Format)VK_FORMAT_R4G4_UNORM_PACK8; //L4A4_UNORM with alpha in R.
 	case D3DFMT_V8U8:
 		return (vk::Format)VK_FORMAT_R8G8_SNORM;
 	case D3DFMT_L6V5U5:
@@ -582,15 +627,15 @@ inline vk::Format ConvertFormat(D3DFORMAT format) noexcept
 	case D3DFMT_G8R8_G8B8:
 		return (vk::Format)VK_FORMAT_UNDEFINED;
 	case D3DFMT_DXT1:
-		return (vk::Format)VK_FORMAT_UNDEFINED;
+		return (vk::Format)VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
 	case D3DFMT_DXT2:
-		return (vk::Format)VK_FORMAT_UNDEFINED;
+		return (vk::Format)VK_FORMAT_BC2_UNORM_BLOCK;
 	case D3DFMT_DXT3:
-		return (vk::Format)VK_FORMAT_UNDEFINED;
+		return (vk::Format)VK_FORMAT_BC2_UNORM_BLOCK;
 	case D3DFMT_DXT4:
-		return (vk::Format)VK_FORMAT_UNDEFINED;
+		return (vk::Format)VK_FORMAT_BC3_UNORM_BLOCK;
 	case D3DFMT_DXT5:
-		return (vk::Format)VK_FORMAT_UNDEFINED;
+		return (vk::Format)VK_FORMAT_BC3_UNORM_BLOCK;
 	case D3DFMT_D16_LOCKABLE:
 		return (vk::Format)VK_FORMAT_UNDEFINED; //D16_LOCKABLE
 	case D3DFMT_D32:
@@ -656,6 +701,88 @@ inline vk::Format ConvertFormat(D3DFORMAT format) noexcept
 	}
 }
 
+/*
+Bytes per pixel of a format as the application sees it, this is what lock pitches are worked out from.
+Compressed formats are given in bytes per 4x4 block.
+*/
+inline uint32_t GetFormatSize(D3DFORMAT format) noexcept
+{
+	switch (format)
+	{
+	case D3DFMT_R3G3B2:
+	case D3DFMT_A8:
+	case D3DFMT_P8:
+	case D3DFMT_L8:
+	case D3DFMT_A4L4:
+		return 1;
+	case D3DFMT_R5G6B5:
+	case D3DFMT_X1R5G5B5:
+	case D3DFMT_A1R5G5B5:
+	case D3DFMT_A4R4G4B4:
+	case D3DFMT_A8R3G3B2:
+	case D3DFMT_X4R4G4B4:
+	case D3DFMT_A8P8:
+	case D3DFMT_A8L8:
+	case D3DFMT_V8U8:
+	case D3DFMT_L6V5U5:
+	case D3DFMT_CxV8U8:
+	case D3DFMT_D16_LOCKABLE:
+	case D3DFMT_D15S1:
+	case D3DFMT_D16:
+	case D3DFMT_L16:
+	case D3DFMT_INDEX16:
+	case D3DFMT_R16F:
+	case D3DFMT_UYVY:
+	case D3DFMT_YUY2:
+	case D3DFMT_R8G8_B8G8:
+	case D3DFMT_G8R8_G8B8:
+		return 2;
+	case D3DFMT_R8G8B8:
+		return 3;
+	case D3DFMT_A16B16G16R16:
+	case D3DFMT_Q16W16V16U16:
+	case D3DFMT_A16B16G16R16F:
+	case D3DFMT_G32R32F:
+	case D3DFMT_DXT1:
+		return 8;
+	case D3DFMT_A32B32G32R32F:
+	case D3DFMT_DXT2:
+	case D3DFMT_DXT3:
+	case D3DFMT_DXT4:
+	case D3DFMT_DXT5:
+		return 16;
+	default:
+		return 4;
+	}
+}
+
+/*
+Width and height in pixels of the blocks a format is stored in, 1 for anything that isn't compressed.
+*/
+inline uint32_t GetFormatBlockSize(D3DFORMAT format) noexcept
+{
+	switch (format)
+	{
+	case D3DFMT_DXT1:
+	case D3DFMT_DXT2:
+	case D3DFMT_DXT3:
+	case D3DFMT_DXT4:
+	case D3DFMT_DXT5:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+/*
+Offset of a pixel from the start of a locked level. Compressed formats have a row per line of blocks so the coordinates are in blocks.
+*/
+inline size_t GetLockOffset(D3DFORMAT format, size_t rowPitch, size_t slicePitch, uint32_t left, uint32_t top, uint32_t front = 0) noexcept
+{
+	const uint32_t blockSize = GetFormatBlockSize(format);
+	return (slicePitch * front) + (rowPitch * (top / blockSize)) + (GetFormatSize(format) * (left / blockSize));
+}
+
 inline D3DFORMAT ConvertFormat(vk::Format format) noexcept
 {
 	/*
@@ -666,7 +793,7 @@ inline D3DFORMAT ConvertFormat(vk::Format format) noexcept
 	{
 	case VK_FORMAT_UNDEFINED:
 		return D3DFMT_UNKNOWN;
-	case VK_FORMAT_R8G8B8_UNORM:
+	case VK_FORMAT_B8G8R8_UNORM:
 		return D3DFMT_R8G8B8;
 	case VK_FORMAT_B8G8R8A8_UNORM:
 		return D3DFMT_A8R8G8B8;
@@ -727,7 +854,7 @@ inline D3DFORMAT ConvertFormat(VkFormat format) noexcept
 	{
 	case VK_FORMAT_UNDEFINED:
 		return D3DFMT_UNKNOWN;
-	case VK_FORMAT_R8G8B8_UNORM:
+	case VK_FORMAT_B8G8R8_UNORM:
 		return D3DFMT_R8G8B8;
 	case VK_FORMAT_B8G8R8A8_UNORM:
 		return D3DFMT_A8R8G8B8;
@@ -29,12 +29,14 @@ struct WorkItem
 {
 	WorkItemType WorkItemType = WorkItemType::None;
 	size_t Id = 0;
+	size_t Key = 0; //The handle a create makes, allocated before the item is queued so the caller doesn't have to wait for it.
 	void* Argument1 = nullptr;
 	void* Argument2 = nullptr;
 	void* Argument3 = nullptr;
 	void* Argument4 = nullptr;
 	void* Argument5 = nullptr;
 	void* Argument6 = nullptr;
+	void* Argument7 = nullptr;
 
 	IUnknown* Caller = nullptr;
 
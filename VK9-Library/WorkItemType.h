@@ -34,7 +34,10 @@ enum WorkItemType
 	, Device_Present
 	, Device_BeginStateBlock
 	, Device_DrawIndexedPrimitive
+	, Device_DrawIndexedPrimitiveUP
 	, Device_DrawPrimitive
+	, Device_DrawPrimitiveUP
+	, Device_CreateUploadBuffer
 	, Device_EndStateBlock
 	, Device_GetDisplayMode
 	, Device_GetFVF
@@ -83,10 +86,15 @@ enum WorkItemType
 	, Device_SetVertexShaderConstantF
 	, Device_SetVertexShaderConstantI
 	, Device_SetViewport
+	, Device_UpdateSurface
 	, Device_UpdateTexture
-	, Device_GetAvailableTextureMem
+	, Device_StretchRect
+	, Device_ColorFill
+	, Device_GetRenderTargetData
+	, Device_EvictManagedResources
 	, Device_SetRenderTarget
 	, Device_SetDepthStencilSurface
+	, Device_SetTexturePalette
 	, Device_Destroy
 	, VertexBuffer_Create
 	, VertexBuffer_Lock
@@ -102,6 +110,9 @@ enum WorkItemType
 	, Texture_Create
 	, Texture_GenerateMipSubLevels
 	, Texture_Destroy
+	, Texture_PreLoad
+	, Texture_SetPriority
+	, Texture_AddDirtyRect
 	, CubeTexture_Create
 	, CubeTexture_GenerateMipSubLevels
 	, CubeTexture_Destroy
@@ -110,7 +121,6 @@ enum WorkItemType
 	, VolumeTexture_Destroy
 	, Surface_Create
 	, Surface_LockRect
-	, Surface_UnlockRect
 	, Surface_Flush
 	, Surface_Destroy
 	, Query_Create
@@ -120,7 +130,6 @@ enum WorkItemType
 	, Query_Destroy
 	, Volume_Create
 	, Volume_LockRect
-	, Volume_UnlockRect
 	, Volume_Flush
 	, Volume_Destroy
 	, Shader_Create
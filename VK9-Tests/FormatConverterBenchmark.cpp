@@ -0,0 +1,114 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+/*
+Measures how fast the software decoders turn BC1, BC2 and BC3 into RGBA8.
+Throughput is counted in decoded bytes so it can be compared with the uncompressed conversions.
+*/
+
+#include "FormatConverter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+const uint32_t Width = 1024;
+const uint32_t Height = 1024;
+const double MinimumSeconds = 0.5; //Each case repeats until it has run at least this long.
+
+template <typename Function>
+void Measure(const char* name, Function function)
+{
+	function(); //Warm up the caches and the pool.
+
+	uint32_t iterationCount = 0;
+	const auto start = std::chrono::steady_clock::now();
+	double seconds = 0.0;
+	do
+	{
+		function();
+		iterationCount++;
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while (seconds < MinimumSeconds);
+
+	const double megabytes = ((double)Width * Height * sizeof(uint32_t) * iterationCount) / (1024.0 * 1024.0);
+	printf("%-24s %8.1f MB/s\n", name, megabytes / seconds);
+}
+
+int main(int argc, char** argv)
+{
+	std::mt19937 random(9);
+	std::vector<uint8_t> source((Width / 4) * (Height / 4) * 16);
+	for (auto& value : source)
+	{
+		value = (uint8_t)random();
+	}
+	std::vector<uint32_t> destination(Width * Height);
+
+	struct
+	{
+		const char* Name;
+		D3DFORMAT Format;
+		ConvertFunction Decode;
+		uint32_t BlockSize;
+	} formats[] =
+	{
+		{ "BC1", D3DFMT_DXT1, DecodeBC1, 8 },
+		{ "BC2", D3DFMT_DXT3, DecodeBC2, 16 },
+		{ "BC3", D3DFMT_DXT5, DecodeBC3, 16 }
+	};
+
+	ThreadPool threadPool;
+	threadPool.Initialize(std::max(std::min(std::thread::hardware_concurrency(), MaximumConversionThreadCount), (uint32_t)1));
+
+	for (auto& format : formats)
+	{
+		const size_t sourcePitch = (Width / 4) * format.BlockSize;
+		char name[64];
+
+		snprintf(name, sizeof(name), "%s one thread", format.Name);
+		Measure(name, [&]()
+		{
+			format.Decode((const char*)source.data(), sourcePitch, (char*)destination.data(), Width * sizeof(uint32_t), Width, Height, nullptr);
+		});
+
+		FormatConversion conversion;
+		conversion.Convert = format.Decode;
+
+		vk::SubresourceLayout sourceLayout;
+		sourceLayout.rowPitch = sourcePitch;
+		vk::SubresourceLayout destinationLayout;
+		destinationLayout.rowPitch = Width * sizeof(uint32_t);
+
+		const D3DBOX region = { 0, 0, Width, Height, 0, 1 };
+
+		snprintf(name, sizeof(name), "%s pool of %u threads", format.Name, threadPool.GetThreadCount());
+		Measure(name, [&]()
+		{
+			ConvertRegion(threadPool, conversion, format.Format, (const char*)source.data(), sourceLayout, (char*)destination.data(), destinationLayout, region);
+		});
+	}
+
+	threadPool.Destroy();
+
+	return 0;
+}
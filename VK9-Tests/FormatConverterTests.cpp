@@ -0,0 +1,208 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+/*
+Decodes hand made BC1, BC2 and BC3 blocks and compares them with the colors the format specifies for them.
+End points are picked so every interpolated value is a whole number and any conforming decoder has to produce the same bytes.
+*/
+
+#include "FormatConverter.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+const uint8_t Bc1FourColorBlock[8] = { 0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4 }; //color0 red > color1 blue, every row indexes 0 1 2 3.
+const uint8_t Bc1ThreeColorBlock[8] = { 0x00, 0x00, 0x00, 0x80, 0xE4, 0xE4, 0xE4, 0xE4 }; //color0 black <= color1 (16,0,0), index 3 is transparent black.
+const uint8_t Bc2Block[16] = { 0x10, 0x32, 0x54, 0x76, 0x98, 0xBA, 0xDC, 0xFE, 0x00, 0x00, 0x00, 0xF8, 0xE4, 0xE4, 0xE4, 0xE4 }; //Pixel i has alpha i, color0 <= color1 must still decode four colors.
+const uint8_t Bc3EightAlphaBlock[16] = { 252, 0, 0x88, 0xC6, 0xFA, 0x88, 0xC6, 0xFA, 0x00, 0x00, 0x00, 0xF8, 0xE4, 0xE4, 0xE4, 0xE4 }; //alpha0 > alpha1, pixel i uses index i % 8.
+const uint8_t Bc3SixAlphaBlock[16] = { 0, 250, 0x88, 0xC6, 0xFA, 0x88, 0xC6, 0xFA, 0x00, 0x00, 0x00, 0xF8, 0xE4, 0xE4, 0xE4, 0xE4 }; //alpha0 <= alpha1, indices 6 and 7 are 0 and 255.
+
+uint32_t RGBA(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+int gFailureCount = 0;
+
+void Check(const char* name, const uint32_t* actual, const uint32_t* expected, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (actual[i] != expected[i])
+		{
+			printf("%s pixel %zu is 0x%08X, expected 0x%08X\n", name, i, actual[i], expected[i]);
+			gFailureCount++;
+			return;
+		}
+	}
+	printf("%s passed\n", name);
+}
+
+void TestBlock(const char* name, ConvertFunction decode, const uint8_t* block, const uint32_t (&expected)[16])
+{
+	uint32_t pixels[16] = {};
+	decode((const char*)block, 0, (char*)pixels, 4 * sizeof(uint32_t), 4, 4, nullptr);
+	Check(name, pixels, expected, 16);
+}
+
+void TestBC1()
+{
+	const uint32_t red[4] = { RGBA(255, 0, 0, 255), RGBA(0, 0, 255, 255), RGBA(170, 0, 85, 255), RGBA(85, 0, 170, 255) };
+	uint32_t expected[16];
+	for (size_t i = 0; i < 16; i++)
+	{
+		expected[i] = red[i % 4];
+	}
+	TestBlock("BC1 four color", DecodeBC1, Bc1FourColorBlock, expected);
+
+	const uint32_t punchThrough[4] = { RGBA(0, 0, 0, 255), RGBA(132, 0, 0, 255), RGBA(66, 0, 0, 255), RGBA(0, 0, 0, 0) };
+	for (size_t i = 0; i < 16; i++)
+	{
+		expected[i] = punchThrough[i % 4];
+	}
+	TestBlock("BC1 three color punch through", DecodeBC1, Bc1ThreeColorBlock, expected);
+}
+
+void TestBC2()
+{
+	const uint32_t red[4] = { 0, 255, 85, 170 };
+	uint32_t expected[16];
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		expected[i] = RGBA(red[i % 4], 0, 0, i * 17);
+	}
+	TestBlock("BC2 explicit alpha", DecodeBC2, Bc2Block, expected);
+}
+
+void TestBC3()
+{
+	const uint32_t red[4] = { 0, 255, 85, 170 };
+	const uint32_t eightAlpha[8] = { 252, 0, 216, 180, 144, 108, 72, 36 };
+	const uint32_t sixAlpha[8] = { 0, 250, 50, 100, 150, 200, 0, 255 };
+	uint32_t expected[16];
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		expected[i] = RGBA(red[i % 4], 0, 0, eightAlpha[i % 8]);
+	}
+	TestBlock("BC3 eight alpha", DecodeBC3, Bc3EightAlphaBlock, expected);
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		expected[i] = RGBA(red[i % 4], 0, 0, sixAlpha[i % 8]);
+	}
+	TestBlock("BC3 six alpha", DecodeBC3, Bc3SixAlphaBlock, expected);
+}
+
+void TestPartialBlocks()
+{
+	//An 8x4 row of two blocks, then the same row clipped to a 6x3 level. Pixels outside the level must not be written.
+	uint8_t blocks[16];
+	memcpy(blocks, Bc1FourColorBlock, 8);
+	memcpy(blocks + 8, Bc1ThreeColorBlock, 8);
+
+	uint32_t first[16], second[16];
+	DecodeBC1((const char*)Bc1FourColorBlock, 0, (char*)first, 16, 4, 4, nullptr);
+	DecodeBC1((const char*)Bc1ThreeColorBlock, 0, (char*)second, 16, 4, 4, nullptr);
+
+	uint32_t expected[32];
+	for (size_t y = 0; y < 4; y++)
+	{
+		memcpy(&expected[y * 8], &first[y * 4], 16);
+		memcpy(&expected[y * 8 + 4], &second[y * 4], 16);
+	}
+
+	uint32_t pixels[32];
+	DecodeBC1((const char*)blocks, sizeof(blocks), (char*)pixels, 8 * sizeof(uint32_t), 8, 4, nullptr);
+	Check("BC1 two blocks", pixels, expected, 32);
+
+	for (size_t i = 0; i < 32; i++)
+	{
+		if ((i % 8) >= 6 || i >= 24)
+		{
+			expected[i] = 0xCDCDCDCD;
+		}
+		pixels[i] = 0xCDCDCDCD;
+	}
+	DecodeBC1((const char*)blocks, sizeof(blocks), (char*)pixels, 8 * sizeof(uint32_t), 6, 3, nullptr);
+	Check("BC1 clipped to the level", pixels, expected, 32);
+}
+
+void TestConvertRegion()
+{
+	//A volume converted on the pool has to match decoding every slice on this thread.
+	const uint32_t width = 512, height = 512, depth = 3;
+	const uint32_t blockCount = (width / 4) * (height / 4) * depth;
+
+	std::vector<uint8_t> source(blockCount * 16);
+	for (uint32_t i = 0; i < blockCount; i++)
+	{
+		const uint8_t* blocks[4] = { Bc2Block, Bc3EightAlphaBlock, Bc3SixAlphaBlock, Bc2Block };
+		memcpy(&source[i * 16], blocks[(i * 7) % 4], 16);
+		source[i * 16 + 8] = (uint8_t)i; //Vary the colors so misplaced bands show up.
+	}
+
+	vk::SubresourceLayout sourceLayout;
+	sourceLayout.rowPitch = (width / 4) * 16;
+	sourceLayout.depthPitch = sourceLayout.rowPitch * (height / 4);
+
+	vk::SubresourceLayout destinationLayout;
+	destinationLayout.rowPitch = width * sizeof(uint32_t);
+	destinationLayout.depthPitch = destinationLayout.rowPitch * height;
+
+	std::vector<uint32_t> expected(width * height * depth);
+	for (uint32_t z = 0; z < depth; z++)
+	{
+		DecodeBC3((const char*)source.data() + (sourceLayout.depthPitch * z), (size_t)sourceLayout.rowPitch, (char*)expected.data() + (destinationLayout.depthPitch * z), (size_t)destinationLayout.rowPitch, width, height, nullptr);
+	}
+
+	FormatConversion conversion;
+	conversion.Format = vk::Format::eR8G8B8A8Unorm;
+	conversion.Convert = DecodeBC3;
+
+	D3DBOX region = { 0, 0, width, height, 0, depth };
+
+	ThreadPool threadPool;
+	threadPool.Initialize(4);
+
+	std::vector<uint32_t> pixels(width * height * depth);
+	ConvertRegion(threadPool, conversion, D3DFMT_DXT5, (const char*)source.data(), sourceLayout, (char*)pixels.data(), destinationLayout, region);
+	Check("ConvertRegion volume", pixels.data(), expected.data(), pixels.size());
+
+	//One slice has fewer tasks than threads so it is split into bands.
+	std::fill(pixels.begin(), pixels.end(), 0);
+	region.Back = 1;
+	ConvertRegion(threadPool, conversion, D3DFMT_DXT5, (const char*)source.data(), sourceLayout, (char*)pixels.data(), destinationLayout, region);
+	Check("ConvertRegion banded slice", pixels.data(), expected.data(), width * height);
+
+	threadPool.Destroy();
+}
+
+int main(int argc, char** argv)
+{
+	TestBC1();
+	TestBC2();
+	TestBC3();
+	TestPartialBlocks();
+	TestConvertRegion();
+
+	return (gFailureCount == 0) ? 0 : 1;
+}
@@ -0,0 +1,357 @@
+/*
+Copyright(c) 2018 Christopher Joseph Dean Schaefer
+
+This software is provided 'as-is', without any express or implied
+warranty.In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions :
+
+1. The origin of this software must not be misrepresented; you must not
+claim that you wrote the original software.If you use this software
+in a product, an acknowledgment in the product documentation would be
+appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+/*
+Runs the memory manager on a mock backend that hands out fake vk::DeviceMemory handles so the buddy allocator can be checked without a GPU.
+*/
+
+#include "MemoryManager.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+const vk::DeviceSize HeapSize = 1024 * 1024 * 1024; //Big enough for the largest blocks.
+const uint32_t DeviceLocalType = 0;
+const uint32_t HostVisibleType = 1;
+
+struct MockMemoryBackend : MemoryBackend
+{
+	std::map<uint64_t, vk::DeviceSize> mMemories; //Live handles and their sizes.
+	std::map<uint64_t, std::vector<char>> mMappings;
+	uint64_t mNextHandle = 1;
+	uint32_t mAllocateCount = 0;
+	uint32_t mFreeCount = 0;
+	bool mIsOutOfMemory = false;
+
+	vk::Result AllocateMemory(vk::DeviceSize size, uint32_t memoryTypeIndex, vk::DeviceMemory& memory) override
+	{
+		if (mIsOutOfMemory)
+		{
+			return vk::Result::eErrorOutOfDeviceMemory;
+		}
+
+		const uint64_t handle = mNextHandle++;
+		mMemories[handle] = size;
+		memory = vk::DeviceMemory((VkDeviceMemory)handle);
+		mAllocateCount++;
+		return vk::Result::eSuccess;
+	}
+
+	vk::Result MapMemory(vk::DeviceMemory memory, void*& data) override
+	{
+		const uint64_t handle = (uint64_t)(VkDeviceMemory)memory;
+		auto& mapping = mMappings[handle];
+		mapping.resize((size_t)mMemories.at(handle));
+		data = mapping.data();
+		return vk::Result::eSuccess;
+	}
+
+	void FreeMemory(vk::DeviceMemory memory) override
+	{
+		const uint64_t handle = (uint64_t)(VkDeviceMemory)memory;
+		mMemories.erase(handle);
+		mMappings.erase(handle);
+		mFreeCount++;
+	}
+
+	vk::Result FlushMappedMemoryRanges(const vk::MappedMemoryRange& mappedMemoryRange) override
+	{
+		return vk::Result::eSuccess;
+	}
+};
+
+int gFailureCount = 0;
+
+#define CHECK(condition) if (!(condition)) { printf("%s:%d %s failed\n", __FUNCTION__, __LINE__, #condition); gFailureCount++; }
+
+void InitializeManager(MemoryManager& memoryManager, MockMemoryBackend& backend)
+{
+	vk::PhysicalDeviceMemoryProperties properties;
+	properties.memoryHeapCount = 1;
+	properties.memoryHeaps[0].size = HeapSize;
+	properties.memoryHeaps[0].flags = vk::MemoryHeapFlagBits::eDeviceLocal;
+	properties.memoryTypeCount = 2;
+	properties.memoryTypes[DeviceLocalType].propertyFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
+	properties.memoryTypes[HostVisibleType].propertyFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+
+	memoryManager.Initialize(&backend, properties, 64);
+}
+
+vk::Result Allocate(MemoryManager& memoryManager, vk::DeviceSize size, vk::DeviceSize alignment, MemoryAllocation& allocation, bool isDedicated = false, vk::MemoryPropertyFlags flags = vk::MemoryPropertyFlagBits::eDeviceLocal)
+{
+	vk::MemoryRequirements requirements;
+	requirements.size = size;
+	requirements.alignment = alignment;
+	requirements.memoryTypeBits = 3;
+
+	return memoryManager.Allocate(requirements, flags, false, allocation, isDedicated);
+}
+
+void TestSplitAndCoalesce()
+{
+	MockMemoryBackend backend;
+	MemoryManager memoryManager;
+	InitializeManager(memoryManager, backend);
+	const vk::DeviceSize blockSize = memoryManager.mBlockSizes[DeviceLocalType];
+
+	//Each allocation takes the lowest free range of its size, splitting larger ranges on the way.
+	MemoryAllocation a, b, c;
+	CHECK(Allocate(memoryManager, 256, 1, a) == vk::Result::eSuccess);
+	CHECK(Allocate(memoryManager, 100, 1, b) == vk::Result::eSuccess);
+	CHECK(Allocate(memoryManager, 512, 1, c) == vk::Result::eSuccess);
+	CHECK(a.Offset == 0 && a.Order == 0);
+	CHECK(b.Offset == 256 && b.Order == 0);
+	CHECK(c.Offset == 512 && c.Order == 1);
+	CHECK(a.Block == b.Block && b.Block == c.Block);
+	CHECK(backend.mAllocateCount == 1);
+	CHECK(a.Block->GetLargestFreeRange() == blockSize / 2);
+
+	//Freeing b and then a merges them back into one 512 byte range, freeing c merges the whole block back together.
+	MemoryBlock* block = a.Block;
+	memoryManager.Free(b);
+	CHECK(block->FreeRanges[0].count(256) == 1);
+	memoryManager.Free(a);
+	CHECK(block->FreeRanges[0].empty());
+	CHECK(block->FreeRanges[1].count(0) == 1);
+	memoryManager.Free(c);
+	CHECK(block->GetLargestFreeRange() == blockSize);
+	CHECK(block->FreeRanges.back().size() == 1);
+
+	//The last empty block is kept for the next allocation.
+	CHECK(backend.mFreeCount == 0);
+
+	memoryManager.Destroy();
+	CHECK(backend.mMemories.empty());
+}
+
+void TestAlignment()
+{
+	MockMemoryBackend backend;
+	MemoryManager memoryManager;
+	InitializeManager(memoryManager, backend);
+
+	const vk::DeviceSize sizes[] = { 300, 64, 5000, 256, 70000, 1 };
+	const vk::DeviceSize alignments[] = { 4096, 256, 1, 65536, 16, 1024 };
+	std::vector<MemoryAllocation> allocations(6);
+
+	for (size_t i = 0; i < allocations.size(); i++)
+	{
+		CHECK(Allocate(memoryManager, sizes[i], alignments[i], allocations[i]) == vk::Result::eSuccess);
+		CHECK(allocations[i].Offset % alignments[i] == 0);
+		CHECK((MinimumAllocationSize << allocations[i].Order) >= std::max(sizes[i], alignments[i]));
+	}
+
+	//No two ranges may overlap.
+	for (size_t i = 0; i < allocations.size(); i++)
+	{
+		for (size_t j = i + 1; j < allocations.size(); j++)
+		{
+			const vk::DeviceSize endI = allocations[i].Offset + (MinimumAllocationSize << allocations[i].Order);
+			const vk::DeviceSize endJ = allocations[j].Offset + (MinimumAllocationSize << allocations[j].Order);
+			CHECK(endI <= allocations[j].Offset || endJ <= allocations[i].Offset);
+		}
+	}
+
+	for (auto& allocation : allocations)
+	{
+		memoryManager.Free(allocation);
+	}
+	memoryManager.Destroy();
+}
+
+void TestFreeOrders()
+{
+	//Whatever order the ranges come back in the block has to end up as one free range again.
+	const vk::DeviceSize sizes[] = { 256, 1024, 300, 4096, 256 };
+	std::vector<size_t> order = { 0, 1, 2, 3, 4 };
+
+	do
+	{
+		MockMemoryBackend backend;
+		MemoryManager memoryManager;
+		InitializeManager(memoryManager, backend);
+		const vk::DeviceSize blockSize = memoryManager.mBlockSizes[DeviceLocalType];
+
+		MemoryAllocation allocations[5];
+		for (size_t i = 0; i < 5; i++)
+		{
+			CHECK(Allocate(memoryManager, sizes[i], 1, allocations[i]) == vk::Result::eSuccess);
+		}
+
+		MemoryBlock* block = allocations[0].Block;
+		for (size_t i : order)
+		{
+			memoryManager.Free(allocations[i]);
+		}
+
+		CHECK(block->AllocationCount == 0 && block->UsedSize == 0 && block->RequestedSize == 0);
+		CHECK(block->GetLargestFreeRange() == blockSize);
+		for (size_t i = 0; i + 1 < block->FreeRanges.size(); i++)
+		{
+			CHECK(block->FreeRanges[i].empty());
+		}
+
+		memoryManager.Destroy();
+	} while (std::next_permutation(order.begin(), order.end()));
+}
+
+void TestStatistics()
+{
+	MockMemoryBackend backend;
+	MemoryManager memoryManager;
+	InitializeManager(memoryManager, backend);
+	const vk::DeviceSize blockSize = memoryManager.mBlockSizes[DeviceLocalType];
+
+	MemoryAllocation a, b, dedicated;
+	CHECK(Allocate(memoryManager, 300, 1, a) == vk::Result::eSuccess);
+	CHECK(Allocate(memoryManager, 1000, 1, b) == vk::Result::eSuccess);
+	CHECK(Allocate(memoryManager, 4096, 1, dedicated, true) == vk::Result::eSuccess);
+
+	MemoryStatistics statistics = memoryManager.GetStatistics();
+	CHECK(statistics.BlockCount == 1);
+	CHECK(statistics.BlockSize == blockSize);
+	CHECK(statistics.AllocationCount == 2);
+	CHECK(statistics.UsedSize == 512 + 1024);
+	CHECK(statistics.RequestedSize == 300 + 1000);
+	CHECK(statistics.DedicatedAllocationCount == 1);
+	CHECK(statistics.DedicatedSize == 4096);
+	CHECK(memoryManager.mHeapUsage[0] == blockSize + 4096);
+
+	memoryManager.Free(a);
+	memoryManager.Free(dedicated);
+
+	statistics = memoryManager.GetStatistics();
+	CHECK(statistics.AllocationCount == 1);
+	CHECK(statistics.UsedSize == 1024);
+	CHECK(statistics.RequestedSize == 1000);
+	CHECK(statistics.DedicatedAllocationCount == 0);
+	CHECK(statistics.DedicatedSize == 0);
+	CHECK(memoryManager.mHeapUsage[0] == blockSize);
+
+	memoryManager.Free(b);
+	memoryManager.Destroy();
+	CHECK(memoryManager.mHeapUsage[0] == 0);
+}
+
+void TestDedicatedThreshold()
+{
+	MockMemoryBackend backend;
+	MemoryManager memoryManager;
+	InitializeManager(memoryManager, backend);
+	const vk::DeviceSize blockSize = memoryManager.mBlockSizes[DeviceLocalType];
+
+	//Half a block is the largest size that is still sub-allocated.
+	MemoryAllocation half, overHalf, requested, aligned;
+	CHECK(Allocate(memoryManager, blockSize / 2, 1, half) == vk::Result::eSuccess);
+	CHECK(half.Block != nullptr);
+	CHECK(Allocate(memoryManager, blockSize / 2 + 1, 1, overHalf) == vk::Result::eSuccess);
+	CHECK(overHalf.Block == nullptr && overHalf.Offset == 0);
+	CHECK(Allocate(memoryManager, 256, 1, requested, true) == vk::Result::eSuccess);
+	CHECK(requested.Block == nullptr);
+	CHECK(Allocate(memoryManager, 256, blockSize * 2, aligned) == vk::Result::eSuccess);
+	CHECK(aligned.Block == nullptr);
+	CHECK(backend.mAllocateCount == 4);
+
+	memoryManager.Free(overHalf);
+	memoryManager.Free(requested);
+	memoryManager.Free(aligned);
+	CHECK(backend.mFreeCount == 3);
+
+	memoryManager.Free(half);
+	memoryManager.Destroy();
+	CHECK(backend.mMemories.empty());
+}
+
+void TestEmptyBlocks()
+{
+	MockMemoryBackend backend;
+	MemoryManager memoryManager;
+	InitializeManager(memoryManager, backend);
+	const vk::DeviceSize blockSize = memoryManager.mBlockSizes[DeviceLocalType];
+
+	//Two halves fill the first block so the third allocation needs a second one.
+	MemoryAllocation a, b, c;
+	CHECK(Allocate(memoryManager, blockSize / 2, 1, a) == vk::Result::eSuccess);
+	CHECK(Allocate(memoryManager, blockSize / 2, 1, b) == vk::Result::eSuccess);
+	CHECK(Allocate(memoryManager, 256, 1, c) == vk::Result::eSuccess);
+	CHECK(a.Block == b.Block && c.Block != a.Block);
+	CHECK(backend.mAllocateCount == 2);
+
+	//One empty block is kept, a second one is given back.
+	memoryManager.Free(c);
+	CHECK(backend.mFreeCount == 0);
+	memoryManager.Free(a);
+	memoryManager.Free(b);
+	CHECK(backend.mFreeCount == 1);
+	CHECK(memoryManager.GetStatistics().BlockCount == 1);
+
+	memoryManager.Destroy();
+	CHECK(backend.mMemories.empty());
+}
+
+void TestHostVisible()
+{
+	MockMemoryBackend backend;
+	MemoryManager memoryManager;
+	InitializeManager(memoryManager, backend);
+
+	MemoryAllocation a, b;
+	CHECK(Allocate(memoryManager, 256, 1, a, false, vk::MemoryPropertyFlagBits::eHostVisible) == vk::Result::eSuccess);
+	CHECK(Allocate(memoryManager, 256, 1, b, false, vk::MemoryPropertyFlagBits::eHostVisible) == vk::Result::eSuccess);
+	CHECK(a.MemoryTypeIndex == HostVisibleType);
+	CHECK(a.Data != nullptr && (char*)b.Data == (char*)a.Data + (b.Offset - a.Offset));
+
+	memoryManager.Free(a);
+	memoryManager.Free(b);
+	memoryManager.Destroy();
+}
+
+void TestOutOfMemory()
+{
+	MockMemoryBackend backend;
+	MemoryManager memoryManager;
+	InitializeManager(memoryManager, backend);
+
+	backend.mIsOutOfMemory = true;
+	MemoryAllocation allocation;
+	CHECK(Allocate(memoryManager, 256, 1, allocation) == vk::Result::eErrorOutOfDeviceMemory);
+	CHECK(allocation.Memory == vk::DeviceMemory());
+	CHECK(memoryManager.GetStatistics().BlockCount == 0);
+
+	memoryManager.Destroy();
+}
+
+int main(int argc, char** argv)
+{
+	TestSplitAndCoalesce();
+	TestAlignment();
+	TestFreeOrders();
+	TestStatistics();
+	TestDedicatedThreshold();
+	TestEmptyBlocks();
+	TestHostVisible();
+	TestOutOfMemory();
+
+	printf("%s\n", (gFailureCount == 0) ? "All memory manager tests passed" : "Memory manager tests failed");
+
+	return (gFailureCount == 0) ? 0 : 1;
+}